@@ -249,9 +249,18 @@ struct zbc_zone {
 	uint8_t			zbz_attributes;
 
 	/**
-	 * Padding to 32 bytes.
+	 * Padding.
 	 */
-	uint8_t			__pad[5];
+	uint8_t			__pad[1];
+
+	/**
+	 * Zone capacity in number of 512B sectors, that is, the number of
+	 * sectors that can be written in the zone. Only zoned block
+	 * devices may report a zone capacity smaller than the zone length.
+	 * 0 means that the zone capacity is equal to the zone length.
+	 * Use \a zbc_zone_capacity to get the zone capacity.
+	 */
+	uint32_t		zbz_capacity;
 
 };
 
@@ -324,6 +333,11 @@ struct zbc_zone {
 /** @brief Get a zone number of 512B sectors */
 #define zbc_zone_length(z)	((unsigned long long)(z)->zbz_length)
 
+/** @brief Get a zone capacity in number of 512B sectors */
+#define zbc_zone_capacity(z)	((z)->zbz_capacity ? \
+				 (unsigned long long)(z)->zbz_capacity : \
+				 zbc_zone_length(z))
+
 /** @brief Get a zone write pointer 512B sector position */
 #define zbc_zone_wp(z)		((unsigned long long)(z)->zbz_write_pointer)
 
@@ -858,6 +872,11 @@ enum zbc_dev_type {
 	 */
 	ZBC_DT_UNKNOWN	= 0x00,
 
+	/**
+	 * Zoned block device (kernel block layer access).
+	 */
+	ZBC_DT_BLOCK	= 0x01,
+
 	/**
 	 * SCSI device.
 	 */
@@ -1207,6 +1226,9 @@ enum zbc_sk {
 	/** Illegal request */
 	ZBC_SK_ILLEGAL_REQUEST	= 0x5,
 
+	/** Unit attention */
+	ZBC_SK_UNIT_ATTENTION	= 0x6,
+
 	/** Data protect */
 	ZBC_SK_DATA_PROTECT	= 0x7,
 
@@ -1278,6 +1300,9 @@ enum zbc_asc_ascq {
 
 	/** Zone reset WP recommended */
 	ZBC_ASC_ZONE_RESET_WP_RECOMMENDED		= 0x2A16,
+
+	/** Capacity data has changed */
+	ZBC_ASC_CAPACITY_DATA_HAS_CHANGED		= 0x2A09,
 };
 
 /**
@@ -1387,6 +1412,75 @@ extern char const *zbc_version(void);
 extern int zbc_device_is_zoned(const char *filename, bool unused,
 			       struct zbc_device_info *info);
 
+/**
+ * @brief Quickly test if a device is a zoned block device
+ * @param[in] filename	Path to the device file
+ * @param[out] model	Address where to store the device zone model
+ *
+ * Lightweight version of \a zbc_device_is_zoned. The device zone model
+ * is first determined using the device sysfs attributes (queue/zoned
+ * and device/type). If the kernel reports a regular block device, which
+ * may still be a host-aware device (not exposed as zoned by recent
+ * kernels) or support the Zone Domains or Zone Realms command sets, a
+ * single INQUIRY command is issued to the device. Only if sysfs does not provide any information about the
+ * device (e.g. partitions or a kernel without zoned block device
+ * support) is the complete device identification of
+ * \a zbc_device_is_zoned executed. If \a model is not NULL and the device
+ * is identified as a zoned block device, the device zone model is
+ * returned at the address specified by \a model.
+ *
+ * @return Returns a negative error code if the device test failed.
+ * 1 is returned if the device is identified as a zoned zoned block device.
+ * Otherwise, 0 is returned.
+ */
+extern int zbc_device_is_zoned_fast(const char *filename,
+				    enum zbc_dev_model *model);
+
+/**
+ * @brief Device probe descriptor
+ *
+ * Describes a device to test with \a zbc_devices_are_zoned and
+ * the result of the test.
+ */
+struct zbc_device_probe {
+
+	/**
+	 * Path to the device file.
+	 */
+	const char		*zbp_filename;
+
+	/**
+	 * Test result: same as the return value of
+	 * \a zbc_device_is_zoned_fast.
+	 */
+	int			zbp_ret;
+
+	/**
+	 * Device zone model (valid only if zbp_ret is 1).
+	 */
+	enum zbc_dev_model	zbp_model;
+
+};
+
+/**
+ * @brief Test if a list of devices are zoned block devices
+ * @param[in,out] probes	Array of device probe descriptors
+ * @param[in] nr_probes		Number of descriptors in \a probes
+ * @param[in] nr_threads	Maximum number of devices tested concurrently
+ *
+ * Execute \a zbc_device_is_zoned_fast for all the devices specified by
+ * \a probes, using up to \a nr_threads threads to test devices in
+ * parallel. If \a nr_threads is 0, a default number of threads is used.
+ * The result of each device test is returned in the zbp_ret and
+ * zbp_model fields of the device descriptor.
+ *
+ * @return Returns 0 if all devices were tested and a negative error
+ * code if the test threads could not be started.
+ */
+extern int zbc_devices_are_zoned(struct zbc_device_probe *probes,
+				 unsigned int nr_probes,
+				 unsigned int nr_threads);
+
 /**
  * @brief ZBC device open flags
  *
@@ -1397,11 +1491,16 @@ extern int zbc_device_is_zoned(const char *filename, bool unused,
  */
 enum zbc_oflags {
 
-	/*
-	 * Block device backend is removed, keep zero mask
-	 * defined for backwards compatibility.
+	/**
+	 * Allow use of the zoned block device backend driver. Unless
+	 * explicitly specified, this driver only accepts zoned block
+	 * devices that cannot be accessed with SG_IO (e.g. null_blk).
+	 * The block device driver is tried first: if this flag is
+	 * specified together with ZBC_O_DRV_SCSI or ZBC_O_DRV_ATA, SCSI
+	 * and ATA devices are also handled by the block device driver.
+	 * This flag was previously defined as 0 and had no effect.
 	 */
-	ZBC_O_DRV_BLOCK		= 0x00000000,
+	ZBC_O_DRV_BLOCK		= 0x01000000,
 
 	/** Allow use of the SCSI backend driver */
 	ZBC_O_DRV_SCSI		= 0x02000000,
@@ -1409,6 +1508,14 @@ enum zbc_oflags {
 	/** Allow use of the ATA backend driver */
 	ZBC_O_DRV_ATA		= 0x04000000,
 
+	/**
+	 * Use NCQ (READ/WRITE FPDMA QUEUED) commands for I/O operations
+	 * with the ATA backend driver if the device supports NCQ. Zone
+	 * management and REPORT ZONES then also use queued commands if the
+	 * device supports them.
+	 */
+	ZBC_O_NCQ		= 0x08000000,
+
 };
 
 /**
@@ -1637,6 +1744,419 @@ extern int zbc_list_zones(struct zbc_device *dev,
 			  uint64_t sector, enum zbc_zone_reporting_options ro,
 			  struct zbc_zone **zones, unsigned int *nr_zones);
 
+/** @brief Number of zone types counted in a zone summary */
+#define ZBC_ZSM_NR_TYPES	(ZBC_ZT_GAP + 1)
+
+/** @brief Number of zone conditions counted in a zone summary */
+#define ZBC_ZSM_NR_CONDS	(ZBC_ZC_OFFLINE + 1)
+
+/**
+ * @brief Zone summary
+ *
+ * Zone counts and capacity totals obtained with \a zbc_zone_summary.
+ */
+struct zbc_zone_summary {
+
+	/**
+	 * Number of zones summarized.
+	 */
+	unsigned int		zsm_nr_zones;
+
+	/**
+	 * Number of zones of each type (enum zbc_zone_type) and
+	 * condition (enum zbc_zone_condition).
+	 */
+	unsigned int		zsm_nr[ZBC_ZSM_NR_TYPES][ZBC_ZSM_NR_CONDS];
+
+	/**
+	 * Number of zones with the reset write pointer recommended
+	 * attribute set.
+	 */
+	unsigned int		zsm_nr_rwp_recommended;
+
+	/**
+	 * Number of zones with the non-sequential write resources
+	 * allocated attribute set.
+	 */
+	unsigned int		zsm_nr_non_seq;
+
+	/**
+	 * Number of implicitly and explicitly open zones.
+	 */
+	unsigned int		zsm_nr_open;
+
+	/**
+	 * Maximum number of open zones of the device: the maximum number
+	 * of open sequential write required zones for host-managed devices
+	 * and the optimal number of open sequential write preferred zones
+	 * for host-aware devices. ZBC_NO_LIMIT if the device has no limit.
+	 */
+	unsigned int		zsm_max_nr_open;
+
+	/**
+	 * Total number of 512B sectors of the zones summarized.
+	 */
+	uint64_t		zsm_sectors;
+
+	/**
+	 * Total number of 512B sectors of the sequential write required
+	 * and sequential write preferred zones summarized.
+	 */
+	uint64_t		zsm_seq_sectors;
+
+	/**
+	 * Number of 512B sectors written in the sequential write required
+	 * and sequential write preferred zones summarized, that is, the
+	 * sectors below the write pointer of open and closed zones and the
+	 * capacity of full zones.
+	 */
+	uint64_t		zsm_used_sectors;
+
+};
+
+/**
+ * @brief Get the number of zones of a type and condition in a zone summary
+ * @param[in] zs	Zone summary obtained with \a zbc_zone_summary
+ * @param[in] type	Zone type
+ * @param[in] cond	Zone condition
+ */
+static inline unsigned int zbc_zone_summary_nr(struct zbc_zone_summary *zs,
+					       enum zbc_zone_type type,
+					       enum zbc_zone_condition cond)
+{
+	if ((unsigned int)type >= ZBC_ZSM_NR_TYPES ||
+	    (unsigned int)cond >= ZBC_ZSM_NR_CONDS)
+		return 0;
+
+	return zs->zsm_nr[type][cond];
+}
+
+/**
+ * @brief Get the number of zones of a condition in a zone summary
+ * @param[in] zs	Zone summary obtained with \a zbc_zone_summary
+ * @param[in] cond	Zone condition
+ */
+static inline unsigned int
+zbc_zone_summary_nr_cond(struct zbc_zone_summary *zs,
+			 enum zbc_zone_condition cond)
+{
+	unsigned int i, nr = 0;
+
+	for (i = 0; i < ZBC_ZSM_NR_TYPES; i++)
+		nr += zbc_zone_summary_nr(zs, i, cond);
+
+	return nr;
+}
+
+/**
+ * @brief Get a summary of the zones of a device
+ * @param[in] dev	Device handle obtained with \a zbc_open
+ * @param[in] sector	Sector from which to summarize zones
+ * @param[out] zs	The zone summary
+ *
+ * Count the zones of each type and condition, the zones with the reset
+ * recommended and non-sequential write resources allocated attributes and
+ * the open zones, and get the capacity totals of the zones, starting from
+ * the zone containing \a sector up to the last zone of the device. Zone
+ * information is obtained in a single pass over the device zones using
+ * a fixed size buffer, regardless of the number of zones of the device.
+ *
+ * @return Returns -EIO if an error happened when communicating with the device.
+ * Returns -ENOMEM if memory could not be allocated for the zone buffer.
+ */
+extern int zbc_zone_summary(struct zbc_device *dev, uint64_t sector,
+			    struct zbc_zone_summary *zs);
+
+/**
+ * @brief Zone search filter
+ *
+ * Select the zones searched with \a zbc_find_zone.
+ */
+struct zbc_zone_filter {
+
+	/**
+	 * Bitmap of the zone types searched: a zone of type t matches
+	 * if bit (1 << t) is set. 0 matches zones of any type.
+	 */
+	unsigned int		zbf_types;
+
+	/**
+	 * Bitmap of the zone conditions searched: a zone in condition c
+	 * matches if bit (1 << c) is set. 0 matches zones in any condition.
+	 */
+	unsigned int		zbf_conds;
+
+	/**
+	 * Zone attributes (enum zbc_zone_attributes) that a zone must have
+	 * to match. 0 matches zones with any attributes.
+	 */
+	unsigned int		zbf_attrs;
+
+};
+
+/** @brief Get the zone filter bit of a zone type */
+#define ZBC_ZF_TYPE(t)		(1U << (t))
+
+/** @brief Get the zone filter bit of a zone condition */
+#define ZBC_ZF_COND(c)		(1U << (c))
+
+/**
+ * @brief Find the first zone matching a filter
+ * @param[in] dev	Device handle obtained with \a zbc_open
+ * @param[in] sector	Sector from which to search zones
+ * @param[in] filter	Zone search filter
+ * @param[out] zone	The zone found
+ *
+ * Search for the first zone containing or after \a sector that matches
+ * \a filter. When \a filter selects a single zone condition or the reset
+ * recommended or non-sequential write resources allocated attributes,
+ * zones are filtered by the device using the corresponding reporting
+ * option. Zones are reported in small chunks and the search stops with
+ * the first chunk containing a matching zone, so that a zone can be found
+ * without getting the information of all zones of the device.
+ *
+ * @return Returns 0 if a zone was found, -ENOENT if no zone matches
+ * \a filter, and -EIO if an error happened when communicating with the
+ * device.
+ */
+extern int zbc_find_zone(struct zbc_device *dev, uint64_t sector,
+			 struct zbc_zone_filter *filter,
+			 struct zbc_zone *zone);
+
+/** @brief Number of zones of a zone table condition bitmap word */
+#define ZBC_ZTB_WORD_BITS	64
+
+/** @brief Write pointer offset of zones without a valid write pointer */
+#define ZBC_ZTB_NO_WP		((uint32_t)-1)
+
+/**
+ * @brief Zone table run
+ *
+ * A run of contiguous zones of the same size and capacity in a zone table.
+ */
+struct zbc_zone_table_run {
+
+	/**
+	 * First sector of the first zone of the run (512B sector unit).
+	 */
+	uint64_t		ztr_start;
+
+	/**
+	 * Length of the zones of the run in number of 512B sectors.
+	 */
+	uint64_t		ztr_zone_sectors;
+
+	/**
+	 * Capacity of the zones of the run (see struct zbc_zone).
+	 */
+	uint32_t		ztr_zone_capacity;
+
+	/**
+	 * Index in the zone table of the first zone of the run.
+	 */
+	unsigned int		ztr_first_zone;
+
+	/**
+	 * Number of zones of the run.
+	 */
+	unsigned int		ztr_nr_zones;
+
+};
+
+/**
+ * @brief Zone table
+ *
+ * Compact representation of an array of zones, stored as one array per
+ * zone field. Zone positions are stored once per run of contiguous zones
+ * of the same size, write pointers are stored as 32-bit offsets from the
+ * zone start, zone types and conditions are packed in one byte per zone,
+ * and one bitmap per zone condition gives the zones in that condition.
+ * Scanning for zones in a set of conditions is thus done with operations
+ * on bitmap words instead of by reading the information of all zones.
+ */
+struct zbc_zone_table {
+
+	/**
+	 * Number of zones of the table.
+	 */
+	unsigned int		ztb_nr_zones;
+
+	/**
+	 * Number of 64-bit words of each condition bitmap.
+	 */
+	unsigned int		ztb_nr_words;
+
+	/**
+	 * Number of zone runs.
+	 */
+	unsigned int		ztb_nr_runs;
+
+	/**
+	 * Size of the run array.
+	 */
+	unsigned int		ztb_max_runs;
+
+	/**
+	 * Zone runs.
+	 */
+	struct zbc_zone_table_run *ztb_runs;
+
+	/**
+	 * Zone write pointer offsets from the zone start, in number of 512B
+	 * sectors, or ZBC_ZTB_NO_WP for zones without a valid write pointer.
+	 */
+	uint32_t		*ztb_wp_ofst;
+
+	/**
+	 * Zone types (high 4 bits) and conditions (low 4 bits).
+	 */
+	uint8_t			*ztb_type_cond;
+
+	/**
+	 * Zone attributes (enum zbc_zone_attributes).
+	 */
+	uint8_t			*ztb_attrs;
+
+	/**
+	 * Zone condition bitmaps: bit i of ztb_cond_map[c] is set if zone i
+	 * is in condition c.
+	 */
+	uint64_t		*ztb_cond_map[ZBC_ZSM_NR_CONDS];
+
+};
+
+/**
+ * @brief Get the type of a zone of a zone table
+ * @param[in] zt	Zone table
+ * @param[in] idx	Zone index in the table
+ */
+static inline enum zbc_zone_type
+zbc_zone_table_type(struct zbc_zone_table *zt, unsigned int idx)
+{
+	return zt->ztb_type_cond[idx] >> 4;
+}
+
+/**
+ * @brief Get the condition of a zone of a zone table
+ * @param[in] zt	Zone table
+ * @param[in] idx	Zone index in the table
+ */
+static inline enum zbc_zone_condition
+zbc_zone_table_cond(struct zbc_zone_table *zt, unsigned int idx)
+{
+	return zt->ztb_type_cond[idx] & 0x0f;
+}
+
+/**
+ * @brief Create a zone table from an array of zones
+ * @param[in] zones	Array of zones
+ * @param[in] nr_zones	Number of zones in \a zones
+ * @param[out] zt	Address where to return the zone table
+ *
+ * Create a zone table holding the information of the zones of \a zones,
+ * in the same order. The zones must be sorted in increasing order of
+ * start sector, as reported by \a zbc_report_zones. The zone table must
+ * be freed with \a zbc_zone_table_free.
+ *
+ * @return Returns 0 on success, -ENOMEM if memory could not be allocated,
+ * -EINVAL if the zones are not sorted and -EOVERFLOW if a zone is too large
+ * to have its write pointer offset stored on 32 bits.
+ */
+extern int zbc_zone_table_from_zones(struct zbc_zone *zones,
+				     unsigned int nr_zones,
+				     struct zbc_zone_table **zt);
+
+/**
+ * @brief Create a zone table for the zones of a device
+ * @param[in] dev	Device handle obtained with \a zbc_open
+ * @param[in] sector	Sector from which to list zones
+ * @param[out] zt	Address where to return the zone table
+ *
+ * Create a zone table holding the information of the zones of \a dev,
+ * starting from the zone containing \a sector up to the last zone of the
+ * device. Zones are reported in chunks using a fixed size buffer, so that
+ * an array of all zones is never allocated. The zone table must be freed
+ * with \a zbc_zone_table_free.
+ *
+ * @return Returns 0 on success, -EIO if an error happened when
+ * communicating with the device and -ENOMEM if memory could not be
+ * allocated.
+ */
+extern int zbc_list_zone_table(struct zbc_device *dev, uint64_t sector,
+			       struct zbc_zone_table **zt);
+
+/**
+ * @brief Free a zone table
+ * @param[in] zt	Zone table
+ */
+extern void zbc_zone_table_free(struct zbc_zone_table *zt);
+
+/**
+ * @brief Get the information of a zone of a zone table
+ * @param[in] zt	Zone table
+ * @param[in] idx	Zone index in the table
+ * @param[out] zone	The zone information
+ *
+ * @return Returns 0 on success and -EINVAL if \a idx is not a valid zone
+ * index.
+ */
+extern int zbc_zone_table_get_zone(struct zbc_zone_table *zt,
+				   unsigned int idx, struct zbc_zone *zone);
+
+/**
+ * @brief Update the information of a zone of a zone table
+ * @param[in] zt	Zone table
+ * @param[in] idx	Zone index in the table
+ * @param[in] zone	The new zone information
+ *
+ * Update the condition, attributes and write pointer of a zone of \a zt,
+ * e.g. after a zone operation or a write. The type and position of the
+ * zone cannot be changed.
+ *
+ * @return Returns 0 on success and -EINVAL if \a idx is not a valid zone
+ * index or if \a zone is not the zone at index \a idx.
+ */
+extern int zbc_zone_table_set_zone(struct zbc_zone_table *zt,
+				   unsigned int idx, struct zbc_zone *zone);
+
+/**
+ * @brief Get the index of a zone of a zone table
+ * @param[in] zt	Zone table
+ * @param[in] sector	A sector of the zone
+ *
+ * @return Returns the index of the zone containing \a sector, or -ENOENT
+ * if no zone of \a zt contains \a sector.
+ */
+extern int zbc_zone_table_zone_idx(struct zbc_zone_table *zt,
+				   uint64_t sector);
+
+/**
+ * @brief Count the zones of a zone table in a set of conditions
+ * @param[in] zt	Zone table
+ * @param[in] conds	Bitmap of zone conditions (see \a ZBC_ZF_COND)
+ *
+ * @return Returns the number of zones of \a zt in one of the conditions
+ * of \a conds.
+ */
+extern unsigned int zbc_zone_table_count(struct zbc_zone_table *zt,
+					 unsigned int conds);
+
+/**
+ * @brief Find the next zone of a zone table in a set of conditions
+ * @param[in] zt	Zone table
+ * @param[in] idx	Zone index from which to search
+ * @param[in] conds	Bitmap of zone conditions (see \a ZBC_ZF_COND)
+ *
+ * Zones in one of the conditions of \a conds can be iterated with:
+ * for (i = zbc_zone_table_next(zt, 0, conds); i >= 0;
+ *      i = zbc_zone_table_next(zt, i + 1, conds))
+ *
+ * @return Returns the index of the first zone at or after \a idx in one
+ * of the conditions of \a conds, or -ENOENT if there is no such zone.
+ */
+extern int zbc_zone_table_next(struct zbc_zone_table *zt, unsigned int idx,
+			       unsigned int conds);
+
 /**
  * @brief Zone operation codes definitions
  *
@@ -2025,6 +2545,12 @@ enum zbc_realm_report_options {
  * descriptors in the array). The number of returned realm records may depend
  * on the chosen reporting options.
  *
+ * The zone domains used to process the realm information are cached in
+ * the device handle. The cache is refreshed after a zone activation done
+ * through the handle and after a CAPACITY DATA HAS CHANGED unit attention
+ * is reported for a command of the handle, but not after zone activations
+ * done by another process or through another handle of the device.
+ *
  * @return Returns -EIO if an error happened when communicating with the device.
  */
 extern int zbc_report_realms(struct zbc_device *dev, uint64_t sector,
@@ -2156,6 +2682,262 @@ extern int zbc_zone_query_list(struct zbc_device *dev, bool zsrc, bool all,
 extern int zbc_zone_activation_ctl(struct zbc_device *dev,
 				   struct zbc_zd_dev_control *ctl, bool set);
 
+/**
+ * @brief Build the zone domain and realm index of a device
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ *
+ * Get the zone domains and zone realms of the device and build a sorted
+ * index of their sector ranges. The index is used by \a zbc_find_domain,
+ * \a zbc_find_realm and \a zbc_find_actv_realm and is built automatically
+ * by these functions if needed. The index is updated by \a zbc_zone_activate
+ * using the activation results records. This function only needs to be
+ * called if the device zone realms configuration is changed by another
+ * application.
+ *
+ * @return Returns -ENOTSUP if the device is not a Zone Domains/Zone Realms
+ * device, -EIO if an error happened when communicating with the device and
+ * -ENOMEM if memory could not be allocated for the index.
+ */
+extern int zbc_build_realm_index(struct zbc_device *dev);
+
+/**
+ * @brief Get the zone domain containing a sector
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ * @param[in] sector		512B sector to look up
+ * @param[out] domain		Zone domain descriptor
+ *
+ * Find the zone domain containing \a sector using the device realm index
+ * and return its descriptor at the address specified by \a domain.
+ *
+ * @return Returns 0 on success, -ENOENT if no domain contains \a sector
+ * and a negative error code if the realm index could not be built.
+ */
+extern int zbc_find_domain(struct zbc_device *dev, uint64_t sector,
+			   struct zbc_zone_domain *domain);
+
+/**
+ * @brief Get the zone realm containing a sector
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ * @param[in] sector		512B sector to look up
+ * @param[out] realm		Zone realm descriptor
+ * @param[out] dom_id		ID of the domain containing \a sector
+ *
+ * Find the zone realm which has a range of sectors containing \a sector in
+ * one of its domains using the device realm index. The realm descriptor is
+ * returned at the address specified by \a realm. If \a dom_id is not NULL,
+ * the ID of the domain containing \a sector is returned at the address
+ * specified by \a dom_id.
+ *
+ * @return Returns 0 on success, -ENOENT if no realm contains \a sector
+ * and a negative error code if the realm index could not be built.
+ */
+extern int zbc_find_realm(struct zbc_device *dev, uint64_t sector,
+			  struct zbc_zone_realm *realm, unsigned int *dom_id);
+
+/**
+ * @brief Get the next realm that can be activated as a zone type
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ * @param[in] realm_number	Number of the first realm to consider
+ * @param[in] type		Zone type to activate
+ * @param[out] realm		Zone realm descriptor
+ *
+ * Find the first realm with a number equal to or greater than
+ * \a realm_number that is not currently of type \a type, that can be
+ * activated as \a type and that has no activation restriction. The realm
+ * descriptor is returned at the address specified by \a realm.
+ *
+ * @return Returns 0 on success, -ENOENT if no such realm exists
+ * and a negative error code if the realm index could not be built.
+ */
+extern int zbc_find_actv_realm(struct zbc_device *dev,
+			       unsigned int realm_number,
+			       enum zbc_zone_type type,
+			       struct zbc_zone_realm *realm);
+
+/**
+ * @brief Zone activation plan step
+ *
+ * Describe a single ZONE ACTIVATE command of a zone activation plan.
+ * A step activates a run of consecutive realms that are contiguous in
+ * both their current domain and the target domain.
+ */
+struct zbc_actv_step {
+
+	/**
+	 * Start 512B sector of the zones to activate in the target domain.
+	 */
+	uint64_t		zbs_start_sector;
+
+	/**
+	 * Start 512B sector of the realms zones in their current domain.
+	 */
+	uint64_t		zbs_src_sector;
+
+	/**
+	 * Number of zones to activate in the target domain.
+	 */
+	unsigned int		zbs_nr_zones;
+
+	/**
+	 * Number of zones of the realms in their current domain to reset
+	 * before activation (0 for conventional zones).
+	 */
+	unsigned int		zbs_src_nr_zones;
+
+	/**
+	 * Target zone domain ID.
+	 */
+	unsigned int		zbs_dom_id;
+
+	/**
+	 * Number of the first realm activated by this step.
+	 */
+	unsigned int		zbs_realm;
+
+	/**
+	 * Number of realms activated by this step.
+	 */
+	unsigned int		zbs_nr_realms;
+
+	/**
+	 * Number of activation results records expected for this step.
+	 * Set when the plan is queried.
+	 */
+	unsigned int		zbs_nr_actv_recs;
+};
+
+/**
+ * @brief Zone activation plan
+ *
+ * List of the ZONE ACTIVATE commands needed to reach a target zone realm
+ * layout, computed with \a zbc_plan_activation.
+ */
+struct zbc_actv_plan {
+
+	/**
+	 * Zone type to activate.
+	 */
+	enum zbc_zone_type	zbp_type;
+
+	/**
+	 * Number of realms to activate.
+	 */
+	unsigned int		zbp_nr_realms;
+
+	/**
+	 * Use FSNOZ to set the number of zones of each step.
+	 */
+	bool			zbp_fsnoz;
+
+	/**
+	 * Use 32-byte SCSI commands.
+	 */
+	bool			zbp_cdb32;
+
+	/**
+	 * Number of steps (ZONE ACTIVATE commands) of the plan.
+	 */
+	unsigned int		zbp_nr_steps;
+
+	/**
+	 * Array of steps.
+	 */
+	struct zbc_actv_step	*zbp_steps;
+};
+
+/**
+ * @brief Zone activation plan execution flags
+ */
+enum zbc_actv_plan_flags {
+
+	/**
+	 * Only query the plan steps, do not activate.
+	 */
+	ZBC_ACTV_PLAN_QUERY	= 0x01,
+
+	/**
+	 * Reset the realms zones before activating them.
+	 */
+	ZBC_ACTV_PLAN_RESET	= 0x02,
+};
+
+/**
+ * @brief Zone activation plan progress callback
+ *
+ * Called by \a zbc_exec_activation_plan after the step number \a step
+ * of \a plan is completed.
+ */
+typedef void (*zbc_actv_progress_t)(struct zbc_device *dev,
+				    struct zbc_actv_plan *plan,
+				    unsigned int step, void *data);
+
+/**
+ * @brief Compute a zone activation plan
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ * @param[in] type		Zone type to activate
+ * @param[in] nr_realms		Target number of realms of type \a type
+ * @param[out] plan		Address where to return the plan
+ *
+ * Compute the minimal list of ZONE ACTIVATE commands needed for the
+ * device to have at least \a nr_realms realms of type \a type. Realms are
+ * selected in increasing realm number order using the device realm index
+ * and consecutive realms are activated with a single command, within the
+ * limits set by the device maximum number of zones to activate
+ * (\a zbd_max_activation) and by the maximum number of realms that can be
+ * activated at once (\a zbt_max_activate). Realms of domains with shifting
+ * boundaries are activated one by one. If the device already has enough
+ * realms of type \a type, the plan has no steps. The plan must be freed
+ * using \a zbc_free_activation_plan.
+ *
+ * @return Returns 0 on success, -ENOTSUP if the device is not a Zone
+ * Domains/Zone Realms device or does not support the zone type, -ENOSPC
+ * if not enough realms can be activated, and another negative error code
+ * if the realm index could not be built.
+ */
+extern int zbc_plan_activation(struct zbc_device *dev,
+			       enum zbc_zone_type type,
+			       unsigned int nr_realms,
+			       struct zbc_actv_plan **plan);
+
+/**
+ * @brief Free a zone activation plan
+ * @param[in] plan		Plan obtained with \a zbc_plan_activation
+ */
+extern void zbc_free_activation_plan(struct zbc_actv_plan *plan);
+
+/**
+ * @brief Execute a zone activation plan
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ * @param[in] plan		Plan obtained with \a zbc_plan_activation
+ * @param[in] flags		Execution flags (enum zbc_actv_plan_flags)
+ * @param[in] progress		Progress callback (may be NULL)
+ * @param[in] data		Progress callback private data
+ *
+ * All steps of \a plan are first queried to check that the activation
+ * can be done and to get the number of activation results records of each
+ * step. If \a flags includes ZBC_ACTV_PLAN_QUERY, the execution stops
+ * there. Otherwise, the steps are executed in order. If \a flags includes
+ * ZBC_ACTV_PLAN_RESET, the zones of the realms of a step are reset by a
+ * separate thread, using another handle to the device opened with the
+ * same flags as \a dev, while the previous step is being activated. If
+ * that handle cannot be opened (e.g. \a dev was opened with O_EXCL), the
+ * zones of each step are reset before activating the step.
+ * \a progress is called after each step is completed.
+ *
+ * For plans using FSNOZ, the device FSNOZ value is changed as needed to
+ * execute the steps and restored to its initial value before returning.
+ * With ZBC_ACTV_PLAN_QUERY, FSNOZ is not changed: steps for which FSNOZ
+ * does not match are queried using the NOZSRC field.
+ *
+ * @return Returns 0 on success and a negative error code if a step query
+ * or activation failed. In the latter case, the steps preceding the
+ * failed step are activated.
+ */
+extern int zbc_exec_activation_plan(struct zbc_device *dev,
+				    struct zbc_actv_plan *plan,
+				    unsigned int flags,
+				    zbc_actv_progress_t progress, void *data);
+
 /**
  * @brief Zoned Block Device Statistics
  *
@@ -2201,6 +2983,343 @@ struct zbc_zoned_blk_dev_stats {
 	unsigned long long	write_rule_fails;
 };
 
+/**
+ * @brief Library statistics
+ *
+ * This structure is filled with statistic counters maintained by
+ * libzbc for an open device, obtained by calling \a zbc_get_lib_stats()
+ * function.
+ */
+struct zbc_lib_stats {
+
+	/** REPORT DOMAINS and REPORT REALMS commands saved */
+	unsigned long long	report_cmds_saved;
+
+	/** Sense data retrieval commands saved for failed asynchronous I/Os */
+	unsigned long long	sense_cmds_saved;
+
+	/** Writes delayed by a write in flight to the same zone */
+	unsigned long long	plugged_writes;
+
+	/** Total and maximum zone write plug wait time in nanoseconds */
+	unsigned long long	plug_wait_ns;
+	unsigned long long	plug_wait_max_ns;
+
+	/** Current and maximum number of zones open (open zone manager) */
+	unsigned long long	nr_open_zones;
+	unsigned long long	max_nr_open_zones;
+
+	/** Zones closed by the open zone manager */
+	unsigned long long	auto_closed_zones;
+
+	/**
+	 * Writes and zone open operations executed with the open zone
+	 * limit reached because no open zone could be closed.
+	 */
+	unsigned long long	open_limit_overruns;
+
+	/**
+	 * Sequential write preferred zones written non-sequentially
+	 * beyond the device optimal number of such zones.
+	 */
+	unsigned long long	non_seq_overruns;
+};
+
+/**
+ * @brief Get library statistics
+ *
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ * @param[out] stats		Points to \a zbc_lib_stats
+ *                              structure allocated by the caller
+ * @param[in] size		Size of the \a stats structure
+ *
+ * Get the library statistics counters of a device. If \a size is smaller
+ * than the size of struct zbc_lib_stats, only the first \a size bytes
+ * of the structure are returned.
+ */
+extern void zbc_get_lib_stats(struct zbc_device *dev,
+			      struct zbc_lib_stats *stats, size_t size);
+
+/**
+ * @brief Enable or disable the open zone manager
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ * @param[in] enable		Enable (true) or disable (false) the manager
+ * @param[in] max_open		Maximum number of open zones
+ *
+ * The open zone manager tracks the zones open explicitly with
+ * \a zbc_open_zone and implicitly by writes issued through \a dev. Before
+ * a write or an explicit open would exceed \a max_open open zones, the
+ * least recently written open zones are closed. If \a max_open is 0, the
+ * device limit is used: \a zbd_max_nr_open_seq_req for host-managed
+ * devices and \a zbd_opt_nr_open_seq_pref for host-aware devices. Exceeding
+ * the open zone limit (when all open zones have writes in flight) and
+ * \a zbd_opt_nr_non_seq_write_seq_pref are reported with a warning message
+ * and counted in the library statistics (see \a zbc_get_lib_stats).
+ * Zones open when the manager is enabled are tracked too. Zones open by
+ * other processes or device handles are not.
+ *
+ * @return Returns 0 on success, -ENOTSUP if the device does not support
+ * open zone management (in device test mode) or another negative error
+ * code if getting the open zones failed.
+ */
+extern int zbc_manage_open_zones(struct zbc_device *dev, bool enable,
+				 unsigned int max_open);
+
+/**
+ * @brief Zone allocator write streams
+ *
+ * Data written with a zone allocator is placed in zones according to its
+ * expected lifetime so that zones tend to be invalidated as a whole.
+ */
+enum zbc_zone_stream {
+
+	/** Short lived data */
+	ZBC_STREAM_HOT		= 0x00,
+
+	/** Data with a medium lifetime */
+	ZBC_STREAM_WARM		= 0x01,
+
+	/** Long lived data */
+	ZBC_STREAM_COLD		= 0x02,
+
+};
+
+/** @brief Number of zone allocator write streams */
+#define ZBC_NR_STREAMS		3
+
+/**
+ * @brief Opaque zone allocator
+ */
+struct zbc_zone_allocator;
+
+/**
+ * @brief Create a zone allocator
+ * @param[in] dev		Device handle obtained with \a zbc_open
+ * @param[in] nr_active		Number of active zones per stream
+ * @param[out] za		Address where to return the allocator
+ *
+ * Create a zone allocator for the writable sequential zones of \a dev.
+ * Empty zones are free, other zones are considered allocated. Each write
+ * stream writes to up to \a nr_active zones (1 if \a nr_active is 0),
+ * and the total number of active zones is limited to the device maximum
+ * (or optimal) number of open zones.
+ *
+ * @return Returns 0 on success and a negative error code otherwise.
+ */
+extern int zbc_create_zone_allocator(struct zbc_device *dev,
+				     unsigned int nr_active,
+				     struct zbc_zone_allocator **za);
+
+/**
+ * @brief Free a zone allocator
+ * @param[in] za		Zone allocator
+ */
+extern void zbc_free_zone_allocator(struct zbc_zone_allocator *za);
+
+/**
+ * @brief Allocate an empty zone
+ * @param[in] za		Zone allocator
+ * @param[in] stream		Write stream of the data stored in the zone
+ * @param[out] sector		Start sector of the allocated zone
+ *
+ * Allocate an empty zone for exclusive use by the caller. The most recently
+ * released zones are allocated first.
+ *
+ * @return Returns 0 on success, -ENOSPC if there is no free zone and
+ * -EINVAL if \a stream is invalid.
+ */
+extern int zbc_alloc_zone(struct zbc_zone_allocator *za,
+			  enum zbc_zone_stream stream, uint64_t *sector);
+
+/**
+ * @brief Allocate sectors in a write stream
+ * @param[in] za		Zone allocator
+ * @param[in] stream		Write stream of the data
+ * @param[in] count		Number of 512B sectors to allocate
+ * @param[out] sector		First allocated sector
+ *
+ * Allocate \a count sectors at the write pointer of one of the active
+ * zones of \a stream, in round robin. If the active zone does not have
+ * enough space left, a new zone is allocated, the space left in the
+ * previous zone is not used and the previous zone is explicitly closed
+ * so that it does not count against the open zones limit. Allocated
+ * sectors must be written in allocation order for each zone.
+ *
+ * @return Returns 0 on success, -ENOSPC if there is no free zone and
+ * -EINVAL if \a stream or \a count is invalid.
+ */
+extern int zbc_alloc_sectors(struct zbc_zone_allocator *za,
+			     enum zbc_zone_stream stream, size_t count,
+			     uint64_t *sector);
+
+/**
+ * @brief Release a zone
+ * @param[in] za		Zone allocator
+ * @param[in] sector		Start sector of the zone
+ *
+ * Reset the write pointer of a zone allocated with \a zbc_alloc_zone or
+ * \a zbc_alloc_sectors and return it to the free zones. The zone stops
+ * being an active zone of its stream, even if the reset fails.
+ *
+ * @return Returns 0 on success, -EINVAL if the zone is not allocated,
+ * -EBUSY if the zone is already being released and the error returned by
+ * \a zbc_reset_zone otherwise.
+ */
+extern int zbc_release_zone(struct zbc_zone_allocator *za, uint64_t sector);
+
+/**
+ * @brief Get the number of free zones of a zone allocator
+ * @param[in] za		Zone allocator
+ *
+ * @return The number of free zones.
+ */
+extern unsigned int zbc_nr_free_zones(struct zbc_zone_allocator *za);
+
+/**
+ * @brief Garbage collector liveness callback
+ *
+ * Return true if the block starting at \a sector contains live data.
+ */
+typedef bool (*zbc_gc_live_cb)(uint64_t sector, void *data);
+
+/**
+ * @brief Garbage collector relocation callback
+ *
+ * Called when \a count sectors of live data starting at \a src were
+ * copied to \a dst.
+ */
+typedef void (*zbc_gc_moved_cb)(uint64_t src, uint64_t dst, size_t count,
+				void *data);
+
+/**
+ * @brief Garbage collection parameters
+ */
+struct zbc_gc_params {
+
+	/** Liveness tracking granularity in 512B sectors (block size) */
+	unsigned int		zgp_block_sectors;
+
+	/**
+	 * Bitmap of the live blocks of the device: bit (b % 64) of word
+	 * (b / 64) is set if block b (sectors b * zgp_block_sectors and
+	 * up) is live. If NULL, \a zgp_live is used.
+	 */
+	const uint64_t		*zgp_live_map;
+
+	/** Liveness callback, used if \a zgp_live_map is NULL */
+	zbc_gc_live_cb		zgp_live;
+
+	/** Relocation callback (optional) */
+	zbc_gc_moved_cb		zgp_moved;
+
+	/** Private data passed to the callbacks */
+	void			*zgp_data;
+
+	/** Write stream of relocated data */
+	enum zbc_zone_stream	zgp_stream;
+
+	/** Maximum number of zones reclaimed by a pass (1 if 0) */
+	unsigned int		zgp_nr_victims;
+
+	/** Number of zones reset after a flush (all victims if 0) */
+	unsigned int		zgp_reset_batch;
+
+	/** Copy I/O size in 512B sectors (maximum I/O size if 0) */
+	size_t			zgp_io_sectors;
+
+};
+
+/**
+ * @brief Garbage collection statistics
+ *
+ * The write amplification of a zone allocator is
+ * (zgs_user_sectors + zgs_sectors_copied) / zgs_user_sectors and the
+ * copy throughput is zgs_sectors_copied * 512 / zgs_copy_ns bytes per
+ * nanosecond.
+ */
+struct zbc_gc_stats {
+
+	/** Garbage collection passes executed */
+	unsigned long long	zgs_passes;
+
+	/** Zones reset and returned to the free zones */
+	unsigned long long	zgs_zones_reclaimed;
+
+	/** Sectors of live data copied */
+	unsigned long long	zgs_sectors_copied;
+
+	/** Sectors allocated with \a zbc_alloc_sectors by the user */
+	unsigned long long	zgs_user_sectors;
+
+	/** Time spent copying live data in nanoseconds */
+	unsigned long long	zgs_copy_ns;
+
+};
+
+/**
+ * @brief Reclaim zones of a zone allocator
+ * @param[in] za		Zone allocator
+ * @param[in] params		Garbage collection parameters
+ *
+ * Execute a garbage collection pass: select up to \a zgp_nr_victims
+ * allocated zones that are not written to by a stream and were not
+ * allocated with \a zbc_alloc_zone, copy their live data to the
+ * \a zgp_stream stream and release them. Victims are selected with the
+ * cost-benefit policy: the zones maximizing (1 - u) * age / (1 + u),
+ * where u is the fraction of live data of the zone and age the time since
+ * the last allocation in the zone, are reclaimed first. Live data is copied
+ * with large asynchronous reads and writes. If the device executes
+ * asynchronous I/Os with queued commands (see \a zbc_aio_queue_depth),
+ * the read of a chunk overlaps the write of the previous one. Otherwise,
+ * the reads and writes are executed one after the other. Relocated data is
+ * flushed before the victims are reset.
+ * The caller must not have asynchronous I/Os in flight on the device and
+ * must not access the data of the victims until the pass completes.
+ *
+ * @return Returns the number of zones reclaimed, -EINVAL if \a params is
+ * invalid, -EBUSY if asynchronous I/Os are in flight and another negative
+ * error code if an I/O or a zone operation failed.
+ */
+extern int zbc_gc(struct zbc_zone_allocator *za,
+		  struct zbc_gc_params *params);
+
+/**
+ * @brief Get the garbage collection statistics of a zone allocator
+ * @param[in] za		Zone allocator
+ * @param[out] stats		Statistics
+ */
+extern void zbc_gc_get_stats(struct zbc_zone_allocator *za,
+			     struct zbc_gc_stats *stats);
+
+/**
+ * @brief Copy the data of a zone to another zone
+ * @param[in] src		Source device handle obtained with \a zbc_open
+ * @param[in] src_sector	Start sector of the source zone
+ * @param[in] dst		Destination device handle obtained with \a zbc_open
+ * @param[in] dst_sector	Start sector of the destination zone
+ * @param[out] nr_sectors	Number of 512B sectors copied (may be NULL)
+ *
+ * Copy the data of a zone up to its write pointer (all sectors for
+ * conventional and full zones) to the start of another zone, possibly
+ * of another device. The destination zone must be a conventional zone or
+ * an empty sequential zone large enough for the data. Data is copied with
+ * asynchronous I/Os of the maximum size supported by both devices using two
+ * buffers. The read of a chunk overlaps the write of the previous one only
+ * if the devices execute asynchronous I/Os with queued commands, that is,
+ * for ATA devices open with ZBC_O_NCQ (see \a zbc_aio_queue_depth).
+ * Otherwise, the reads and writes are executed one after the other. A
+ * sequential destination zone is left finished if the source zone is full
+ * and closed otherwise. The devices must not have asynchronous I/Os in
+ * flight.
+ *
+ * @return Returns 0 on success, -EINVAL if a zone cannot be copied, -EBUSY
+ * if asynchronous I/Os are in flight and another negative error code if an
+ * I/O or a zone operation failed.
+ */
+extern int zbc_copy_zone(struct zbc_device *src, uint64_t src_sector,
+			 struct zbc_device *dst, uint64_t dst_sector,
+			 uint64_t *nr_sectors);
+
 /**
  * @brief Get Zoned Block Device statistics
  *
@@ -2329,6 +3448,102 @@ extern int zbc_map_iov(const void *buf, size_t sectors,
  */
 extern int zbc_flush(struct zbc_device *dev);
 
+/**
+ * @brief Asynchronous I/O descriptor
+ *
+ * Describe a read or write operation submitted with \a zbc_aio_submit.
+ * The descriptor must not be modified nor freed until it is returned by
+ * \a zbc_aio_reap.
+ */
+struct zbc_aio {
+
+	/**
+	 * Caller supplied data buffer.
+	 */
+	void			*zio_buf;
+
+	/**
+	 * Number of 512B sectors to transfer.
+	 */
+	size_t			zio_count;
+
+	/**
+	 * Offset where to start the transfer (512B sector unit).
+	 */
+	uint64_t		zio_offset;
+
+	/**
+	 * Write operation if true, read operation otherwise.
+	 */
+	bool			zio_write;
+
+	/**
+	 * Operation result: the number of 512B sectors transferred
+	 * on success or a negative error code.
+	 */
+	ssize_t			zio_ret;
+
+	/**
+	 * Caller private data.
+	 */
+	void			*zio_private;
+};
+
+/**
+ * @brief Get the maximum number of asynchronous I/Os in flight
+ * @param[in] dev	Device handle obtained with \a zbc_open
+ *
+ * Asynchronous I/Os are executed using queued commands for ATA devices
+ * open with ZBC_O_NCQ through an SG node (/dev/sgX) if the device supports
+ * NCQ. In this case, the device queue depth is returned. Otherwise,
+ * asynchronous I/Os are executed synchronously on submission and 1 is
+ * returned.
+ *
+ * @return The maximum number of asynchronous I/Os in flight.
+ */
+extern unsigned int zbc_aio_queue_depth(struct zbc_device *dev);
+
+/**
+ * @brief Submit an asynchronous I/O
+ * @param[in] dev	Device handle obtained with \a zbc_open
+ * @param[in] aio	I/O descriptor
+ *
+ * Submit the read or write operation described by \a aio. The operation
+ * must be executable with a single command: its size is limited to the
+ * device maximum number of sectors per command (\a zbd_max_rw_sectors) and
+ * must be aligned as described in \a zbc_pread and \a zbc_pwrite.
+ * Completed operations are obtained with \a zbc_aio_reap.
+ *
+ * At most one write is executed at any time for a sequential write required
+ * zone: if asynchronous I/Os are executed with queued commands (see
+ * \a zbc_aio_queue_depth), a write to a zone with a write in flight is
+ * submitted to the device only once that write is reaped. Other writes and
+ * reads are not delayed.
+ * Writes to a zone with asynchronous writes in flight must thus not be
+ * issued with \a zbc_pwrite from the thread reaping these writes.
+ *
+ * @return Returns 0 on success, -EAGAIN if \a zbc_aio_queue_depth I/Os are
+ * already in flight, -EINVAL if the operation is invalid and another
+ * negative error code if the operation could not be submitted.
+ */
+extern int zbc_aio_submit(struct zbc_device *dev, struct zbc_aio *aio);
+
+/**
+ * @brief Get a completed asynchronous I/O
+ * @param[in] dev	Device handle obtained with \a zbc_open
+ * @param[out] aio	Address where to return the completed I/O descriptor
+ * @param[in] wait	Wait for an I/O completion if none is available
+ *
+ * Get an I/O submitted with \a zbc_aio_submit that is completed. The result
+ * of the operation is indicated by the descriptor \a zio_ret field.
+ *
+ * @return Returns 0 if a completed I/O is returned, -ENOENT if no I/O is in
+ * flight, -EAGAIN if \a wait is false and no I/O is completed, and another
+ * negative error code if getting a completion failed.
+ */
+extern int zbc_aio_reap(struct zbc_device *dev, struct zbc_aio **aio,
+			bool wait);
+
 /**
  * @}
  */
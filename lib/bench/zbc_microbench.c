@@ -0,0 +1,657 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ *
+ * CPU overhead micro-benchmarks of the library hot paths.
+ *
+ * The library sources are linked directly with this program and the SG_IO
+ * ioctl is replaced with a stub returning canned device responses, so that
+ * only the CPU cost of the library code (command setup and execution,
+ * vector conversion and report parsing) is measured. Memory allocations
+ * done by the library are counted by wrapping the allocation functions.
+ */
+#include "zbc.h"
+#include "zbc_sg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <libgen.h>
+#include <sys/ioctl.h>
+
+/*
+ * Stub device geometry: 4 KiB logical blocks and 256 MiB zones.
+ */
+#define ZBC_MB_LBLOCK_SIZE	4096
+#define ZBC_MB_ZONE_LBAS	65536ULL
+#define ZBC_MB_NR_ZONES		4096
+#define ZBC_MB_MAX_RW_SECTORS	1024
+#define ZBC_MB_NR_REALMS	256
+#define ZBC_MB_NR_IOVS		256
+
+/*
+ * Zone descriptor definitions (see zbc_scsi.c and zbc_ata.c).
+ */
+#define ZBC_MB_ZONE_DESCRIPTOR_LENGTH	64
+#define ZBC_MB_ZONE_DESCRIPTOR_OFFSET	64
+
+/*
+ * ATA REPORT ZONES EXT definitions (see zbc_ata.c).
+ */
+#define ZBC_MB_ATA_ZAC_MANAGEMENT_IN	0x4A
+#define ZBC_MB_ATA_REPORT_ZONES_EXT_AF	0x00
+
+/*
+ * Realm report definitions (see zbc_scsi.c).
+ */
+#define ZBC_MB_RPT_REALMS_HEADER_SIZE	64
+#define ZBC_MB_RPT_REALMS_RECORD_SIZE	128
+#define ZBC_MB_RPT_REALMS_DESC_OFFSET	16
+#define ZBC_MB_RPT_REALMS_SE_DESC_SIZE	16
+
+/*
+ * Canned responses of the stub device.
+ */
+static uint8_t *zbc_mb_scsi_zones;
+static uint8_t *zbc_mb_ata_zones;
+static uint8_t *zbc_mb_realms;
+static size_t zbc_mb_zones_bufsz;
+static size_t zbc_mb_realms_bufsz;
+
+/*
+ * Stub SG file descriptor.
+ */
+static int zbc_mb_sg_fd = -1;
+
+/*
+ * Number of memory allocations done by the library.
+ */
+static unsigned long long zbc_mb_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **memptr, size_t alignment, size_t size);
+int __real_ioctl(int fd, unsigned long request, ...);
+
+void *__wrap_malloc(size_t size)
+{
+	zbc_mb_allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	zbc_mb_allocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	zbc_mb_allocs++;
+	return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	zbc_mb_allocs++;
+	return __real_posix_memalign(memptr, alignment, size);
+}
+
+/*
+ * Complete a command of the stub device with a canned response.
+ */
+static void zbc_mb_complete(sg_io_hdr_t *hdr, uint8_t *data, size_t len)
+{
+	if (data && !hdr->iovec_count) {
+		if (len > hdr->dxfer_len)
+			len = hdr->dxfer_len;
+		memcpy(hdr->dxferp, data, len);
+		hdr->resid = hdr->dxfer_len - len;
+	} else {
+		hdr->resid = 0;
+	}
+
+	hdr->status = 0;
+	hdr->masked_status = 0;
+	hdr->host_status = 0;
+	hdr->driver_status = 0;
+	hdr->sb_len_wr = 0;
+	hdr->duration = 0;
+	hdr->info = 0;
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+	sg_io_hdr_t *hdr;
+	uint8_t *cdb;
+	va_list ap;
+	void *arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (fd != zbc_mb_sg_fd || request != SG_IO)
+		return __real_ioctl(fd, request, arg);
+
+	hdr = arg;
+	cdb = hdr->cmdp;
+	if (cdb[0] == ZBC_SG_REPORT_ZONES_CDB_OPCODE &&
+	    (cdb[1] & 0x1f) == ZBC_SG_REPORT_ZONES_CDB_SA)
+		zbc_mb_complete(hdr, zbc_mb_scsi_zones, zbc_mb_zones_bufsz);
+	else if (cdb[0] == ZBC_SG_REPORT_REALMS_CDB_OPCODE &&
+		 (cdb[1] & 0x1f) == ZBC_SG_REPORT_REALMS_CDB_SA)
+		zbc_mb_complete(hdr, zbc_mb_realms, zbc_mb_realms_bufsz);
+	else if (cdb[0] == ZBC_SG_ATA16_CDB_OPCODE &&
+		 cdb[14] == ZBC_MB_ATA_ZAC_MANAGEMENT_IN &&
+		 cdb[4] == ZBC_MB_ATA_REPORT_ZONES_EXT_AF)
+		zbc_mb_complete(hdr, zbc_mb_ata_zones, zbc_mb_zones_bufsz);
+	else
+		zbc_mb_complete(hdr, NULL, 0);
+
+	return 0;
+}
+
+static inline void zbc_mb_put_le64(uint8_t *buf, uint64_t val)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		buf[i] = (val >> (i * 8)) & 0xff;
+}
+
+static inline void zbc_mb_put_le32(uint8_t *buf, uint32_t val)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		buf[i] = (val >> (i * 8)) & 0xff;
+}
+
+/*
+ * Build the REPORT ZONES responses: a few conventional zones followed by
+ * sequential write required zones in various conditions.
+ */
+static int zbc_mb_init_zones(void)
+{
+	uint8_t *sbuf, *abuf;
+	uint64_t start, wp;
+	uint8_t type, cond;
+	unsigned int i;
+
+	zbc_mb_zones_bufsz = ZBC_MB_ZONE_DESCRIPTOR_OFFSET +
+		ZBC_MB_NR_ZONES * ZBC_MB_ZONE_DESCRIPTOR_LENGTH;
+	zbc_mb_scsi_zones = __real_calloc(1, zbc_mb_zones_bufsz);
+	zbc_mb_ata_zones = __real_calloc(1, zbc_mb_zones_bufsz);
+	if (!zbc_mb_scsi_zones || !zbc_mb_ata_zones)
+		return -ENOMEM;
+
+	sbuf = zbc_mb_scsi_zones;
+	abuf = zbc_mb_ata_zones;
+	zbc_sg_set_int32(sbuf, ZBC_MB_NR_ZONES * ZBC_MB_ZONE_DESCRIPTOR_LENGTH);
+	zbc_mb_put_le32(abuf, ZBC_MB_NR_ZONES * ZBC_MB_ZONE_DESCRIPTOR_LENGTH);
+	zbc_sg_set_int64(&sbuf[8], ZBC_MB_NR_ZONES * ZBC_MB_ZONE_LBAS - 1);
+	zbc_mb_put_le64(&abuf[8], ZBC_MB_NR_ZONES * ZBC_MB_ZONE_LBAS - 1);
+
+	sbuf += ZBC_MB_ZONE_DESCRIPTOR_OFFSET;
+	abuf += ZBC_MB_ZONE_DESCRIPTOR_OFFSET;
+	for (i = 0; i < ZBC_MB_NR_ZONES; i++) {
+		start = i * ZBC_MB_ZONE_LBAS;
+		if (i < 64) {
+			type = ZBC_ZT_CONVENTIONAL;
+			cond = ZBC_ZC_NOT_WP;
+			wp = (uint64_t)-1;
+		} else {
+			type = ZBC_ZT_SEQUENTIAL_REQ;
+			switch (i % 4) {
+			case 0:
+				cond = ZBC_ZC_EMPTY;
+				wp = start;
+				break;
+			case 1:
+				cond = ZBC_ZC_IMP_OPEN;
+				wp = start + ZBC_MB_ZONE_LBAS / 2;
+				break;
+			case 2:
+				cond = ZBC_ZC_CLOSED;
+				wp = start + ZBC_MB_ZONE_LBAS / 4;
+				break;
+			default:
+				cond = ZBC_ZC_FULL;
+				wp = start + ZBC_MB_ZONE_LBAS;
+				break;
+			}
+		}
+
+		sbuf[0] = abuf[0] = type;
+		sbuf[1] = abuf[1] = cond << 4;
+		zbc_sg_set_int64(&sbuf[8], ZBC_MB_ZONE_LBAS);
+		zbc_mb_put_le64(&abuf[8], ZBC_MB_ZONE_LBAS);
+		zbc_sg_set_int64(&sbuf[16], start);
+		zbc_mb_put_le64(&abuf[16], start);
+		zbc_sg_set_int64(&sbuf[24], wp);
+		zbc_mb_put_le64(&abuf[24], wp);
+
+		sbuf += ZBC_MB_ZONE_DESCRIPTOR_LENGTH;
+		abuf += ZBC_MB_ZONE_DESCRIPTOR_LENGTH;
+	}
+
+	return 0;
+}
+
+/*
+ * Build the REPORT REALMS response for a device with a conventional and a
+ * sequential write required domain.
+ */
+static int zbc_mb_init_realms(void)
+{
+	uint64_t realm_lbas = ZBC_MB_NR_ZONES * ZBC_MB_ZONE_LBAS /
+		ZBC_MB_NR_REALMS;
+	uint8_t *buf, *ptr;
+	unsigned int i, j;
+
+	zbc_mb_realms_bufsz = ZBC_MB_RPT_REALMS_HEADER_SIZE +
+		ZBC_MB_NR_REALMS * ZBC_MB_RPT_REALMS_RECORD_SIZE;
+	zbc_mb_realms = __real_calloc(1, zbc_mb_realms_bufsz);
+	if (!zbc_mb_realms)
+		return -ENOMEM;
+
+	buf = zbc_mb_realms;
+	zbc_sg_set_int32(&buf[4], ZBC_MB_NR_REALMS);
+	zbc_sg_set_int32(&buf[8], ZBC_MB_RPT_REALMS_RECORD_SIZE);
+
+	buf += ZBC_MB_RPT_REALMS_HEADER_SIZE;
+	for (i = 0; i < ZBC_MB_NR_REALMS; i++) {
+		zbc_sg_set_int32(buf, i);
+		zbc_sg_set_int16(&buf[4], 0x03);
+		buf[7] = i & 1;
+		ptr = buf + ZBC_MB_RPT_REALMS_DESC_OFFSET;
+		for (j = 0; j < 2; j++) {
+			zbc_sg_set_int64(ptr, i * realm_lbas);
+			zbc_sg_set_int64(ptr + 8, (i + 1) * realm_lbas - 1);
+			ptr += ZBC_MB_RPT_REALMS_SE_DESC_SIZE;
+		}
+		buf += ZBC_MB_RPT_REALMS_RECORD_SIZE;
+	}
+
+	return 0;
+}
+
+/*
+ * Setup a stub host-managed device with two zone domains.
+ */
+static int zbc_mb_init_dev(struct zbc_device *dev, struct zbc_drv *drv)
+{
+	struct zbc_device_info *di = &dev->zbd_info;
+	uint64_t sectors = ZBC_MB_NR_ZONES * ZBC_MB_ZONE_LBAS *
+		(ZBC_MB_LBLOCK_SIZE >> 9);
+	unsigned int i;
+
+	memset(dev, 0, sizeof(struct zbc_device));
+	dev->zbd_filename = "stub";
+	dev->zbd_fd = zbc_mb_sg_fd;
+	dev->zbd_sg_fd = zbc_mb_sg_fd;
+	dev->zbd_drv = drv;
+	dev->zbd_report_bufsz_min = 512;
+	dev->zbd_report_bufsz_mask = dev->zbd_report_bufsz_min - 1;
+
+	di->zbd_type = drv == &zbc_ata_drv ? ZBC_DT_ATA : ZBC_DT_SCSI;
+	di->zbd_model = ZBC_DM_HOST_MANAGED;
+	di->zbd_flags = ZBC_STANDARD_RPT_REALMS;
+	di->zbd_sectors = sectors;
+	di->zbd_lblock_size = ZBC_MB_LBLOCK_SIZE;
+	di->zbd_lblocks = sectors / (ZBC_MB_LBLOCK_SIZE >> 9);
+	di->zbd_pblock_size = ZBC_MB_LBLOCK_SIZE;
+	di->zbd_pblocks = di->zbd_lblocks;
+	di->zbd_max_rw_sectors = ZBC_MB_MAX_RW_SECTORS;
+
+	for (i = 0; i < 2; i++) {
+		dev->zbd_domains[i].zbm_id = i;
+		dev->zbd_domains[i].zbm_type = i ? ZBC_ZT_SEQUENTIAL_REQ :
+			ZBC_ZT_CONVENTIONAL;
+		dev->zbd_domains[i].zbm_start_sector = i * sectors;
+		dev->zbd_domains[i].zbm_end_sector = (i + 1) * sectors - 1;
+		dev->zbd_domains[i].zbm_nr_zones = ZBC_MB_NR_ZONES;
+	}
+	dev->zbd_nr_domains = 2;
+	dev->zbd_domains_valid = true;
+
+	return 0;
+}
+
+/*
+ * Benchmark context and cases.
+ */
+struct zbc_mb_ctx {
+	struct zbc_device	scsi_dev;
+	struct zbc_device	ata_dev;
+	struct zbc_zone		*zones;
+	struct zbc_zone_table	*zt;
+	struct zbc_zone_realm	*realms;
+	struct iovec		iov[ZBC_MB_NR_IOVS];
+	void			*buf;
+};
+
+static int zbc_mb_sg_cmd(struct zbc_mb_ctx *ctx)
+{
+	struct zbc_device *dev = &ctx->scsi_dev;
+	struct zbc_sg_cmd cmd;
+	int ret;
+
+	ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_REPORT_ZONES, NULL, 4096);
+	if (ret != 0)
+		return ret;
+
+	cmd.cdb[0] = ZBC_SG_REPORT_ZONES_CDB_OPCODE;
+	cmd.cdb[1] = 0x1f;
+	ret = zbc_sg_cmd_exec(dev, &cmd);
+
+	zbc_sg_cmd_destroy(&cmd);
+
+	return ret;
+}
+
+static int zbc_mb_report_zones(struct zbc_device *dev, struct zbc_zone *zones)
+{
+	unsigned int nr_zones = ZBC_MB_NR_ZONES;
+	int ret;
+
+	ret = (dev->zbd_drv->zbd_report_zones)(dev, 0, ZBC_RZ_RO_ALL,
+					       zones, &nr_zones);
+	if (ret == 0 && nr_zones != ZBC_MB_NR_ZONES)
+		return -EIO;
+
+	return ret;
+}
+
+static int zbc_mb_scsi_report_zones(struct zbc_mb_ctx *ctx)
+{
+	return zbc_mb_report_zones(&ctx->scsi_dev, ctx->zones);
+}
+
+static int zbc_mb_ata_report_zones(struct zbc_mb_ctx *ctx)
+{
+	return zbc_mb_report_zones(&ctx->ata_dev, ctx->zones);
+}
+
+/*
+ * Number of open zones of the stub device: one sequential zone out of 4
+ * after the 64 conventional zones.
+ */
+#define ZBC_MB_NR_OPEN_ZONES	((ZBC_MB_NR_ZONES - 64) / 4)
+
+static int zbc_mb_zone_array_scan(struct zbc_mb_ctx *ctx)
+{
+	unsigned int i, nr = 0;
+
+	for (i = 0; i < ZBC_MB_NR_ZONES; i++) {
+		if (zbc_zone_is_open(&ctx->zones[i]))
+			nr++;
+	}
+
+	return nr == ZBC_MB_NR_OPEN_ZONES ? 0 : -EIO;
+}
+
+static int zbc_mb_zone_table_count(struct zbc_mb_ctx *ctx)
+{
+	unsigned int conds = ZBC_ZF_COND(ZBC_ZC_IMP_OPEN) |
+		ZBC_ZF_COND(ZBC_ZC_EXP_OPEN);
+	unsigned int nr;
+
+	nr = zbc_zone_table_count(ctx->zt, conds);
+
+	return nr == ZBC_MB_NR_OPEN_ZONES ? 0 : -EIO;
+}
+
+static int zbc_mb_zone_table_scan(struct zbc_mb_ctx *ctx)
+{
+	unsigned int conds = ZBC_ZF_COND(ZBC_ZC_IMP_OPEN) |
+		ZBC_ZF_COND(ZBC_ZC_EXP_OPEN);
+	unsigned int nr = 0;
+	int i;
+
+	for (i = zbc_zone_table_next(ctx->zt, 0, conds); i >= 0;
+	     i = zbc_zone_table_next(ctx->zt, i + 1, conds))
+		nr++;
+
+	return nr == ZBC_MB_NR_OPEN_ZONES ? 0 : -EIO;
+}
+
+static int zbc_mb_report_realms(struct zbc_mb_ctx *ctx)
+{
+	struct zbc_device *dev = &ctx->scsi_dev;
+	unsigned int nr_realms = ZBC_MB_NR_REALMS;
+	int ret;
+
+	ret = (dev->zbd_drv->zbd_report_realms)(dev, 0, ZBC_RR_RO_ALL,
+						ctx->realms, &nr_realms);
+	if (ret == 0 && nr_realms != ZBC_MB_NR_REALMS)
+		return -EIO;
+
+	return ret;
+}
+
+static int zbc_mb_preadv(struct zbc_mb_ctx *ctx)
+{
+	ssize_t ret;
+
+	ret = zbc_preadv(&ctx->scsi_dev, ctx->iov, ZBC_MB_NR_IOVS, 0);
+	if (ret < 0)
+		return ret;
+
+	return 0;
+}
+
+struct zbc_mb_case {
+	const char	*name;
+	const char	*desc;
+	unsigned int	iters;
+	int		(*run)(struct zbc_mb_ctx *ctx);
+};
+
+static struct zbc_mb_case zbc_mb_cases[] = {
+	{ "sg_cmd", "SG command init, exec and destroy",
+	  1000000, zbc_mb_sg_cmd },
+	{ "scsi_report_zones", "SCSI REPORT ZONES of 4096 zones",
+	  2000, zbc_mb_scsi_report_zones },
+	{ "ata_report_zones", "ATA REPORT ZONES EXT of 4096 zones",
+	  2000, zbc_mb_ata_report_zones },
+	{ "zone_array_scan", "Scan 4096 zones for open zones (zone array)",
+	  100000, zbc_mb_zone_array_scan },
+	{ "zone_table_count", "Count open zones of 4096 zones (zone table)",
+	  100000, zbc_mb_zone_table_count },
+	{ "zone_table_scan", "Scan 4096 zones for open zones (zone table)",
+	  100000, zbc_mb_zone_table_scan },
+	{ "report_realms", "SCSI REPORT REALMS of 256 realms",
+	  20000, zbc_mb_report_realms },
+	{ "preadv", "1 MiB vector read of 256 x 4 KiB buffers",
+	  100000, zbc_mb_preadv },
+};
+
+#define ZBC_MB_NR_CASES	(sizeof(zbc_mb_cases) / sizeof(zbc_mb_cases[0]))
+
+static unsigned long long zbc_mb_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int zbc_mb_run(struct zbc_mb_ctx *ctx, struct zbc_mb_case *c,
+		      unsigned int iters)
+{
+	unsigned long long allocs, t;
+	unsigned int i;
+	int ret;
+
+	/* Warm up */
+	ret = c->run(ctx);
+	if (ret != 0) {
+		fprintf(stderr, "%s failed %d (%s)\n",
+			c->name, ret, strerror(-ret));
+		return ret;
+	}
+
+	allocs = zbc_mb_allocs;
+	t = zbc_mb_time_ns();
+	for (i = 0; i < iters; i++) {
+		ret = c->run(ctx);
+		if (ret != 0) {
+			fprintf(stderr, "%s failed %d (%s)\n",
+				c->name, ret, strerror(-ret));
+			return ret;
+		}
+	}
+	t = zbc_mb_time_ns() - t;
+	allocs = zbc_mb_allocs - allocs;
+
+	printf("%-20s %10u %12.1f %10.2f  %s\n",
+	       c->name, iters, (double)t / iters, (double)allocs / iters,
+	       c->desc);
+
+	return 0;
+}
+
+static int zbc_mb_usage(FILE *out, char *prog)
+{
+	unsigned int i;
+
+	fprintf(out,
+		"Usage: %s [options] [benchmark...]\n"
+		"  Measure the CPU overhead of the library hot paths\n"
+		"  using a stub device. By default, all benchmarks are run.\n"
+		"Options:\n"
+		"  -h | --help : Display this help message and exit\n"
+		"  -n <num>    : Scale the number of iterations by <num>\n"
+		"Benchmarks:\n",
+		basename(prog));
+	for (i = 0; i < ZBC_MB_NR_CASES; i++)
+		fprintf(out, "  %-20s: %s\n",
+			zbc_mb_cases[i].name, zbc_mb_cases[i].desc);
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct zbc_mb_ctx ctx;
+	unsigned int scale = 1, i;
+	int a, j, ret = 1;
+
+	for (a = 1; a < argc; a++) {
+		if (strcmp(argv[a], "-h") == 0 ||
+		    strcmp(argv[a], "--help") == 0)
+			return zbc_mb_usage(stdout, argv[0]);
+
+		if (strcmp(argv[a], "-n") == 0) {
+			if (a == argc - 1)
+				return zbc_mb_usage(stderr, argv[0]);
+			a++;
+			scale = atoi(argv[a]);
+			if (!scale) {
+				fprintf(stderr, "Invalid iteration scale\n");
+				return 1;
+			}
+		} else if (argv[a][0] == '-') {
+			fprintf(stderr, "Unknown option \"%s\"\n", argv[a]);
+			return 1;
+		} else {
+			break;
+		}
+	}
+	for (j = a; j < argc; j++) {
+		for (i = 0; i < ZBC_MB_NR_CASES; i++) {
+			if (strcmp(argv[j], zbc_mb_cases[i].name) == 0)
+				break;
+		}
+		if (i == ZBC_MB_NR_CASES) {
+			fprintf(stderr, "Unknown benchmark \"%s\"\n", argv[j]);
+			return 1;
+		}
+	}
+
+	zbc_set_log_level("warning");
+
+	memset(&ctx, 0, sizeof(ctx));
+
+	zbc_mb_sg_fd = open("/dev/null", O_RDWR);
+	if (zbc_mb_sg_fd < 0) {
+		perror("Open /dev/null failed");
+		return 1;
+	}
+
+	if (zbc_mb_init_zones() || zbc_mb_init_realms()) {
+		fprintf(stderr, "No memory for device responses\n");
+		goto out;
+	}
+
+	zbc_mb_init_dev(&ctx.scsi_dev, &zbc_scsi_drv);
+	zbc_mb_init_dev(&ctx.ata_dev, &zbc_ata_drv);
+
+	ctx.zones = __real_calloc(ZBC_MB_NR_ZONES, sizeof(struct zbc_zone));
+	ctx.realms = __real_calloc(ZBC_MB_NR_REALMS,
+				   sizeof(struct zbc_zone_realm));
+	if (!ctx.zones || !ctx.realms ||
+	    __real_posix_memalign(&ctx.buf, sysconf(_SC_PAGESIZE),
+				  ZBC_MB_NR_IOVS * 4096)) {
+		fprintf(stderr, "No memory for benchmark buffers\n");
+		goto out;
+	}
+	for (i = 0; i < ZBC_MB_NR_IOVS; i++) {
+		ctx.iov[i].iov_base = ctx.buf + i * 4096;
+		ctx.iov[i].iov_len = 4096 >> 9;
+	}
+
+	/* Zone array and zone table of the scan benchmarks */
+	if (zbc_mb_report_zones(&ctx.scsi_dev, ctx.zones) ||
+	    zbc_zone_table_from_zones(ctx.zones, ZBC_MB_NR_ZONES, &ctx.zt)) {
+		fprintf(stderr, "Failed to get zones\n");
+		goto out;
+	}
+
+	printf("%-20s %10s %12s %10s  %s\n",
+	       "benchmark", "iters", "ns/op", "allocs/op", "description");
+
+	for (i = 0; i < ZBC_MB_NR_CASES; i++) {
+		if (a < argc) {
+			for (j = a; j < argc; j++) {
+				if (strcmp(argv[j], zbc_mb_cases[i].name) == 0)
+					break;
+			}
+			if (j == argc)
+				continue;
+		}
+
+		ret = zbc_mb_run(&ctx, &zbc_mb_cases[i],
+				 zbc_mb_cases[i].iters * scale);
+		if (ret != 0) {
+			ret = 1;
+			goto out;
+		}
+	}
+
+	ret = 0;
+
+out:
+	zbc_zone_table_free(ctx.zt);
+	free(ctx.buf);
+	free(ctx.realms);
+	free(ctx.zones);
+	free(zbc_mb_realms);
+	free(zbc_mb_ata_zones);
+	free(zbc_mb_scsi_zones);
+	close(zbc_mb_sg_fd);
+
+	return ret;
+}
@@ -10,10 +10,16 @@
  *          Christoph Hellwig (hch@infradead.org)
  */
 #include "zbc.h"
+#include "zbc_utils.h"
 
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 /*
  * Log level.
@@ -24,6 +30,7 @@ int zbc_log_level = ZBC_LOG_WARNING;
  * Backend drivers.
  */
 static struct zbc_drv *zbc_drv[] = {
+	&zbc_block_drv,
 	&zbc_scsi_drv,
 	&zbc_ata_drv,
 	NULL
@@ -39,6 +46,7 @@ static struct zbc_sg_sk_s {
 	{ ZBC_SK_NOT_READY,		"Not-ready"		},
 	{ ZBC_SK_MEDIUM_ERROR,		"Medium-error"		},
 	{ ZBC_SK_ILLEGAL_REQUEST,	"Illegal-request"	},
+	{ ZBC_SK_UNIT_ATTENTION,	"Unit-attention"	},
 	{ ZBC_SK_DATA_PROTECT,		"Data-protect"		},
 	{ ZBC_SK_HARDWARE_ERROR,	"Hardware-error"	},
 	{ ZBC_SK_ABORTED_COMMAND,	"Aborted-command"	},
@@ -130,6 +138,10 @@ static struct zbc_sg_asc_ascq_s {
 		ZBC_ASC_ZONE_RESET_WP_RECOMMENDED,
 		"Zone-reset-wp-recommended"
 	},
+	{
+		ZBC_ASC_CAPACITY_DATA_HAS_CHANGED,
+		"Capacity-data-has-changed"
+	},
 	{
 		0,
 		NULL
@@ -184,6 +196,8 @@ void zbc_set_log_level(char const *log_level)
 const char *zbc_device_type_str(enum zbc_dev_type type)
 {
 	switch (type) {
+	case ZBC_DT_BLOCK:
+		return "Zoned block device";
 	case ZBC_DT_SCSI:
 		return "SCSI ZBC device";
 	case ZBC_DT_ATA:
@@ -442,6 +456,219 @@ out:
 	return ret;
 }
 
+/**
+ * Get a device zone model from its sysfs attributes. Returns 1 if the
+ * device is zoned, 0 if it is not, -EAGAIN if the device may be a Zone
+ * Domains or Zone Realms device that the kernel sees as a regular device,
+ * and -ENODATA if sysfs does not provide enough information.
+ */
+static int zbc_sysfs_probe_zoned(const char *path, enum zbc_dev_model *model)
+{
+	unsigned long long type = ULLONG_MAX;
+	char sysfs_path[PATH_MAX];
+	char zoned[32];
+	const char *dev_class;
+	struct stat st;
+
+	if (stat(path, &st) != 0)
+		return -errno;
+
+	if (S_ISBLK(st.st_mode))
+		dev_class = "block";
+	else if (S_ISCHR(st.st_mode))
+		dev_class = "char";
+	else
+		return 0;
+
+	/*
+	 * Devices without a SCSI device type (partitions, device mapper
+	 * devices, ...) cannot be used directly with SG_IO.
+	 */
+	snprintf(sysfs_path, sizeof(sysfs_path), "/sys/dev/%s/%u:%u/device/type",
+		 dev_class, major(st.st_rdev), minor(st.st_rdev));
+	if (zbc_get_sysfs_val_ull(sysfs_path, &type) != 0 ||
+	    type == ULLONG_MAX)
+		return -ENODATA;
+
+	switch (type) {
+	case 0x14:
+		/* Host-managed device */
+		*model = ZBC_DM_HOST_MANAGED;
+		return 1;
+	case 0x00:
+		break;
+	default:
+		/* Not a block device */
+		return 0;
+	}
+
+	/* For a standard block device type, trust the kernel zone model */
+	snprintf(sysfs_path, sizeof(sysfs_path), "/sys/dev/%s/%u:%u/queue/zoned",
+		 dev_class, major(st.st_rdev), minor(st.st_rdev));
+	if (zbc_get_sysfs_val_str(sysfs_path, zoned, sizeof(zoned)) != 0)
+		return -ENODATA;
+
+	if (strcmp(zoned, "host-managed") == 0) {
+		*model = ZBC_DM_HOST_MANAGED;
+		return 1;
+	}
+	if (strcmp(zoned, "host-aware") == 0) {
+		*model = ZBC_DM_HOST_AWARE;
+		return 1;
+	}
+
+	return -EAGAIN;
+}
+
+/**
+ * zbc_device_is_zoned_fast - Quickly test if a physical device is zoned.
+ */
+int zbc_device_is_zoned_fast(const char *filename, enum zbc_dev_model *model)
+{
+	enum zbc_dev_model m = ZBC_DM_STANDARD;
+	struct zbc_device_info info;
+	struct zbc_device dev;
+	char *path = NULL;
+	int ret;
+
+	ret = zbc_realpath(filename, &path);
+	if (ret)
+		return ret;
+
+	ret = zbc_sysfs_probe_zoned(path, &m);
+	switch (ret) {
+	case -EAGAIN:
+		/*
+		 * The kernel does not know about Zone Domains and Zone
+		 * Realms devices and recent kernels expose host-aware
+		 * devices as regular block devices: ask the device.
+		 */
+		memset(&dev, 0, sizeof(struct zbc_device));
+		dev.zbd_filename = path;
+		dev.zbd_fd = open(path, O_RDONLY);
+		if (dev.zbd_fd < 0) {
+			ret = -errno;
+			zbc_error("%s: Open device file failed %d (%s)\n",
+				  path, errno, strerror(errno));
+			break;
+		}
+		dev.zbd_sg_fd = dev.zbd_fd;
+		ret = zbc_scsi_probe_zoned(&dev, &m);
+		close(dev.zbd_fd);
+		break;
+	case -ENODATA:
+		/* No sysfs information: do a full device identification */
+		ret = zbc_device_is_zoned(path, false, &info);
+		if (ret == 1)
+			m = info.zbd_model;
+		break;
+	default:
+		break;
+	}
+
+	if (ret == 1) {
+		if (model)
+			*model = m;
+	} else if (ret < 0 && ret != -EPERM && ret != -EACCES) {
+		ret = 0;
+	}
+
+	free(path);
+
+	return ret;
+}
+
+/**
+ * Default maximum number of devices tested in parallel.
+ */
+#define ZBC_PROBE_NR_THREADS	32
+
+/**
+ * Bulk device test context.
+ */
+struct zbc_probe_ctx {
+	struct zbc_device_probe	*probes;
+	unsigned int		nr_probes;
+	unsigned int		next;
+	pthread_mutex_t		lock;
+};
+
+static void *zbc_probe_thread(void *arg)
+{
+	struct zbc_probe_ctx *ctx = arg;
+	struct zbc_device_probe *p;
+	unsigned int i;
+
+	for (;;) {
+		pthread_mutex_lock(&ctx->lock);
+		i = ctx->next++;
+		pthread_mutex_unlock(&ctx->lock);
+		if (i >= ctx->nr_probes)
+			break;
+
+		p = &ctx->probes[i];
+		p->zbp_model = ZBC_DM_STANDARD;
+		p->zbp_ret = zbc_device_is_zoned_fast(p->zbp_filename,
+						      &p->zbp_model);
+	}
+
+	return NULL;
+}
+
+/**
+ * zbc_devices_are_zoned - Test if a list of devices are zoned.
+ */
+int zbc_devices_are_zoned(struct zbc_device_probe *probes,
+			  unsigned int nr_probes, unsigned int nr_threads)
+{
+	struct zbc_probe_ctx ctx;
+	pthread_t *threads;
+	unsigned int i, n;
+	int ret = 0;
+
+	if (!probes || !nr_probes)
+		return 0;
+
+	if (!nr_threads)
+		nr_threads = ZBC_PROBE_NR_THREADS;
+	if (nr_threads > nr_probes)
+		nr_threads = nr_probes;
+
+	ctx.probes = probes;
+	ctx.nr_probes = nr_probes;
+	ctx.next = 0;
+	pthread_mutex_init(&ctx.lock, NULL);
+
+	threads = calloc(nr_threads, sizeof(pthread_t));
+	if (!threads) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (n = 0; n < nr_threads; n++) {
+		ret = pthread_create(&threads[n], NULL, zbc_probe_thread, &ctx);
+		if (ret) {
+			zbc_error("Create probe thread %u failed %d (%s)\n",
+				  n, ret, strerror(ret));
+			ret = -ret;
+			break;
+		}
+	}
+
+	if (n) {
+		/* Devices not tested yet are handled by the running threads */
+		ret = 0;
+		for (i = 0; i < n; i++)
+			pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+out:
+	pthread_mutex_destroy(&ctx.lock);
+
+	return ret;
+}
+
 /**
  * zbc_open - open a ZBC device
  */
@@ -477,8 +704,9 @@ int zbc_open(const char *filename, int flags, struct zbc_device **pdev)
 		case 0:
 			/* This backend accepted the drive */
 			dev->zbd_drv = zbc_drv[i];
-			*pdev = dev;
-			goto out;
+			dev->zbd_open_flags = flags;
+			pthread_mutex_init(&dev->zbd_aio_lock, NULL);
+			goto init;
 		case -ENXIO:
 			continue;
 		default:
@@ -487,10 +715,18 @@ int zbc_open(const char *filename, int flags, struct zbc_device **pdev)
 
 	}
 
-out:
+	goto out;
+
+init:
+	ret = zbc_get_domain_info(dev);
 	if (!ret)
-		ret = zbc_get_domain_info(dev);
+		ret = zbc_init_zone_plugs(dev);
+	if (ret)
+		zbc_close(dev);
+	else
+		*pdev = dev;
 
+out:
 	free(path);
 	return ret;
 }
@@ -500,6 +736,41 @@ out:
  */
 int zbc_close(struct zbc_device *dev)
 {
+	unsigned int nr_errors = 0, nr_retries = 0;
+	struct zbc_aio *aio;
+	int ret;
+
+	/*
+	 * Wait for all asynchronous I/Os in flight: the commands reference
+	 * the caller buffers and the zone plugs. Reap errors are retried,
+	 * unless the device keeps failing without completing any I/O.
+	 */
+	while (zbc_aio_nr_inflight(dev)) {
+		ret = zbc_aio_reap(dev, &aio, true);
+		if (!ret) {
+			nr_retries = 0;
+			continue;
+		}
+		if (ret == -ENOENT)
+			break;
+		if (ret != -EINTR && ret != -EAGAIN) {
+			nr_errors++;
+			if (++nr_retries >= ZBC_MAX_REAP_RETRIES) {
+				zbc_error("%s: Abandoning %u asynchronous I/Os in flight\n",
+					  dev->zbd_filename,
+					  zbc_aio_nr_inflight(dev));
+				break;
+			}
+		}
+	}
+	if (nr_errors)
+		zbc_error("%s: %u errors while waiting for asynchronous I/Os\n",
+			  dev->zbd_filename, nr_errors);
+
+	zbc_free_zone_plugs(dev);
+	zbc_free_realm_index(dev);
+	pthread_mutex_destroy(&dev->zbd_aio_lock);
+
 	return dev->zbd_drv->zbd_close(dev);
 }
 
@@ -741,12 +1012,192 @@ out:
 	return 0;
 }
 
+/*
+ * Number of zones reported per REPORT ZONES command by zbc_zone_summary().
+ */
+#define ZBC_ZONE_SUMMARY_CHUNK	1024
+
 /**
- * zbc_zone_group_op - Execute an operation on a group of zones
+ * zbc_zone_summary_add - Account a zone in a zone summary
  */
-int zbc_zone_group_op(struct zbc_device *dev, uint64_t sector,
-		      unsigned int count, enum zbc_zone_op op,
-		      unsigned int flags)
+static void zbc_zone_summary_add(struct zbc_zone_summary *zs,
+				 struct zbc_zone *z)
+{
+	zs->zsm_nr_zones++;
+	zs->zsm_sectors += zbc_zone_length(z);
+
+	if ((unsigned int)zbc_zone_type(z) < ZBC_ZSM_NR_TYPES &&
+	    (unsigned int)zbc_zone_condition(z) < ZBC_ZSM_NR_CONDS)
+		zs->zsm_nr[zbc_zone_type(z)][zbc_zone_condition(z)]++;
+
+	if (zbc_zone_rwp_recommended(z))
+		zs->zsm_nr_rwp_recommended++;
+	if (zbc_zone_non_seq(z))
+		zs->zsm_nr_non_seq++;
+	if (zbc_zone_is_open(z))
+		zs->zsm_nr_open++;
+
+	if (!zbc_zone_sequential(z))
+		return;
+
+	zs->zsm_seq_sectors += zbc_zone_length(z);
+	if (zbc_zone_full(z))
+		zs->zsm_used_sectors += zbc_zone_capacity(z);
+	else if ((zbc_zone_is_open(z) || zbc_zone_closed(z)) &&
+		 zbc_zone_wp(z) > zbc_zone_start(z))
+		zs->zsm_used_sectors += zbc_zone_wp(z) - zbc_zone_start(z);
+}
+
+/**
+ * zbc_zone_summary - Get a summary of the zones of a device
+ */
+int zbc_zone_summary(struct zbc_device *dev, uint64_t sector,
+		     struct zbc_zone_summary *zs)
+{
+	struct zbc_device_info *di = &dev->zbd_info;
+	struct zbc_zone *zones;
+	unsigned int i, nr_zones;
+	int ret = 0;
+
+	memset(zs, 0, sizeof(struct zbc_zone_summary));
+
+	if (zbc_dev_model(dev) == ZBC_DM_HOST_MANAGED)
+		zs->zsm_max_nr_open = di->zbd_max_nr_open_seq_req;
+	else
+		zs->zsm_max_nr_open = di->zbd_opt_nr_open_seq_pref;
+	if (!zs->zsm_max_nr_open || zs->zsm_max_nr_open == ZBC_NOT_REPORTED)
+		zs->zsm_max_nr_open = ZBC_NO_LIMIT;
+
+	zones = calloc(ZBC_ZONE_SUMMARY_CHUNK, sizeof(struct zbc_zone));
+	if (!zones)
+		return -ENOMEM;
+
+	while (sector < di->zbd_sectors) {
+
+		nr_zones = ZBC_ZONE_SUMMARY_CHUNK;
+		ret = zbc_report_zones(dev, sector, ZBC_RZ_RO_ALL,
+				       zones, &nr_zones);
+		if (ret != 0) {
+			zbc_error("%s: zbc_report_zones failed %d\n",
+				  dev->zbd_filename, ret);
+			break;
+		}
+
+		if (!nr_zones)
+			break;
+
+		for (i = 0; i < nr_zones; i++)
+			zbc_zone_summary_add(zs, &zones[i]);
+
+		sector = zbc_zone_start(&zones[nr_zones - 1]) +
+			zbc_zone_length(&zones[nr_zones - 1]);
+	}
+
+	free(zones);
+
+	return ret;
+}
+
+/*
+ * Number of zones reported per REPORT ZONES command by zbc_find_zone():
+ * the zone descriptors and the report header fit in 4 KB.
+ */
+#define ZBC_FIND_ZONE_CHUNK	63
+
+/**
+ * zbc_find_zone_ro - Get the reporting option to use for a zone filter
+ */
+static enum zbc_zone_reporting_options
+zbc_find_zone_ro(struct zbc_zone_filter *f)
+{
+	static const struct {
+		enum zbc_zone_condition		cond;
+		enum zbc_zone_reporting_options	ro;
+	} cond_ro[] = {
+		{ ZBC_ZC_NOT_WP,	ZBC_RZ_RO_NOT_WP	},
+		{ ZBC_ZC_EMPTY,		ZBC_RZ_RO_EMPTY		},
+		{ ZBC_ZC_IMP_OPEN,	ZBC_RZ_RO_IMP_OPEN	},
+		{ ZBC_ZC_EXP_OPEN,	ZBC_RZ_RO_EXP_OPEN	},
+		{ ZBC_ZC_CLOSED,	ZBC_RZ_RO_CLOSED	},
+		{ ZBC_ZC_INACTIVE,	ZBC_RZ_RO_INACTIVE	},
+		{ ZBC_ZC_RDONLY,	ZBC_RZ_RO_RDONLY	},
+		{ ZBC_ZC_FULL,		ZBC_RZ_RO_FULL		},
+		{ ZBC_ZC_OFFLINE,	ZBC_RZ_RO_OFFLINE	},
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(cond_ro) / sizeof(cond_ro[0]); i++) {
+		if (f->zbf_conds == ZBC_ZF_COND(cond_ro[i].cond))
+			return cond_ro[i].ro;
+	}
+
+	if (f->zbf_attrs & ZBC_ZA_RWP_RECOMMENDED)
+		return ZBC_RZ_RO_RWP_RECMND;
+	if (f->zbf_attrs & ZBC_ZA_NON_SEQ)
+		return ZBC_RZ_RO_NON_SEQ;
+
+	return ZBC_RZ_RO_ALL;
+}
+
+/**
+ * zbc_find_zone_match - Test if a zone matches a zone filter
+ */
+static bool zbc_find_zone_match(struct zbc_zone_filter *f, struct zbc_zone *z)
+{
+	if (f->zbf_types &&
+	    (zbc_zone_type(z) >= 32 ||
+	     !(f->zbf_types & ZBC_ZF_TYPE(zbc_zone_type(z)))))
+		return false;
+
+	if (f->zbf_conds &&
+	    (zbc_zone_condition(z) >= 32 ||
+	     !(f->zbf_conds & ZBC_ZF_COND(zbc_zone_condition(z)))))
+		return false;
+
+	return (z->zbz_attributes & f->zbf_attrs) == f->zbf_attrs;
+}
+
+/**
+ * zbc_find_zone - Find the first zone matching a filter
+ */
+int zbc_find_zone(struct zbc_device *dev, uint64_t sector,
+		  struct zbc_zone_filter *filter, struct zbc_zone *zone)
+{
+	enum zbc_zone_reporting_options ro = zbc_find_zone_ro(filter);
+	struct zbc_zone zones[ZBC_FIND_ZONE_CHUNK];
+	unsigned int i, nr_zones;
+	int ret;
+
+	while (sector < dev->zbd_info.zbd_sectors) {
+
+		nr_zones = ZBC_FIND_ZONE_CHUNK;
+		ret = zbc_report_zones(dev, sector, ro, zones, &nr_zones);
+		if (ret != 0)
+			return ret;
+
+		if (!nr_zones)
+			break;
+
+		for (i = 0; i < nr_zones; i++) {
+			if (zbc_find_zone_match(filter, &zones[i])) {
+				memcpy(zone, &zones[i], sizeof(struct zbc_zone));
+				return 0;
+			}
+		}
+
+		sector = zbc_zone_start(&zones[nr_zones - 1]) +
+			zbc_zone_length(&zones[nr_zones - 1]);
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * zbc_do_zone_group_op - Execute an operation on a group of zones
+ */
+static int zbc_do_zone_group_op(struct zbc_device *dev, uint64_t sector,
+				unsigned int count, enum zbc_zone_op op,
+				unsigned int flags)
 {
 	struct zbc_zone zone;
 	unsigned int i, nr_zones;
@@ -780,6 +1231,24 @@ int zbc_zone_group_op(struct zbc_device *dev, uint64_t sector,
 	return 0;
 }
 
+/**
+ * zbc_zone_group_op - Execute an operation on a group of zones
+ */
+int zbc_zone_group_op(struct zbc_device *dev, uint64_t sector,
+		      unsigned int count, enum zbc_zone_op op,
+		      unsigned int flags)
+{
+	int ret;
+
+	zbc_zone_plug_prepare_op(dev, sector, count, op, flags);
+
+	ret = zbc_do_zone_group_op(dev, sector, count, op, flags);
+	if (ret == 0)
+		zbc_zone_plug_end_op(dev, sector, count, op, flags);
+
+	return ret;
+}
+
 /**
  * zbc_zone_operation - Execute an operation on a zone
  */
@@ -822,6 +1291,61 @@ int zbc_report_domains(struct zbc_device *dev, uint64_t sector,
 	return ret;
 }
 
+/**
+ * Get the zone domains of a device. The domains are reported to the cache
+ * of the device only if the cache is not valid, that is, for the first
+ * call, after a zone activation or a change to the device configuration,
+ * and after a CAPACITY DATA HAS CHANGED unit attention was reported for
+ * a command. The cache belongs to the device handle: it is not invalidated
+ * by zone activations done by other processes or through other handles of
+ * the same device.
+ * Returns the number of domains in the cache.
+ */
+int zbc_get_cached_domains(struct zbc_device *dev,
+			   struct zbc_zone_domain **pdomains)
+{
+	int ret;
+
+	if (!dev->zbd_domains_valid) {
+		if (!dev->zbd_drv || !dev->zbd_drv->zbd_report_domains)
+			return -ENOTSUP;
+
+		memset(dev->zbd_domains, 0, sizeof(dev->zbd_domains));
+		ret = (dev->zbd_drv->zbd_report_domains)(dev, 0LL,
+							 ZBC_RZD_RO_ALL,
+							 dev->zbd_domains,
+							 ZBC_NR_ZONE_TYPES);
+		if (ret < 0)
+			return ret;
+
+		if (ret > ZBC_NR_ZONE_TYPES) {
+			zbc_warning("%s: Device has %i domains, only %u are supported\n",
+				    dev->zbd_filename, ret, ZBC_NR_ZONE_TYPES);
+			ret = ZBC_NR_ZONE_TYPES;
+		}
+
+		dev->zbd_nr_domains = ret;
+		dev->zbd_domains_valid = true;
+	} else {
+		/* Cached domains: a REPORT DOMAINS command is saved */
+		dev->zbd_stats.report_cmds_saved++;
+	}
+
+	*pdomains = dev->zbd_domains;
+
+	return dev->zbd_nr_domains;
+}
+
+/**
+ * Maximum number of zone domains: REPORT ZONE DOMAINS reports the number
+ * of domains using a single byte.
+ */
+#define ZBC_MAX_DOMAINS		255
+
+/**
+ * Number of domains previously allocated by zbc_list_domains() for the
+ * first report. Used to account for the commands saved.
+ */
 #define ZBC_EST_ALLOC_DOMAINS	6
 
 /**
@@ -833,7 +1357,7 @@ int zbc_list_domains(struct zbc_device *dev, uint64_t sector,
 		     struct zbc_zone_domain **pdomains,
 		     unsigned int *pnr_domains)
 {
-	struct zbc_zone_domain *domains = NULL;
+	struct zbc_zone_domain *domains = NULL, *d;
 	unsigned int nr_domains;
 	int ret;
 
@@ -857,18 +1381,17 @@ int zbc_list_domains(struct zbc_device *dev, uint64_t sector,
 	}
 
 	/*
-	 * The number of zone domains is usually small, try allocating
-	 * the buffer to hold a few domains and see if it will be enough.
-	 * This will likely save us a SCSI call.
+	 * The number of zone domains is reported with a single byte, so
+	 * a report for the maximum number of domains always gets all
+	 * domains with a single command.
 	 */
-	domains = (struct zbc_zone_domain *)calloc(ZBC_EST_ALLOC_DOMAINS,
+	domains = (struct zbc_zone_domain *)calloc(ZBC_MAX_DOMAINS,
 					 sizeof(struct zbc_zone_domain));
 	if (!domains)
 		return -ENOMEM;
 
 	/* Get zone domain information */
-	ret = zbc_report_domains(dev, sector, ro, domains,
-				 ZBC_EST_ALLOC_DOMAINS);
+	ret = zbc_report_domains(dev, sector, ro, domains, ZBC_MAX_DOMAINS);
 	if (ret < 0) {
 		zbc_error("%s: zbc_report_domains failed %d\n",
 			  dev->zbd_filename, ret);
@@ -876,24 +1399,17 @@ int zbc_list_domains(struct zbc_device *dev, uint64_t sector,
 		return ret;
 	}
 	nr_domains = ret;
+	if (nr_domains > ZBC_MAX_DOMAINS)
+		nr_domains = ZBC_MAX_DOMAINS;
 
-	if (nr_domains > ZBC_EST_ALLOC_DOMAINS) {
-		/* Reallocate zone domain descriptor array */
-		free(domains);
-		domains = (struct zbc_zone_domain *)calloc(nr_domains,
-					 sizeof(struct zbc_zone_domain));
-		if (!domains)
-			return -ENOMEM;
+	if (nr_domains > ZBC_EST_ALLOC_DOMAINS)
+		dev->zbd_stats.report_cmds_saved++;
 
-		/* Get zone domain information again */
-		ret = zbc_report_domains(dev, sector, ro, domains, nr_domains);
-		if (ret < 0) {
-			zbc_error("%s: zbc_report_domains failed %d\n",
-				  dev->zbd_filename, ret);
-			free(domains);
-			return ret;
-		}
-		nr_domains = ret;
+	/* Trim the array to the number of domains */
+	if (nr_domains) {
+		d = realloc(domains, nr_domains * sizeof(struct zbc_zone_domain));
+		if (d)
+			domains = d;
 	}
 
 	*pdomains = domains;
@@ -965,6 +1481,13 @@ int zbc_report_realms(struct zbc_device *dev, uint64_t sector,
 	return ret;
 }
 
+/**
+ * Number of realms allocated by zbc_list_zone_realms() for the first
+ * report. Devices with more realms are reported again with an array
+ * sized using the number of realms of the first report header.
+ */
+#define ZBC_EST_ALLOC_REALMS	128
+
 /**
  * zbc_list_zone_realms - List zone realm information
  */
@@ -973,7 +1496,7 @@ int zbc_list_zone_realms(struct zbc_device *dev, uint64_t sector,
 			 struct zbc_zone_realm **prealms,
 			 unsigned int *pnr_realms)
 {
-	struct zbc_zone_realm *realms = NULL;
+	struct zbc_zone_realm *realms = NULL, *r;
 	unsigned int nr_realms;
 	int ret;
 
@@ -990,15 +1513,37 @@ int zbc_list_zone_realms(struct zbc_device *dev, uint64_t sector,
 		return -ENOTSUP;
 	}
 
-	/* Get the total number of realm descriptors */
-	ret = zbc_report_nr_realms(dev, &nr_realms);
-	if (ret < 0)
+	/*
+	 * Try first to get all realms with a single report using an array
+	 * sized for the number of realms of most devices. The report header
+	 * gives the total number of realms: if the array was too small,
+	 * report again using an array of that size.
+	 */
+	nr_realms = ZBC_EST_ALLOC_REALMS;
+	realms = (struct zbc_zone_realm *)calloc(nr_realms,
+						 sizeof(struct zbc_zone_realm));
+	if (!realms)
+		return -ENOMEM;
+
+	dev->zbd_rpt_nr_realms = 0;
+	ret = zbc_report_realms(dev, sector, ro, realms, &nr_realms);
+	if (ret != 0) {
+		zbc_error("%s: zbc_report_realms failed %d\n",
+			  dev->zbd_filename, ret);
+		free(realms);
 		return ret;
+	}
 
-	zbc_debug("%s: %d zone realms\n",
-		  dev->zbd_filename, nr_realms);
+	if (dev->zbd_rpt_nr_realms <= ZBC_EST_ALLOC_REALMS) {
+		/* The realm count pass is saved */
+		dev->zbd_stats.report_cmds_saved++;
+		goto out;
+	}
+
+	free(realms);
 
-	/* Allocate zone realm descriptor array */
+	/* Allocate the zone realm descriptor array from the header count */
+	nr_realms = dev->zbd_rpt_nr_realms;
 	realms = (struct zbc_zone_realm *)calloc(nr_realms,
 						 sizeof(struct zbc_zone_realm));
 	if (!realms)
@@ -1013,6 +1558,17 @@ int zbc_list_zone_realms(struct zbc_device *dev, uint64_t sector,
 		return ret;
 	}
 
+out:
+	zbc_debug("%s: %d zone realms\n",
+		  dev->zbd_filename, nr_realms);
+
+	/* Trim the array to the number of realms */
+	if (nr_realms) {
+		r = realloc(realms, nr_realms * sizeof(struct zbc_zone_realm));
+		if (r)
+			realms = r;
+	}
+
 	*prealms = realms;
 	*pnr_realms = nr_realms;
 
@@ -1058,6 +1614,9 @@ int zbc_zone_activate(struct zbc_device *dev, bool zsrc,
 		      struct zbc_actv_res *actv_recs,
 		      unsigned int *nr_actv_recs)
 {
+	unsigned int max_actv_recs = *nr_actv_recs;
+	int ret;
+
 	if (!zbc_dev_is_zdr(dev)) {
 		zbc_error("%s: Not a ZD/ZR device\n",
 			  dev->zbd_filename);
@@ -1071,11 +1630,27 @@ int zbc_zone_activate(struct zbc_device *dev, bool zsrc,
 	}
 
 	/* Execute the operation */
-	return (dev->zbd_drv->zbd_zone_query_actv)(dev, zsrc,
-						   all, use_32_byte_cdb,
-						   false, sector, nr_zones,
-						   domain_id, actv_recs,
-						   nr_actv_recs);
+	ret = (dev->zbd_drv->zbd_zone_query_actv)(dev, zsrc,
+						  all, use_32_byte_cdb,
+						  false, sector, nr_zones,
+						  domain_id, actv_recs,
+						  nr_actv_recs);
+
+	/* Zone activation may change the domains and zone types */
+	zbc_invalidate_domains(dev);
+	zbc_invalidate_zone_plugs(dev);
+
+	/*
+	 * Update the realm index with the activation results. If the
+	 * activation failed or if not all results were returned, the
+	 * index is dropped and rebuilt on the next lookup.
+	 */
+	if (ret == 0 && *nr_actv_recs < max_actv_recs)
+		zbc_update_realm_index(dev, actv_recs, *nr_actv_recs);
+	else
+		zbc_update_realm_index(dev, NULL, 0);
+
+	return ret;
 }
 
 /**
@@ -1207,6 +1782,16 @@ int zbc_zone_activation_ctl(struct zbc_device *dev,
 		return -ENOTSUP;
 	}
 
+	/*
+	 * Changing the number of zones per activation changes the
+	 * domains capacity: drop the domains cache and the realm index.
+	 */
+	if (set) {
+		zbc_invalidate_domains(dev);
+		zbc_invalidate_zone_plugs(dev);
+		zbc_free_realm_index(dev);
+	}
+
 	return (dev->zbd_drv->zbd_dev_control)(dev, ctl, set);
 }
 
@@ -1398,6 +1983,8 @@ static ssize_t zbc_do_pwritev(struct zbc_device *dev,
 	size_t count = zbc_iov_count(iov, iovcnt);
 	struct iovec wr_iov[iovcnt];
 	size_t wr_iov_count = 0, wr_iov_offset = 0;
+	uint64_t start = offset;
+	bool plugged;
 	int wr_iovcnt;
 	ssize_t ret;
 
@@ -1444,6 +2031,9 @@ static ssize_t zbc_do_pwritev(struct zbc_device *dev,
 		return ret;
 	}
 
+	/* Wait for any write in flight to the zone */
+	plugged = zbc_zone_plug(dev, start);
+
 	while (wr_iov_offset < count) {
 
 		wr_iov_count = count - wr_iov_offset;
@@ -1459,7 +2049,9 @@ static ssize_t zbc_do_pwritev(struct zbc_device *dev,
 				  dev->zbd_filename,
 				  wr_iov_count, (unsigned long long) offset,
 				  -ret, strerror(-ret));
-			return ret ? ret : -EIO;
+			if (!ret)
+				ret = -EIO;
+			goto out;
 		}
 
 		offset += ret;
@@ -1467,7 +2059,13 @@ static ssize_t zbc_do_pwritev(struct zbc_device *dev,
 
 	}
 
-	return count;
+	ret = count;
+
+out:
+	if (plugged)
+		zbc_zone_unplug(dev, start, ret);
+
+	return ret;
 }
 
 /**
@@ -1532,6 +2130,139 @@ int zbc_flush(struct zbc_device *dev)
 	return (dev->zbd_drv->zbd_flush)(dev);
 }
 
+/**
+ * zbc_aio_queue_depth - Get the maximum number of asynchronous I/Os in flight
+ */
+unsigned int zbc_aio_queue_depth(struct zbc_device *dev)
+{
+	return dev->zbd_aio_qd ? dev->zbd_aio_qd : 1;
+}
+
+/**
+ * zbc_aio_submit - Submit an asynchronous I/O
+ */
+int zbc_aio_submit(struct zbc_device *dev, struct zbc_aio *aio)
+{
+	size_t count = aio->zio_count;
+	uint64_t offset = aio->zio_offset;
+	bool aligned;
+	int ret;
+
+	if (!aio->zio_buf || !count ||
+	    count > dev->zbd_info.zbd_max_rw_sectors ||
+	    offset + count > dev->zbd_info.zbd_sectors)
+		return -EINVAL;
+
+	if (aio->zio_write)
+		aligned = zbc_dev_sect_paligned(dev, count) &&
+			zbc_dev_sect_paligned(dev, offset);
+	else
+		aligned = zbc_dev_sect_laligned(dev, count) &&
+			zbc_dev_sect_laligned(dev, offset);
+	if (!aligned) {
+		zbc_error("%s: Unaligned %s %zu sectors at sector %llu\n",
+			  dev->zbd_filename,
+			  aio->zio_write ? "write" : "read",
+			  count, (unsigned long long) offset);
+		return -EINVAL;
+	}
+
+	/* Reserve a slot in the queue */
+	pthread_mutex_lock(&dev->zbd_aio_lock);
+	if (dev->zbd_aio_inflight >= zbc_aio_queue_depth(dev)) {
+		pthread_mutex_unlock(&dev->zbd_aio_lock);
+		return -EAGAIN;
+	}
+	dev->zbd_aio_inflight++;
+	pthread_mutex_unlock(&dev->zbd_aio_lock);
+
+	if (dev->zbd_aio_qd && dev->zbd_drv->zbd_submit_aio) {
+		/*
+		 * Writes to a zone with a write in flight are submitted
+		 * when that write completes.
+		 */
+		ret = zbc_zone_plug_aio(dev, aio);
+		if (ret < 0)
+			goto err;
+		if (!ret) {
+			ret = (dev->zbd_drv->zbd_submit_aio)(dev, aio);
+			if (ret) {
+				if (aio->zio_write)
+					zbc_zone_unplug(dev, aio->zio_offset,
+							ret);
+				goto err;
+			}
+		}
+	} else {
+		/* Emulate using a synchronous I/O */
+		if (aio->zio_write)
+			aio->zio_ret = zbc_pwrite(dev, aio->zio_buf,
+						  count, offset);
+		else
+			aio->zio_ret = zbc_pread(dev, aio->zio_buf,
+						 count, offset);
+		pthread_mutex_lock(&dev->zbd_aio_lock);
+		dev->zbd_aio_done = aio;
+		pthread_mutex_unlock(&dev->zbd_aio_lock);
+	}
+
+	return 0;
+
+err:
+	zbc_aio_put_inflight(dev);
+
+	return ret;
+}
+
+/**
+ * zbc_aio_reap - Get a completed asynchronous I/O
+ */
+int zbc_aio_reap(struct zbc_device *dev, struct zbc_aio **aio, bool wait)
+{
+	int ret;
+
+	pthread_mutex_lock(&dev->zbd_aio_lock);
+	if (!dev->zbd_aio_inflight) {
+		pthread_mutex_unlock(&dev->zbd_aio_lock);
+		return -ENOENT;
+	}
+	if (dev->zbd_aio_done) {
+		*aio = dev->zbd_aio_done;
+		dev->zbd_aio_done = NULL;
+		dev->zbd_aio_inflight--;
+		pthread_mutex_unlock(&dev->zbd_aio_lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&dev->zbd_aio_lock);
+
+	if ((*aio = zbc_zone_plug_failed_aio(dev)) == NULL) {
+		ret = (dev->zbd_drv->zbd_reap_aio)(dev, aio, wait);
+		if (ret)
+			return ret;
+
+		/* Submit the next write queued for the zone, if any */
+		if ((*aio)->zio_write)
+			zbc_zone_unplug(dev, (*aio)->zio_offset,
+					(*aio)->zio_ret);
+	}
+
+	zbc_aio_put_inflight(dev);
+
+	return 0;
+}
+
+/**
+ * zbc_get_lib_stats - Get library statistics counters
+ */
+void zbc_get_lib_stats(struct zbc_device *dev, struct zbc_lib_stats *stats,
+		       size_t size)
+{
+	if (size > sizeof(struct zbc_lib_stats))
+		size = sizeof(struct zbc_lib_stats);
+
+	memcpy(stats, &dev->zbd_stats, size);
+}
+
 /**
  * zbc_get_zbd_stats - Receive Zoned Block Device statistics
  */
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <scsi/scsi.h>
 #include <scsi/sg.h>
@@ -117,6 +118,17 @@ struct zbc_drv {
 	 */
 	int		(*zbd_get_stats)(struct zbc_device *,
 					 struct zbc_zoned_blk_dev_stats *);
+
+	/**
+	 * Submit an asynchronous I/O (optional).
+	 */
+	int		(*zbd_submit_aio)(struct zbc_device *, struct zbc_aio *);
+
+	/**
+	 * Get a completed asynchronous I/O (optional).
+	 */
+	int		(*zbd_reap_aio)(struct zbc_device *, struct zbc_aio **,
+					bool);
 };
 
 /**
@@ -155,6 +167,12 @@ struct zbc_device {
 	 */
 	unsigned int		zbd_o_flags;
 
+	/**
+	 * Flags passed to zbc_open(), used to open other handles
+	 * to the device.
+	 */
+	int			zbd_open_flags;
+
 	/**
 	 * Device backend driver flags.
 	 */
@@ -170,6 +188,57 @@ struct zbc_device {
 	 */
 	size_t			zbd_report_bufsz_min;
 
+	/**
+	 * Zone domain and realm lookup index.
+	 */
+	struct zbc_realm_index	*zbd_realm_index;
+
+	/**
+	 * Zone domains cache, used to process REPORT REALMS results.
+	 * The cache is per handle: zone activations done by another
+	 * process or through another handle are not seen and leave the
+	 * cache stale. The cache is dropped when the device reports a
+	 * capacity change.
+	 */
+	struct zbc_zone_domain	zbd_domains[ZBC_NR_ZONE_TYPES];
+	unsigned int		zbd_nr_domains;
+	bool			zbd_domains_valid;
+
+	/**
+	 * Total number of realms of the last REPORT REALMS header,
+	 * regardless of the number of realm descriptors returned.
+	 */
+	unsigned int		zbd_rpt_nr_realms;
+
+	/**
+	 * Library statistics counters.
+	 */
+	struct zbc_lib_stats	zbd_stats;
+
+	/**
+	 * Asynchronous I/O queue depth set by the backend driver
+	 * (0 if asynchronous I/Os are emulated), number of I/Os in flight
+	 * and emulated I/O completion, the last two protected by
+	 * zbd_aio_lock.
+	 */
+	unsigned int		zbd_aio_qd;
+	pthread_mutex_t		zbd_aio_lock;
+	unsigned int		zbd_aio_inflight;
+	struct zbc_aio		*zbd_aio_done;
+
+	/**
+	 * Sense data of the last failed asynchronous I/O, shared by
+	 * the I/Os failed with the same device error.
+	 */
+	struct zbc_err_ext	zbd_aio_err;
+	bool			zbd_aio_err_valid;
+
+	/**
+	 * Zone write plugs, serializing writes to sequential
+	 * write required zones.
+	 */
+	struct zbc_zone_plugs	*zbd_plugs;
+
 };
 
 /**
@@ -222,7 +291,7 @@ static inline void zbc_clear_errno(void)
  */
 #define ZBC_O_MODE_MASK		(O_RDONLY | O_WRONLY | O_RDWR)
 #define ZBC_O_DMODE_MASK	(ZBC_O_MODE_MASK | O_DIRECT)
-#define ZBC_O_DRV_MASK		(ZBC_O_DRV_SCSI | ZBC_O_DRV_ATA)
+#define ZBC_O_DRV_MASK		(ZBC_O_DRV_BLOCK | ZBC_O_DRV_SCSI | ZBC_O_DRV_ATA)
 #define ZBC_O_TEST_DRV_MASK	(ZBC_O_DRV_SCSI | ZBC_O_DRV_ATA)
 
 /**
@@ -234,6 +303,11 @@ static inline void zbc_clear_errno(void)
 #define zbc_test_mode(dev)	(false)
 #endif
 
+/**
+ * Zoned block device driver (uses the kernel zoned block device ioctls).
+ */
+extern struct zbc_drv zbc_block_drv;
+
 /**
  * ZAC (ATA) device driver (uses SG_IO).
  */
@@ -252,6 +326,16 @@ extern struct zbc_drv zbc_scsi_drv;
  */
 #define zbc_rz_ro_mask(ro)		((ro) & 0x3f)
 
+/**
+ * REPORT REALMS output definitions, common to the SCSI and ATA drivers:
+ * header size, largest zone realm descriptor size, offset of the first
+ * start/end descriptor in a realm descriptor and start/end descriptor size.
+ */
+#define ZBC_RPT_REALMS_HEADER_SIZE	64
+#define ZBC_RPT_REALMS_RECORD_SIZE	128
+#define ZBC_RPT_REALMS_DESC_OFFSET	16
+#define ZBC_RPT_REALMS_SE_DESC_SIZE	16
+
 /**
  * Logical block to sector conversion.
  */
@@ -293,11 +377,164 @@ ssize_t zbc_scsi_pwritev(struct zbc_device *dev,
 			 const struct iovec *iov, int iovcnt, uint64_t offset);
 int zbc_scsi_flush(struct zbc_device *dev);
 
+/**
+ * Test if a SCSI device supports Zone Domains or Zone Realms
+ * using a single VPD page INQUIRY.
+ */
+int zbc_scsi_probe_zoned(struct zbc_device *dev, enum zbc_dev_model *model);
+
 /**
  * Get device capacity information of an ATA device.
  */
 int zbc_ata_get_capacity(struct zbc_device *dev);
 
+/**
+ * Zone domains cache management.
+ */
+int zbc_get_cached_domains(struct zbc_device *dev,
+			   struct zbc_zone_domain **pdomains);
+
+static inline void zbc_invalidate_domains(struct zbc_device *dev)
+{
+	dev->zbd_domains_valid = false;
+}
+
+/**
+ * Zone domain and realm index management.
+ */
+void zbc_free_realm_index(struct zbc_device *dev);
+void zbc_update_realm_index(struct zbc_device *dev,
+			    struct zbc_actv_res *actv_recs,
+			    unsigned int nr_actv_recs);
+
+/**
+ * Number of consecutive failed reaps after which waiting for the
+ * asynchronous I/Os in flight of a device is abandoned.
+ */
+#define ZBC_MAX_REAP_RETRIES	128
+
+/**
+ * Asynchronous I/O in flight accounting.
+ */
+static inline unsigned int zbc_aio_nr_inflight(struct zbc_device *dev)
+{
+	unsigned int nr;
+
+	pthread_mutex_lock(&dev->zbd_aio_lock);
+	nr = dev->zbd_aio_inflight;
+	pthread_mutex_unlock(&dev->zbd_aio_lock);
+
+	return nr;
+}
+
+static inline void zbc_aio_put_inflight(struct zbc_device *dev)
+{
+	pthread_mutex_lock(&dev->zbd_aio_lock);
+	dev->zbd_aio_inflight--;
+	pthread_mutex_unlock(&dev->zbd_aio_lock);
+}
+
+/**
+ * Zone write plugging and open zone management.
+ */
+int zbc_init_zone_plugs(struct zbc_device *dev);
+void zbc_free_zone_plugs(struct zbc_device *dev);
+void zbc_invalidate_zone_plugs(struct zbc_device *dev);
+bool zbc_zone_plug(struct zbc_device *dev, uint64_t sector);
+int zbc_zone_plug_aio(struct zbc_device *dev, struct zbc_aio *aio);
+void zbc_zone_unplug(struct zbc_device *dev, uint64_t sector, ssize_t count);
+void zbc_zone_plug_prepare_op(struct zbc_device *dev, uint64_t sector,
+			      unsigned int count, enum zbc_zone_op op,
+			      unsigned int flags);
+void zbc_zone_plug_end_op(struct zbc_device *dev, uint64_t sector,
+			  unsigned int count, enum zbc_zone_op op,
+			  unsigned int flags);
+struct zbc_aio *zbc_zone_plug_failed_aio(struct zbc_device *dev);
+
+/**
+ * Zone allocator (zbc_alloc.c) and garbage collector (zbc_gc.c).
+ */
+#define ZBC_ALLOC_WORD_BITS	64
+
+/**
+ * Zone not assigned to a stream.
+ */
+#define ZBC_ALLOC_NO_STREAM	0xff
+
+/**
+ * Zone allocated with zbc_alloc_zone: its data is never moved by
+ * the garbage collector.
+ */
+#define ZBC_ALLOC_EXCLUSIVE	0x80
+
+/**
+ * Zone being reset by zbc_release_zone. ZBC_ALLOC_EXCLUSIVE is set so
+ * that the garbage collector ignores the zone.
+ */
+#define ZBC_ALLOC_RELEASING	0xfe
+
+/**
+ * Active zone of a stream.
+ */
+struct zbc_alloc_slot {
+	unsigned int		idx;
+	uint64_t		wp;
+	bool			valid;
+};
+
+/**
+ * Zone allocator. Free zones are tracked with a bitmap and a stack of
+ * zone indexes so that allocating and freeing a zone are O(1). Each
+ * stream writes to up to nr_active zones in round robin. The allocation
+ * clock is incremented for every allocation and the last value used for
+ * a zone gives its age to the garbage collector, which also uses the
+ * number of sectors allocated in each zone so that it does not need to
+ * report the zones of the device.
+ */
+struct zbc_zone_allocator {
+	struct zbc_device	*dev;
+	pthread_mutex_t		lock;
+
+	struct zbc_zone		*zones;
+	unsigned int		nr_zones;
+	uint64_t		zone_sectors;
+
+	uint8_t			*stream;
+	uint64_t		*free_map;
+	unsigned int		*free_stack;
+	unsigned int		nr_free;
+
+	unsigned int		nr_active;
+	struct zbc_alloc_slot	*slots[ZBC_NR_STREAMS];
+	unsigned int		next_slot[ZBC_NR_STREAMS];
+
+	uint64_t		clock;
+	uint64_t		*mtime;
+	uint64_t		*used;
+	uint64_t		nr_alloc_sectors;
+
+	struct zbc_gc_stats	gc_stats;
+};
+
+static inline bool zbc_alloc_is_free(struct zbc_zone_allocator *za,
+				     unsigned int idx)
+{
+	return za->free_map[idx / ZBC_ALLOC_WORD_BITS] &
+		(1ULL << (idx % ZBC_ALLOC_WORD_BITS));
+}
+
+int zbc_alloc_zone_idx(struct zbc_zone_allocator *za, uint64_t sector);
+void zbc_alloc_put_free(struct zbc_zone_allocator *za, unsigned int idx);
+
+/**
+ * Pipelined copy (zbc_copy.c).
+ */
+int zbc_copy_alloc_bufs(size_t io_sectors, void *bufs[2]);
+void zbc_copy_free_bufs(void *bufs[2]);
+int zbc_copy_sectors(struct zbc_device *src, uint64_t src_sector,
+		     struct zbc_device *dst, uint64_t dst_sector,
+		     uint64_t count, size_t io_sectors, void *bufs[2]);
+
 /**
  * Log levels.
  */
@@ -0,0 +1,387 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ *
+ * Zone allocator with write streams.
+ */
+#include "zbc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+void zbc_alloc_put_free(struct zbc_zone_allocator *za, unsigned int idx)
+{
+	za->free_map[idx / ZBC_ALLOC_WORD_BITS] |=
+		1ULL << (idx % ZBC_ALLOC_WORD_BITS);
+	za->free_stack[za->nr_free++] = idx;
+	za->stream[idx] = ZBC_ALLOC_NO_STREAM;
+	za->used[idx] = 0;
+}
+
+static int zbc_alloc_get_free(struct zbc_zone_allocator *za,
+			      enum zbc_zone_stream stream)
+{
+	unsigned int idx;
+
+	if (!za->nr_free)
+		return -ENOSPC;
+
+	idx = za->free_stack[--za->nr_free];
+	za->free_map[idx / ZBC_ALLOC_WORD_BITS] &=
+		~(1ULL << (idx % ZBC_ALLOC_WORD_BITS));
+	za->stream[idx] = stream;
+
+	return idx;
+}
+
+/**
+ * Get the index of the zone starting at @sector, or -1.
+ */
+int zbc_alloc_zone_idx(struct zbc_zone_allocator *za, uint64_t sector)
+{
+	unsigned int lo = 0, hi = za->nr_zones, mid;
+
+	/* Uniform zone sizes: direct lookup */
+	if (za->zone_sectors) {
+		mid = (sector - za->zones[0].zbz_start) / za->zone_sectors;
+		if (sector >= za->zones[0].zbz_start && mid < za->nr_zones &&
+		    za->zones[mid].zbz_start == sector)
+			return mid;
+		return -1;
+	}
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (za->zones[mid].zbz_start == sector)
+			return mid;
+		if (za->zones[mid].zbz_start < sector)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return -1;
+}
+
+/**
+ * Get the number of zones that can be open at the same time.
+ */
+static unsigned int zbc_alloc_max_open(struct zbc_device *dev)
+{
+	struct zbc_device_info *di = &dev->zbd_info;
+	uint32_t max_open;
+
+	if (zbc_dev_model(dev) == ZBC_DM_HOST_MANAGED)
+		max_open = di->zbd_max_nr_open_seq_req;
+	else
+		max_open = di->zbd_opt_nr_open_seq_pref;
+
+	if (!max_open || max_open == ZBC_NOT_REPORTED)
+		return UINT32_MAX;
+
+	return max_open;
+}
+
+/**
+ * zbc_free_zone_allocator - Free a zone allocator
+ */
+void zbc_free_zone_allocator(struct zbc_zone_allocator *za)
+{
+	int i;
+
+	if (!za)
+		return;
+
+	for (i = 0; i < ZBC_NR_STREAMS; i++)
+		free(za->slots[i]);
+	free(za->free_stack);
+	free(za->free_map);
+	free(za->mtime);
+	free(za->used);
+	free(za->stream);
+	free(za->zones);
+	pthread_mutex_destroy(&za->lock);
+	free(za);
+}
+
+/**
+ * zbc_create_zone_allocator - Create a zone allocator
+ */
+int zbc_create_zone_allocator(struct zbc_device *dev, unsigned int nr_active,
+			      struct zbc_zone_allocator **pza)
+{
+	struct zbc_zone_allocator *za;
+	struct zbc_zone *zones, *z;
+	unsigned int nr_zones, i, n = 0, max_open;
+	int ret;
+
+	if (!zbc_dev_is_zoned(dev))
+		return -ENOTSUP;
+
+	za = calloc(1, sizeof(struct zbc_zone_allocator));
+	if (!za)
+		return -ENOMEM;
+	za->dev = dev;
+	pthread_mutex_init(&za->lock, NULL);
+
+	/* Keep all active zones of all streams open within the limits */
+	if (!nr_active)
+		nr_active = 1;
+	max_open = zbc_alloc_max_open(dev);
+	if (max_open < ZBC_NR_STREAMS) {
+		zbc_error("%s: Not enough open zones for %d streams\n",
+			  dev->zbd_filename, ZBC_NR_STREAMS);
+		ret = -EINVAL;
+		goto err;
+	}
+	if (nr_active > max_open / ZBC_NR_STREAMS) {
+		nr_active = max_open / ZBC_NR_STREAMS;
+		zbc_warning("%s: Using %u active zones per stream\n",
+			    dev->zbd_filename, nr_active);
+	}
+	za->nr_active = nr_active;
+
+	for (i = 0; i < ZBC_NR_STREAMS; i++) {
+		za->slots[i] = calloc(nr_active, sizeof(struct zbc_alloc_slot));
+		if (!za->slots[i]) {
+			ret = -ENOMEM;
+			goto err;
+		}
+	}
+
+	/* Keep the sequential zones that can be written */
+	ret = zbc_list_zones(dev, 0, ZBC_RZ_RO_ALL, &zones, &nr_zones);
+	if (ret != 0)
+		goto err;
+
+	for (i = 0; i < nr_zones; i++) {
+		z = &zones[i];
+		if (!zbc_zone_sequential(z) || zbc_zone_rdonly(z) ||
+		    zbc_zone_offline(z) || zbc_zone_inactive(z))
+			continue;
+		zones[n++] = *z;
+	}
+	za->zones = zones;
+	za->nr_zones = n;
+
+	if (!n) {
+		zbc_error("%s: No writable sequential zones\n",
+			  dev->zbd_filename);
+		ret = -ENOSPC;
+		goto err;
+	}
+
+	/* Check for uniform zone sizes to speed up zone lookups */
+	za->zone_sectors = zones[0].zbz_length;
+	for (i = 1; i < n; i++) {
+		if (zones[i].zbz_start != zones[0].zbz_start +
+		    (uint64_t)i * za->zone_sectors) {
+			za->zone_sectors = 0;
+			break;
+		}
+	}
+
+	za->stream = malloc(n);
+	za->free_map = calloc((n + ZBC_ALLOC_WORD_BITS - 1) /
+			      ZBC_ALLOC_WORD_BITS, sizeof(uint64_t));
+	za->free_stack = calloc(n, sizeof(unsigned int));
+	za->mtime = calloc(n, sizeof(uint64_t));
+	za->used = calloc(n, sizeof(uint64_t));
+	if (!za->stream || !za->free_map || !za->free_stack || !za->mtime ||
+	    !za->used) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	/* Empty zones are free, lower zones are allocated first */
+	memset(za->stream, ZBC_ALLOC_NO_STREAM, n);
+	for (i = n; i > 0; i--) {
+		z = &zones[i - 1];
+		if (zbc_zone_empty(z))
+			zbc_alloc_put_free(za, i - 1);
+		else if (zbc_zone_full(z))
+			za->used[i - 1] = zbc_zone_capacity(z);
+		else
+			za->used[i - 1] = zbc_zone_wp(z) - zbc_zone_start(z);
+	}
+
+	zbc_debug("%s: Zone allocator: %u zones, %u free, %u active zones per stream\n",
+		  dev->zbd_filename, n, za->nr_free, nr_active);
+
+	*pza = za;
+
+	return 0;
+
+err:
+	zbc_free_zone_allocator(za);
+
+	return ret;
+}
+
+/**
+ * zbc_alloc_zone - Allocate an empty zone
+ */
+int zbc_alloc_zone(struct zbc_zone_allocator *za, enum zbc_zone_stream stream,
+		   uint64_t *sector)
+{
+	int idx;
+
+	if (stream >= ZBC_NR_STREAMS)
+		return -EINVAL;
+
+	pthread_mutex_lock(&za->lock);
+	idx = zbc_alloc_get_free(za, stream);
+	if (idx >= 0) {
+		za->stream[idx] |= ZBC_ALLOC_EXCLUSIVE;
+		za->mtime[idx] = ++za->clock;
+	}
+	pthread_mutex_unlock(&za->lock);
+	if (idx < 0)
+		return idx;
+
+	*sector = za->zones[idx].zbz_start;
+
+	return 0;
+}
+
+/**
+ * zbc_release_zone - Reset a zone and return it to the free zones
+ */
+int zbc_release_zone(struct zbc_zone_allocator *za, uint64_t sector)
+{
+	struct zbc_alloc_slot *slot;
+	unsigned int i;
+	uint8_t s;
+	int idx, ret;
+
+	pthread_mutex_lock(&za->lock);
+
+	idx = zbc_alloc_zone_idx(za, sector);
+	if (idx < 0 || zbc_alloc_is_free(za, idx)) {
+		pthread_mutex_unlock(&za->lock);
+		return -EINVAL;
+	}
+
+	s = za->stream[idx];
+	if (s == ZBC_ALLOC_RELEASING) {
+		pthread_mutex_unlock(&za->lock);
+		return -EBUSY;
+	}
+
+	/*
+	 * Drop the zone from its stream active zones and hold it while it
+	 * is reset without the allocator lock held.
+	 */
+	if (s < ZBC_NR_STREAMS) {
+		for (i = 0; i < za->nr_active; i++) {
+			slot = &za->slots[s][i];
+			if (slot->valid && slot->idx == (unsigned int)idx)
+				slot->valid = false;
+		}
+	}
+	za->stream[idx] = ZBC_ALLOC_RELEASING;
+
+	pthread_mutex_unlock(&za->lock);
+
+	ret = zbc_reset_zone(za->dev, sector, 0);
+
+	pthread_mutex_lock(&za->lock);
+	if (ret == 0)
+		zbc_alloc_put_free(za, idx);
+	else
+		za->stream[idx] = s;
+	pthread_mutex_unlock(&za->lock);
+
+	return ret;
+}
+
+/**
+ * zbc_alloc_sectors - Allocate sectors in a stream active zones
+ */
+int zbc_alloc_sectors(struct zbc_zone_allocator *za,
+		      enum zbc_zone_stream stream, size_t count,
+		      uint64_t *sector)
+{
+	struct zbc_alloc_slot *slot;
+	uint64_t close_sector = 0;
+	bool close = false;
+	struct zbc_zone *zone;
+	int idx, ret = 0;
+
+	if (stream >= ZBC_NR_STREAMS || !count)
+		return -EINVAL;
+
+	pthread_mutex_lock(&za->lock);
+
+	slot = &za->slots[stream][za->next_slot[stream]];
+	za->next_slot[stream] = (za->next_slot[stream] + 1) % za->nr_active;
+
+	/*
+	 * Replace the active zone if it does not have enough space. If it
+	 * is not full, close it: finishing it would fail the writes of the
+	 * sectors already allocated that are not yet written.
+	 */
+	if (slot->valid) {
+		zone = &za->zones[slot->idx];
+		if (slot->wp + count >
+		    zbc_zone_start(zone) + zbc_zone_capacity(zone)) {
+			slot->valid = false;
+			if (slot->wp <
+			    zbc_zone_start(zone) + zbc_zone_capacity(zone)) {
+				close = true;
+				close_sector = zbc_zone_start(zone);
+			}
+		}
+	}
+
+	if (!slot->valid) {
+		idx = zbc_alloc_get_free(za, stream);
+		if (idx < 0) {
+			ret = idx;
+			goto out;
+		}
+		zone = &za->zones[idx];
+		if (count > zbc_zone_capacity(zone)) {
+			zbc_alloc_put_free(za, idx);
+			ret = -EINVAL;
+			goto out;
+		}
+		slot->idx = idx;
+		slot->wp = zone->zbz_start;
+		slot->valid = true;
+	}
+
+	*sector = slot->wp;
+	slot->wp += count;
+	za->used[slot->idx] = slot->wp - za->zones[slot->idx].zbz_start;
+	za->mtime[slot->idx] = ++za->clock;
+	za->nr_alloc_sectors += count;
+
+out:
+	pthread_mutex_unlock(&za->lock);
+
+	if (close && zbc_close_zone(za->dev, close_sector, 0) != 0)
+		zbc_warning("%s: Close replaced active zone %llu failed\n",
+			    za->dev->zbd_filename,
+			    (unsigned long long)close_sector);
+
+	return ret;
+}
+
+/**
+ * zbc_nr_free_zones - Get the number of free zones of a zone allocator
+ */
+unsigned int zbc_nr_free_zones(struct zbc_zone_allocator *za)
+{
+	unsigned int nr_free;
+
+	pthread_mutex_lock(&za->lock);
+	nr_free = za->nr_free;
+	pthread_mutex_unlock(&za->lock);
+
+	return nr_free;
+}
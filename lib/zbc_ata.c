@@ -39,28 +39,6 @@
  */
 #define ZBC_RPT_DOMAINS_RECORD_SIZE		96
 
-/*
- * REPORT REALMS output header size.
- */
-#define ZBC_RPT_REALMS_HEADER_SIZE		64
-
-/*
- * REPORT REALMS output descriptor size.
- */
-#define ZBC_RPT_REALMS_RECORD_SIZE		128
-
-/*
- * REPORT REALMS descriptor header size
- * aka the offset to the first start/end
- * descriptor.
- */
-#define ZBC_RPT_REALMS_DESC_OFFSET		16
-
-/*
- * REPORT REALMS start/end descriptor size
- */
-#define ZBC_RPT_REALMS_SE_DESC_SIZE		16
-
 /**
  * Zone activation results header size.
  */
@@ -81,6 +59,10 @@
 #define ZBC_ATA_REQUEST_SENSE_DATA_EXT		0x0B
 #define ZBC_ATA_READ_DMA_EXT			0x25
 #define ZBC_ATA_WRITE_DMA_EXT			0x35
+#define ZBC_ATA_READ_FPDMA_QUEUED		0x60
+#define ZBC_ATA_WRITE_FPDMA_QUEUED		0x61
+#define ZBC_ATA_NCQ_NON_DATA			0x63
+#define ZBC_ATA_RECEIVE_FPDMA_QUEUED		0x65
 #define ZBC_ATA_FLUSH_CACHE_EXT			0xEA
 #define ZBC_ATA_ZAC_MANAGEMENT_IN		0x4A
 #define ZBC_ATA_ZAC_MANAGEMENT_OUT		0x9F
@@ -108,6 +90,15 @@
 #define ZBC_ATA_OPEN_ZONE_EXT_AF		0x03
 #define ZBC_ATA_RESET_WRITE_POINTER_EXT_AF	0x04
 
+/**
+ * NCQ NON-DATA and RECEIVE FPDMA QUEUED subcommands.
+ */
+#define ZBC_ATA_NCQ_NON_DATA_ZAC_MGMT_OUT	0x07
+#define ZBC_ATA_RECV_FPDMA_ZAC_MGMT_IN		0x02
+
+#define ZBC_ATA_NCQ_CMD_ERROR_LOG_ADDR		0x10
+#define ZBC_ATA_NCQ_NON_DATA_LOG_ADDR		0x12
+#define ZBC_ATA_NCQ_SEND_RECV_LOG_ADDR		0x13
 #define ZBC_ATA_IDENTIFY_DEVICE_DATA_LOG_ADDR	0x30
 #define ZBC_ATA_CAPACITY_PAGE			0x02
 #define ZBC_ATA_SUPPORTED_CAPABILITIES_PAGE	0x03
@@ -133,10 +124,41 @@ enum zbc_ata_drv_flags {
 	/** Use SCSI SBC commands for I/O operations */
 	ZBC_ATA_USE_SBC		= 0x00000001,
 
+	/** Use NCQ commands for native I/O operations */
+	ZBC_ATA_USE_NCQ		= 0x00000002,
+
+	/** Use NCQ NON-DATA for zone operations */
+	ZBC_ATA_NCQ_ZONE_OP	= 0x00000004,
+
+	/** Use RECEIVE FPDMA QUEUED for REPORT ZONES */
+	ZBC_ATA_NCQ_REPORT_ZONES = 0x00000008,
+
+	/** Sense data reporting is disabled */
+	ZBC_ATA_NO_SENSE_DATA	= 0x00000010,
+
+	/** A queued zone operation completed successfully */
+	ZBC_ATA_NCQ_ZONE_OP_OK	= 0x00000020,
+
+	/** A queued REPORT ZONES completed successfully */
+	ZBC_ATA_NCQ_REPORT_ZONES_OK = 0x00000040,
+
 };
 
 char *zbc_ata_cmd_name(struct zbc_sg_cmd *cmd)
 {
+	if (cmd->code == ZBC_SG_ATA32) {
+		switch (cmd->cdb[25]) {
+		case ZBC_ATA_NCQ_NON_DATA:
+			return "/NCQ NON-DATA";
+		case ZBC_ATA_RECEIVE_FPDMA_QUEUED:
+			return "/RECEIVE FPDMA QUEUED";
+		}
+		return "/UNKNOWN COMMAND";
+	}
+
+	if (cmd->code != ZBC_SG_ATA16)
+		return "";
+
 	switch (cmd->cdb[14]) {
 	case ZBC_ATA_IDENTIFY:
 		return "/IDENTIFY";
@@ -152,6 +174,10 @@ char *zbc_ata_cmd_name(struct zbc_sg_cmd *cmd)
 		return "/READ DMA EXT";
 	case ZBC_ATA_WRITE_DMA_EXT:
 		return "/WRITE DMA EXT";
+	case ZBC_ATA_READ_FPDMA_QUEUED:
+		return "/READ FPDMA QUEUED";
+	case ZBC_ATA_WRITE_FPDMA_QUEUED:
+		return "/WRITE FPDMA QUEUED";
 	case ZBC_ATA_FLUSH_CACHE_EXT:
 		return "/FLUSH CACHE EXT";
 	case ZBC_ATA_ENABLE_SENSE_DATA_REPORTING:
@@ -266,6 +292,59 @@ static inline void zbc_ata_put_feat_lba(uint8_t *cdb, uint64_t lba)
 	zbc_ata_set_feat_lba(&cdb[8], lba);
 }
 
+/**
+ * Initialize an ATA PASSTHROUGH (32) command CDB.
+ */
+static void zbc_ata32_cdb_init(struct zbc_sg_cmd *cmd, uint64_t lba)
+{
+	/*
+	 * Bytes 10 and 11 are the protocol and transfer fields of ATA16
+	 * bytes 1 and 2, bytes 12 to 19 the LBA, bytes 20 to 23 the
+	 * features and count fields, byte 24 the device, byte 25 the
+	 * command and bytes 28 to 31 the auxiliary field.
+	 */
+	cmd->cdb[0] = ZBC_SG_ATA32_CDB_OPCODE;
+	cmd->cdb[7] = ZBC_SG_ATA32_CDB_LENGTH - 8;
+	zbc_sg_set_int16(&cmd->cdb[8], ZBC_SG_ATA32_CDB_SA);
+	zbc_sg_set_int64(&cmd->cdb[12], lba);
+	cmd->cdb[24] = 1 << 6;
+}
+
+/**
+ * Check the result of the NCQ command indicated by @flag. HBAs and kernels
+ * that do not support a queued command fail it in various ways (invalid
+ * opcode or field in the CDB, I/O error without sense data, host errors),
+ * so until a queued command of this type has succeeded, any failure stops
+ * the use of the NCQ command and returns -EOPNOTSUPP to let the caller
+ * retry with a non-queued command. Afterwards, only an invalid command
+ * operation code does so.
+ */
+static int zbc_ata_ncq_fallback(struct zbc_device *dev, int ret,
+				unsigned int flag)
+{
+	unsigned int ok_flag = flag == ZBC_ATA_NCQ_ZONE_OP ?
+		ZBC_ATA_NCQ_ZONE_OP_OK : ZBC_ATA_NCQ_REPORT_ZONES_OK;
+
+	if (!ret) {
+		dev->zbd_drv_flags |= ok_flag;
+		return 0;
+	}
+
+	if ((dev->zbd_drv_flags & ok_flag) &&
+	    (ret != -EIO ||
+	     zerrno.sk != ZBC_SK_ILLEGAL_REQUEST ||
+	     zerrno.asc_ascq != ZBC_ASC_INVALID_COMMAND_OPERATION_CODE))
+		return ret;
+
+	zbc_warning("%s: NCQ %s failed (%d), using non-queued commands\n",
+		    dev->zbd_filename,
+		    flag == ZBC_ATA_NCQ_ZONE_OP ?
+		    "zone management" : "report zones", ret);
+	dev->zbd_drv_flags &= ~flag;
+
+	return -EOPNOTSUPP;
+}
+
 /**
  * Read a log page.
  */
@@ -341,6 +420,37 @@ static int zbc_ata_read_log(struct zbc_device *dev, uint8_t log,
 	return ret;
 }
 
+/**
+ * Get IDENTIFY DEVICE data.
+ */
+static int zbc_ata_identify(struct zbc_device *dev, uint8_t *buf)
+{
+	struct zbc_sg_cmd cmd;
+	int ret;
+
+	/* Initialize command */
+	ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, buf, 512);
+	if (ret != 0)
+		return ret;
+
+	cmd.io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+	cmd.cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
+	/* PIO Data-In protocol, ext=0 */
+	cmd.cdb[1] = 0x4 << 1;
+	/* off_line=0, ck_cond=0, t_type=0, t_dir=1, byt_blk=1, t_length=10 */
+	cmd.cdb[2] = 0x0e;
+	cmd.cdb[6] = 1;
+	cmd.cdb[14] = ZBC_ATA_IDENTIFY;
+
+	/* Execute the command */
+	ret = zbc_sg_cmd_exec(dev, &cmd);
+
+	/* Done */
+	zbc_sg_cmd_destroy(&cmd);
+
+	return ret;
+}
+
 /**
  * Set features
  */
@@ -411,6 +521,17 @@ static int zbc_ata_set_features(struct zbc_device *dev, uint8_t feature,
 	return ret;
 }
 
+/**
+ * Test if a command uses the NCQ protocol.
+ */
+static inline bool zbc_ata_cmd_is_ncq(struct zbc_sg_cmd *cmd)
+{
+	if (cmd->code == ZBC_SG_ATA32)
+		return ((cmd->cdb[10] >> 1) & 0x0f) == 0xc;
+
+	return ((cmd->cdb[1] >> 1) & 0x0f) == 0xc;
+}
+
 /**
  * Test if sense data is needed and can be obtained.
  */
@@ -420,9 +541,24 @@ static inline bool zbc_ata_need_sense_data(struct zbc_sg_cmd *cmd)
 	if (zerrno.asc_ascq)
 		return false;
 
-	return cmd->io_hdr.sb_len_wr > 8 &&
-		cmd->sense_buf[8] == 0x09 && /* ATA descriptor header present */
-		cmd->sense_buf[21] & 0x02;   /* ATA status error bit set */
+	/*
+	 * For NCQ commands, libata error handling already read the NCQ
+	 * command error log and returned the sense data it found with the
+	 * failed command. Reading the log again is only useful if no sense
+	 * data at all was returned.
+	 */
+	if (zbc_ata_cmd_is_ncq(cmd))
+		return !zerrno.sk;
+
+	/*
+	 * For other commands, an ATA descriptor with the ATA status sense
+	 * data available bit set must be present.
+	 */
+	if (cmd->io_hdr.sb_len_wr <= 8 ||
+	    cmd->sense_buf[8] != 0x09)
+		return false;
+
+	return cmd->sense_buf[21] & 0x02;
 }
 
 /**
@@ -533,7 +669,41 @@ out:
 }
 
 /**
- * Request sense data.
+ * Get the sense data of a failed NCQ command from the NCQ command
+ * error log, for when the kernel did not return any. Reading this log
+ * also clears the device NCQ error state.
+ */
+static void zbc_ata_ncq_error_sense(struct zbc_device *dev)
+{
+	uint8_t buf[512];
+	int sk, asc, ascq;
+	int ret;
+
+	ret = zbc_ata_read_log(dev, ZBC_ATA_NCQ_CMD_ERROR_LOG_ADDR, 0,
+			       buf, sizeof(buf));
+	if (ret != 0) {
+		zbc_debug("%s: Read NCQ command error log failed %d\n",
+			  dev->zbd_filename, ret);
+		return;
+	}
+
+	/* NQ bit set: the error is not for an NCQ command */
+	if (buf[0] & 0x80)
+		return;
+
+	sk = buf[14] & 0x0f;
+	asc = buf[15];
+	ascq = buf[16];
+
+	zbc_debug("%s: NCQ error tag %d, sense key 0x%x, ASC/ASCQ 0x%02x/0x%02x\n",
+		  dev->zbd_filename, buf[0] & 0x1f, sk, asc, ascq);
+
+	zbc_set_errno(sk, (asc << 8) | ascq);
+}
+
+/**
+ * Request sense data. Nothing is done if the sense data was returned
+ * with the failed command.
  */
 static void zbc_ata_get_sense_data(struct zbc_device *dev,
 				   struct zbc_sg_cmd *cmd, int ret)
@@ -542,7 +712,10 @@ static void zbc_ata_get_sense_data(struct zbc_device *dev,
 	if (ret != -EIO || !zbc_ata_need_sense_data(cmd))
 		return;
 
-	zbc_ata_request_sense_data_ext(dev);
+	if (zbc_ata_cmd_is_ncq(cmd))
+		zbc_ata_ncq_error_sense(dev);
+	else if (!(dev->zbd_drv_flags & ZBC_ATA_NO_SENSE_DATA))
+		zbc_ata_request_sense_data_ext(dev);
 }
 
 /**
@@ -766,27 +939,13 @@ static int zbc_ata_report_realms(struct zbc_device *dev, uint64_t sector,
 	int ret, j, nr_domains;
 
 	/*
-	 * Always get zone domains first. Allocate the buffer for
-	 * ZBC_NR_ZONE_TYPES domains since we will be only able to
-	 * process this many.
+	 * Get the zone domains first. These are cached and only
+	 * reported again after a zone activation.
 	 */
-	nr_domains = ZBC_NR_ZONE_TYPES;
-	domains = calloc(nr_domains, sizeof(struct zbc_zone_domain));
-	if (!domains)
-		return -ENOMEM;
-
-	nr_domains = zbc_ata_report_domains(dev, 0LL, ZBC_RZD_RO_ALL, domains,
-					    nr_domains);
-	if (nr_domains < 0) {
-		free(domains);
+	nr_domains = zbc_get_cached_domains(dev, &domains);
+	if (nr_domains < 0)
 		return nr_domains;
-	}
-	if (nr_domains > ZBC_NR_ZONE_TYPES) {
-		zbc_warning("%s: Device has %i domains, only %u are supported\n",
-			    dev->zbd_filename, nr_domains, ZBC_NR_ZONE_TYPES);
 
-		nr_domains = ZBC_NR_ZONE_TYPES;
-	}
 	if (*nr_realms)
 		bufsz += (size_t)*nr_realms * ZBC_RPT_REALMS_RECORD_SIZE;
 
@@ -794,10 +953,8 @@ static int zbc_ata_report_realms(struct zbc_device *dev, uint64_t sector,
 
 	/* Allocate and initialize REPORT REALMS command */
 	ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, bufsz);
-	if (ret != 0) {
-		free(domains);
+	if (ret != 0)
 		return ret;
-	}
 
 	/* Fill command CDB:
 	 * +=============================================================================+
@@ -860,6 +1017,7 @@ static int zbc_ata_report_realms(struct zbc_device *dev, uint64_t sector,
 	/* Get the number of realm descriptors from the header */
 	buf = cmd.buf;
 	nr = zbc_ata_get_dword(&buf[0]);
+	dev->zbd_rpt_nr_realms = nr;
 
 	if (!realms || !nr)
 		goto out;
@@ -967,9 +1125,6 @@ oldrealms:
 	}
 
 out:
-	if (domains)
-		free(domains);
-
 	/* Return the number of descriptors */
 	*nr_realms = nr;
 
@@ -1468,8 +1623,49 @@ static int zbc_ata_get_zoned_device_info(struct zbc_device *dev)
 }
 
 /**
- * Read from a ZAC device using READ DMA EXT packed
- * in an ATA PASSTHROUGH command.
+ * Fill an ATA16 CDB for a read or write command. If NCQ is enabled,
+ * READ/WRITE FPDMA QUEUED are used, READ/WRITE DMA EXT otherwise.
+ */
+static void zbc_ata_rw_cdb(struct zbc_device *dev, struct zbc_sg_cmd *cmd,
+			   bool write, uint64_t lba, uint32_t lba_count)
+{
+	cmd->io_hdr.dxfer_direction =
+		write ? SG_DXFER_TO_DEV : SG_DXFER_FROM_DEV;
+	cmd->cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
+	zbc_ata_put_lba(cmd->cdb, lba);
+	cmd->cdb[13] = 1 << 6;
+
+	if (dev->zbd_drv_flags & ZBC_ATA_USE_NCQ) {
+		/* FPDMA protocol, ext=1 */
+		cmd->cdb[1] = (0xc << 1) | 0x01;
+		/*
+		 * off_line=0, ck_cond=0, t_type=0, t_dir=1 for read,
+		 * byt_blk=1, t_length=01 (count in features).
+		 * The NCQ tag (count (7:3)) is set by the HBA.
+		 */
+		cmd->cdb[2] = write ? 0x05 : 0x0d;
+		cmd->cdb[3] = (lba_count >> 8) & 0xff;
+		cmd->cdb[4] = lba_count & 0xff;
+		cmd->cdb[14] = write ?
+			ZBC_ATA_WRITE_FPDMA_QUEUED : ZBC_ATA_READ_FPDMA_QUEUED;
+		return;
+	}
+
+	/* DMA protocol, ext=1 */
+	cmd->cdb[1] = (0x6 << 1) | 0x01;
+	/*
+	 * off_line=0, ck_cond=0, t_type=0, t_dir=1 for read,
+	 * byt_blk=1, t_length=10
+	 */
+	cmd->cdb[2] = write ? 0x06 : 0x0e;
+	cmd->cdb[5] = (lba_count >> 8) & 0xff;
+	cmd->cdb[6] = lba_count & 0xff;
+	cmd->cdb[14] = write ? ZBC_ATA_WRITE_DMA_EXT : ZBC_ATA_READ_DMA_EXT;
+}
+
+/**
+ * Read from a ZAC device using READ DMA EXT or READ FPDMA QUEUED
+ * packed in an ATA PASSTHROUGH command.
  */
 static ssize_t zbc_ata_native_preadv(struct zbc_device *dev,
 				     const struct iovec *iov, int iovcnt,
@@ -1533,17 +1729,7 @@ static ssize_t zbc_ata_native_preadv(struct zbc_device *dev,
 	 * | 15  |                           Control                                     |
 	 * +=============================================================================+
 	 */
-	cmd.io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
-	cmd.cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
-	/* DMA protocol, ext=1 */
-	cmd.cdb[1] = (0x6 << 1) | 0x01;
-	/* off_line=0, ck_cond=0, t_type=0, t_dir=1, byt_blk=1, t_length=10 */
-	cmd.cdb[2] = 0x0e;
-	cmd.cdb[5] = (lba_count >> 8) & 0xff;
-	cmd.cdb[6] = lba_count & 0xff;
-	zbc_ata_put_lba(cmd.cdb, lba);
-	cmd.cdb[13] = 1 << 6;
-	cmd.cdb[14] = ZBC_ATA_READ_DMA_EXT;
+	zbc_ata_rw_cdb(dev, &cmd, false, lba, lba_count);
 
 	/* Execute the command */
 	ret = zbc_sg_cmd_exec(dev, &cmd);
@@ -1572,8 +1758,8 @@ static ssize_t zbc_ata_preadv(struct zbc_device *dev,
 }
 
 /**
- * Write to a ZAC device using WRITE DMA EXT packed
- * in an ATA PASSTHROUGH command.
+ * Write to a ZAC device using WRITE DMA EXT or WRITE FPDMA QUEUED
+ * packed in an ATA PASSTHROUGH command.
  */
 static ssize_t zbc_ata_native_pwritev(struct zbc_device *dev,
 				      const struct iovec *iov, int iovcnt,
@@ -1636,17 +1822,7 @@ static ssize_t zbc_ata_native_pwritev(struct zbc_device *dev,
 	 * | 15  |                             Control                                   |
 	 * +=============================================================================+
 	 */
-	cmd.io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
-	cmd.cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
-	/* DMA protocol, ext=1 */
-	cmd.cdb[1] = (0x6 << 1) | 0x01;
-	/* off_line=0, ck_cond=0, t_type=1, t_dir=0, byt_blk=1, t_length=10 */
-	cmd.cdb[2] = 0x06;
-	cmd.cdb[5] = (lba_count >> 8) & 0xff;
-	cmd.cdb[6] = lba_count & 0xff;
-	zbc_ata_put_lba(cmd.cdb, lba);
-	cmd.cdb[13] = 1 << 6;
-	cmd.cdb[14] = ZBC_ATA_WRITE_DMA_EXT;
+	zbc_ata_rw_cdb(dev, &cmd, true, lba, lba_count);
 
 	/* Execute the command */
 	ret = zbc_sg_cmd_exec(dev, &cmd);
@@ -1674,6 +1850,96 @@ static ssize_t zbc_ata_pwritev(struct zbc_device *dev,
 	return zbc_ata_native_pwritev(dev, iov, iovcnt, offset);
 }
 
+/**
+ * Asynchronous I/O command.
+ */
+struct zbc_ata_aio {
+	struct zbc_sg_cmd	cmd;
+	struct zbc_aio		*aio;
+};
+
+/**
+ * Submit an asynchronous I/O using an NCQ command.
+ */
+static int zbc_ata_submit_aio(struct zbc_device *dev, struct zbc_aio *aio)
+{
+	struct zbc_ata_aio *ata_aio;
+	int ret;
+
+	ata_aio = malloc(sizeof(struct zbc_ata_aio));
+	if (!ata_aio)
+		return -ENOMEM;
+
+	ret = zbc_sg_cmd_init(dev, &ata_aio->cmd, ZBC_SG_ATA16,
+			      aio->zio_buf, aio->zio_count << 9);
+	if (ret != 0)
+		goto err;
+
+	zbc_ata_rw_cdb(dev, &ata_aio->cmd, aio->zio_write,
+		       zbc_dev_sect2lba(dev, aio->zio_offset),
+		       zbc_dev_sect2lba(dev, aio->zio_count));
+	ata_aio->aio = aio;
+
+	ret = zbc_sg_cmd_submit(dev, &ata_aio->cmd);
+	if (ret != 0) {
+		zbc_sg_cmd_destroy(&ata_aio->cmd);
+		goto err;
+	}
+
+	return 0;
+
+err:
+	free(ata_aio);
+
+	return ret;
+}
+
+/**
+ * Get a completed asynchronous I/O.
+ */
+static int zbc_ata_reap_aio(struct zbc_device *dev, struct zbc_aio **paio,
+			    bool wait)
+{
+	struct zbc_sg_cmd *cmd = NULL;
+	struct zbc_ata_aio *ata_aio;
+	struct zbc_aio *aio;
+	int ret;
+
+	ret = zbc_sg_cmd_reap(dev, &cmd, wait);
+	if (!cmd)
+		return ret;
+
+	ata_aio = (struct zbc_ata_aio *)cmd;
+	aio = ata_aio->aio;
+	if (ret) {
+		/*
+		 * An NCQ error aborts all commands in flight: get the sense
+		 * data once and use it for all the I/Os failed until an I/O
+		 * succeeds.
+		 */
+		if (ret == -EIO && zbc_ata_need_sense_data(cmd) &&
+		    dev->zbd_aio_err_valid) {
+			memcpy(&zerrno, &dev->zbd_aio_err, sizeof(zerrno));
+			dev->zbd_stats.sense_cmds_saved++;
+		} else {
+			zbc_ata_get_sense_data(dev, cmd, ret);
+			memcpy(&dev->zbd_aio_err, &zerrno, sizeof(zerrno));
+			dev->zbd_aio_err_valid = true;
+		}
+		aio->zio_ret = ret;
+	} else {
+		dev->zbd_aio_err_valid = false;
+		aio->zio_ret = ((aio->zio_count << 9) - cmd->io_hdr.resid) >> 9;
+	}
+
+	zbc_sg_cmd_destroy(cmd);
+	free(ata_aio);
+
+	*paio = aio;
+
+	return 0;
+}
+
 /**
  * Flush a ZAC device cache.
  */
@@ -1716,21 +1982,17 @@ static int zbc_ata_flush(struct zbc_device *dev)
 }
 
 /**
- * Get device zone information.
+ * Initialize a REPORT ZONES EXT command.
  */
-static int zbc_ata_do_report_zones(struct zbc_device *dev, uint64_t sector,
-			enum zbc_zone_reporting_options ro, uint64_t *max_lba,
-			struct zbc_zone *zones, unsigned int *nr_zones,
-			size_t bufsz)
+static int zbc_ata_report_zones_cmd(struct zbc_device *dev,
+				    struct zbc_sg_cmd *cmd, uint64_t lba,
+				    enum zbc_zone_reporting_options ro,
+				    size_t bufsz)
 {
-	uint64_t lba = zbc_dev_sect2lba(dev, sector);
-	unsigned int i, nz = 0, buf_nz;
-	struct zbc_sg_cmd cmd;
-	uint8_t *buf;
 	int ret;
 
 	/* Initialize the command */
-	ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, bufsz);
+	ret = zbc_sg_cmd_init(dev, cmd, ZBC_SG_ATA16, NULL, bufsz);
 	if (ret != 0)
 		return ret;
 
@@ -1772,27 +2034,95 @@ static int zbc_ata_do_report_zones(struct zbc_device *dev, uint64_t sector,
 	 * | 15  |                           Control                                     |
 	 * +=============================================================================+
 	 */
-	cmd.io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
-	cmd.cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
+	cmd->io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+	cmd->cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
 	/* DMA protocol, ext=1 */
-	cmd.cdb[1] = (0x06 << 1) | 0x01;
+	cmd->cdb[1] = (0x06 << 1) | 0x01;
 	/* off_line=0, ck_cond=0, t_type=0, t_dir=1, byt_blk=1, t_length=10 */
-	cmd.cdb[2] = 0x0e;
+	cmd->cdb[2] = 0x0e;
 	/* Partial bit and reporting options */
-	cmd.cdb[3] = ro & 0xbf;
-	cmd.cdb[4] = ZBC_ATA_REPORT_ZONES_EXT_AF;
-	cmd.cdb[5] = ((bufsz / 512) >> 8) & 0xff;
-	cmd.cdb[6] = (bufsz / 512) & 0xff;
-	zbc_ata_put_lba(cmd.cdb, lba);
-	cmd.cdb[13] = 1 << 6;
-	cmd.cdb[14] = ZBC_ATA_ZAC_MANAGEMENT_IN;
+	cmd->cdb[3] = ro & 0xbf;
+	cmd->cdb[4] = ZBC_ATA_REPORT_ZONES_EXT_AF;
+	cmd->cdb[5] = ((bufsz / 512) >> 8) & 0xff;
+	cmd->cdb[6] = (bufsz / 512) & 0xff;
+	zbc_ata_put_lba(cmd->cdb, lba);
+	cmd->cdb[13] = 1 << 6;
+	cmd->cdb[14] = ZBC_ATA_ZAC_MANAGEMENT_IN;
+
+	return 0;
+}
+
+/**
+ * Initialize a REPORT ZONES EXT command using RECEIVE FPDMA QUEUED
+ * (ZAC MANAGEMENT IN) packed in an ATA PASSTHROUGH (32) command.
+ */
+static int zbc_ata_ncq_report_zones_cmd(struct zbc_device *dev,
+					struct zbc_sg_cmd *cmd, uint64_t lba,
+					enum zbc_zone_reporting_options ro,
+					size_t bufsz)
+{
+	int ret;
+
+	/* Initialize the command */
+	ret = zbc_sg_cmd_init(dev, cmd, ZBC_SG_ATA32, NULL, bufsz);
+	if (ret != 0)
+		return ret;
+
+	cmd->io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+	zbc_ata32_cdb_init(cmd, lba);
+	/* NCQ protocol, ext=1 */
+	cmd->cdb[10] = (0xc << 1) | 0x01;
+	/* off_line=0, ck_cond=0, t_type=0, t_dir=1, byt_blk=1, t_length=01 */
+	cmd->cdb[11] = 0x0d;
+	/* Transfer length in features, subcommand in count (15:8) */
+	cmd->cdb[20] = ((bufsz / 512) >> 8) & 0xff;
+	cmd->cdb[21] = (bufsz / 512) & 0xff;
+	cmd->cdb[22] = ZBC_ATA_RECV_FPDMA_ZAC_MGMT_IN;
+	cmd->cdb[25] = ZBC_ATA_RECEIVE_FPDMA_QUEUED;
+	/* Partial bit and reporting options, action */
+	cmd->cdb[30] = ro & 0xbf;
+	cmd->cdb[31] = ZBC_ATA_REPORT_ZONES_EXT_AF;
+
+	return 0;
+}
+
+/**
+ * Get device zone information.
+ */
+static int zbc_ata_do_report_zones(struct zbc_device *dev, uint64_t sector,
+			enum zbc_zone_reporting_options ro, uint64_t *max_lba,
+			struct zbc_zone *zones, unsigned int *nr_zones,
+			size_t bufsz)
+{
+	uint64_t lba = zbc_dev_sect2lba(dev, sector);
+	bool ncq = dev->zbd_drv_flags & ZBC_ATA_NCQ_REPORT_ZONES;
+	unsigned int i, nz = 0, buf_nz;
+	struct zbc_sg_cmd cmd;
+	uint8_t *buf;
+	int ret;
+
+retry:
+	/* Initialize the command */
+	if (ncq)
+		ret = zbc_ata_ncq_report_zones_cmd(dev, &cmd, lba, ro, bufsz);
+	else
+		ret = zbc_ata_report_zones_cmd(dev, &cmd, lba, ro, bufsz);
+	if (ret != 0)
+		return ret;
 
 	/* Send the SG_IO command */
 	ret = zbc_sg_cmd_exec(dev, &cmd);
-	if (ret) {
+	if (ret)
 		zbc_ata_get_sense_data(dev, &cmd, ret);
-		goto out;
+	if (ncq &&
+	    zbc_ata_ncq_fallback(dev, ret, ZBC_ATA_NCQ_REPORT_ZONES) ==
+	    -EOPNOTSUPP) {
+		zbc_sg_cmd_destroy(&cmd);
+		ncq = false;
+		goto retry;
 	}
+	if (ret)
+		goto out;
 
 	if (cmd.bufsz < ZBC_ZONE_DESCRIPTOR_OFFSET) {
 		zbc_error("%s: Not enough REPORT ZONES data received "
@@ -1830,6 +2160,7 @@ static int zbc_ata_do_report_zones(struct zbc_device *dev, uint64_t sector,
 
 		zones[i].zbz_attributes = buf[1] & 0x03;
 		zones[i].zbz_condition = (buf[1] >> 4) & 0x0f;
+		zones[i].zbz_capacity = 0;
 
 		zones[i].zbz_length =
 			zbc_dev_lba2sect(dev, zbc_ata_get_qword(&buf[8]));
@@ -1879,6 +2210,48 @@ static int zbc_ata_report_zones(struct zbc_device *dev, uint64_t sector,
 				       bufsz);
 }
 
+/**
+ * Zone(s) operation using NCQ NON-DATA (ZAC MANAGEMENT OUT)
+ * packed in an ATA PASSTHROUGH (32) command.
+ */
+static int zbc_ata_ncq_zone_op(struct zbc_device *dev, uint64_t lba,
+			       unsigned int count, unsigned int af,
+			       unsigned int flags)
+{
+	struct zbc_sg_cmd cmd;
+	int ret;
+
+	/* Initialize command */
+	ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA32, NULL, 0);
+	if (ret != 0)
+		return ret;
+
+	cmd.io_hdr.dxfer_direction = SG_DXFER_NONE;
+	zbc_ata32_cdb_init(&cmd, (flags & ZBC_OP_ALL_ZONES) ? 0 : lba);
+	/* NCQ protocol, ext=1 */
+	cmd.cdb[10] = (0xc << 1) | 0x01;
+	/* Subcommand in features (3:0) */
+	cmd.cdb[21] = ZBC_ATA_NCQ_NON_DATA_ZAC_MGMT_OUT;
+	cmd.cdb[25] = ZBC_ATA_NCQ_NON_DATA;
+	/* Auxiliary: zone count (31:16), all (8), action (7:0) */
+	cmd.cdb[28] = (count >> 8) & 0xff;
+	cmd.cdb[29] = count & 0xff;
+	if (flags & ZBC_OP_ALL_ZONES)
+		cmd.cdb[30] = 0x01;
+	cmd.cdb[31] = af;
+
+	/* Execute the command */
+	ret = zbc_sg_cmd_exec(dev, &cmd);
+	if (ret)
+		zbc_ata_get_sense_data(dev, &cmd, ret);
+	ret = zbc_ata_ncq_fallback(dev, ret, ZBC_ATA_NCQ_ZONE_OP);
+
+	/* Done */
+	zbc_sg_cmd_destroy(&cmd);
+
+	return ret;
+}
+
 /**
  * Zone(s) operation.
  */
@@ -1910,6 +2283,12 @@ static int zbc_ata_zone_op(struct zbc_device *dev, uint64_t sector,
 		return -EINVAL;
 	}
 
+	if (dev->zbd_drv_flags & ZBC_ATA_NCQ_ZONE_OP) {
+		ret = zbc_ata_ncq_zone_op(dev, lba, count, af, flags);
+		if (ret != -EOPNOTSUPP)
+			return ret;
+	}
+
 	/* Initialize command */
 	ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 0);
 	if (ret != 0)
@@ -2417,6 +2796,72 @@ static void zbc_ata_enable_sense_data_reporting(struct zbc_device *dev)
 			    dev->zbd_filename, ret);
 		zbc_warning("%s: Detailed error reporting may not work\n",
 			    dev->zbd_filename);
+		dev->zbd_drv_flags |= ZBC_ATA_NO_SENSE_DATA;
+	}
+}
+
+/**
+ * Check NCQ support. If requested with ZBC_O_NCQ, enable NCQ commands for
+ * I/O operations and, if the device supports them, for zone management
+ * and REPORT ZONES.
+ */
+static void zbc_ata_ncq_init(struct zbc_device *dev)
+{
+	uint8_t buf[512];
+	unsigned int qd;
+	uint16_t sata_cap2;
+	int ret;
+
+	ret = zbc_ata_identify(dev, buf);
+	if (ret != 0) {
+		zbc_debug("%s: IDENTIFY DEVICE failed %d, not using NCQ\n",
+			  dev->zbd_filename, ret);
+		return;
+	}
+
+	/* Word 76 bit 8: NCQ supported, word 75 bits 4:0: queue depth - 1 */
+	if (!(zbc_ata_get_word(&buf[76 * 2]) & (1 << 8))) {
+		if (dev->zbd_o_flags & ZBC_O_NCQ)
+			zbc_warning("%s: NCQ is not supported\n",
+				    dev->zbd_filename);
+		return;
+	}
+	qd = (zbc_ata_get_word(&buf[75 * 2]) & 0x1f) + 1;
+
+	if (dev->zbd_o_flags & ZBC_O_NCQ) {
+		dev->zbd_drv_flags |= ZBC_ATA_USE_NCQ;
+		if (zbc_sg_async_supported(dev))
+			dev->zbd_aio_qd = qd;
+		zbc_debug("%s: Using NCQ, queue depth %u%s\n",
+			  dev->zbd_filename, qd,
+			  dev->zbd_aio_qd ? "" : " (no asynchronous I/O)");
+	}
+
+	if (!(dev->zbd_o_flags & ZBC_O_NCQ) || !zbc_dev_is_zoned(dev))
+		return;
+
+	/*
+	 * Word 77 bit 5: NCQ NON-DATA supported,
+	 * bit 6: SEND/RECEIVE FPDMA QUEUED supported.
+	 */
+	sata_cap2 = zbc_ata_get_word(&buf[77 * 2]);
+
+	if ((sata_cap2 & (1 << 5)) &&
+	    zbc_ata_read_log(dev, ZBC_ATA_NCQ_NON_DATA_LOG_ADDR, 0,
+			     buf, sizeof(buf)) == 0 &&
+	    (zbc_ata_get_dword(&buf[0x1c]) & 0x01)) {
+		dev->zbd_drv_flags |= ZBC_ATA_NCQ_ZONE_OP;
+		zbc_debug("%s: Using NCQ NON-DATA for zone management\n",
+			  dev->zbd_filename);
+	}
+
+	if ((sata_cap2 & (1 << 6)) &&
+	    zbc_ata_read_log(dev, ZBC_ATA_NCQ_SEND_RECV_LOG_ADDR, 0,
+			     buf, sizeof(buf)) == 0 &&
+	    (zbc_ata_get_dword(&buf[0x10]) & 0x02)) {
+		dev->zbd_drv_flags |= ZBC_ATA_NCQ_REPORT_ZONES;
+		zbc_debug("%s: Using RECEIVE FPDMA QUEUED for REPORT ZONES\n",
+			  dev->zbd_filename);
 	}
 }
 
@@ -2472,6 +2917,7 @@ static int zbc_ata_open(const char *filename,
 #endif
 	if (flags & O_DIRECT)
 		dev->zbd_o_flags |= ZBC_O_DIRECT;
+	dev->zbd_o_flags |= flags & ZBC_O_NCQ;
 
 	dev->zbd_filename = strdup(filename);
 	if (!dev->zbd_filename)
@@ -2487,6 +2933,8 @@ static int zbc_ata_open(const char *filename,
 
 	zbc_ata_enable_sense_data_reporting(dev);
 
+	zbc_ata_ncq_init(dev);
+
 	*pdev = dev;
 
 	zbc_debug("%s: ########## ATA driver succeeded ##########\n\n",
@@ -2539,5 +2987,7 @@ struct zbc_drv zbc_ata_drv = {
 	.zbd_report_realms	= zbc_ata_report_realms,
 	.zbd_zone_query_actv	= zbc_ata_zone_query_activate,
 	.zbd_get_stats		= zbc_ata_get_stats,
+	.zbd_submit_aio		= zbc_ata_submit_aio,
+	.zbd_reap_aio		= zbc_ata_reap_aio,
 };
 
@@ -0,0 +1,695 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc. All rights reserved.
+ * Copyright (C) 2016, Western Digital. All rights reserved.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@wdc.com)
+ */
+#define _GNU_SOURCE
+#include "zbc.h"
+#include "zbc_utils.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+
+#ifdef HAVE_LINUX_BLKZONED_H
+#include <linux/blkzoned.h>
+
+/**
+ * Number of zones reported with a single BLKREPORTZONE ioctl.
+ */
+#define ZBC_BLOCK_REPORT_NR_ZONES	8192
+
+/**
+ * Default maximum I/O size (in 512B sectors) if the kernel
+ * does not report one.
+ */
+#define ZBC_BLOCK_MAX_RW_SECTORS	1024
+
+/**
+ * Block device descriptor data.
+ */
+struct zbc_block_device {
+
+	struct zbc_device	dev;
+
+	/**
+	 * Zone size in 512B sectors and total number of zones.
+	 */
+	uint64_t		zone_sectors;
+	unsigned int		nr_zones;
+
+};
+
+/**
+ * Convert device address to block device address.
+ */
+static inline struct zbc_block_device *zbc_dev_to_block(struct zbc_device *dev)
+{
+	return container_of(dev, struct zbc_block_device, dev);
+}
+
+/**
+ * Get the kernel zone model of a block device. Returns -ENXIO if
+ * the device is not a zoned block device.
+ */
+static int zbc_block_get_model(struct zbc_device *dev)
+{
+	char zoned[32];
+	int ret;
+
+	ret = zbc_get_sysfs_queue_str(dev->zbd_filename, "zoned",
+				      zoned, sizeof(zoned));
+	if (ret != 0) {
+		zbc_debug("%s: No zoned attribute\n",
+			  dev->zbd_filename);
+		return -ENXIO;
+	}
+
+	if (strcmp(zoned, "host-managed") == 0) {
+		dev->zbd_info.zbd_model = ZBC_DM_HOST_MANAGED;
+	} else if (strcmp(zoned, "host-aware") == 0) {
+		dev->zbd_info.zbd_model = ZBC_DM_HOST_AWARE;
+	} else {
+		zbc_debug("%s: Not a zoned block device (%s)\n",
+			  dev->zbd_filename, zoned);
+		return -ENXIO;
+	}
+
+	return 0;
+}
+
+/**
+ * Get the vendor ID of a block device. Devices without a
+ * vendor (e.g. null_blk) get a generic ID.
+ */
+static void zbc_block_get_vendor_id(struct zbc_device *dev)
+{
+	struct zbc_device_info *di = &dev->zbd_info;
+	char vendor[9], model[17], rev[5];
+	char *name;
+
+	if (zbc_get_sysfs_device_str(dev->zbd_filename, "vendor",
+				     vendor, sizeof(vendor)) != 0 ||
+	    zbc_get_sysfs_device_str(dev->zbd_filename, "model",
+				     model, sizeof(model)) != 0) {
+		name = strrchr(dev->zbd_filename, '/');
+		snprintf(di->zbd_vendor_id, ZBC_DEVICE_INFO_LENGTH,
+			 "Linux %s", name ? name + 1 : dev->zbd_filename);
+		return;
+	}
+
+	if (zbc_get_sysfs_device_str(dev->zbd_filename, "rev",
+				     rev, sizeof(rev)) != 0)
+		rev[0] = '\0';
+
+	snprintf(di->zbd_vendor_id, ZBC_DEVICE_INFO_LENGTH,
+		 "%s %s %s", vendor, model, rev);
+}
+
+/**
+ * Get a block device zone configuration.
+ */
+static int zbc_block_get_zone_info(struct zbc_device *dev)
+{
+	struct zbc_block_device *bdev = zbc_dev_to_block(dev);
+	struct zbc_device_info *di = &dev->zbd_info;
+	unsigned long long val;
+	__u32 zone_sectors = 0, nr_zones = 0;
+
+	if (ioctl(dev->zbd_fd, BLKGETZONESZ, &zone_sectors) < 0 ||
+	    ioctl(dev->zbd_fd, BLKGETNRZONES, &nr_zones) < 0) {
+		zbc_error("%s: Get zone configuration failed %d (%s)\n",
+			  dev->zbd_filename, errno, strerror(errno));
+		return -errno;
+	}
+
+	if (!zone_sectors || !nr_zones) {
+		zbc_error("%s: Invalid zone configuration\n",
+			  dev->zbd_filename);
+		return -EIO;
+	}
+
+	bdev->zone_sectors = zone_sectors;
+	bdev->nr_zones = nr_zones;
+
+	/* Zone operations accept a range of zones */
+	di->zbd_flags |= ZBC_ZONE_OP_COUNT_SUPPORT;
+
+	di->zbd_opt_nr_open_seq_pref = ZBC_NOT_REPORTED;
+	di->zbd_opt_nr_non_seq_write_seq_pref = ZBC_NOT_REPORTED;
+	di->zbd_max_nr_open_seq_req = ZBC_NOT_REPORTED;
+	if (zbc_get_sysfs_queue_val_ull(dev->zbd_filename, "max_open_zones",
+					&val) == 0) {
+		if (di->zbd_model == ZBC_DM_HOST_MANAGED)
+			di->zbd_max_nr_open_seq_req = val ? val : ZBC_NO_LIMIT;
+		else if (val)
+			di->zbd_opt_nr_open_seq_pref = val;
+	}
+
+	return 0;
+}
+
+/**
+ * Get a block device capacity and I/O limits.
+ */
+static int zbc_block_get_capacity(struct zbc_device *dev)
+{
+	struct zbc_device_info *di = &dev->zbd_info;
+	unsigned long long max_kb = 0;
+	unsigned int pblock_size;
+	int lblock_size;
+	__u64 size;
+
+	if (ioctl(dev->zbd_fd, BLKSSZGET, &lblock_size) < 0 ||
+	    ioctl(dev->zbd_fd, BLKPBSZGET, &pblock_size) < 0 ||
+	    ioctl(dev->zbd_fd, BLKGETSIZE64, &size) < 0) {
+		zbc_error("%s: Get capacity failed %d (%s)\n",
+			  dev->zbd_filename, errno, strerror(errno));
+		return -errno;
+	}
+
+	if (lblock_size <= 0 || !pblock_size || !size) {
+		zbc_error("%s: Invalid capacity\n",
+			  dev->zbd_filename);
+		return -EIO;
+	}
+
+	di->zbd_lblock_size = lblock_size;
+	di->zbd_lblocks = size / lblock_size;
+	di->zbd_pblock_size = pblock_size;
+	di->zbd_pblocks = size / pblock_size;
+	di->zbd_sectors = size >> 9;
+
+	/* The kernel splits large I/Os, use the preferred maximum size */
+	if (zbc_get_sysfs_queue_val_ull(dev->zbd_filename, "max_sectors_kb",
+					&max_kb) != 0 || !max_kb)
+		di->zbd_max_rw_sectors = ZBC_BLOCK_MAX_RW_SECTORS;
+	else
+		di->zbd_max_rw_sectors = max_kb << 1;
+
+	return 0;
+}
+
+/**
+ * Test if a block device can also be accessed with SG_IO, that is,
+ * if the device has a SCSI device type.
+ */
+static bool zbc_block_has_sg(struct zbc_device *dev)
+{
+	unsigned long long type = ULLONG_MAX;
+
+	return zbc_get_sysfs_device_val_ull(dev->zbd_filename, "type",
+					    &type) == 0 &&
+		type != ULLONG_MAX;
+}
+
+/**
+ * Open a device.
+ */
+static int zbc_block_open(const char *filename,
+			  int flags, struct zbc_device **pdev)
+{
+	struct zbc_block_device *bdev;
+	struct zbc_device *dev;
+	struct stat st;
+	int fd, ret;
+
+	zbc_debug("%s: ########## Trying BLOCK driver ##########\n",
+		  filename);
+
+	/* Open the device file */
+	fd = open(filename, flags & ZBC_O_DMODE_MASK);
+	if (fd < 0) {
+		ret = -errno;
+		zbc_error("%s: Open device file failed %d (%s)\n",
+			  filename,
+			  errno, strerror(errno));
+		goto out;
+	}
+
+	/* Check device */
+	if (fstat(fd, &st) != 0) {
+		ret = -errno;
+		zbc_error("%s: Stat device file failed %d (%s)\n",
+			  filename,
+			  errno, strerror(errno));
+		goto out;
+	}
+
+	if (!S_ISBLK(st.st_mode)) {
+		ret = -ENXIO;
+		goto out;
+	}
+
+	/* Set device descriptor */
+	ret = -ENOMEM;
+	bdev = calloc(1, sizeof(struct zbc_block_device));
+	if (!bdev)
+		goto out;
+
+	dev = &bdev->dev;
+	dev->zbd_fd = fd;
+	dev->zbd_sg_fd = -1;
+	if (flags & O_DIRECT)
+		dev->zbd_o_flags |= ZBC_O_DIRECT;
+
+	dev->zbd_filename = strdup(filename);
+	if (!dev->zbd_filename)
+		goto out_free_dev;
+
+	ret = zbc_block_get_model(dev);
+	if (ret != 0)
+		goto out_free_filename;
+
+	/*
+	 * Unless this driver is explicitly requested, leave devices that
+	 * can be accessed with SG_IO to the SCSI and ATA drivers so that
+	 * detailed error information remains available.
+	 */
+	if (!(flags & ZBC_O_DRV_BLOCK) && zbc_block_has_sg(dev)) {
+		zbc_debug("%s: SG_IO capable device\n",
+			  filename);
+		ret = -ENXIO;
+		goto out_free_filename;
+	}
+
+	dev->zbd_info.zbd_type = ZBC_DT_BLOCK;
+	zbc_block_get_vendor_id(dev);
+
+	ret = zbc_block_get_capacity(dev);
+	if (ret != 0)
+		goto out_free_filename;
+
+	ret = zbc_block_get_zone_info(dev);
+	if (ret != 0)
+		goto out_free_filename;
+
+	*pdev = dev;
+
+	zbc_debug("%s: ########## BLOCK driver succeeded ##########\n\n",
+		  filename);
+
+	return 0;
+
+out_free_filename:
+	free(dev->zbd_filename);
+
+out_free_dev:
+	free(bdev);
+
+out:
+	if (fd >= 0)
+		close(fd);
+
+	zbc_debug("%s: ########## BLOCK driver failed %d ##########\n\n",
+		  filename,
+		  ret);
+
+	return ret;
+}
+
+/**
+ * Close a device.
+ */
+static int zbc_block_close(struct zbc_device *dev)
+{
+
+	if (close(dev->zbd_fd))
+		return -errno;
+
+	free(dev->zbd_filename);
+	free(zbc_dev_to_block(dev));
+
+	return 0;
+}
+
+/**
+ * Test if a zone must be reported with the reporting options @ro.
+ */
+static bool zbc_block_must_report(struct zbc_zone *zone,
+				  enum zbc_zone_reporting_options ro)
+{
+	switch (zbc_rz_ro_mask(ro)) {
+	case ZBC_RZ_RO_ALL:
+		return true;
+	case ZBC_RZ_RO_EMPTY:
+		return zone->zbz_condition == ZBC_ZC_EMPTY;
+	case ZBC_RZ_RO_IMP_OPEN:
+		return zone->zbz_condition == ZBC_ZC_IMP_OPEN;
+	case ZBC_RZ_RO_EXP_OPEN:
+		return zone->zbz_condition == ZBC_ZC_EXP_OPEN;
+	case ZBC_RZ_RO_CLOSED:
+		return zone->zbz_condition == ZBC_ZC_CLOSED;
+	case ZBC_RZ_RO_FULL:
+		return zone->zbz_condition == ZBC_ZC_FULL;
+	case ZBC_RZ_RO_RDONLY:
+		return zone->zbz_condition == ZBC_ZC_RDONLY;
+	case ZBC_RZ_RO_OFFLINE:
+		return zone->zbz_condition == ZBC_ZC_OFFLINE;
+	case ZBC_RZ_RO_INACTIVE:
+		return zone->zbz_condition == ZBC_ZC_INACTIVE;
+	case ZBC_RZ_RO_RWP_RECMND:
+		return zone->zbz_attributes & ZBC_ZA_RWP_RECOMMENDED;
+	case ZBC_RZ_RO_NON_SEQ:
+		return zone->zbz_attributes & ZBC_ZA_NON_SEQ;
+	case ZBC_RZ_RO_GAP:
+		return zone->zbz_type == ZBC_ZT_GAP;
+	case ZBC_RZ_RO_NOT_WP:
+		return zone->zbz_condition == ZBC_ZC_NOT_WP;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Convert a kernel zone descriptor. The kernel zone type and condition
+ * values are identical to the ZBC values. The zone capacity is set only
+ * if the kernel reports it and it is smaller than the zone length.
+ */
+static void zbc_block_convert_zone(struct blk_zone_report *rep,
+				   struct blk_zone *blkz,
+				   struct zbc_zone *zone)
+{
+	memset(zone, 0, sizeof(struct zbc_zone));
+	zone->zbz_start = blkz->start;
+	zone->zbz_length = blkz->len;
+	zone->zbz_write_pointer = blkz->wp;
+	zone->zbz_type = blkz->type;
+	zone->zbz_condition = blkz->cond;
+	if (blkz->reset)
+		zone->zbz_attributes |= ZBC_ZA_RWP_RECOMMENDED;
+	if (blkz->non_seq)
+		zone->zbz_attributes |= ZBC_ZA_NON_SEQ;
+#ifdef HAVE_STRUCT_BLK_ZONE_CAPACITY
+	if ((rep->flags & BLK_ZONE_REP_CAPACITY) &&
+	    blkz->capacity < blkz->len && blkz->capacity <= UINT32_MAX)
+		zone->zbz_capacity = blkz->capacity;
+#endif
+}
+
+/**
+ * Get a block device zone information.
+ */
+static int zbc_block_report_zones(struct zbc_device *dev, uint64_t sector,
+				  enum zbc_zone_reporting_options ro,
+				  struct zbc_zone *zones,
+				  unsigned int *nr_zones)
+{
+	struct zbc_block_device *bdev = zbc_dev_to_block(dev);
+	unsigned int max_zones = *nr_zones, nz = 0, i;
+	uint64_t end = dev->zbd_info.zbd_sectors;
+	struct blk_zone_report *rep;
+	struct zbc_zone zone;
+	size_t rep_size;
+	int ret = 0;
+
+	/* All zones count: no need to report anything */
+	if (!zones && zbc_rz_ro_mask(ro) == ZBC_RZ_RO_ALL) {
+		*nr_zones = bdev->nr_zones - sector / bdev->zone_sectors;
+		return 0;
+	}
+
+	rep_size = sizeof(struct blk_zone_report) +
+		sizeof(struct blk_zone) * ZBC_BLOCK_REPORT_NR_ZONES;
+	rep = malloc(rep_size);
+	if (!rep)
+		return -ENOMEM;
+
+	while (sector < end && (!zones || nz < max_zones)) {
+
+		memset(rep, 0, rep_size);
+		rep->sector = sector;
+		rep->nr_zones = ZBC_BLOCK_REPORT_NR_ZONES;
+		if (ioctl(dev->zbd_fd, BLKREPORTZONE, rep) < 0) {
+			ret = -errno;
+			zbc_error("%s: BLKREPORTZONE at sector %llu failed %d (%s)\n",
+				  dev->zbd_filename,
+				  (unsigned long long)sector,
+				  errno, strerror(errno));
+			goto out;
+		}
+
+		if (!rep->nr_zones)
+			break;
+
+		for (i = 0; i < rep->nr_zones; i++) {
+			zbc_block_convert_zone(rep, &rep->zones[i], &zone);
+			if (!zbc_block_must_report(&zone, ro))
+				continue;
+			if (zones) {
+				if (nz >= max_zones)
+					break;
+				memcpy(&zones[nz], &zone,
+				       sizeof(struct zbc_zone));
+			}
+			nz++;
+		}
+
+		i = rep->nr_zones - 1;
+		sector = rep->zones[i].start + rep->zones[i].len;
+	}
+
+	*nr_zones = nz;
+
+out:
+	free(rep);
+
+	return ret;
+}
+
+/**
+ * Execute an operation on a range of zones.
+ */
+static int zbc_block_zone_range_op(struct zbc_device *dev, uint64_t sector,
+				   uint64_t nr_sectors, enum zbc_zone_op op)
+{
+	struct blk_zone_range range;
+	unsigned long cmd;
+
+	switch (op) {
+	case ZBC_OP_RESET_ZONE:
+		cmd = BLKRESETZONE;
+		break;
+#ifdef BLKOPENZONE
+	case ZBC_OP_OPEN_ZONE:
+		cmd = BLKOPENZONE;
+		break;
+	case ZBC_OP_CLOSE_ZONE:
+		cmd = BLKCLOSEZONE;
+		break;
+	case ZBC_OP_FINISH_ZONE:
+		cmd = BLKFINISHZONE;
+		break;
+#endif
+	default:
+		zbc_error("%s: Zone operation 0x%x not supported\n",
+			  dev->zbd_filename, op);
+		return -EOPNOTSUPP;
+	}
+
+	range.sector = sector;
+	range.nr_sectors = nr_sectors;
+	if (ioctl(dev->zbd_fd, cmd, &range) < 0) {
+		zbc_error("%s: Zone operation 0x%x on sectors %llu+%llu failed %d (%s)\n",
+			  dev->zbd_filename, op,
+			  (unsigned long long)sector,
+			  (unsigned long long)nr_sectors,
+			  errno, strerror(errno));
+		return -errno;
+	}
+
+	return 0;
+}
+
+/**
+ * Test if an operation on all zones applies to a zone, following
+ * the ZBC semantic of the ALL bit.
+ */
+static bool zbc_block_all_op_applies(struct zbc_zone *zone,
+				     enum zbc_zone_op op)
+{
+	switch (op) {
+	case ZBC_OP_OPEN_ZONE:
+		return zbc_zone_closed(zone);
+	case ZBC_OP_CLOSE_ZONE:
+		return zbc_zone_is_open(zone);
+	case ZBC_OP_FINISH_ZONE:
+		return zbc_zone_is_open(zone) || zbc_zone_closed(zone);
+	default:
+		return false;
+	}
+}
+
+/**
+ * Execute an operation on all zones. The kernel resets all zones with
+ * a single command, other operations are applied zone by zone.
+ */
+static int zbc_block_all_zones_op(struct zbc_device *dev, enum zbc_zone_op op)
+{
+	struct zbc_zone *zones;
+	unsigned int nr_zones, i;
+	int ret;
+
+	if (op == ZBC_OP_RESET_ZONE)
+		return zbc_block_zone_range_op(dev, 0, dev->zbd_info.zbd_sectors,
+					       op);
+
+	ret = zbc_list_zones(dev, 0, ZBC_RZ_RO_ALL, &zones, &nr_zones);
+	if (ret != 0)
+		return ret;
+
+	for (i = 0; i < nr_zones; i++) {
+		if (!zbc_block_all_op_applies(&zones[i], op))
+			continue;
+		ret = zbc_block_zone_range_op(dev, zones[i].zbz_start,
+					      zones[i].zbz_length, op);
+		if (ret != 0)
+			break;
+	}
+
+	free(zones);
+
+	return ret;
+}
+
+/**
+ * Execute an operation on a zone.
+ */
+static int zbc_block_zone_op(struct zbc_device *dev, uint64_t sector,
+			     unsigned int count, enum zbc_zone_op op,
+			     unsigned int flags)
+{
+	struct zbc_block_device *bdev = zbc_dev_to_block(dev);
+	uint64_t nr_sectors;
+
+	if (flags & ZBC_OP_ALL_ZONES)
+		return zbc_block_all_zones_op(dev, op);
+
+	if (!count)
+		count = 1;
+
+	/* The last zone of the device may be smaller */
+	nr_sectors = (uint64_t)count * bdev->zone_sectors;
+	if (sector + nr_sectors > dev->zbd_info.zbd_sectors)
+		nr_sectors = dev->zbd_info.zbd_sectors - sector;
+
+	return zbc_block_zone_range_op(dev, sector, nr_sectors, op);
+}
+
+/**
+ * Read from a block device.
+ */
+static ssize_t zbc_block_preadv(struct zbc_device *dev,
+				const struct iovec *iov, int iovcnt,
+				uint64_t offset)
+{
+	ssize_t ret;
+
+	ret = preadv(dev->zbd_fd, iov, iovcnt, offset << 9);
+	if (ret < 0)
+		return -errno;
+
+	return ret >> 9;
+}
+
+/**
+ * Write to a block device.
+ */
+static ssize_t zbc_block_pwritev(struct zbc_device *dev,
+				 const struct iovec *iov, int iovcnt,
+				 uint64_t offset)
+{
+	ssize_t ret;
+
+	ret = pwritev(dev->zbd_fd, iov, iovcnt, offset << 9);
+	if (ret < 0)
+		return -errno;
+
+	return ret >> 9;
+}
+
+/**
+ * Flush a block device write cache.
+ */
+static int zbc_block_flush(struct zbc_device *dev)
+{
+	if (fsync(dev->zbd_fd) < 0)
+		return -errno;
+
+	return 0;
+}
+
+#else /* HAVE_LINUX_BLKZONED_H */
+
+static int zbc_block_open(const char *filename,
+			  int flags, struct zbc_device **pdev)
+{
+	return -ENXIO;
+}
+
+static int zbc_block_close(struct zbc_device *dev)
+{
+	return -EOPNOTSUPP;
+}
+
+static int zbc_block_report_zones(struct zbc_device *dev, uint64_t sector,
+				  enum zbc_zone_reporting_options ro,
+				  struct zbc_zone *zones,
+				  unsigned int *nr_zones)
+{
+	return -EOPNOTSUPP;
+}
+
+static int zbc_block_zone_op(struct zbc_device *dev, uint64_t sector,
+			     unsigned int count, enum zbc_zone_op op,
+			     unsigned int flags)
+{
+	return -EOPNOTSUPP;
+}
+
+static ssize_t zbc_block_preadv(struct zbc_device *dev,
+				const struct iovec *iov, int iovcnt,
+				uint64_t offset)
+{
+	return -EOPNOTSUPP;
+}
+
+static ssize_t zbc_block_pwritev(struct zbc_device *dev,
+				 const struct iovec *iov, int iovcnt,
+				 uint64_t offset)
+{
+	return -EOPNOTSUPP;
+}
+
+static int zbc_block_flush(struct zbc_device *dev)
+{
+	return -EOPNOTSUPP;
+}
+
+#endif /* HAVE_LINUX_BLKZONED_H */
+
+/**
+ * Zoned block device driver definition.
+ */
+struct zbc_drv zbc_block_drv = {
+	.flag			= ZBC_O_DRV_BLOCK,
+	.zbd_open		= zbc_block_open,
+	.zbd_close		= zbc_block_close,
+	.zbd_preadv		= zbc_block_preadv,
+	.zbd_pwritev		= zbc_block_pwritev,
+	.zbd_flush		= zbc_block_flush,
+	.zbd_report_zones	= zbc_block_report_zones,
+	.zbd_zone_op		= zbc_block_zone_op,
+};
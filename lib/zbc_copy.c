@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ *
+ * Pipelined copy of sectors between devices.
+ */
+#include "zbc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Copy I/O: an asynchronous read or write of one of the copy buffers.
+ */
+struct zbc_copy_io {
+	struct zbc_aio		aio;
+	bool			busy;
+};
+
+/**
+ * Reap one asynchronous I/O of a device, waiting for it if needed.
+ */
+static int zbc_copy_reap_one(struct zbc_device *dev)
+{
+	struct zbc_copy_io *io;
+	struct zbc_aio *aio;
+	int ret;
+
+	ret = zbc_aio_reap(dev, &aio, true);
+	if (ret != 0)
+		return ret;
+
+	io = aio->zio_private;
+	io->busy = false;
+
+	return 0;
+}
+
+/**
+ * Wait for the two copy I/Os @io of a device. Return false if the device
+ * keeps failing to complete them.
+ */
+static bool zbc_copy_drain(struct zbc_device *dev, struct zbc_copy_io *io)
+{
+	unsigned int nr_retries = 0;
+	int ret;
+
+	while (io[0].busy || io[1].busy) {
+		ret = zbc_copy_reap_one(dev);
+		if (!ret) {
+			nr_retries = 0;
+			continue;
+		}
+		if (ret == -ENOENT) {
+			/* Nothing in flight */
+			io[0].busy = false;
+			io[1].busy = false;
+			break;
+		}
+		if (ret != -EINTR && ret != -EAGAIN &&
+		    ++nr_retries >= ZBC_MAX_REAP_RETRIES)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Submit a copy I/O. If the device queue is full, wait for
+ * an I/O completion first.
+ */
+static int zbc_copy_submit(struct zbc_device *dev, struct zbc_copy_io *io,
+			   void *buf, size_t count, uint64_t sector, bool write)
+{
+	int ret;
+
+	io->aio.zio_buf = buf;
+	io->aio.zio_count = count;
+	io->aio.zio_offset = sector;
+	io->aio.zio_write = write;
+	io->aio.zio_ret = 0;
+	io->aio.zio_private = io;
+
+	while ((ret = zbc_aio_submit(dev, &io->aio)) == -EAGAIN) {
+		ret = zbc_copy_reap_one(dev);
+		if (ret != 0)
+			return ret;
+	}
+
+	if (ret == 0)
+		io->busy = true;
+
+	return ret;
+}
+
+/**
+ * Wait for the completion of a copy I/O.
+ */
+static int zbc_copy_wait(struct zbc_device *dev, struct zbc_copy_io *io)
+{
+	int ret;
+
+	while (io->busy) {
+		ret = zbc_copy_reap_one(dev);
+		if (ret != 0)
+			return ret;
+	}
+
+	if (io->aio.zio_ret < 0)
+		return io->aio.zio_ret;
+	if ((size_t)io->aio.zio_ret != io->aio.zio_count)
+		return -EIO;
+
+	return 0;
+}
+
+/**
+ * Copy @count sectors from @src_sector of @src to @dst_sector of @dst
+ * using the two buffers @bufs of @io_sectors sectors each. The I/Os are
+ * issued with zbc_aio_submit() so that the read of a chunk is executed
+ * while the previous chunk is written, but only with devices supporting
+ * asynchronous I/Os (ATA devices open with ZBC_O_NCQ): with other devices,
+ * the I/Os are executed synchronously one after the other. The devices
+ * must not have other asynchronous I/Os in flight. @src and @dst may be
+ * the same device.
+ */
+int zbc_copy_sectors(struct zbc_device *src, uint64_t src_sector,
+		     struct zbc_device *dst, uint64_t dst_sector,
+		     uint64_t count, size_t io_sectors, void *bufs[2])
+{
+	struct zbc_copy_io *io, *rd, *wr;
+	uint64_t nr_chunks, k;
+	size_t len[2];
+	unsigned int b, nb, i;
+	int ret;
+
+	if (!count)
+		return 0;
+
+	/*
+	 * The I/Os are not on the stack so that they can be abandoned if
+	 * the devices fail to complete them.
+	 */
+	io = calloc(4, sizeof(struct zbc_copy_io));
+	if (!io)
+		return -ENOMEM;
+	rd = &io[0];
+	wr = &io[2];
+	nr_chunks = (count + io_sectors - 1) / io_sectors;
+
+	len[0] = count < io_sectors ? count : io_sectors;
+	ret = zbc_copy_submit(src, &rd[0], bufs[0], len[0], src_sector, false);
+	if (ret != 0)
+		goto drain;
+
+	for (k = 0; k < nr_chunks; k++) {
+		b = k % 2;
+		nb = (k + 1) % 2;
+
+		ret = zbc_copy_wait(src, &rd[b]);
+		if (ret != 0)
+			goto drain;
+
+		/* Read the next chunk once its buffer is written */
+		if (k + 1 < nr_chunks) {
+			if (k) {
+				ret = zbc_copy_wait(dst, &wr[nb]);
+				if (ret != 0)
+					goto drain;
+			}
+			len[nb] = count - (k + 1) * io_sectors;
+			if (len[nb] > io_sectors)
+				len[nb] = io_sectors;
+			ret = zbc_copy_submit(src, &rd[nb], bufs[nb], len[nb],
+					      src_sector + (k + 1) * io_sectors,
+					      false);
+			if (ret != 0)
+				goto drain;
+		}
+
+		ret = zbc_copy_submit(dst, &wr[b], bufs[b], len[b],
+				      dst_sector + k * io_sectors, true);
+		if (ret != 0)
+			goto drain;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (wr[i].aio.zio_count) {
+			ret = zbc_copy_wait(dst, &wr[i]);
+			if (ret != 0)
+				goto drain;
+		}
+	}
+
+drain:
+	/* Buffers are owned by the caller: wait for all I/Os in flight */
+	if (!zbc_copy_drain(src, rd) || !zbc_copy_drain(dst, wr)) {
+		zbc_error("Copy %s -> %s: Abandoning I/Os in flight\n",
+			  src->zbd_filename, dst->zbd_filename);
+		return ret ? ret : -EIO;
+	}
+
+	free(io);
+
+	return ret;
+}
+
+/**
+ * Allocate the two copy buffers for I/Os of @io_sectors sectors.
+ */
+int zbc_copy_alloc_bufs(size_t io_sectors, void *bufs[2])
+{
+	int i, ret;
+
+	for (i = 0; i < 2; i++) {
+		ret = posix_memalign(&bufs[i], PAGE_SIZE, io_sectors << 9);
+		if (ret != 0) {
+			if (i)
+				free(bufs[0]);
+			return -ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Free the copy buffers.
+ */
+void zbc_copy_free_bufs(void *bufs[2])
+{
+	free(bufs[0]);
+	free(bufs[1]);
+}
+
+/**
+ * Get the zone starting at @sector.
+ */
+static int zbc_copy_get_zone(struct zbc_device *dev, uint64_t sector,
+			     struct zbc_zone *zone)
+{
+	unsigned int nr_zones = 1;
+	int ret;
+
+	ret = zbc_report_zones(dev, sector, ZBC_RZ_RO_ALL, zone, &nr_zones);
+	if (ret != 0)
+		return ret;
+
+	if (!nr_zones || zbc_zone_start(zone) != sector) {
+		zbc_error("%s: Sector %llu is not the start of a zone\n",
+			  dev->zbd_filename, (unsigned long long)sector);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * zbc_copy_zone - Copy the data of a zone to another zone
+ */
+int zbc_copy_zone(struct zbc_device *src, uint64_t src_sector,
+		  struct zbc_device *dst, uint64_t dst_sector,
+		  uint64_t *nr_sectors)
+{
+	struct zbc_zone szone, dzone;
+	uint64_t count;
+	size_t io_sectors;
+	void *bufs[2];
+	int ret;
+
+	if (nr_sectors)
+		*nr_sectors = 0;
+
+	/* Copy I/Os are reaped with zbc_aio_reap */
+	if (zbc_aio_nr_inflight(src) || zbc_aio_nr_inflight(dst))
+		return -EBUSY;
+
+	ret = zbc_copy_get_zone(src, src_sector, &szone);
+	if (ret != 0)
+		return ret;
+	ret = zbc_copy_get_zone(dst, dst_sector, &dzone);
+	if (ret != 0)
+		return ret;
+
+	if (zbc_zone_offline(&szone) || zbc_zone_inactive(&szone) ||
+	    zbc_zone_offline(&dzone) || zbc_zone_inactive(&dzone) ||
+	    zbc_zone_rdonly(&dzone)) {
+		zbc_error("Zone copy %s:%llu -> %s:%llu: unusable zone\n",
+			  src->zbd_filename, (unsigned long long)src_sector,
+			  dst->zbd_filename, (unsigned long long)dst_sector);
+		return -EINVAL;
+	}
+
+	if (zbc_zone_sequential(&dzone) && !zbc_zone_empty(&dzone)) {
+		zbc_error("%s: Destination zone %llu is not empty\n",
+			  dst->zbd_filename, (unsigned long long)dst_sector);
+		return -EINVAL;
+	}
+
+	/* Copy up to the source zone write pointer */
+	if (zbc_zone_sequential(&szone) && !zbc_zone_full(&szone))
+		count = zbc_zone_wp(&szone) - zbc_zone_start(&szone);
+	else
+		count = zbc_zone_capacity(&szone);
+
+	if (count > zbc_zone_capacity(&dzone) ||
+	    (count << 9) % dst->zbd_info.zbd_lblock_size) {
+		zbc_error("%s: Cannot copy %llu sectors to zone %llu\n",
+			  dst->zbd_filename, (unsigned long long)count,
+			  (unsigned long long)dst_sector);
+		return -EINVAL;
+	}
+
+	if (!count)
+		return 0;
+
+	io_sectors = src->zbd_info.zbd_max_rw_sectors;
+	if (io_sectors > dst->zbd_info.zbd_max_rw_sectors)
+		io_sectors = dst->zbd_info.zbd_max_rw_sectors;
+
+	ret = zbc_copy_alloc_bufs(io_sectors, bufs);
+	if (ret != 0)
+		return ret;
+
+	ret = zbc_copy_sectors(src, src_sector, dst, dst_sector,
+			       count, io_sectors, bufs);
+
+	zbc_copy_free_bufs(bufs);
+
+	if (ret != 0) {
+		zbc_error("Zone copy %s:%llu -> %s:%llu failed %d (%s)\n",
+			  src->zbd_filename, (unsigned long long)src_sector,
+			  dst->zbd_filename, (unsigned long long)dst_sector,
+			  ret, strerror(-ret));
+		return ret;
+	}
+
+	/* Leave the destination zone in the source zone condition */
+	if (zbc_zone_sequential(&dzone) && count < zbc_zone_capacity(&dzone)) {
+		if (zbc_zone_full(&szone))
+			ret = zbc_finish_zone(dst, dst_sector, 0);
+		else
+			ret = zbc_close_zone(dst, dst_sector, 0);
+		if (ret != 0)
+			return ret;
+	}
+
+	if (nr_sectors)
+		*nr_sectors = count;
+
+	return 0;
+}
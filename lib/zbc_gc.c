@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ *
+ * Garbage collection of the zones of a zone allocator.
+ */
+#include "zbc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Maximum size of a relocated extent in number of copy I/Os: longer live
+ * extents are split so that little space is lost at the end of the
+ * destination zones.
+ */
+#define ZBC_GC_EXTENT_IOS	8
+
+/**
+ * Garbage collection victim zone.
+ */
+struct zbc_gc_victim {
+	unsigned int		idx;
+	uint64_t		start;
+	uint64_t		written;
+	double			score;
+};
+
+static unsigned long long zbc_gc_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline bool zbc_gc_block_live(struct zbc_gc_params *params,
+				     uint64_t block)
+{
+	if (params->zgp_live_map)
+		return (params->zgp_live_map[block / 64] >> (block % 64)) & 1;
+
+	return params->zgp_live(block * params->zgp_block_sectors,
+				params->zgp_data);
+}
+
+/**
+ * Count the live blocks in the range [@first, @last).
+ */
+static uint64_t zbc_gc_count_live(struct zbc_gc_params *params,
+				  uint64_t first, uint64_t last)
+{
+	const uint64_t *map = params->zgp_live_map;
+	uint64_t b = first, nr_live = 0;
+
+	if (!map) {
+		for (; b < last; b++)
+			nr_live += zbc_gc_block_live(params, b);
+		return nr_live;
+	}
+
+	/* Count whole bitmap words at once */
+	for (; b < last && (b % 64); b++)
+		nr_live += zbc_gc_block_live(params, b);
+	for (; b + 64 <= last; b += 64)
+		nr_live += __builtin_popcountll(map[b / 64]);
+	for (; b < last; b++)
+		nr_live += zbc_gc_block_live(params, b);
+
+	return nr_live;
+}
+
+/**
+ * Test if a zone is an active zone of a stream.
+ */
+static bool zbc_gc_zone_active(struct zbc_zone_allocator *za,
+			       unsigned int idx)
+{
+	unsigned int s, i;
+
+	for (s = 0; s < ZBC_NR_STREAMS; s++) {
+		for (i = 0; i < za->nr_active; i++) {
+			if (za->slots[s][i].valid && za->slots[s][i].idx == idx)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Get the age of a zone if it can be garbage collected, 0 otherwise,
+ * and the number of sectors allocated in the zone.
+ */
+static uint64_t zbc_gc_zone_age(struct zbc_zone_allocator *za,
+				unsigned int idx, uint64_t *written)
+{
+	uint64_t age = 0;
+
+	pthread_mutex_lock(&za->lock);
+
+	if (zbc_alloc_is_free(za, idx) ||
+	    (za->stream[idx] != ZBC_ALLOC_NO_STREAM &&
+	     (za->stream[idx] & ZBC_ALLOC_EXCLUSIVE)) ||
+	    zbc_gc_zone_active(za, idx))
+		goto out;
+
+	age = za->clock - za->mtime[idx] + 1;
+	*written = za->used[idx];
+
+out:
+	pthread_mutex_unlock(&za->lock);
+
+	return age;
+}
+
+/**
+ * Add a candidate to the victims, sorted in decreasing score order.
+ */
+static void zbc_gc_add_victim(struct zbc_gc_victim *victims,
+			      unsigned int *nr_victims,
+			      unsigned int max_victims,
+			      struct zbc_gc_victim *v)
+{
+	unsigned int i = *nr_victims;
+
+	if (i == max_victims) {
+		if (v->score <= victims[i - 1].score)
+			return;
+		i--;
+	} else {
+		(*nr_victims)++;
+	}
+
+	while (i > 0 && victims[i - 1].score < v->score) {
+		victims[i] = victims[i - 1];
+		i--;
+	}
+	victims[i] = *v;
+}
+
+/**
+ * Select the victims with the cost-benefit policy. The zones state is
+ * taken from the allocator so that the zones are not reported.
+ */
+static int zbc_gc_select(struct zbc_zone_allocator *za,
+			 struct zbc_gc_params *params,
+			 struct zbc_gc_victim *victims,
+			 unsigned int max_victims)
+{
+	uint64_t bs = params->zgp_block_sectors;
+	unsigned int nr_victims = 0, i;
+	struct zbc_gc_victim v;
+	uint64_t age, live;
+	double u;
+
+	for (i = 0; i < za->nr_zones; i++) {
+		age = zbc_gc_zone_age(za, i, &v.written);
+		if (!age || !v.written)
+			continue;
+
+		v.idx = i;
+		v.start = za->zones[i].zbz_start;
+		live = zbc_gc_count_live(params, v.start / bs,
+				(v.start + v.written + bs - 1) / bs) * bs;
+		if (live >= v.written)
+			continue;
+
+		u = (double)live / v.written;
+		v.score = (1.0 - u) * age / (1.0 + u);
+		zbc_gc_add_victim(victims, &nr_victims, max_victims, &v);
+	}
+
+	return nr_victims;
+}
+
+/**
+ * Copy the live data of a victim zone.
+ */
+static int zbc_gc_copy_zone(struct zbc_zone_allocator *za,
+			    struct zbc_gc_params *params,
+			    struct zbc_gc_victim *v,
+			    size_t io_sectors, void *bufs[2])
+{
+	uint64_t bs = params->zgp_block_sectors;
+	uint64_t end = v->start + v->written;
+	uint64_t max_len = io_sectors * ZBC_GC_EXTENT_IOS;
+	uint64_t sector = v->start, src, dst, len;
+	unsigned long long t;
+	int ret;
+
+	while (sector < end) {
+
+		/* Find the next extent of live blocks */
+		if (!zbc_gc_block_live(params, sector / bs)) {
+			sector += bs;
+			continue;
+		}
+		src = sector;
+		while (sector < end && sector - src < max_len &&
+		       zbc_gc_block_live(params, sector / bs))
+			sector += bs;
+		len = (sector < end ? sector : end) - src;
+
+		ret = zbc_alloc_sectors(za, params->zgp_stream, len, &dst);
+		if (ret != 0)
+			return ret;
+
+		t = zbc_gc_time_ns();
+		ret = zbc_copy_sectors(za->dev, src, za->dev, dst, len,
+				       io_sectors, bufs);
+		if (ret != 0) {
+			zbc_error("%s: Copy %llu sectors from %llu to %llu failed %d (%s)\n",
+				  za->dev->zbd_filename,
+				  (unsigned long long)len,
+				  (unsigned long long)src,
+				  (unsigned long long)dst,
+				  ret, strerror(-ret));
+			return ret;
+		}
+		t = zbc_gc_time_ns() - t;
+
+		pthread_mutex_lock(&za->lock);
+		za->gc_stats.zgs_sectors_copied += len;
+		za->gc_stats.zgs_copy_ns += t;
+		pthread_mutex_unlock(&za->lock);
+
+		if (params->zgp_moved)
+			params->zgp_moved(src, dst, len, params->zgp_data);
+	}
+
+	return 0;
+}
+
+static int zbc_gc_victim_cmp(const void *a, const void *b)
+{
+	const struct zbc_gc_victim *va = a, *vb = b;
+
+	if (va->start < vb->start)
+		return -1;
+	return va->start > vb->start;
+}
+
+/**
+ * Flush the relocated data and reset a batch of victims, using a single
+ * zone operation for contiguous victims.
+ */
+static int zbc_gc_reclaim(struct zbc_zone_allocator *za,
+			  struct zbc_gc_victim *victims,
+			  unsigned int nr_victims)
+{
+	struct zbc_zone *z;
+	unsigned int i, j;
+	int ret;
+
+	ret = zbc_flush(za->dev);
+	if (ret != 0)
+		return ret;
+
+	qsort(victims, nr_victims, sizeof(struct zbc_gc_victim),
+	      zbc_gc_victim_cmp);
+
+	for (i = 0; i < nr_victims; i = j) {
+		for (j = i + 1; j < nr_victims; j++) {
+			z = &za->zones[victims[j - 1].idx];
+			if (victims[j].start != z->zbz_start + z->zbz_length)
+				break;
+		}
+
+		ret = zbc_zone_group_op(za->dev, victims[i].start, j - i,
+					ZBC_OP_RESET_ZONE, 0);
+		if (ret != 0)
+			return ret;
+
+		pthread_mutex_lock(&za->lock);
+		za->gc_stats.zgs_zones_reclaimed += j - i;
+		for (; i < j; i++)
+			zbc_alloc_put_free(za, victims[i].idx);
+		pthread_mutex_unlock(&za->lock);
+	}
+
+	return 0;
+}
+
+/**
+ * zbc_gc - Reclaim zones of a zone allocator
+ */
+int zbc_gc(struct zbc_zone_allocator *za, struct zbc_gc_params *params)
+{
+	struct zbc_device *dev = za->dev;
+	struct zbc_gc_victim *victims;
+	unsigned int max_victims, batch, first = 0, i;
+	size_t io_sectors;
+	void *bufs[2];
+	int nr_victims, ret;
+
+	if (!params || !params->zgp_block_sectors ||
+	    (!params->zgp_live_map && !params->zgp_live) ||
+	    params->zgp_stream >= ZBC_NR_STREAMS)
+		return -EINVAL;
+
+	/* Copy I/Os are reaped with zbc_aio_reap */
+	if (zbc_aio_nr_inflight(dev))
+		return -EBUSY;
+
+	io_sectors = params->zgp_io_sectors;
+	if (!io_sectors || io_sectors > dev->zbd_info.zbd_max_rw_sectors)
+		io_sectors = dev->zbd_info.zbd_max_rw_sectors;
+	io_sectors -= io_sectors % params->zgp_block_sectors;
+	if (!io_sectors)
+		return -EINVAL;
+
+	max_victims = params->zgp_nr_victims;
+	if (!max_victims)
+		max_victims = 1;
+	batch = params->zgp_reset_batch;
+	if (!batch || batch > max_victims)
+		batch = max_victims;
+
+	victims = calloc(max_victims, sizeof(struct zbc_gc_victim));
+	if (!victims)
+		return -ENOMEM;
+
+	nr_victims = zbc_gc_select(za, params, victims, max_victims);
+	if (nr_victims <= 0) {
+		ret = nr_victims;
+		goto out;
+	}
+
+	ret = zbc_copy_alloc_bufs(io_sectors, bufs);
+	if (ret != 0)
+		goto out;
+
+	for (i = 0; i < (unsigned int)nr_victims; i++) {
+		ret = zbc_gc_copy_zone(za, params, &victims[i],
+				       io_sectors, bufs);
+		if (ret != 0)
+			break;
+
+		if (i + 1 - first == batch || i + 1 == (unsigned int)nr_victims) {
+			ret = zbc_gc_reclaim(za, &victims[first], i + 1 - first);
+			if (ret != 0)
+				break;
+			first = i + 1;
+		}
+	}
+
+	zbc_copy_free_bufs(bufs);
+
+	if (ret == 0) {
+		zbc_debug("%s: Garbage collection reclaimed %d zones\n",
+			  dev->zbd_filename, nr_victims);
+		ret = nr_victims;
+	}
+
+out:
+	pthread_mutex_lock(&za->lock);
+	za->gc_stats.zgs_passes++;
+	pthread_mutex_unlock(&za->lock);
+
+	free(victims);
+
+	return ret;
+}
+
+/**
+ * zbc_gc_get_stats - Get the garbage collection statistics of an allocator
+ */
+void zbc_gc_get_stats(struct zbc_zone_allocator *za,
+		      struct zbc_gc_stats *stats)
+{
+	pthread_mutex_lock(&za->lock);
+	*stats = za->gc_stats;
+	stats->zgs_user_sectors =
+		za->nr_alloc_sectors - za->gc_stats.zgs_sectors_copied;
+	pthread_mutex_unlock(&za->lock);
+}
@@ -0,0 +1,1070 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ *
+ * Zone write plugging: at most one write in flight per sequential
+ * write required zone, and open zone management.
+ */
+#include "zbc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/**
+ * Write waiting for a zone write plug.
+ */
+struct zbc_plugged_aio {
+	struct zbc_aio		*aio;
+	unsigned long long	ts;
+};
+
+/**
+ * FIFO of plugged asynchronous writes.
+ */
+struct zbc_aio_fifo {
+	struct zbc_plugged_aio	*ent;
+	unsigned int		head;
+	unsigned int		nr;
+	unsigned int		size;
+};
+
+/**
+ * Zone write plug. Plugs are created on the first write to a zone and
+ * are kept until the zone configuration changes. Writes are serialized
+ * only for sequential write required zones (seq is true). With the open
+ * zone manager enabled, the write pointer and open condition of the
+ * zone are also tracked, and open zones are linked in LRU order.
+ */
+struct zbc_zone_plug {
+	uint64_t		start;
+	uint64_t		length;
+	uint64_t		capacity;
+	uint64_t		wp;
+	uint8_t			type;
+	bool			seq;
+	bool			busy;
+	bool			open;
+	bool			non_seq;
+	unsigned int		waiters;
+	struct zbc_aio_fifo	aios;
+
+	struct zbc_zone_plug	*lru_prev;
+	struct zbc_zone_plug	*lru_next;
+};
+
+/**
+ * Zone write plugs of a device, indexed by zone number in a table of the
+ * device zones. The table is built on first use, outside of the plugs
+ * lock, and its zone conditions and write pointers are used to
+ * initialize plugs as long as they are current (zt_cur is true). When
+ * they are not, plugs are initialized with a REPORT ZONES of their zone,
+ * also done without the plugs lock held. If the zone layout may have
+ * changed (zt_stale is true), the table is rebuilt once no plug is left.
+ * Asynchronous writes that failed when dispatched from a plug are kept
+ * until reaped.
+ */
+struct zbc_zone_plugs {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+
+	struct zbc_zone_table	*zt;
+	bool			zt_cur;
+	bool			zt_stale;
+
+	struct zbc_zone_plug	**plugs;
+	unsigned int		nr_plugs;
+
+	struct zbc_aio_fifo	failed;
+
+	/*
+	 * Writes must be serialized for sequential write required zones
+	 * when asynchronous I/Os use queued commands.
+	 */
+	bool			serialize;
+
+	/* Open zone manager: open zones, most recently written first */
+	bool			mgr;
+	unsigned int		max_open;
+	unsigned int		max_non_seq;
+	unsigned int		nr_non_seq;
+	struct zbc_zone_plug	*lru_head;
+	struct zbc_zone_plug	*lru_tail;
+};
+
+static unsigned long long zbc_plug_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int zbc_aio_fifo_push(struct zbc_aio_fifo *f, struct zbc_aio *aio,
+			     unsigned long long ts)
+{
+	struct zbc_plugged_aio *ent;
+	unsigned int i, size;
+
+	if (f->nr == f->size) {
+		size = f->size ? f->size * 2 : 8;
+		ent = calloc(size, sizeof(struct zbc_plugged_aio));
+		if (!ent)
+			return -ENOMEM;
+		for (i = 0; i < f->nr; i++)
+			ent[i] = f->ent[(f->head + i) % f->size];
+		free(f->ent);
+		f->ent = ent;
+		f->head = 0;
+		f->size = size;
+	}
+
+	ent = &f->ent[(f->head + f->nr) % f->size];
+	ent->aio = aio;
+	ent->ts = ts;
+	f->nr++;
+
+	return 0;
+}
+
+static struct zbc_aio *zbc_aio_fifo_pop(struct zbc_aio_fifo *f,
+					unsigned long long *ts)
+{
+	struct zbc_plugged_aio *ent;
+
+	if (!f->nr)
+		return NULL;
+
+	ent = &f->ent[f->head];
+	f->head = (f->head + 1) % f->size;
+	f->nr--;
+	if (ts)
+		*ts = ent->ts;
+
+	return ent->aio;
+}
+
+/**
+ * Initialize the zone write plugs of a device. Plugs are disabled in test
+ * mode to keep the commands sent to the device unchanged. Writes are only
+ * serialized for devices with sequential write required zones and if
+ * asynchronous I/Os are executed with queued commands: otherwise, writes
+ * are executed synchronously by the submitter and synchronous writes do
+ * not pay for the plugs lock and the zone table built on first use.
+ */
+int zbc_init_zone_plugs(struct zbc_device *dev)
+{
+	struct zbc_zone_plugs *zp;
+
+	if (zbc_test_mode(dev) || !zbc_dev_is_zoned(dev))
+		return 0;
+
+	zp = calloc(1, sizeof(struct zbc_zone_plugs));
+	if (!zp)
+		return -ENOMEM;
+
+	pthread_mutex_init(&zp->lock, NULL);
+	pthread_cond_init(&zp->cond, NULL);
+	zp->serialize = dev->zbd_aio_qd &&
+		(zbc_dev_model(dev) == ZBC_DM_HOST_MANAGED ||
+		 zbc_dev_is_zdr(dev));
+	dev->zbd_plugs = zp;
+
+	return 0;
+}
+
+/**
+ * Open zones LRU list management.
+ */
+static void zbc_plug_lru_del(struct zbc_zone_plugs *zp,
+			     struct zbc_zone_plug *plug)
+{
+	if (plug->lru_prev)
+		plug->lru_prev->lru_next = plug->lru_next;
+	else
+		zp->lru_head = plug->lru_next;
+	if (plug->lru_next)
+		plug->lru_next->lru_prev = plug->lru_prev;
+	else
+		zp->lru_tail = plug->lru_prev;
+	plug->lru_prev = NULL;
+	plug->lru_next = NULL;
+}
+
+static void zbc_plug_lru_add(struct zbc_zone_plugs *zp,
+			     struct zbc_zone_plug *plug)
+{
+	plug->lru_prev = NULL;
+	plug->lru_next = zp->lru_head;
+	if (zp->lru_head)
+		zp->lru_head->lru_prev = plug;
+	else
+		zp->lru_tail = plug;
+	zp->lru_head = plug;
+}
+
+/**
+ * Mark a zone as open (and most recently used) or not open.
+ */
+static void zbc_plug_set_open(struct zbc_device *dev,
+			      struct zbc_zone_plug *plug, bool open)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_lib_stats *st = &dev->zbd_stats;
+
+	if (plug->open)
+		zbc_plug_lru_del(zp, plug);
+	else if (open)
+		st->nr_open_zones++;
+	else
+		return;
+
+	if (open) {
+		zbc_plug_lru_add(zp, plug);
+		if (st->nr_open_zones > st->max_nr_open_zones)
+			st->max_nr_open_zones = st->nr_open_zones;
+	} else {
+		st->nr_open_zones--;
+	}
+
+	plug->open = open;
+}
+
+/**
+ * Set or clear the non-sequential write condition of a zone.
+ */
+static void zbc_plug_set_non_seq(struct zbc_device *dev,
+				 struct zbc_zone_plug *plug, bool non_seq)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+
+	if (plug->non_seq == non_seq)
+		return;
+
+	plug->non_seq = non_seq;
+	if (!non_seq) {
+		zp->nr_non_seq--;
+		return;
+	}
+
+	zp->nr_non_seq++;
+	if (zp->nr_non_seq > zp->max_non_seq) {
+		if (!dev->zbd_stats.non_seq_overruns)
+			zbc_warning("%s: More than %u zones written "
+				    "non-sequentially\n",
+				    dev->zbd_filename, zp->max_non_seq);
+		dev->zbd_stats.non_seq_overruns++;
+	}
+}
+
+/**
+ * Free the idle zone write plugs of a device. If @all is true, all
+ * plugs are freed, which is only valid when no write is in flight.
+ */
+static void zbc_drop_zone_plugs(struct zbc_device *dev, bool all)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	unsigned int i, n = zp->nr_plugs;
+	struct zbc_zone_plug *plug;
+
+	for (i = 0; n && zp->zt && i < zp->zt->ztb_nr_zones; i++) {
+		plug = zp->plugs[i];
+		if (!plug)
+			continue;
+		n--;
+		if (!all && (plug->busy || plug->waiters || plug->aios.nr))
+			continue;
+		zbc_plug_set_open(dev, plug, false);
+		zbc_plug_set_non_seq(dev, plug, false);
+		free(plug->aios.ent);
+		free(plug);
+		zp->plugs[i] = NULL;
+		zp->nr_plugs--;
+	}
+
+	/* The conditions of the zones without a plug must be reported */
+	zp->zt_cur = false;
+}
+
+/**
+ * Free the zone table of the zone write plugs of a device.
+ * Must be called with no plug left.
+ */
+static void zbc_free_zone_plugs_table(struct zbc_zone_plugs *zp)
+{
+	zbc_zone_table_free(zp->zt);
+	zp->zt = NULL;
+	zp->zt_cur = false;
+	zp->zt_stale = false;
+	free(zp->plugs);
+	zp->plugs = NULL;
+}
+
+/**
+ * Test if two zone tables describe the same zones.
+ */
+static bool zbc_zone_tables_match(struct zbc_zone_table *a,
+				  struct zbc_zone_table *b)
+{
+	struct zbc_zone_table_run *ra, *rb;
+	unsigned int i;
+
+	if (a->ztb_nr_zones != b->ztb_nr_zones ||
+	    a->ztb_nr_runs != b->ztb_nr_runs)
+		return false;
+
+	for (i = 0; i < a->ztb_nr_runs; i++) {
+		ra = &a->ztb_runs[i];
+		rb = &b->ztb_runs[i];
+		if (ra->ztr_start != rb->ztr_start ||
+		    ra->ztr_zone_sectors != rb->ztr_zone_sectors ||
+		    ra->ztr_zone_capacity != rb->ztr_zone_capacity ||
+		    ra->ztr_nr_zones != rb->ztr_nr_zones)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Use the zone table @zt, whose zone conditions are current, for the zone
+ * write plugs of a device. The plugs left must be for the same zones.
+ * @zt is freed if it cannot be used.
+ */
+static int zbc_set_zone_plugs_table(struct zbc_device *dev,
+				    struct zbc_zone_table *zt)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_zone_plug **plugs;
+
+	if (zp->zt_stale && !zp->nr_plugs)
+		zbc_free_zone_plugs_table(zp);
+
+	if (zp->zt) {
+		if (!zbc_zone_tables_match(zp->zt, zt)) {
+			zbc_zone_table_free(zt);
+			return -EBUSY;
+		}
+		zbc_zone_table_free(zp->zt);
+		zp->zt = zt;
+		zp->zt_cur = true;
+		zp->zt_stale = false;
+		return 0;
+	}
+
+	plugs = calloc(zt->ztb_nr_zones ? zt->ztb_nr_zones : 1,
+		       sizeof(struct zbc_zone_plug *));
+	if (!plugs) {
+		zbc_zone_table_free(zt);
+		return -ENOMEM;
+	}
+
+	zp->zt = zt;
+	zp->zt_cur = true;
+	zp->plugs = plugs;
+
+	return 0;
+}
+
+/**
+ * Free the zone write plugs of a device.
+ */
+void zbc_free_zone_plugs(struct zbc_device *dev)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+
+	if (!zp)
+		return;
+
+	zbc_drop_zone_plugs(dev, true);
+	zbc_free_zone_plugs_table(zp);
+	free(zp->failed.ent);
+	pthread_cond_destroy(&zp->cond);
+	pthread_mutex_destroy(&zp->lock);
+	free(zp);
+
+	dev->zbd_plugs = NULL;
+}
+
+/**
+ * Drop the cached zone information of idle zone write plugs, e.g.
+ * after zone activation changed zone types. The zone table is rebuilt
+ * once the plugs of the zones with writes in flight are idle.
+ */
+void zbc_invalidate_zone_plugs(struct zbc_device *dev)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+
+	if (!zp)
+		return;
+
+	pthread_mutex_lock(&zp->lock);
+	zbc_drop_zone_plugs(dev, false);
+	if (zp->nr_plugs)
+		zp->zt_stale = true;
+	else
+		zbc_free_zone_plugs_table(zp);
+	pthread_mutex_unlock(&zp->lock);
+}
+
+/**
+ * Find the plug of the zone containing @sector.
+ * Must be called with the plugs lock held.
+ */
+static struct zbc_zone_plug *zbc_find_zone_plug(struct zbc_zone_plugs *zp,
+						uint64_t sector)
+{
+	int idx;
+
+	if (!zp->zt)
+		return NULL;
+
+	idx = zbc_zone_table_zone_idx(zp->zt, sector);
+	if (idx < 0)
+		return NULL;
+
+	return zp->plugs[idx];
+}
+
+/**
+ * Add the plug of @zone at index @idx of the plug array.
+ */
+static struct zbc_zone_plug *zbc_add_zone_plug(struct zbc_device *dev,
+					       unsigned int idx,
+					       struct zbc_zone *zone)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_zone_plug *plug;
+
+	plug = calloc(1, sizeof(struct zbc_zone_plug));
+	if (!plug)
+		return NULL;
+
+	plug->start = zone->zbz_start;
+	plug->length = zone->zbz_length;
+	plug->capacity = zbc_zone_capacity(zone);
+	plug->wp = zone->zbz_write_pointer;
+	plug->type = zone->zbz_type;
+	plug->seq = zp->serialize && zbc_zone_sequential_req(zone);
+
+	zp->plugs[idx] = plug;
+	zp->nr_plugs++;
+
+	if (zp->mgr && zbc_zone_is_open(zone))
+		zbc_plug_set_open(dev, plug, true);
+	if (zp->mgr && (zone->zbz_attributes & ZBC_ZA_NON_SEQ))
+		zbc_plug_set_non_seq(dev, plug, true);
+
+	return plug;
+}
+
+/**
+ * Test if writes to zones of type @type need a plug: writes are only
+ * serialized for sequential write required zones, and the open zone
+ * manager only tracks zones with a write pointer.
+ */
+static inline bool zbc_plug_write_needed(struct zbc_zone_plugs *zp,
+					 unsigned int type)
+{
+	switch (type) {
+	case ZBC_ZT_SEQUENTIAL_REQ:
+		return true;
+	case ZBC_ZT_SEQUENTIAL_PREF:
+	case ZBC_ZT_SEQ_OR_BEF_REQ:
+		return zp->mgr;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Get the plug of the zone containing @sector, creating it if needed.
+ * For writes (@write is true), no plug is returned for zones that do not
+ * need one, e.g. conventional zones. Must be called with the plugs lock
+ * held, which is released while the zone table or the zone information
+ * is reported.
+ */
+static struct zbc_zone_plug *zbc_get_zone_plug(struct zbc_device *dev,
+					       uint64_t sector, bool write)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_zone_table *zt;
+	unsigned int nr_zones = 1;
+	struct zbc_zone zone, tz;
+	int idx, ret;
+
+again:
+	if (zp->zt_stale && !zp->nr_plugs)
+		zbc_free_zone_plugs_table(zp);
+
+	if (!zp->zt) {
+		pthread_mutex_unlock(&zp->lock);
+		ret = zbc_list_zone_table(dev, 0, &zt);
+		pthread_mutex_lock(&zp->lock);
+		if (ret)
+			return NULL;
+		if (zp->zt)
+			zbc_zone_table_free(zt);
+		else if (zbc_set_zone_plugs_table(dev, zt))
+			return NULL;
+	}
+
+	zt = zp->zt;
+	idx = zbc_zone_table_zone_idx(zt, sector);
+	if (idx < 0)
+		return NULL;
+	if (write && !zbc_plug_write_needed(zp, zbc_zone_table_type(zt, idx)))
+		return NULL;
+	if (zp->plugs[idx])
+		return zp->plugs[idx];
+
+	if (zp->zt_cur) {
+		zbc_zone_table_get_zone(zt, idx, &zone);
+		return zbc_add_zone_plug(dev, idx, &zone);
+	}
+
+	pthread_mutex_unlock(&zp->lock);
+	ret = zbc_report_zones(dev, sector, ZBC_RZ_RO_ALL, &zone, &nr_zones);
+	pthread_mutex_lock(&zp->lock);
+	if (ret || nr_zones != 1)
+		return NULL;
+
+	/* The plugs may have changed while the lock was released */
+	if (zp->zt != zt)
+		goto again;
+	if (zp->plugs[idx])
+		return zp->plugs[idx];
+
+	/* Ignore zones that do not match the table zone layout */
+	zbc_zone_table_get_zone(zt, idx, &tz);
+	if (zbc_zone_start(&zone) != zbc_zone_start(&tz) ||
+	    zbc_zone_length(&zone) != zbc_zone_length(&tz))
+		return NULL;
+
+	return zbc_add_zone_plug(dev, idx, &zone);
+}
+
+/**
+ * Test if a zone has a write pointer managed by the open zone manager.
+ */
+static inline bool zbc_plug_wp_zone(struct zbc_zone_plug *plug)
+{
+	return plug->type == ZBC_ZT_SEQUENTIAL_REQ ||
+		plug->type == ZBC_ZT_SEQUENTIAL_PREF ||
+		plug->type == ZBC_ZT_SEQ_OR_BEF_REQ;
+}
+
+/**
+ * Account for the time a write waited for a zone write plug.
+ */
+static void zbc_plug_account_wait(struct zbc_device *dev,
+				  unsigned long long start)
+{
+	unsigned long long wait = zbc_plug_time_ns() - start;
+
+	dev->zbd_stats.plugged_writes++;
+	dev->zbd_stats.plug_wait_ns += wait;
+	if (wait > dev->zbd_stats.plug_wait_max_ns)
+		dev->zbd_stats.plug_wait_max_ns = wait;
+}
+
+/**
+ * Release a zone plug held for a write or a zone close, submitting the
+ * first asynchronous write queued on the plug, if any.
+ * Must be called with the plugs lock held.
+ */
+static void zbc_plug_release(struct zbc_device *dev,
+			     struct zbc_zone_plug *plug)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	unsigned long long ts;
+	struct zbc_aio *aio;
+	int ret;
+
+	while ((aio = zbc_aio_fifo_pop(&plug->aios, &ts))) {
+		zbc_plug_account_wait(dev, ts);
+		ret = (dev->zbd_drv->zbd_submit_aio)(dev, aio);
+		if (!ret)
+			return;
+
+		/* Complete the write with the submission error */
+		aio->zio_ret = ret;
+		if (zbc_aio_fifo_push(&zp->failed, aio, 0)) {
+			zbc_error("%s: Lost failed write at sector %llu\n",
+				  dev->zbd_filename,
+				  (unsigned long long)aio->zio_offset);
+			zbc_aio_put_inflight(dev);
+		}
+	}
+
+	plug->busy = false;
+	pthread_cond_broadcast(&zp->cond);
+}
+
+/**
+ * Maximum number of zones closed at once by zbc_plug_close_lru().
+ */
+#define ZBC_PLUG_CLOSE_BATCH	8
+
+/**
+ * Close the least recently written open zones until @room zones can be
+ * open without exceeding the open zones limit. Zones with a write in
+ * flight and the zone starting at sector @keep are not closed. The zones
+ * to close are chosen and held (busy) with the plugs lock held, and
+ * closed with the lock released.
+ * Must be called without the plugs lock held.
+ */
+static void zbc_plug_close_lru(struct zbc_device *dev, unsigned int room,
+			       uint64_t keep)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_lib_stats *st = &dev->zbd_stats;
+	uint64_t victims[ZBC_PLUG_CLOSE_BATCH];
+	int ret[ZBC_PLUG_CLOSE_BATCH];
+	struct zbc_zone_plug *plug, *prev;
+	unsigned int max_open, i, nr;
+
+	do {
+		pthread_mutex_lock(&zp->lock);
+
+		max_open = zp->max_open > room ? zp->max_open - room : 0;
+		nr = 0;
+		plug = zp->lru_tail;
+		while (st->nr_open_zones > max_open && plug &&
+		       nr < ZBC_PLUG_CLOSE_BATCH) {
+			prev = plug->lru_prev;
+			if (plug->start != keep && !plug->busy) {
+				plug->busy = true;
+				zbc_plug_set_open(dev, plug, false);
+				victims[nr++] = plug->start;
+			}
+			plug = prev;
+		}
+
+		if (nr < ZBC_PLUG_CLOSE_BATCH &&
+		    st->nr_open_zones > max_open) {
+			if (!st->open_limit_overruns)
+				zbc_warning("%s: More than %u open zones\n",
+					    dev->zbd_filename, zp->max_open);
+			st->open_limit_overruns++;
+		}
+
+		pthread_mutex_unlock(&zp->lock);
+
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++)
+			ret[i] = (dev->zbd_drv->zbd_zone_op)(dev, victims[i], 0,
+							     ZBC_OP_CLOSE_ZONE,
+							     0);
+
+		pthread_mutex_lock(&zp->lock);
+
+		for (i = 0; i < nr; i++) {
+			/* Held plugs are not freed */
+			plug = zbc_find_zone_plug(zp, victims[i]);
+			if (!plug)
+				continue;
+			if (ret[i] == 0) {
+				st->auto_closed_zones++;
+			} else {
+				zbc_warning("%s: Close zone %llu failed %d\n",
+					    dev->zbd_filename,
+					    (unsigned long long)victims[i],
+					    ret[i]);
+				zbc_plug_set_open(dev, plug, true);
+			}
+			zbc_plug_release(dev, plug);
+		}
+
+		pthread_mutex_unlock(&zp->lock);
+
+	} while (nr == ZBC_PLUG_CLOSE_BATCH);
+}
+
+/**
+ * Account for a write to a zone with the open zone manager:
+ * the zone becomes (or stays) the most recently written open zone.
+ * Returns true if the zone was not open and open zones must be closed
+ * with zbc_plug_close_lru() to stay within the open zones limit.
+ */
+static bool zbc_plug_start_write(struct zbc_device *dev,
+				 struct zbc_zone_plug *plug, uint64_t sector)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	bool was_open = plug->open;
+
+	if (!zp->mgr || !zbc_plug_wp_zone(plug))
+		return false;
+
+	if (plug->type == ZBC_ZT_SEQUENTIAL_PREF && sector != plug->wp)
+		zbc_plug_set_non_seq(dev, plug, true);
+
+	zbc_plug_set_open(dev, plug, true);
+
+	return !was_open && dev->zbd_stats.nr_open_zones > zp->max_open;
+}
+
+/**
+ * Account for the completion of a write with the open zone manager.
+ */
+static void zbc_plug_end_write(struct zbc_device *dev,
+			       struct zbc_zone_plug *plug, uint64_t sector,
+			       ssize_t count)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+
+	if (!zp->mgr || !zbc_plug_wp_zone(plug) || count <= 0)
+		return;
+
+	if (sector + count > plug->wp)
+		plug->wp = sector + count;
+
+	/* A full zone is not open anymore */
+	if (plug->wp >= plug->start + plug->capacity)
+		zbc_plug_set_open(dev, plug, false);
+}
+
+/**
+ * Plug the zone of a synchronous write at @sector, waiting for the write
+ * in flight to the zone, if any. Returns true if the zone was plugged, in
+ * which case zbc_zone_unplug() must be called once the write completes.
+ */
+bool zbc_zone_plug(struct zbc_device *dev, uint64_t sector)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_zone_plug *plug;
+	unsigned long long start;
+	uint64_t zone_start;
+	bool close;
+
+	if (!zp || (!zp->serialize && !zp->mgr))
+		return false;
+
+	pthread_mutex_lock(&zp->lock);
+
+	plug = zbc_get_zone_plug(dev, sector, true);
+	if (!plug || (!plug->seq && !zp->mgr)) {
+		pthread_mutex_unlock(&zp->lock);
+		return false;
+	}
+
+	if (plug->seq) {
+		if (plug->busy) {
+			start = zbc_plug_time_ns();
+			plug->waiters++;
+			while (plug->busy)
+				pthread_cond_wait(&zp->cond, &zp->lock);
+			plug->waiters--;
+			zbc_plug_account_wait(dev, start);
+		}
+		plug->busy = true;
+	}
+
+	close = zbc_plug_start_write(dev, plug, sector);
+	zone_start = plug->start;
+
+	pthread_mutex_unlock(&zp->lock);
+
+	if (close)
+		zbc_plug_close_lru(dev, 0, zone_start);
+
+	return true;
+}
+
+/**
+ * Plug the zone of an asynchronous write. Returns 1 if the write was
+ * queued on the zone plug, in which case it is submitted when the write
+ * in flight to the zone completes, 0 if the write must be submitted now
+ * and a negative error code otherwise.
+ */
+int zbc_zone_plug_aio(struct zbc_device *dev, struct zbc_aio *aio)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_zone_plug *plug;
+	uint64_t zone_start = 0;
+	bool close = false;
+	int ret = 0;
+
+	if (!zp || (!zp->serialize && !zp->mgr) || !aio->zio_write)
+		return 0;
+
+	pthread_mutex_lock(&zp->lock);
+
+	plug = zbc_get_zone_plug(dev, aio->zio_offset, true);
+	if (plug) {
+		close = zbc_plug_start_write(dev, plug, aio->zio_offset);
+		zone_start = plug->start;
+	}
+	if (plug && plug->seq) {
+		if (plug->busy) {
+			ret = zbc_aio_fifo_push(&plug->aios, aio,
+						zbc_plug_time_ns());
+			if (!ret)
+				ret = 1;
+		} else {
+			plug->busy = true;
+		}
+	}
+
+	pthread_mutex_unlock(&zp->lock);
+
+	if (close)
+		zbc_plug_close_lru(dev, 0, zone_start);
+
+	return ret;
+}
+
+/**
+ * Unplug the zone of a completed write of @count sectors at @sector
+ * (@count is negative if the write failed). Asynchronous writes queued
+ * on the zone plug are submitted first, in submission order.
+ */
+void zbc_zone_unplug(struct zbc_device *dev, uint64_t sector, ssize_t count)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_zone_plug *plug;
+
+	if (!zp)
+		return;
+
+	pthread_mutex_lock(&zp->lock);
+
+	plug = zbc_find_zone_plug(zp, sector);
+	if (plug) {
+		zbc_plug_end_write(dev, plug, sector, count);
+		if (plug->busy)
+			zbc_plug_release(dev, plug);
+	}
+
+	pthread_mutex_unlock(&zp->lock);
+}
+
+/**
+ * Get an asynchronous write that failed when submitted from a zone plug.
+ */
+struct zbc_aio *zbc_zone_plug_failed_aio(struct zbc_device *dev)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_aio *aio;
+
+	if (!zp)
+		return NULL;
+
+	pthread_mutex_lock(&zp->lock);
+	aio = zbc_aio_fifo_pop(&zp->failed, NULL);
+	pthread_mutex_unlock(&zp->lock);
+
+	return aio;
+}
+
+/**
+ * Prepare a zone operation: with the open zone manager, make room for
+ * zones explicitly open.
+ */
+void zbc_zone_plug_prepare_op(struct zbc_device *dev, uint64_t sector,
+			      unsigned int count, enum zbc_zone_op op,
+			      unsigned int flags)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	struct zbc_zone_plug *plug;
+	uint64_t zone_start = 0;
+	bool close = false;
+
+	if (!zp || !zp->mgr || op != ZBC_OP_OPEN_ZONE ||
+	    (flags & ZBC_OP_ALL_ZONES))
+		return;
+
+	if (!count)
+		count = 1;
+
+	pthread_mutex_lock(&zp->lock);
+
+	plug = zbc_get_zone_plug(dev, sector, false);
+	if (plug && !plug->open) {
+		close = true;
+		zone_start = plug->start;
+	}
+
+	pthread_mutex_unlock(&zp->lock);
+
+	if (close)
+		zbc_plug_close_lru(dev, count, zone_start);
+}
+
+/**
+ * Update a plug after a successful zone operation.
+ */
+static void zbc_plug_end_op(struct zbc_device *dev,
+			    struct zbc_zone_plug *plug, enum zbc_zone_op op,
+			    bool all)
+{
+	if (!zbc_plug_wp_zone(plug))
+		return;
+
+	switch (op) {
+	case ZBC_OP_RESET_ZONE:
+		plug->wp = plug->start;
+		zbc_plug_set_open(dev, plug, false);
+		zbc_plug_set_non_seq(dev, plug, false);
+		break;
+	case ZBC_OP_OPEN_ZONE:
+		/* Opening all zones only opens closed zones */
+		if (!all && plug->wp < plug->start + plug->capacity)
+			zbc_plug_set_open(dev, plug, true);
+		break;
+	case ZBC_OP_CLOSE_ZONE:
+		zbc_plug_set_open(dev, plug, false);
+		break;
+	case ZBC_OP_FINISH_ZONE:
+		if (all && !plug->open)
+			break;
+		plug->wp = plug->start + plug->capacity;
+		zbc_plug_set_open(dev, plug, false);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Update the zone plugs after a successful zone operation.
+ */
+void zbc_zone_plug_end_op(struct zbc_device *dev, uint64_t sector,
+			  unsigned int count, enum zbc_zone_op op,
+			  unsigned int flags)
+{
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	bool all = flags & ZBC_OP_ALL_ZONES;
+	struct zbc_zone_plug *plug;
+	struct zbc_zone zone;
+	int idx;
+
+	if (!zp || !zp->mgr)
+		return;
+
+	if (!count)
+		count = 1;
+
+	pthread_mutex_lock(&zp->lock);
+
+	if (!zp->zt)
+		goto out;
+
+	if (all && op == ZBC_OP_OPEN_ZONE) {
+		/* Closed zones are not tracked: drop the cached zones */
+		zbc_drop_zone_plugs(dev, false);
+		goto out;
+	}
+
+	if (all) {
+		for (idx = 0; idx < (int)zp->zt->ztb_nr_zones; idx++) {
+			if (zp->plugs[idx])
+				zbc_plug_end_op(dev, zp->plugs[idx], op, true);
+		}
+		/* The table conditions of the other zones are now outdated */
+		zp->zt_cur = false;
+		goto out;
+	}
+
+	idx = zbc_zone_table_zone_idx(zp->zt, sector);
+	if (idx < 0)
+		goto out;
+
+	for (; idx < (int)zp->zt->ztb_nr_zones && count; idx++, count--) {
+		plug = zp->plugs[idx];
+		if (!plug && zp->zt_cur) {
+			zbc_zone_table_get_zone(zp->zt, idx, &zone);
+			plug = zbc_add_zone_plug(dev, idx, &zone);
+		}
+		if (plug)
+			zbc_plug_end_op(dev, plug, op, false);
+	}
+
+out:
+	pthread_mutex_unlock(&zp->lock);
+}
+
+/**
+ * zbc_manage_open_zones - Enable or disable the open zone manager
+ */
+int zbc_manage_open_zones(struct zbc_device *dev, bool enable,
+			  unsigned int max_open)
+{
+	struct zbc_device_info *di = &dev->zbd_info;
+	struct zbc_zone_plugs *zp = dev->zbd_plugs;
+	unsigned int conds = ZBC_ZF_COND(ZBC_ZC_IMP_OPEN) |
+		ZBC_ZF_COND(ZBC_ZC_EXP_OPEN);
+	struct zbc_zone_table *zt = NULL;
+	struct zbc_zone zone;
+	int i, ret = 0;
+
+	if (!zp) {
+		zbc_error("%s: Open zone management is not supported\n",
+			  dev->zbd_filename);
+		return -ENOTSUP;
+	}
+
+	/* Start from the device state */
+	if (enable) {
+		ret = zbc_list_zone_table(dev, 0, &zt);
+		if (ret != 0)
+			return ret;
+	}
+
+	pthread_mutex_lock(&zp->lock);
+
+	zbc_drop_zone_plugs(dev, false);
+
+	zp->mgr = enable;
+	if (!enable)
+		goto out;
+
+	if (!max_open) {
+		if (zbc_dev_model(dev) == ZBC_DM_HOST_MANAGED)
+			max_open = di->zbd_max_nr_open_seq_req;
+		else
+			max_open = di->zbd_opt_nr_open_seq_pref;
+		if (!max_open)
+			max_open = ZBC_NO_LIMIT;
+	}
+	zp->max_open = max_open;
+
+	zp->max_non_seq = di->zbd_opt_nr_non_seq_write_seq_pref;
+	if (!zp->max_non_seq)
+		zp->max_non_seq = ZBC_NO_LIMIT;
+
+	ret = zbc_set_zone_plugs_table(dev, zt);
+	if (ret != 0) {
+		zbc_error("%s: Zone layout changed with writes in flight\n",
+			  dev->zbd_filename);
+		zp->mgr = false;
+		goto out;
+	}
+
+	/* Track the zones that are already open */
+	for (i = zbc_zone_table_next(zt, 0, conds); i >= 0;
+	     i = zbc_zone_table_next(zt, i + 1, conds)) {
+		if (zp->plugs[i]) {
+			zbc_plug_set_open(dev, zp->plugs[i], true);
+		} else {
+			zbc_zone_table_get_zone(zt, i, &zone);
+			zbc_add_zone_plug(dev, i, &zone);
+		}
+	}
+
+	zbc_debug("%s: Managing open zones, %llu zones open, limit %u\n",
+		  dev->zbd_filename, dev->zbd_stats.nr_open_zones,
+		  zp->max_open);
+
+out:
+	pthread_mutex_unlock(&zp->lock);
+
+	return ret;
+}
@@ -0,0 +1,926 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ *
+ * Zone domain and zone realm lookup index.
+ */
+#include "zbc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/**
+ * Sector range of a realm in a domain.
+ */
+struct zbc_realm_range {
+	uint64_t		start;
+	uint64_t		end;
+	unsigned int		idx;
+};
+
+/**
+ * Realm index: zone domains sorted by start sector, and for each domain,
+ * the sector ranges of the realms in that domain sorted by start sector.
+ * For each domain, a bitmap of the realms that can be activated in the
+ * domain is also maintained.
+ */
+struct zbc_realm_index {
+	struct zbc_zone_domain	*domains;
+	unsigned int		nr_domains;
+
+	struct zbc_zone_realm	*realms;
+	unsigned int		nr_realms;
+
+	struct zbc_realm_range	*ranges[ZBC_NR_ZONE_TYPES];
+	unsigned int		nr_ranges[ZBC_NR_ZONE_TYPES];
+
+	uint64_t		*actv_map[ZBC_NR_ZONE_TYPES];
+	unsigned int		nr_map_words;
+};
+
+#define ZBC_MAP_WORD_BITS	64
+
+static int zbc_domain_cmp(const void *a, const void *b)
+{
+	const struct zbc_zone_domain *d1 = a, *d2 = b;
+
+	if (d1->zbm_start_sector < d2->zbm_start_sector)
+		return -1;
+	return d1->zbm_start_sector > d2->zbm_start_sector;
+}
+
+static int zbc_realm_cmp(const void *a, const void *b)
+{
+	const struct zbc_zone_realm *r1 = a, *r2 = b;
+
+	return (int)r1->zbr_number - (int)r2->zbr_number;
+}
+
+static int zbc_realm_range_cmp(const void *a, const void *b)
+{
+	const struct zbc_realm_range *r1 = a, *r2 = b;
+
+	if (r1->start < r2->start)
+		return -1;
+	return r1->start > r2->start;
+}
+
+/**
+ * Free a device realm index.
+ */
+void zbc_free_realm_index(struct zbc_device *dev)
+{
+	struct zbc_realm_index *ri = dev->zbd_realm_index;
+	int i;
+
+	if (!ri)
+		return;
+
+	for (i = 0; i < ZBC_NR_ZONE_TYPES; i++) {
+		free(ri->ranges[i]);
+		free(ri->actv_map[i]);
+	}
+	free(ri->domains);
+	free(ri->realms);
+	free(ri);
+
+	dev->zbd_realm_index = NULL;
+}
+
+/**
+ * Test if a realm can be activated in a domain.
+ */
+static inline bool zbc_realm_actv_in_dom(struct zbc_zone_realm *r,
+					 unsigned int dom_id)
+{
+	return zbc_realm_actv_as_dom_id(r, dom_id) &&
+		zbc_realm_activation_allowed(r) &&
+		r->zbr_dom_id != dom_id;
+}
+
+/**
+ * Update the activation bitmaps of a realm.
+ */
+static void zbc_realm_index_set_actv(struct zbc_realm_index *ri,
+				     unsigned int idx)
+{
+	struct zbc_zone_realm *r = &ri->realms[idx];
+	uint64_t bit = 1ULL << (idx % ZBC_MAP_WORD_BITS);
+	unsigned int w = idx / ZBC_MAP_WORD_BITS;
+	int i;
+
+	for (i = 0; i < ZBC_NR_ZONE_TYPES; i++) {
+		if (zbc_realm_actv_in_dom(r, i))
+			ri->actv_map[i][w] |= bit;
+		else
+			ri->actv_map[i][w] &= ~bit;
+	}
+}
+
+/**
+ * zbc_build_realm_index - Build a device zone domain and realm index.
+ */
+int zbc_build_realm_index(struct zbc_device *dev)
+{
+	struct zbc_realm_index *ri;
+	struct zbc_realm_range *rr;
+	struct zbc_zone_realm *r;
+	unsigned int i, j;
+	int ret;
+
+	if (!zbc_dev_is_zdr(dev)) {
+		zbc_error("%s: Not a ZD/ZR device\n",
+			  dev->zbd_filename);
+		return -ENOTSUP;
+	}
+
+	zbc_free_realm_index(dev);
+
+	ri = calloc(1, sizeof(struct zbc_realm_index));
+	if (!ri)
+		return -ENOMEM;
+
+	ret = zbc_list_domains(dev, 0LL, ZBC_RZD_RO_ALL,
+			       &ri->domains, &ri->nr_domains);
+	if (ret != 0)
+		goto err;
+
+	ret = zbc_list_zone_realms(dev, 0LL, ZBC_RR_RO_ALL,
+				   &ri->realms, &ri->nr_realms);
+	if (ret != 0)
+		goto err;
+
+	qsort(ri->domains, ri->nr_domains, sizeof(struct zbc_zone_domain),
+	      zbc_domain_cmp);
+	qsort(ri->realms, ri->nr_realms, sizeof(struct zbc_zone_realm),
+	      zbc_realm_cmp);
+
+	ret = -ENOMEM;
+	ri->nr_map_words = (ri->nr_realms + ZBC_MAP_WORD_BITS - 1) /
+		ZBC_MAP_WORD_BITS;
+	for (i = 0; i < ZBC_NR_ZONE_TYPES; i++) {
+		ri->ranges[i] = calloc(ri->nr_realms + 1,
+				       sizeof(struct zbc_realm_range));
+		ri->actv_map[i] = calloc(ri->nr_map_words + 1,
+					 sizeof(uint64_t));
+		if (!ri->ranges[i] || !ri->actv_map[i])
+			goto err;
+	}
+
+	for (i = 0; i < ri->nr_realms; i++) {
+		r = &ri->realms[i];
+		for (j = 0; j < ZBC_NR_ZONE_TYPES; j++) {
+			if (!zbc_realm_actv_as_dom_id(r, j))
+				continue;
+			rr = &ri->ranges[j][ri->nr_ranges[j]++];
+			rr->start = zbc_realm_start_sector(r, j);
+			rr->end = zbc_realm_high_sector(dev, r, j);
+			rr->idx = i;
+		}
+		zbc_realm_index_set_actv(ri, i);
+	}
+
+	for (j = 0; j < ZBC_NR_ZONE_TYPES; j++)
+		qsort(ri->ranges[j], ri->nr_ranges[j],
+		      sizeof(struct zbc_realm_range), zbc_realm_range_cmp);
+
+	zbc_debug("%s: Realm index built (%u domains, %u realms)\n",
+		  dev->zbd_filename, ri->nr_domains, ri->nr_realms);
+
+	dev->zbd_realm_index = ri;
+
+	return 0;
+
+err:
+	dev->zbd_realm_index = ri;
+	zbc_free_realm_index(dev);
+
+	return ret;
+}
+
+/**
+ * Get a device realm index, building it if necessary.
+ */
+static int zbc_get_realm_index(struct zbc_device *dev,
+			       struct zbc_realm_index **pri)
+{
+	int ret;
+
+	if (!dev->zbd_realm_index) {
+		ret = zbc_build_realm_index(dev);
+		if (ret)
+			return ret;
+	}
+
+	*pri = dev->zbd_realm_index;
+
+	return 0;
+}
+
+/**
+ * Get the index of the first realm range of a domain
+ * ending at or after @sector.
+ */
+static unsigned int zbc_realm_range_lower(struct zbc_realm_index *ri,
+					  unsigned int dom_id, uint64_t sector)
+{
+	struct zbc_realm_range *rr = ri->ranges[dom_id];
+	unsigned int lo = 0, hi = ri->nr_ranges[dom_id], mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rr[mid].end < sector)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/**
+ * Find the domain containing @sector.
+ */
+static struct zbc_zone_domain *
+zbc_realm_index_domain(struct zbc_device *dev, struct zbc_realm_index *ri,
+		       uint64_t sector)
+{
+	unsigned int lo = 0, hi = ri->nr_domains, mid;
+	struct zbc_zone_domain *d;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		d = &ri->domains[mid];
+		if (sector < zbc_zone_domain_start_sect(d))
+			hi = mid;
+		else if (sector > zbc_zone_domain_high_sect(dev, d))
+			lo = mid + 1;
+		else
+			return d;
+	}
+
+	return NULL;
+}
+
+/**
+ * zbc_find_domain - Get the zone domain containing a sector.
+ */
+int zbc_find_domain(struct zbc_device *dev, uint64_t sector,
+		    struct zbc_zone_domain *domain)
+{
+	struct zbc_realm_index *ri;
+	struct zbc_zone_domain *d;
+	int ret;
+
+	ret = zbc_get_realm_index(dev, &ri);
+	if (ret)
+		return ret;
+
+	d = zbc_realm_index_domain(dev, ri, sector);
+	if (!d)
+		return -ENOENT;
+
+	memcpy(domain, d, sizeof(struct zbc_zone_domain));
+
+	return 0;
+}
+
+/**
+ * zbc_find_realm - Get the zone realm containing a sector.
+ */
+int zbc_find_realm(struct zbc_device *dev, uint64_t sector,
+		   struct zbc_zone_realm *realm, unsigned int *dom_id)
+{
+	struct zbc_realm_index *ri;
+	struct zbc_realm_range *rr;
+	struct zbc_zone_domain *d;
+	unsigned int id, i;
+	int ret;
+
+	ret = zbc_get_realm_index(dev, &ri);
+	if (ret)
+		return ret;
+
+	d = zbc_realm_index_domain(dev, ri, sector);
+	if (!d)
+		return -ENOENT;
+
+	id = zbc_zone_domain_id(d);
+	if (id >= ZBC_NR_ZONE_TYPES)
+		return -ENOENT;
+
+	i = zbc_realm_range_lower(ri, id, sector);
+	if (i >= ri->nr_ranges[id])
+		return -ENOENT;
+
+	rr = &ri->ranges[id][i];
+	if (sector < rr->start)
+		return -ENOENT;
+
+	memcpy(realm, &ri->realms[rr->idx], sizeof(struct zbc_zone_realm));
+	if (dom_id)
+		*dom_id = id;
+
+	return 0;
+}
+
+/**
+ * Find the next set bit of a bitmap starting from @start.
+ */
+static int zbc_map_next_bit(uint64_t *map, unsigned int nr_bits,
+			    unsigned int start)
+{
+	unsigned int w = start / ZBC_MAP_WORD_BITS;
+	unsigned int nr_words = (nr_bits + ZBC_MAP_WORD_BITS - 1) /
+		ZBC_MAP_WORD_BITS;
+	unsigned int bit;
+	uint64_t word;
+
+	if (start >= nr_bits)
+		return -1;
+
+	word = map[w] & (~0ULL << (start % ZBC_MAP_WORD_BITS));
+	for (;;) {
+		if (word) {
+			bit = w * ZBC_MAP_WORD_BITS + __builtin_ctzll(word);
+			return bit < nr_bits ? (int)bit : -1;
+		}
+		if (++w >= nr_words)
+			return -1;
+		word = map[w];
+	}
+}
+
+/**
+ * zbc_find_actv_realm - Get the next realm that can be
+ *                       activated as a zone type.
+ */
+int zbc_find_actv_realm(struct zbc_device *dev, unsigned int realm_number,
+			enum zbc_zone_type type, struct zbc_zone_realm *realm)
+{
+	unsigned int lo, hi, mid, i, id;
+	struct zbc_realm_index *ri;
+	int ret, idx, best = -1;
+
+	ret = zbc_get_realm_index(dev, &ri);
+	if (ret)
+		return ret;
+
+	/* Get the index of the first realm to consider */
+	lo = 0;
+	hi = ri->nr_realms;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ri->realms[mid].zbr_number < realm_number)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Look at all domains with the requested zone type */
+	for (i = 0; i < ri->nr_domains; i++) {
+		id = zbc_zone_domain_id(&ri->domains[i]);
+		if (id >= ZBC_NR_ZONE_TYPES ||
+		    zbc_zone_domain_type(&ri->domains[i]) != type)
+			continue;
+		idx = zbc_map_next_bit(ri->actv_map[id], ri->nr_realms, lo);
+		if (idx >= 0 && (best < 0 || idx < best))
+			best = idx;
+	}
+
+	if (best < 0)
+		return -ENOENT;
+
+	memcpy(realm, &ri->realms[best], sizeof(struct zbc_zone_realm));
+
+	return 0;
+}
+
+/**
+ * Update a device realm index using the results of a zone activation.
+ * If the results cannot be used, the index is dropped and will be
+ * rebuilt on the next lookup.
+ */
+void zbc_update_realm_index(struct zbc_device *dev,
+			    struct zbc_actv_res *actv_recs,
+			    unsigned int nr_actv_recs)
+{
+	struct zbc_realm_index *ri = dev->zbd_realm_index;
+	struct zbc_zone_domain *d = NULL;
+	struct zbc_realm_range *rr;
+	struct zbc_zone_realm *r;
+	uint64_t start, end, zone_size;
+	unsigned int i, j, id;
+
+	if (!ri)
+		return;
+
+	if (!actv_recs || !nr_actv_recs)
+		goto drop;
+
+	for (i = 0; i < nr_actv_recs; i++) {
+		id = actv_recs[i].zbe_domain;
+		if (id >= ZBC_NR_ZONE_TYPES)
+			goto drop;
+
+		for (j = 0, d = NULL; j < ri->nr_domains; j++) {
+			if (zbc_zone_domain_id(&ri->domains[j]) == id) {
+				d = &ri->domains[j];
+				break;
+			}
+		}
+		if (!d || !zbc_zone_domain_nr_zones(d))
+			goto drop;
+
+		zone_size = zbc_zone_domain_zone_size(d);
+		start = actv_recs[i].zbe_start_zone;
+		end = start + actv_recs[i].zbe_nr_zones * zone_size - 1;
+
+		/* Update all realms overlapping the activated zones */
+		j = zbc_realm_range_lower(ri, id, start);
+		for (rr = &ri->ranges[id][j];
+		     j < ri->nr_ranges[id] && rr->start <= end; j++, rr++) {
+			r = &ri->realms[rr->idx];
+			r->zbr_dom_id = id;
+			r->zbr_type = actv_recs[i].zbe_type;
+			zbc_realm_index_set_actv(ri, rr->idx);
+		}
+	}
+
+	return;
+
+drop:
+	zbc_free_realm_index(dev);
+}
+
+/**
+ * Add a realm to an activation plan, extending the last step of the plan
+ * if the realm can be activated with the same ZONE ACTIVATE command.
+ */
+static int zbc_plan_add_realm(struct zbc_device *dev,
+			      struct zbc_actv_plan *plan,
+			      unsigned int *max_steps,
+			      struct zbc_zone_realm *last,
+			      struct zbc_zone_realm *r, unsigned int dom_id,
+			      unsigned int max_zones, unsigned int max_realms)
+{
+	struct zbc_actv_step *s = NULL, *steps;
+	unsigned int src_id = r->zbr_dom_id;
+	unsigned int nr_zones = zbc_realm_length(r, dom_id);
+	unsigned int src_nr_zones = 0;
+
+	if (!zbc_zone_realm_conventional(r))
+		src_nr_zones = zbc_realm_length(r, src_id);
+
+	if (plan->zbp_nr_steps)
+		s = &plan->zbp_steps[plan->zbp_nr_steps - 1];
+
+	if (s && s->zbs_dom_id == dom_id &&
+	    last->zbr_dom_id == src_id &&
+	    last->zbr_number + 1 == r->zbr_number &&
+	    zbc_realm_high_sector(dev, last, dom_id) + 1 ==
+	    zbc_realm_start_sector(r, dom_id) &&
+	    zbc_realm_high_sector(dev, last, src_id) + 1 ==
+	    zbc_realm_start_sector(r, src_id) &&
+	    (!max_realms || s->zbs_nr_realms < max_realms) &&
+	    (!max_zones || s->zbs_nr_zones + nr_zones <= max_zones)) {
+		s->zbs_nr_zones += nr_zones;
+		s->zbs_src_nr_zones += src_nr_zones;
+		s->zbs_nr_realms++;
+		goto out;
+	}
+
+	if (plan->zbp_nr_steps >= *max_steps) {
+		*max_steps = *max_steps ? *max_steps * 2 : 16;
+		steps = realloc(plan->zbp_steps,
+				*max_steps * sizeof(struct zbc_actv_step));
+		if (!steps)
+			return -ENOMEM;
+		plan->zbp_steps = steps;
+	}
+
+	s = &plan->zbp_steps[plan->zbp_nr_steps++];
+	memset(s, 0, sizeof(struct zbc_actv_step));
+	s->zbs_start_sector = zbc_realm_start_sector(r, dom_id);
+	s->zbs_src_sector = zbc_realm_start_sector(r, src_id);
+	s->zbs_nr_zones = nr_zones;
+	s->zbs_src_nr_zones = src_nr_zones;
+	s->zbs_dom_id = dom_id;
+	s->zbs_realm = r->zbr_number;
+	s->zbs_nr_realms = 1;
+
+	if (max_zones && nr_zones > max_zones)
+		zbc_warning("%s: Realm %u has %u zones, exceeding the maximum activation of %u zones\n",
+			    dev->zbd_filename, r->zbr_number,
+			    nr_zones, max_zones);
+
+out:
+	if (!plan->zbp_fsnoz && s->zbs_nr_zones > 0xffff)
+		plan->zbp_cdb32 = true;
+
+	return 0;
+}
+
+/**
+ * zbc_plan_activation - Compute the zone activations needed for
+ *                       a realm layout.
+ */
+int zbc_plan_activation(struct zbc_device *dev, enum zbc_zone_type type,
+			unsigned int nr_realms, struct zbc_actv_plan **pplan)
+{
+	struct zbc_device_info *info = &dev->zbd_info;
+	struct zbc_zone_realm r, last;
+	struct zbc_zd_dev_control ctl;
+	struct zbc_realm_item *item;
+	struct zbc_realm_index *ri;
+	struct zbc_actv_plan *plan;
+	struct zbc_zone_domain *d;
+	unsigned int max_zones, max_realms = 0, max_steps = 0;
+	unsigned int i, nr = 0, realm_number = 0;
+	bool found = false, shifting = false;
+	int ret;
+
+	*pplan = NULL;
+
+	/* Get the maximum number of realms that can be activated at once */
+	ret = zbc_zone_activation_ctl(dev, &ctl, false);
+	if (ret == 0 && ctl.zbt_max_activate != 0xffff)
+		max_realms = ctl.zbt_max_activate;
+
+	ret = zbc_get_realm_index(dev, &ri);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < ri->nr_domains; i++) {
+		d = &ri->domains[i];
+		if (zbc_zone_domain_type(d) != type ||
+		    !(zbc_zone_domain_flags(d) & ZBC_ZDF_VALID_ZONE_TYPE))
+			continue;
+		found = true;
+		if (zbc_zone_domain_flags(d) & ZBC_ZDF_SHIFTING_BOUNDARIES)
+			shifting = true;
+	}
+	if (!found) {
+		zbc_error("%s: Zone type 0x%x is not supported\n",
+			  dev->zbd_filename, type);
+		return -ENOTSUP;
+	}
+
+	for (i = 0; i < ri->nr_realms; i++) {
+		if (zbc_zone_realm_type(&ri->realms[i]) == (int)type)
+			nr++;
+	}
+
+	plan = calloc(1, sizeof(struct zbc_actv_plan));
+	if (!plan)
+		return -ENOMEM;
+	plan->zbp_type = type;
+
+	/* Without NOZSRC support, the number of zones is set with FSNOZ */
+	if (!(info->zbd_flags & ZBC_NOZSRC_SUPPORT)) {
+		if (!(info->zbd_flags & ZBC_ZA_CONTROL_SUPPORT)) {
+			zbc_error("%s: Neither NOZSRC nor FSNOZ are supported\n",
+				  dev->zbd_filename);
+			ret = -ENOTSUP;
+			goto err;
+		}
+		plan->zbp_fsnoz = true;
+	}
+
+	/* Realms of domains with shifting boundaries go one by one */
+	if (shifting)
+		max_realms = 1;
+	max_zones = info->zbd_max_activation;
+
+	while (nr < nr_realms) {
+		ret = zbc_find_actv_realm(dev, realm_number, type, &r);
+		if (ret == -ENOENT) {
+			zbc_error("%s: Only %u realms can be activated as zone type 0x%x, %u requested\n",
+				  dev->zbd_filename, nr, type, nr_realms);
+			ret = -ENOSPC;
+			goto err;
+		}
+		if (ret)
+			goto err;
+
+		item = zbc_realm_item_by_type(&r, type);
+		if (!item) {
+			ret = -EIO;
+			goto err;
+		}
+
+		ret = zbc_plan_add_realm(dev, plan, &max_steps, &last, &r,
+					 item->zbi_dom_id, max_zones,
+					 max_realms);
+		if (ret)
+			goto err;
+
+		memcpy(&last, &r, sizeof(struct zbc_zone_realm));
+		realm_number = r.zbr_number + 1;
+		plan->zbp_nr_realms++;
+		nr++;
+	}
+
+	zbc_debug("%s: Activation plan of %u realms as zone type 0x%x in %u steps\n",
+		  dev->zbd_filename, plan->zbp_nr_realms, type,
+		  plan->zbp_nr_steps);
+
+	*pplan = plan;
+
+	return 0;
+
+err:
+	zbc_free_activation_plan(plan);
+
+	return ret;
+}
+
+/**
+ * zbc_free_activation_plan - Free a zone activation plan.
+ */
+void zbc_free_activation_plan(struct zbc_actv_plan *plan)
+{
+	if (!plan)
+		return;
+
+	free(plan->zbp_steps);
+	free(plan);
+}
+
+/**
+ * Zone reset thread context for activation plan execution. The reset
+ * thread uses its own device handle: zone activations change the realm
+ * index, the domains cache and the zone plugs of the handle they are
+ * executed on, which are not protected against concurrent zone operations.
+ */
+struct zbc_actv_reset_ctx {
+	struct zbc_device	*dev;
+	struct zbc_actv_plan	*plan;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	unsigned int		nr_reset;
+	unsigned int		nr_actv;
+	bool			abort;
+	int			ret;
+};
+
+/**
+ * Reset the zones of the plan steps, staying at most one
+ * step ahead of the activation.
+ */
+static void *zbc_actv_reset_thread(void *arg)
+{
+	struct zbc_actv_reset_ctx *ctx = arg;
+	struct zbc_actv_plan *plan = ctx->plan;
+	struct zbc_actv_step *s;
+	bool stop = false;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < plan->zbp_nr_steps; i++) {
+		pthread_mutex_lock(&ctx->mutex);
+		while (!ctx->abort && i > ctx->nr_actv + 1)
+			pthread_cond_wait(&ctx->cond, &ctx->mutex);
+		stop = ctx->abort;
+		pthread_mutex_unlock(&ctx->mutex);
+		if (stop)
+			break;
+
+		s = &plan->zbp_steps[i];
+		if (s->zbs_src_nr_zones)
+			ret = zbc_zone_group_op(ctx->dev, s->zbs_src_sector,
+						s->zbs_src_nr_zones,
+						ZBC_OP_RESET_ZONE, 0);
+
+		pthread_mutex_lock(&ctx->mutex);
+		if (ret)
+			ctx->ret = ret;
+		else
+			ctx->nr_reset = i + 1;
+		pthread_cond_broadcast(&ctx->cond);
+		pthread_mutex_unlock(&ctx->mutex);
+
+		if (ret) {
+			zbc_error("%s: Reset of %u zones at sector %llu failed %d\n",
+				  ctx->dev->zbd_filename, s->zbs_src_nr_zones,
+				  (unsigned long long)s->zbs_src_sector, ret);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Set the device FSNOZ (number of zones to activate) to @nr_zones.
+ */
+static int zbc_actv_set_fsnoz(struct zbc_device *dev, unsigned int nr_zones,
+			      unsigned int *fsnoz)
+{
+	struct zbc_zd_dev_control ctl;
+	int ret;
+
+	if (*fsnoz == nr_zones)
+		return 0;
+
+	ctl.zbt_nr_zones = nr_zones;
+	ctl.zbt_urswrz = 0xff;
+	ctl.zbt_max_activate = 0xffff;
+	ret = zbc_zone_activation_ctl(dev, &ctl, true);
+	if (ret) {
+		zbc_error("%s: Set FSNOZ to %u failed %d\n",
+			  dev->zbd_filename, nr_zones, ret);
+		return ret;
+	}
+
+	*fsnoz = nr_zones;
+
+	return 0;
+}
+
+/**
+ * zbc_exec_activation_plan - Query and execute a zone activation plan.
+ */
+int zbc_exec_activation_plan(struct zbc_device *dev,
+			     struct zbc_actv_plan *plan, unsigned int flags,
+			     zbc_actv_progress_t progress, void *data)
+{
+	struct zbc_zd_dev_control ctl;
+	struct zbc_actv_reset_ctx ctx;
+	struct zbc_actv_res *actv_recs;
+	struct zbc_actv_step *s;
+	unsigned int i, nr_actv_recs, fsnoz = 0, orig_fsnoz = 0;
+	bool zsrc = !plan->zbp_fsnoz, step_zsrc, cdb32;
+	pthread_t reset_thread;
+	bool reset = false, sync_reset = false;
+	int ret = 0, err;
+
+	/* FSNOZ is a persistent setting: restore it when done */
+	if (plan->zbp_fsnoz) {
+		ret = zbc_zone_activation_ctl(dev, &ctl, false);
+		if (ret) {
+			zbc_error("%s: Get FSNOZ failed %d\n",
+				  dev->zbd_filename, ret);
+			return ret;
+		}
+		fsnoz = ctl.zbt_nr_zones;
+		orig_fsnoz = fsnoz;
+	}
+
+	/* Query all steps before activating anything */
+	for (i = 0; i < plan->zbp_nr_steps; i++) {
+		s = &plan->zbp_steps[i];
+		step_zsrc = zsrc;
+		if (plan->zbp_fsnoz && s->zbs_nr_zones != fsnoz) {
+			if (flags & ZBC_ACTV_PLAN_QUERY) {
+				/* Query only: leave the device FSNOZ as is */
+				step_zsrc = true;
+			} else {
+				ret = zbc_actv_set_fsnoz(dev, s->zbs_nr_zones,
+							 &fsnoz);
+				if (ret)
+					goto restore;
+			}
+		}
+		cdb32 = plan->zbp_cdb32 ||
+			(step_zsrc && s->zbs_nr_zones > 0xffff);
+		ret = zbc_get_nr_actv_records(dev, step_zsrc, false, cdb32,
+					      s->zbs_start_sector,
+					      step_zsrc ? s->zbs_nr_zones : 0,
+					      s->zbs_dom_id);
+		if (ret < 0) {
+			zbc_error("%s: Query of step %u (realms %u..%u) failed %d\n",
+				  dev->zbd_filename, i, s->zbs_realm,
+				  s->zbs_realm + s->zbs_nr_realms - 1, ret);
+			goto restore;
+		}
+		s->zbs_nr_actv_recs = ret;
+		ret = 0;
+
+		if ((flags & ZBC_ACTV_PLAN_QUERY) && progress)
+			progress(dev, plan, i, data);
+	}
+
+	if (flags & ZBC_ACTV_PLAN_QUERY)
+		goto restore;
+
+	/*
+	 * Reset the zones of the next step while the current
+	 * step is being activated.
+	 */
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.plan = plan;
+	pthread_mutex_init(&ctx.mutex, NULL);
+	pthread_cond_init(&ctx.cond, NULL);
+	if ((flags & ZBC_ACTV_PLAN_RESET) && plan->zbp_nr_steps) {
+		ret = zbc_open(dev->zbd_filename, dev->zbd_open_flags,
+			       &ctx.dev);
+		if (ret) {
+			/* E.g. exclusive open: reset zones before each step */
+			zbc_warning("%s: Open for zone reset failed %d, "
+				    "not overlapping resets and activations\n",
+				    dev->zbd_filename, ret);
+			ctx.dev = NULL;
+			sync_reset = true;
+			ret = 0;
+		} else {
+			ret = pthread_create(&reset_thread, NULL,
+					     zbc_actv_reset_thread, &ctx);
+			if (ret) {
+				ret = -ret;
+				goto out;
+			}
+			reset = true;
+		}
+	}
+
+	for (i = 0; i < plan->zbp_nr_steps; i++) {
+		s = &plan->zbp_steps[i];
+
+		if (sync_reset && s->zbs_src_nr_zones) {
+			ret = zbc_zone_group_op(dev, s->zbs_src_sector,
+						s->zbs_src_nr_zones,
+						ZBC_OP_RESET_ZONE, 0);
+			if (ret) {
+				zbc_error("%s: Reset of %u zones at sector %llu failed %d\n",
+					  dev->zbd_filename,
+					  s->zbs_src_nr_zones,
+					  (unsigned long long)s->zbs_src_sector,
+					  ret);
+				break;
+			}
+		}
+
+		if (reset) {
+			pthread_mutex_lock(&ctx.mutex);
+			while (!ctx.ret && ctx.nr_reset <= i)
+				pthread_cond_wait(&ctx.cond, &ctx.mutex);
+			ret = ctx.ret;
+			pthread_mutex_unlock(&ctx.mutex);
+			if (ret)
+				break;
+		}
+
+		if (plan->zbp_fsnoz) {
+			ret = zbc_actv_set_fsnoz(dev, s->zbs_nr_zones, &fsnoz);
+			if (ret)
+				break;
+		}
+
+		/* Get one more record than needed to keep the index updated */
+		nr_actv_recs = s->zbs_nr_actv_recs + 1;
+		actv_recs = calloc(nr_actv_recs, sizeof(struct zbc_actv_res));
+		if (!actv_recs) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		ret = zbc_zone_activate(dev, zsrc, false, plan->zbp_cdb32,
+					s->zbs_start_sector,
+					zsrc ? s->zbs_nr_zones : 0,
+					s->zbs_dom_id, actv_recs,
+					&nr_actv_recs);
+		free(actv_recs);
+		if (ret) {
+			zbc_error("%s: Activation of step %u (realms %u..%u) failed %d\n",
+				  dev->zbd_filename, i, s->zbs_realm,
+				  s->zbs_realm + s->zbs_nr_realms - 1, ret);
+			break;
+		}
+
+		pthread_mutex_lock(&ctx.mutex);
+		ctx.nr_actv = i + 1;
+		pthread_cond_broadcast(&ctx.cond);
+		pthread_mutex_unlock(&ctx.mutex);
+
+		if (progress)
+			progress(dev, plan, i, data);
+	}
+
+	if (reset) {
+		pthread_mutex_lock(&ctx.mutex);
+		ctx.abort = true;
+		pthread_cond_broadcast(&ctx.cond);
+		pthread_mutex_unlock(&ctx.mutex);
+		pthread_join(reset_thread, NULL);
+	}
+
+out:
+	if (ctx.dev)
+		zbc_close(ctx.dev);
+	pthread_cond_destroy(&ctx.cond);
+	pthread_mutex_destroy(&ctx.mutex);
+
+restore:
+	if (plan->zbp_fsnoz) {
+		err = zbc_actv_set_fsnoz(dev, orig_fsnoz, &fsnoz);
+		if (err && !ret)
+			ret = err;
+	}
+
+	return ret;
+}
@@ -40,18 +40,6 @@
  */
 #define ZBC_RPT_DOMAINS_RECORD_SIZE	96
 
-/**
- * REPORT REALMS output header size.
- */
-#define ZBC_RPT_REALMS_HEADER_SIZE	64
-
-/**
- * REPORT REALMS output zone realm descriptor definitions.
- */
-#define ZBC_RPT_REALMS_RECORD_SIZE	128
-#define ZBC_RPT_REALMS_DESC_OFFSET	16
-#define ZBC_RPT_REALMS_SE_DESC_SIZE	16
-
 /**
  * SCSI commands reply length.
  */
@@ -403,6 +391,43 @@ out:
 	return 0;
 }
 
+/**
+ * Test if a standard block device is zoned using a single INQUIRY of the
+ * zoned block device characteristics VPD page (B6h), as done by the full
+ * device classification: a ZBD EXTENSION value of 1 indicates a host-aware
+ * device and a value of 2 a Zone Domains or Zone Realms device. This is
+ * used to quickly probe devices that the kernel reported as not zoned,
+ * including host-aware devices that recent kernels expose as regular
+ * block devices, without a full device classification.
+ */
+int zbc_scsi_probe_zoned(struct zbc_device *dev, enum zbc_dev_model *model)
+{
+	uint8_t buf[ZBC_SCSI_VPD_PAGE_B6_LEN];
+	int ret;
+
+	ret = zbc_scsi_vpd_inquiry(dev, 0xB6, buf, ZBC_SCSI_VPD_PAGE_B6_LEN);
+	if (ret != 0) {
+		/* Page not supported: not a zoned device */
+		zbc_debug("%s: VPD page 0xB6 not supported\n",
+			  dev->zbd_filename);
+		return 0;
+	}
+
+	if (buf[1] != 0xB6)
+		return 0;
+
+	switch ((buf[4] >> 4) & 0x0f) {
+	case 1:
+		*model = ZBC_DM_HOST_AWARE;
+		return 1;
+	case 2:
+		*model = ZBC_DM_HOST_MANAGED;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
 /**
  * Get a SCSI device zone information.
  */
@@ -560,6 +585,7 @@ static int zbc_scsi_do_report_zones(struct zbc_device *dev, uint64_t sector,
 
 		zones[i].zbz_attributes = buf[1] & 0x03;
 		zones[i].zbz_condition = (buf[1] >> 4) & 0x0f;
+		zones[i].zbz_capacity = 0;
 
 		zones[i].zbz_length =
 			zbc_dev_lba2sect(dev, zbc_sg_get_int64(&buf[8]));
@@ -860,27 +886,12 @@ static int zbc_scsi_report_realms(struct zbc_device *dev, uint64_t sector,
 	if (!zbc_dev_is_zoned(dev))
 		return -ENXIO;
 	/*
-	 * Always get zone domains first. Allocate the buffer for
-	 * ZBC_NR_ZONE_TYPES domains since we will be only able to
-	 * process as many.
+	 * Get the zone domains first. These are cached and only
+	 * reported again after a zone activation.
 	 */
-	nr_domains = ZBC_NR_ZONE_TYPES;
-	domains = calloc(nr_domains, sizeof(struct zbc_zone_domain));
-	if (!domains)
-		return -ENOMEM;
-
-	nr_domains = zbc_scsi_report_domains(dev, 0LL, ZBC_RZD_RO_ALL, domains,
-					     nr_domains);
-	if (nr_domains > ZBC_NR_ZONE_TYPES) {
-		zbc_warning("%s: Device has %i domains, only %u are supported\n",
-			    dev->zbd_filename, nr_domains, ZBC_NR_ZONE_TYPES);
-
-		nr_domains = ZBC_NR_ZONE_TYPES;
-	}
-	if (nr_domains < 0) {
-		free(domains);
+	nr_domains = zbc_get_cached_domains(dev, &domains);
+	if (nr_domains < 0)
 		return nr_domains;
-	}
 
 	if (*nr_realms)
 		bufsz += (size_t)*nr_realms * ZBC_RPT_REALMS_RECORD_SIZE;
@@ -889,10 +900,8 @@ static int zbc_scsi_report_realms(struct zbc_device *dev, uint64_t sector,
 
 	/* Allocate and initialize REPORT REALMS command */
 	ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_REPORT_REALMS, NULL, bufsz);
-	if (ret != 0) {
-		free(domains);
+	if (ret != 0)
 		return ret;
-	}
 
 	/* Fill command CDB:
 	 * +=============================================================================+
@@ -940,6 +949,7 @@ static int zbc_scsi_report_realms(struct zbc_device *dev, uint64_t sector,
 	/* Get number of realm descriptors from the header */
 	buf = cmd.buf;
 	nr = zbc_sg_get_int32(&buf[4]);
+	dev->zbd_rpt_nr_realms = nr;
 
 	if (!realms || !nr)
 		goto out;
@@ -1006,9 +1016,6 @@ static int zbc_scsi_report_realms(struct zbc_device *dev, uint64_t sector,
 	}
 
 out:
-	if (domains)
-		free(domains);
-
 	/* Return the number of realm descriptors */
 	*nr_realms = nr;
 
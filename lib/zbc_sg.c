@@ -15,9 +15,13 @@
 #include <string.h>
 #include <linux/limits.h>
 #include <linux/fs.h>
+#include <linux/major.h>
+#include <unistd.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <assert.h>
 
 #include "zbc.h"
@@ -241,6 +245,15 @@ static struct zbc_sg_cmd_s
 		ZBC_SG_ATA16_CDB_LENGTH,
 		0,
 		ZBC_SG_TIMEOUT,
+	},
+
+	[ZBC_SG_ATA32] = {
+		"ATA 32",
+		ZBC_SG_ATA32_CDB_OPCODE,
+		ZBC_SG_ATA32_CDB_SA,
+		ZBC_SG_ATA32_CDB_LENGTH,
+		0,
+		ZBC_SG_TIMEOUT,
 	}
 };
 
@@ -255,6 +268,22 @@ static const char *zbc_sg_cmd_name(struct zbc_sg_cmd *cmd)
 	return "(UNKNOWN COMMAND)";
 }
 
+/**
+ * Process unit attentions of interest.
+ */
+static void zbc_sg_check_unit_attention(struct zbc_device *dev)
+{
+	if (zerrno.sk != ZBC_SK_UNIT_ATTENTION)
+		return;
+
+	/* The zone domains change with the device capacity */
+	if (zerrno.asc_ascq == ZBC_ASC_CAPACITY_DATA_HAS_CHANGED) {
+		zbc_debug("%s: Capacity changed, invalidating domains cache\n",
+			  dev->zbd_filename);
+		zbc_invalidate_domains(dev);
+	}
+}
+
 /**
  * Set ASC, ASCQ.
  */
@@ -300,6 +329,8 @@ static void zbc_sg_set_sense(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
 			desc += 2 + desc[1];
 		}
 
+		zbc_sg_check_unit_attention(dev);
+
 		return;
 	}
 
@@ -315,6 +346,8 @@ static void zbc_sg_set_sense(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
 
 	/* Sense Data Command-Specific Information Field */
 	zerrno.err_csinfo = zbc_sg_get_int32(&sb[8]);
+
+	zbc_sg_check_unit_attention(dev);
 }
 
 #ifdef SG_FLAG_DIRECT_IO
@@ -401,33 +434,27 @@ void zbc_sg_cmd_destroy(struct zbc_sg_cmd *cmd)
 }
 
 /**
- * Execute a command.
+ * Print a command before sending it.
  */
-int zbc_sg_cmd_exec(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
+static void zbc_sg_cmd_print(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
 {
-	int ret;
-
-	if (zbc_log_level >= ZBC_LOG_DEBUG) {
-		zbc_debug("%s: Executing command 0x%02x:0x%02x (%s%s), %zu B:\n",
-			  dev->zbd_filename,
-			  cmd->cdb_opcode, cmd->cdb_sa,
-			  zbc_sg_cmd_name(cmd),
-			  cmd->code == ZBC_SG_ATA16 ?
-			  zbc_ata_cmd_name(cmd) : "",
-			  cmd->bufsz);
-		zbc_sg_print_bytes(dev, cmd->cdb, cmd->cdb_sz);
-	}
+	if (zbc_log_level < ZBC_LOG_DEBUG)
+		return;
 
-	/* Send the SG_IO command */
-	ret = ioctl(dev->zbd_sg_fd, SG_IO, &cmd->io_hdr);
-	if (ret != 0) {
-		ret = -errno;
-		zbc_debug("%s: SG_IO ioctl failed %d (%s)\n",
-			  dev->zbd_filename,
-			  errno, strerror(errno));
-		return ret;
-	}
+	zbc_debug("%s: Executing command 0x%02x:0x%02x (%s%s), %zu B:\n",
+		  dev->zbd_filename,
+		  cmd->cdb_opcode, cmd->cdb_sa,
+		  zbc_sg_cmd_name(cmd),
+		  zbc_ata_cmd_name(cmd),
+		  cmd->bufsz);
+	zbc_sg_print_bytes(dev, cmd->cdb, cmd->cdb_sz);
+}
 
+/**
+ * Check the status of a completed command.
+ */
+static int zbc_sg_cmd_check(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
+{
 	/* Reset errno */
 	zbc_sg_set_sense(dev, NULL);
 
@@ -439,8 +466,7 @@ int zbc_sg_cmd_exec(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
 			  "(flags 0x%04x)\n",
 			  dev->zbd_filename,
 			  zbc_sg_cmd_name(cmd),
-			  cmd->code == ZBC_SG_ATA16 ?
-			  zbc_ata_cmd_name(cmd) : "",
+			  zbc_ata_cmd_name(cmd),
 			  (unsigned int)cmd->io_hdr.status,
 			  (unsigned int)cmd->io_hdr.masked_status,
 			  (unsigned int)cmd->io_hdr.host_status,
@@ -479,8 +505,7 @@ int zbc_sg_cmd_exec(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
 				  "0x%04x (flags 0x%04x)\n",
 				  dev->zbd_filename,
 				  zbc_sg_cmd_name(cmd),
-				  cmd->code == ZBC_SG_ATA16 ?
-				  zbc_ata_cmd_name(cmd) : "",
+				  zbc_ata_cmd_name(cmd),
 				  (unsigned int)cmd->io_hdr.status,
 				  (unsigned int)cmd->io_hdr.masked_status,
 				  (unsigned int)cmd->io_hdr.host_status,
@@ -514,13 +539,108 @@ int zbc_sg_cmd_exec(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
 		  "(%d B residual)\n\n",
 		  dev->zbd_filename,
 		  zbc_sg_cmd_name(cmd),
-		  cmd->code == ZBC_SG_ATA16 ? zbc_ata_cmd_name(cmd) : "",
+		  zbc_ata_cmd_name(cmd),
 		  cmd->io_hdr.duration,
 		  cmd->bufsz, cmd->io_hdr.resid);
 
 	return 0;
 }
 
+/**
+ * Execute a command.
+ */
+int zbc_sg_cmd_exec(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
+{
+	int ret;
+
+	zbc_sg_cmd_print(dev, cmd);
+
+	/* Send the SG_IO command */
+	ret = ioctl(dev->zbd_sg_fd, SG_IO, &cmd->io_hdr);
+	if (ret != 0) {
+		ret = -errno;
+		zbc_debug("%s: SG_IO ioctl failed %d (%s)\n",
+			  dev->zbd_filename,
+			  errno, strerror(errno));
+		return ret;
+	}
+
+	return zbc_sg_cmd_check(dev, cmd);
+}
+
+/**
+ * Test if commands can be submitted asynchronously, that is,
+ * if the device SG file descriptor is an SG node.
+ */
+bool zbc_sg_async_supported(struct zbc_device *dev)
+{
+	struct stat st;
+
+	if (fstat(dev->zbd_sg_fd, &st) != 0)
+		return false;
+
+	return S_ISCHR(st.st_mode) && major(st.st_rdev) == SCSI_GENERIC_MAJOR;
+}
+
+/**
+ * Submit a command without waiting for its completion.
+ */
+int zbc_sg_cmd_submit(struct zbc_device *dev, struct zbc_sg_cmd *cmd)
+{
+	ssize_t ret;
+
+	zbc_sg_cmd_print(dev, cmd);
+
+	cmd->io_hdr.usr_ptr = cmd;
+	ret = write(dev->zbd_sg_fd, &cmd->io_hdr, sizeof(sg_io_hdr_t));
+	if (ret != sizeof(sg_io_hdr_t)) {
+		ret = ret < 0 ? -errno : -EIO;
+		zbc_debug("%s: SG write failed %zd (%s)\n",
+			  dev->zbd_filename, -ret, strerror(-ret));
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * Get a command submitted with zbc_sg_cmd_submit once completed.
+ * If @wait is false and no command is completed, return -EAGAIN.
+ */
+int zbc_sg_cmd_reap(struct zbc_device *dev, struct zbc_sg_cmd **pcmd,
+		    bool wait)
+{
+	struct pollfd pfd = { .fd = dev->zbd_sg_fd, .events = POLLIN };
+	struct zbc_sg_cmd *cmd;
+	sg_io_hdr_t io_hdr;
+	ssize_t ret;
+
+	if (!wait) {
+		ret = poll(&pfd, 1, 0);
+		if (ret < 0)
+			return -errno;
+		if (!ret)
+			return -EAGAIN;
+	}
+
+	memset(&io_hdr, 0, sizeof(sg_io_hdr_t));
+	io_hdr.interface_id = 'S';
+	io_hdr.pack_id = -1;
+	ret = read(dev->zbd_sg_fd, &io_hdr, sizeof(sg_io_hdr_t));
+	if (ret != sizeof(sg_io_hdr_t)) {
+		ret = ret < 0 ? -errno : -EIO;
+		zbc_debug("%s: SG read failed %zd (%s)\n",
+			  dev->zbd_filename, -ret, strerror(-ret));
+		return ret;
+	}
+
+	cmd = io_hdr.usr_ptr;
+	memcpy(&cmd->io_hdr, &io_hdr, sizeof(sg_io_hdr_t));
+	*pcmd = cmd;
+
+	return zbc_sg_cmd_check(dev, cmd);
+}
+
 /**
  * SG command maximum transfer length in number of 4KB pages.
  * This may limit the SG reported value to a smaller value likely to work
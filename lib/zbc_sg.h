@@ -44,6 +44,7 @@ enum {
 	ZBC_SG_ZONE_QUERY_32,
 	ZBC_SG_RECEIVE_DIAG_RESULTS,
 	ZBC_SG_ATA16,
+	ZBC_SG_ATA32,
 
 	ZBC_SG_CMD_NUM,
 };
@@ -205,6 +206,13 @@ enum {
 #define ZBC_SG_ATA16_CDB_OPCODE			0x85
 #define ZBC_SG_ATA16_CDB_LENGTH			16
 
+/**
+ * ATA pass through 32.
+ */
+#define ZBC_SG_ATA32_CDB_OPCODE			0x7F
+#define ZBC_SG_ATA32_CDB_SA			0x1FF0
+#define ZBC_SG_ATA32_CDB_LENGTH			32
+
 /**
  * Command sense buffer maximum length.
  */
@@ -323,6 +331,23 @@ extern void zbc_sg_get_max_cmd_blocks(struct zbc_device *dev);
  */
 extern int zbc_sg_cmd_exec(struct zbc_device *dev, struct zbc_sg_cmd *cmd);
 
+/**
+ * Test if commands can be submitted asynchronously.
+ */
+extern bool zbc_sg_async_supported(struct zbc_device *dev);
+
+/**
+ * Submit a command without waiting for its completion.
+ */
+extern int zbc_sg_cmd_submit(struct zbc_device *dev, struct zbc_sg_cmd *cmd);
+
+/**
+ * Get a completed command submitted with zbc_sg_cmd_submit. The
+ * command is returned at @pcmd even if it failed.
+ */
+extern int zbc_sg_cmd_reap(struct zbc_device *dev, struct zbc_sg_cmd **pcmd,
+			   bool wait);
+
 /**
  * Test if unit is ready. This will retry 5 times if the command
  * returns "UNIT ATTENTION".
@@ -455,7 +480,8 @@ extern void zbc_sg_print_bytes(struct zbc_device *dev,
 			       uint8_t const *buf, unsigned int len);
 
 /**
- * Get the name of an ATA command sent with ATA16 passthrough.
+ * Get the name of an ATA command sent with ATA16 or ATA32 passthrough.
+ * Return an empty string for other commands.
  */
 char *zbc_ata_cmd_name(struct zbc_sg_cmd *cmd);
 
@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ *
+ * Compact zone tables.
+ */
+#include "zbc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Number of zones reported per REPORT ZONES command by zbc_list_zone_table().
+ */
+#define ZBC_ZONE_TABLE_CHUNK	1024
+
+static inline void zbc_zone_table_set_bit(uint64_t *map, unsigned int idx)
+{
+	map[idx / ZBC_ZTB_WORD_BITS] |= 1ULL << (idx % ZBC_ZTB_WORD_BITS);
+}
+
+static inline void zbc_zone_table_clear_bit(uint64_t *map, unsigned int idx)
+{
+	map[idx / ZBC_ZTB_WORD_BITS] &= ~(1ULL << (idx % ZBC_ZTB_WORD_BITS));
+}
+
+/**
+ * zbc_zone_table_free - Free a zone table
+ */
+void zbc_zone_table_free(struct zbc_zone_table *zt)
+{
+	if (!zt)
+		return;
+
+	free(zt->ztb_cond_map[0]);
+	free(zt->ztb_attrs);
+	free(zt->ztb_type_cond);
+	free(zt->ztb_wp_ofst);
+	free(zt->ztb_runs);
+	free(zt);
+}
+
+/**
+ * zbc_zone_table_alloc - Allocate an empty zone table for up to @nr_zones
+ */
+static struct zbc_zone_table *zbc_zone_table_alloc(unsigned int nr_zones)
+{
+	struct zbc_zone_table *zt;
+	uint64_t *maps;
+	int c;
+
+	zt = calloc(1, sizeof(struct zbc_zone_table));
+	if (!zt)
+		return NULL;
+
+	zt->ztb_nr_words = (nr_zones + ZBC_ZTB_WORD_BITS - 1) /
+		ZBC_ZTB_WORD_BITS;
+	zt->ztb_wp_ofst = calloc(nr_zones + 1, sizeof(uint32_t));
+	zt->ztb_type_cond = calloc(nr_zones + 1, sizeof(uint8_t));
+	zt->ztb_attrs = calloc(nr_zones + 1, sizeof(uint8_t));
+	maps = calloc((size_t)zt->ztb_nr_words * ZBC_ZSM_NR_CONDS + 1,
+		      sizeof(uint64_t));
+	if (!zt->ztb_wp_ofst || !zt->ztb_type_cond || !zt->ztb_attrs ||
+	    !maps) {
+		free(maps);
+		zbc_zone_table_free(zt);
+		return NULL;
+	}
+
+	/* All condition bitmaps are in a single buffer */
+	for (c = 0; c < ZBC_ZSM_NR_CONDS; c++)
+		zt->ztb_cond_map[c] = maps + c * zt->ztb_nr_words;
+
+	return zt;
+}
+
+/**
+ * zbc_zone_table_add - Add a zone at the end of a zone table
+ */
+static int zbc_zone_table_add(struct zbc_zone_table *zt, struct zbc_zone *z)
+{
+	struct zbc_zone_table_run *r = NULL, *runs;
+	unsigned int idx = zt->ztb_nr_zones;
+	uint64_t end;
+
+	if (zbc_zone_length(z) >= ZBC_ZTB_NO_WP)
+		return -EOVERFLOW;
+
+	/* Extend the last run or start a new one */
+	if (zt->ztb_nr_runs) {
+		r = &zt->ztb_runs[zt->ztb_nr_runs - 1];
+		end = r->ztr_start + r->ztr_zone_sectors * r->ztr_nr_zones;
+		if (zbc_zone_start(z) < end)
+			return -EINVAL;
+		if (zbc_zone_start(z) != end ||
+		    zbc_zone_length(z) != r->ztr_zone_sectors ||
+		    z->zbz_capacity != r->ztr_zone_capacity)
+			r = NULL;
+	}
+
+	if (!r) {
+		if (zt->ztb_nr_runs == zt->ztb_max_runs) {
+			zt->ztb_max_runs = zt->ztb_max_runs ?
+				zt->ztb_max_runs * 2 : 4;
+			runs = realloc(zt->ztb_runs, zt->ztb_max_runs *
+				       sizeof(struct zbc_zone_table_run));
+			if (!runs)
+				return -ENOMEM;
+			zt->ztb_runs = runs;
+		}
+		r = &zt->ztb_runs[zt->ztb_nr_runs++];
+		r->ztr_start = zbc_zone_start(z);
+		r->ztr_zone_sectors = zbc_zone_length(z);
+		r->ztr_zone_capacity = z->zbz_capacity;
+		r->ztr_first_zone = idx;
+		r->ztr_nr_zones = 0;
+	}
+	r->ztr_nr_zones++;
+
+	if (zbc_zone_wp(z) >= zbc_zone_start(z) &&
+	    zbc_zone_wp(z) - zbc_zone_start(z) <= zbc_zone_length(z))
+		zt->ztb_wp_ofst[idx] = zbc_zone_wp(z) - zbc_zone_start(z);
+	else
+		zt->ztb_wp_ofst[idx] = ZBC_ZTB_NO_WP;
+	zt->ztb_type_cond[idx] = (z->zbz_type << 4) |
+		(z->zbz_condition & 0x0f);
+	zt->ztb_attrs[idx] = z->zbz_attributes;
+	zbc_zone_table_set_bit(zt->ztb_cond_map[z->zbz_condition & 0x0f], idx);
+
+	zt->ztb_nr_zones++;
+
+	return 0;
+}
+
+/**
+ * zbc_zone_table_from_zones - Create a zone table from an array of zones
+ */
+int zbc_zone_table_from_zones(struct zbc_zone *zones, unsigned int nr_zones,
+			      struct zbc_zone_table **pzt)
+{
+	struct zbc_zone_table *zt;
+	unsigned int i;
+	int ret;
+
+	zt = zbc_zone_table_alloc(nr_zones);
+	if (!zt)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_zones; i++) {
+		ret = zbc_zone_table_add(zt, &zones[i]);
+		if (ret != 0) {
+			zbc_zone_table_free(zt);
+			return ret;
+		}
+	}
+
+	*pzt = zt;
+
+	return 0;
+}
+
+/**
+ * zbc_list_zone_table - Create a zone table for the zones of a device
+ */
+int zbc_list_zone_table(struct zbc_device *dev, uint64_t sector,
+			struct zbc_zone_table **pzt)
+{
+	struct zbc_zone_table *zt;
+	struct zbc_zone *zones;
+	unsigned int i, nr_zones, max_zones = 0;
+	int ret;
+
+	/* Get total number of zones */
+	ret = zbc_report_nr_zones(dev, sector, ZBC_RZ_RO_ALL, &max_zones);
+	if (ret < 0)
+		return ret;
+
+	zones = calloc(ZBC_ZONE_TABLE_CHUNK, sizeof(struct zbc_zone));
+	zt = zbc_zone_table_alloc(max_zones);
+	if (!zones || !zt) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	while (zt->ztb_nr_zones < max_zones &&
+	       sector < dev->zbd_info.zbd_sectors) {
+
+		nr_zones = ZBC_ZONE_TABLE_CHUNK;
+		if (nr_zones > max_zones - zt->ztb_nr_zones)
+			nr_zones = max_zones - zt->ztb_nr_zones;
+		ret = zbc_report_zones(dev, sector, ZBC_RZ_RO_ALL,
+				       zones, &nr_zones);
+		if (ret != 0) {
+			zbc_error("%s: zbc_report_zones failed %d\n",
+				  dev->zbd_filename, ret);
+			goto out;
+		}
+
+		if (!nr_zones)
+			break;
+
+		for (i = 0; i < nr_zones; i++) {
+			ret = zbc_zone_table_add(zt, &zones[i]);
+			if (ret != 0)
+				goto out;
+		}
+
+		sector = zbc_zone_start(&zones[nr_zones - 1]) +
+			zbc_zone_length(&zones[nr_zones - 1]);
+	}
+
+	zbc_debug("%s: Zone table: %u zones, %u runs\n",
+		  dev->zbd_filename, zt->ztb_nr_zones, zt->ztb_nr_runs);
+
+	*pzt = zt;
+	zt = NULL;
+
+out:
+	zbc_zone_table_free(zt);
+	free(zones);
+
+	return ret;
+}
+
+/**
+ * zbc_zone_table_run - Get the run of the zone at index @idx
+ */
+static struct zbc_zone_table_run *
+zbc_zone_table_run(struct zbc_zone_table *zt, unsigned int idx)
+{
+	unsigned int lo = 0, hi = zt->ztb_nr_runs, mid;
+
+	/* Most tables have a single run, or a few runs */
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (zt->ztb_runs[mid].ztr_first_zone <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return &zt->ztb_runs[lo];
+}
+
+/**
+ * zbc_zone_table_get_zone - Get the information of a zone of a zone table
+ */
+int zbc_zone_table_get_zone(struct zbc_zone_table *zt, unsigned int idx,
+			    struct zbc_zone *zone)
+{
+	struct zbc_zone_table_run *r;
+
+	if (idx >= zt->ztb_nr_zones)
+		return -EINVAL;
+
+	r = zbc_zone_table_run(zt, idx);
+
+	memset(zone, 0, sizeof(struct zbc_zone));
+	zone->zbz_start = r->ztr_start +
+		(uint64_t)(idx - r->ztr_first_zone) * r->ztr_zone_sectors;
+	zone->zbz_length = r->ztr_zone_sectors;
+	zone->zbz_capacity = r->ztr_zone_capacity;
+	if (zt->ztb_wp_ofst[idx] == ZBC_ZTB_NO_WP)
+		zone->zbz_write_pointer = (uint64_t)-1;
+	else
+		zone->zbz_write_pointer = zone->zbz_start +
+			zt->ztb_wp_ofst[idx];
+	zone->zbz_type = zbc_zone_table_type(zt, idx);
+	zone->zbz_condition = zbc_zone_table_cond(zt, idx);
+	zone->zbz_attributes = zt->ztb_attrs[idx];
+
+	return 0;
+}
+
+/**
+ * zbc_zone_table_set_zone - Update the information of a zone of a zone table
+ */
+int zbc_zone_table_set_zone(struct zbc_zone_table *zt, unsigned int idx,
+			    struct zbc_zone *zone)
+{
+	struct zbc_zone cur;
+	unsigned int cond = zone->zbz_condition & 0x0f;
+
+	if (zbc_zone_table_get_zone(zt, idx, &cur) != 0 ||
+	    zbc_zone_start(zone) != zbc_zone_start(&cur) ||
+	    zbc_zone_length(zone) != zbc_zone_length(&cur) ||
+	    zbc_zone_type(zone) != zbc_zone_type(&cur))
+		return -EINVAL;
+
+	zbc_zone_table_clear_bit(zt->ztb_cond_map[zbc_zone_condition(&cur)],
+				 idx);
+	zbc_zone_table_set_bit(zt->ztb_cond_map[cond], idx);
+
+	if (zbc_zone_wp(zone) >= zbc_zone_start(zone) &&
+	    zbc_zone_wp(zone) - zbc_zone_start(zone) <= zbc_zone_length(zone))
+		zt->ztb_wp_ofst[idx] = zbc_zone_wp(zone) - zbc_zone_start(zone);
+	else
+		zt->ztb_wp_ofst[idx] = ZBC_ZTB_NO_WP;
+	zt->ztb_type_cond[idx] = (zone->zbz_type << 4) | cond;
+	zt->ztb_attrs[idx] = zone->zbz_attributes;
+
+	return 0;
+}
+
+/**
+ * zbc_zone_table_zone_idx - Get the index of the zone containing @sector
+ */
+int zbc_zone_table_zone_idx(struct zbc_zone_table *zt, uint64_t sector)
+{
+	unsigned int lo = 0, hi = zt->ztb_nr_runs, mid;
+	struct zbc_zone_table_run *r;
+	uint64_t i;
+
+	if (!hi || sector < zt->ztb_runs[0].ztr_start)
+		return -ENOENT;
+
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (zt->ztb_runs[mid].ztr_start <= sector)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	r = &zt->ztb_runs[lo];
+	i = (sector - r->ztr_start) / r->ztr_zone_sectors;
+	if (i >= r->ztr_nr_zones)
+		return -ENOENT;
+
+	return r->ztr_first_zone + i;
+}
+
+/**
+ * zbc_zone_table_count - Count the zones in a set of conditions
+ */
+unsigned int zbc_zone_table_count(struct zbc_zone_table *zt,
+				  unsigned int conds)
+{
+	unsigned int c, w, nr = 0;
+	uint64_t *map;
+
+	/* A zone is in a single condition: the bitmaps are disjoint */
+	for (c = 0; c < ZBC_ZSM_NR_CONDS; c++) {
+		if (!(conds & ZBC_ZF_COND(c)))
+			continue;
+		map = zt->ztb_cond_map[c];
+		for (w = 0; w < zt->ztb_nr_words; w++)
+			nr += __builtin_popcountll(map[w]);
+	}
+
+	return nr;
+}
+
+/**
+ * zbc_zone_table_next - Find the next zone in a set of conditions
+ */
+int zbc_zone_table_next(struct zbc_zone_table *zt, unsigned int idx,
+			unsigned int conds)
+{
+	unsigned int first = idx / ZBC_ZTB_WORD_BITS, w, bits;
+	uint64_t word;
+
+	if (idx >= zt->ztb_nr_zones)
+		return -ENOENT;
+
+	conds &= ZBC_ZF_COND(ZBC_ZSM_NR_CONDS) - 1;
+
+	for (w = first; w < zt->ztb_nr_words; w++) {
+		word = 0;
+		for (bits = conds; bits; bits &= bits - 1)
+			word |= zt->ztb_cond_map[__builtin_ctz(bits)][w];
+		if (w == first)
+			word &= ~0ULL << (idx % ZBC_ZTB_WORD_BITS);
+		if (word)
+			return w * ZBC_ZTB_WORD_BITS + __builtin_ctzll(word);
+	}
+
+	return -ENOENT;
+}
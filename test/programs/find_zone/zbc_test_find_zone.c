@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libzbc/zbc.h"
+#include "zbc_private.h"
+
+/*
+ * Parse a list of values separated with '|' (e.g. "0x2|0x3") into a bitmap.
+ */
+static int zbc_test_parse_bitmap(char *str, unsigned int *bitmap)
+{
+	unsigned long val;
+	char *tok, *end;
+
+	*bitmap = 0;
+	for (tok = strtok(str, "|"); tok; tok = strtok(NULL, "|")) {
+		val = strtoul(tok, &end, 0);
+		if (*end != '\0' || val >= 32)
+			return -1;
+		*bitmap |= 1U << val;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct zbc_zone_filter filter;
+	struct zbc_device_info info;
+	unsigned long long lba = 0;
+	struct zbc_device *dev;
+	struct zbc_zone zone;
+	unsigned int oflags;
+	int i, ret = 1;
+
+	memset(&filter, 0, sizeof(filter));
+
+	/* Check command line */
+	if (argc < 2) {
+usage:
+		fprintf(stderr,
+			"Usage: %s [options] <dev>\n"
+			"Options:\n"
+			"    -v            : Verbose mode\n"
+			"    -lba <lba>    : Start the search from the zone\n"
+			"                    containing <lba> (default is 0)\n"
+			"    -t <types>    : Zone types searched, as a list of\n"
+			"                    values separated with '|'\n"
+			"    -c <conds>    : Zone conditions searched, as a list\n"
+			"                    of values separated with '|'\n",
+			argv[0]);
+		return 1;
+	}
+
+	/* Parse options */
+	for (i = 1; i < (argc - 1); i++) {
+
+		if (strcmp(argv[i], "-v") == 0) {
+
+			zbc_set_log_level("debug");
+
+		} else if (strcmp(argv[i], "-lba") == 0) {
+
+			if (i >= argc - 1)
+				goto usage;
+			i++;
+
+			lba = strtoll(argv[i], NULL, 10);
+
+		} else if (strcmp(argv[i], "-t") == 0) {
+
+			if (i >= argc - 1)
+				goto usage;
+			i++;
+
+			if (zbc_test_parse_bitmap(argv[i], &filter.zbf_types))
+				goto usage;
+
+		} else if (strcmp(argv[i], "-c") == 0) {
+
+			if (i >= argc - 1)
+				goto usage;
+			i++;
+
+			if (zbc_test_parse_bitmap(argv[i], &filter.zbf_conds))
+				goto usage;
+
+		} else if (argv[i][0] == '-') {
+
+			printf("Unknown option \"%s\"\n", argv[i]);
+			goto usage;
+
+		} else {
+
+			break;
+
+		}
+
+	}
+
+	if (i != argc - 1)
+		goto usage;
+
+	/* Open device */
+	oflags = ZBC_O_DEVTEST;
+	oflags |= ZBC_O_DRV_ATA;
+	if (!getenv("ZBC_TEST_FORCE_ATA"))
+		oflags |= ZBC_O_DRV_SCSI;
+
+	ret = zbc_open(argv[i], oflags | O_RDONLY, &dev);
+	if (ret != 0) {
+		fprintf(stderr, "[TEST][ERROR],open device failed, err %d (%s) %s\n",
+			ret, strerror(-ret), argv[i]);
+		printf("[TEST][ERROR][SENSE_KEY],open-device-failed\n");
+		printf("[TEST][ERROR][ASC_ASCQ],open-device-failed\n");
+		return 1;
+	}
+
+	zbc_get_device_info(dev, &info);
+
+	/* Search the zone */
+	ret = zbc_find_zone(dev, zbc_lba2sect(&info, lba), &filter, &zone);
+	if (ret == -ENOENT) {
+		/* No matching zone: no zone information is printed */
+		ret = 0;
+		goto out;
+	}
+	if (ret != 0) {
+		fprintf(stderr,
+			"[TEST][ERROR],zbc_find_zone lba %llu failed %d\n",
+			lba, ret);
+		ret = 1;
+		goto out;
+	}
+
+	if (zbc_zone_conventional(&zone))
+		printf("[ZONE_INFO],0,0x%x,0x%x,%llu,%llu,N/A\n",
+		       zbc_zone_type(&zone),
+		       zbc_zone_condition(&zone),
+		       zbc_sect2lba(&info, zbc_zone_start(&zone)),
+		       zbc_sect2lba(&info, zbc_zone_length(&zone)));
+	else
+		printf("[ZONE_INFO],0,0x%x,0x%x,%llu,%llu,%llu\n",
+		       zbc_zone_type(&zone),
+		       zbc_zone_condition(&zone),
+		       zbc_sect2lba(&info, zbc_zone_start(&zone)),
+		       zbc_sect2lba(&info, zbc_zone_length(&zone)),
+		       zbc_sect2lba(&info, zbc_zone_wp(&zone)));
+
+out:
+	if (ret != 0) {
+		struct zbc_errno zbc_err;
+		const char *sk_name;
+		const char *ascq_name;
+
+		zbc_errno(dev, &zbc_err);
+		sk_name = zbc_sk_str(zbc_err.sk);
+		ascq_name = zbc_asc_ascq_str(zbc_err.asc_ascq);
+
+		printf("[TEST][ERROR][SENSE_KEY],%s\n", sk_name);
+		printf("[TEST][ERROR][ASC_ASCQ],%s\n", ascq_name);
+
+	}
+
+	zbc_close(dev);
+
+	return ret;
+}
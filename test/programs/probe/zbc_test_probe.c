@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2023 Western Digital Corporation or its affiliates.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libzbc/zbc.h>
+
+/*
+ * Probe a device with zbc_device_is_zoned() and zbc_device_is_zoned_fast()
+ * and print the results of both tests.
+ */
+int main(int argc, char **argv)
+{
+	enum zbc_dev_model model = ZBC_DM_STANDARD;
+	struct zbc_device_info info;
+	int i, ret, fast_ret;
+
+	/* Check command line */
+	if (argc < 2) {
+usage:
+		fprintf(stderr,
+			"Usage: %s [-v] <dev>\n"
+			"Options:\n"
+			"    -v         : Verbose mode\n",
+			argv[0]);
+		return 1;
+	}
+
+	/* Parse options */
+	for (i = 1; i < (argc - 1); i++) {
+		if (strcmp(argv[i], "-v") == 0) {
+			zbc_set_log_level("debug");
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
+			goto usage;
+		} else {
+			break;
+		}
+	}
+
+	if (i != argc - 1)
+		goto usage;
+
+	memset(&info, 0, sizeof(info));
+	info.zbd_model = ZBC_DM_STANDARD;
+	ret = zbc_device_is_zoned(argv[i], false, &info);
+	if (ret < 0) {
+		fprintf(stderr,
+			"[TEST][ERROR],zbc_device_is_zoned failed %d (%s)\n",
+			ret, strerror(-ret));
+		return 1;
+	}
+	if (ret != 1)
+		info.zbd_model = ZBC_DM_STANDARD;
+
+	fast_ret = zbc_device_is_zoned_fast(argv[i], &model);
+	if (fast_ret < 0) {
+		fprintf(stderr,
+			"[TEST][ERROR],zbc_device_is_zoned_fast failed %d (%s)\n",
+			fast_ret, strerror(-fast_ret));
+		return 1;
+	}
+
+	printf("[TEST][INFO][PROBE],%d,%s\n",
+	       ret, zbc_device_model_str(info.zbd_model));
+	printf("[TEST][INFO][PROBE_FAST],%d,%s\n",
+	       fast_ret, zbc_device_model_str(model));
+
+	return 0;
+}
@@ -14,10 +14,24 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "libzbc/zbc.h"
 #include "zbc_private.h"
 
+/*
+ * Get the current time in microseconds, to time the device commands.
+ */
+static inline unsigned long long zbc_test_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000ULL +
+		ts.tv_nsec / 1000;
+}
+
 int main(int argc, char **argv)
 {
 	struct zbc_device_info info;
@@ -28,6 +42,7 @@ int main(int argc, char **argv)
 	int i, ret = 1;
 	struct zbc_zone *z, *zones = NULL;
 	unsigned int nr_zones;
+	unsigned long long elapsed;
 	unsigned int oflags;
 
 	/* Check command line */
@@ -130,7 +145,9 @@ usage:
 	}
 
 	/* Get zone information */
+	elapsed = zbc_test_usec();
 	ret = zbc_report_zones(dev, lba, ro, zones, &nr_zones);
+	elapsed = zbc_test_usec() - elapsed;
 	if (ret != 0) {
 		fprintf(stderr,
 			"[TEST][ERROR],zbc_report_zones failed %d\n",
@@ -158,6 +175,8 @@ usage:
 			       zbc_sect2lba(&info, zbc_zone_wp(z)));
 	}
 
+	printf("[TEST][INFO][ELAPSED_US],%llu\n", elapsed);
+
 out:
 	if (ret != 0) {
 		struct zbc_errno zbc_err;
@@ -13,16 +13,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "libzbc/zbc.h"
 #include "zbc_private.h"
 
+/*
+ * Get the current time in microseconds, to time the device commands.
+ */
+static inline unsigned long long zbc_test_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000ULL +
+		ts.tv_nsec / 1000;
+}
+
 int main(int argc, char **argv)
 {
 	struct zbc_device_info info;
 	struct zbc_device *dev;
 	unsigned int flags = 0;
 	unsigned int oflags;
+	unsigned long long elapsed;
 	long long lba;
 	char *path;
 	int ret;
@@ -76,8 +91,12 @@ int main(int argc, char **argv)
 	}
 
 	/* Reset zone(s) */
+	elapsed = zbc_test_usec();
 	ret = zbc_reset_zone(dev, zbc_lba2sect(&info, lba), flags);
-	if (ret != 0) {
+	elapsed = zbc_test_usec() - elapsed;
+	if (ret == 0) {
+		printf("[TEST][INFO][ELAPSED_US],%llu\n", elapsed);
+	} else {
 		struct zbc_errno zbc_err;
 		const char *sk_name;
 		const char *ascq_name;
@@ -13,10 +13,24 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include "libzbc/zbc.h"
 #include "zbc_private.h"
 
+/*
+ * Get the current time in microseconds, to time the device commands.
+ */
+static inline unsigned long long zbc_test_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000ULL +
+		ts.tv_nsec / 1000;
+}
+
 int main(int argc, char **argv)
 {
 	struct zbc_device_info info;
@@ -26,7 +40,7 @@ int main(int argc, char **argv)
 	struct iovec *iov = NULL;
 	size_t bufsize, iosize;
 	ssize_t ret;
-	unsigned long long lba, sector;
+	unsigned long long lba, sector, start, elapsed = 0;
 	unsigned int oflags, lba_count, sector_count;
 	int i, nio = 1, pattern = 0, iovcnt = 1, n;
 	bool vio = false;
@@ -176,10 +190,13 @@ usage:
 				ret = 1;
 				goto out;
 			}
+			start = zbc_test_usec();
 			ret = zbc_pwritev(dev, iov, n, sector);
 		} else {
+			start = zbc_test_usec();
 			ret = zbc_pwrite(dev, iobuf, sector_count, sector);
 		}
+		elapsed += zbc_test_usec() - start;
 		if (ret <= 0) {
 			struct zbc_errno zbc_err;
 			const char *sk_name;
@@ -207,6 +224,9 @@ usage:
 
 	}
 
+	if (ret == 0)
+		printf("[TEST][INFO][ELAPSED_US],%llu\n", elapsed);
+
 out:
 	free(iobuf);
 	zbc_close(dev);
@@ -0,0 +1,32 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: BSD-2-Clause
+# SPDX-License-Identifier: LGPL-3.0-or-later
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2023, Western Digital. All rights reserved.
+
+. scripts/zbc_test_lib.sh
+
+zbc_test_init $0 "Fast and full zoned device probe results match" $*
+
+# Get drive information
+zbc_test_get_device_info
+
+# Start testing
+zbc_test_run ${bin_path}/zbc_test_probe ${device}
+if [ $? -ne 0 ]; then
+	zbc_test_fail_exit "Device probe failed"
+fi
+
+# Check result
+probe=`tac ${log_file} | grep -m 1 -F "[TEST][INFO][PROBE]," | cut -d , -f 2-`
+probe_fast=`tac ${log_file} | grep -m 1 -F "[TEST][INFO][PROBE_FAST]," | cut -d , -f 2-`
+
+if [ -z "${probe}" -o "${probe}" != "${probe_fast}" ]; then
+	echo "=> Expected ${probe}, Got ${probe_fast}" >> ${log_file} 2>&1
+	zbc_test_print_failed "fast probe ${probe_fast}, full probe ${probe}"
+else
+	zbc_test_print_passed "${probe}"
+fi
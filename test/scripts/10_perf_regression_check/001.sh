@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: BSD-2-Clause
+# SPDX-License-Identifier: LGPL-3.0-or-later
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2023, Western Digital. All rights reserved.
+
+. scripts/zbc_test_lib.sh
+
+zbc_test_init $0 "REPORT_ZONES full zone listing time" $*
+
+# Get drive information
+zbc_test_get_device_info
+
+zbc_test_perf_init
+
+# Keep the best of 3 runs of a listing of all zones
+declare -i best_us=0
+for (( i=0 ; i<3 ; i++ )); do
+	zbc_test_perf_run ${bin_path}/zbc_test_report_zones ${device}
+	zbc_test_get_sk_ascq
+	zbc_test_fail_exit_if_sk_ascq "REPORT_ZONES failed"
+	if [ ${best_us} -eq 0 -o ${perf_elapsed_us} -lt ${best_us} ]; then
+		best_us=${perf_elapsed_us}
+	fi
+done
+if [ ${best_us} -eq 0 ]; then
+	best_us=1
+fi
+
+# Check result
+zbc_test_perf_check "list_time" ${best_us} "us" "lower"
+zbc_test_perf_check "list_rate" $(( ${dev_nr_zones} * 1000000 / ${best_us} )) \
+		    "zones/s" "higher"
+zbc_test_perf_print_res
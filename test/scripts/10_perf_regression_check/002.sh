@@ -0,0 +1,62 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: BSD-2-Clause
+# SPDX-License-Identifier: LGPL-3.0-or-later
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2023, Western Digital. All rights reserved.
+
+. scripts/zbc_test_lib.sh
+
+zbc_test_init $0 "WRITE sequential fill of ${ZBC_TEST_PERF_NR_ZONES:-4} zones throughput" $*
+
+# Get drive information
+zbc_test_get_device_info
+
+zbc_test_perf_init
+
+# Get empty sequential zones
+zbc_test_get_zone_info
+targets=(`zbc_zones | zbc_zone_filter_in_type "${ZT_SEQ}" \
+		    | zbc_zone_filter_in_cond "${ZC_EMPTY}" \
+		    | head -n ${perf_nr_zones} | cut -d , -f 5`)
+if [ ${#targets[@]} -lt ${perf_nr_zones} ]; then
+	zbc_test_print_not_applicable \
+		"Not enough empty sequential zones (${#targets[@]} < ${perf_nr_zones})"
+fi
+
+# Specify post process
+for slba in ${targets[@]}; do
+	zbc_test_case_on_exit zbc_test_run ${bin_path}/zbc_test_reset_zone ${device} ${slba}
+done
+
+# Start testing: write each zone from its start to its end with
+# maximum size writes
+declare -i nio=$(( ${lblk_per_zone} / ${max_rw_lba} ))
+declare -i rem=$(( ${lblk_per_zone} % ${max_rw_lba} ))
+declare -i elapsed_us=0
+for slba in ${targets[@]}; do
+	zbc_test_perf_run ${bin_path}/zbc_test_write_zone -n ${nio} ${device} \
+			  ${slba} ${max_rw_lba}
+	zbc_test_get_sk_ascq
+	zbc_test_fail_exit_if_sk_ascq "WRITE failed, zone ${slba}"
+	elapsed_us+=${perf_elapsed_us}
+
+	if [ ${rem} -ne 0 ]; then
+		zbc_test_perf_run ${bin_path}/zbc_test_write_zone ${device} \
+				  $(( ${slba} + ${nio} * ${max_rw_lba} )) ${rem}
+		zbc_test_get_sk_ascq
+		zbc_test_fail_exit_if_sk_ascq "WRITE failed, zone ${slba}"
+		elapsed_us+=${perf_elapsed_us}
+	fi
+done
+if [ ${elapsed_us} -eq 0 ]; then
+	elapsed_us=1
+fi
+
+# Check result
+declare -i kib=$(( ${perf_nr_zones} * ${lblk_per_zone} * ${logical_block_size} / 1024 ))
+zbc_test_perf_check "fill_bw" $(( ${kib} * 1000000 / ${elapsed_us} )) \
+		    "KiB/s" "higher"
+zbc_test_perf_print_res
@@ -0,0 +1,70 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: BSD-2-Clause
+# SPDX-License-Identifier: LGPL-3.0-or-later
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2023, Western Digital. All rights reserved.
+
+. scripts/zbc_test_lib.sh
+
+zbc_test_init $0 "RESET_WRITE_PTR bulk reset latency of ${ZBC_TEST_PERF_NR_ZONES:-4} zones" $*
+
+# Get drive information
+zbc_test_get_device_info
+
+zbc_test_perf_init
+
+# Get empty sequential zones
+zbc_test_get_zone_info
+targets=(`zbc_zones | zbc_zone_filter_in_type "${ZT_SEQ}" \
+		    | zbc_zone_filter_in_cond "${ZC_EMPTY}" \
+		    | head -n ${perf_nr_zones} | cut -d , -f 5`)
+if [ ${#targets[@]} -lt ${perf_nr_zones} ]; then
+	zbc_test_print_not_applicable \
+		"Not enough empty sequential zones (${#targets[@]} < ${perf_nr_zones})"
+fi
+
+# Specify post process
+zbc_test_case_on_exit zbc_test_run ${bin_path}/zbc_test_reset_zone ${device} -1
+
+function write_targets()
+{
+	local slba
+
+	for slba in ${targets[@]}; do
+		zbc_test_run ${bin_path}/zbc_test_write_zone ${device} \
+			     ${slba} ${max_rw_lba}
+		zbc_test_get_sk_ascq
+		zbc_test_fail_exit_if_sk_ascq "WRITE failed, zone ${slba}"
+	done
+}
+
+# Start testing: reset the written zones one at a time
+write_targets
+declare -i elapsed_us=0
+for slba in ${targets[@]}; do
+	zbc_test_perf_run ${bin_path}/zbc_test_reset_zone ${device} ${slba}
+	zbc_test_get_sk_ascq
+	zbc_test_fail_exit_if_sk_ascq "RESET_WRITE_PTR failed, zone ${slba}"
+	elapsed_us+=${perf_elapsed_us}
+done
+elapsed_us=$(( ${elapsed_us} / ${perf_nr_zones} ))
+if [ ${elapsed_us} -eq 0 ]; then
+	elapsed_us=1
+fi
+zbc_test_perf_check "reset_zone_lat" ${elapsed_us} "us" "lower"
+
+# Then reset all zones at once
+write_targets
+zbc_test_perf_run ${bin_path}/zbc_test_reset_zone ${device} -1
+zbc_test_get_sk_ascq
+zbc_test_fail_exit_if_sk_ascq "RESET_WRITE_PTR ALL failed"
+if [ ${perf_elapsed_us} -eq 0 ]; then
+	perf_elapsed_us=1
+fi
+zbc_test_perf_check "reset_all_lat" ${perf_elapsed_us} "us" "lower"
+
+# Check result
+zbc_test_perf_print_res
@@ -765,6 +765,8 @@ function zbc_test_open_nr_zones()
 		return 0
 	fi
 
+	zbc_test_get_zone_info
+
 	for _line in `zbc_zones | zbc_zone_filter_in_type "${_zone_type}" \
 				| zbc_zone_filter_in_cond "${_zone_cond}"` ; do
 		local _IFS="${IFS}"
@@ -808,6 +810,8 @@ function zbc_test_iopen_nr_zones()
 		return 0
 	fi
 
+	zbc_test_get_zone_info
+
 	for _line in `zbc_zones | zbc_zone_filter_in_type "${_zone_type}" \
 				| zbc_zone_filter_in_cond "${_zone_cond}"` ; do
 		local _IFS="${IFS}"
@@ -851,6 +855,8 @@ function zbc_test_close_nr_zones()
 		return 0
 	fi
 
+	zbc_test_get_zone_info
+
 	for _line in `zbc_zones | zbc_zone_filter_in_type "${_zone_type}" \
 				| zbc_zone_filter_in_cond "${_zone_cond}"` ; do
 		local _IFS="${IFS}"
@@ -971,15 +977,21 @@ function zbc_test_get_target_zone_from_slba()
 
 # These _search_ functions look for a zone aleady in the condition
 
+# The search is done by zbc_test_find_zone, which stops at the first
+# matching zone rather than reporting all zones of the device.
 function zbc_test_search_target_zone_from_type_and_cond()
 {
 	local zone_type="${1}"
 	local zone_cond="${2}"
 
-	zbc_test_get_zone_info
+	local _cmd="${bin_path}/zbc_test_find_zone -t ${zone_type} -c ${zone_cond} ${device}"
+	echo "" >> ${log_file} 2>&1
+	echo "## `date -Ins` Executing: ${_cmd}" >> ${log_file} 2>&1
+	echo "" >> ${log_file} 2>&1
 
-	for _line in `zbc_zones | zbc_zone_filter_in_type "${zone_type}" \
-				| zbc_zone_filter_in_cond "${zone_cond}"`; do
+	for _line in `${VALGRIND} ${bin_path}/zbc_test_find_zone \
+			-t "${zone_type}" -c "${zone_cond}" ${device} \
+			2>> ${log_file} | grep -F "[ZONE_INFO]"`; do
 
 		local _IFS="${IFS}"
 		IFS=$',\n'
@@ -2281,6 +2293,115 @@ function zbc_test_check_sk_ascq_zone_cond_wp()
 	fi
 }
 
+# Performance regression functions
+#
+# Baselines are stored per device model (vendor, product and revision
+# identification) in ${ZBC_TEST_PERF_BASELINE_PATH}, one "<test>.<metric>,
+# <value>,<unit>" line per metric. A metric without a baseline is recorded
+# and passes. With ZBC_TEST_PERF_UPDATE set, all baselines are rewritten.
+
+function zbc_test_perf_init()
+{
+	if [ -n "${VALGRIND}" ]; then
+		zbc_test_print_not_applicable "Performance tests do not run under valgrind"
+	fi
+
+	perf_threshold=${ZBC_TEST_PERF_THRESHOLD:-20}
+	perf_nr_zones=${ZBC_TEST_PERF_NR_ZONES:-4}
+	perf_regressions=""
+	perf_summary=""
+
+	local _IFS="${IFS}"
+	local vendor=`${bin_path}/zbc_test_print_devinfo ${device} | grep -F '[VENDOR_ID]' | while IFS=$',\n' read a b; do echo $b; done`
+	IFS="$_IFS"
+
+	local model=`echo -n "${vendor}" | tr -s -c 'A-Za-z0-9._-' '_'`
+	if [ ${ZBC_TEST_FORCE_ATA} ]; then
+		model+="_ata"
+	fi
+
+	perf_baseline_file="${ZBC_TEST_PERF_BASELINE_PATH:-perf}/${model}.baseline"
+	echo "[PERF_BASELINE] ${perf_baseline_file}" >> ${log_file}
+}
+
+# Run a test program and set perf_elapsed_us to the execution time of
+# its device commands, as reported by the program with an [ELAPSED_US]
+# line. This excludes the program startup and the device open.
+function zbc_test_perf_run()
+{
+	local -i nr_lines=`wc -l < ${log_file}`
+
+	zbc_test_run "$@"
+	local -i ret=$?
+
+	local _IFS="${IFS}"
+	IFS=$',\n'
+
+	local elapsed_line=`tail -n +$(( nr_lines + 1 )) ${log_file} | grep -m 1 -F "[ELAPSED_US]"`
+	set -- ${elapsed_line}
+	perf_elapsed_us=${2:-0}
+
+	IFS="$_IFS"
+
+	return ${ret}
+}
+
+# Compare a metric with its baseline
+# $1: metric name, $2: measured integer value, $3: unit,
+# $4: "higher" if higher values are better, "lower" otherwise
+function zbc_test_perf_check()
+{
+	local metric="$1"
+	local -i value=$2
+	local unit="$3"
+	local better="$4"
+	local key="${test_case_id}.${metric}"
+	local -i baseline=0 delta
+
+	echo "[PERF] ${key},${value},${unit}" >> ${log_file}
+
+	if [ -z "${ZBC_TEST_PERF_UPDATE}" -a -f "${perf_baseline_file}" ]; then
+		baseline=`grep -F "${key}," ${perf_baseline_file} | tail -n 1 | cut -d , -f 2`
+	fi
+
+	if [ ${baseline} -le 0 ]; then
+		mkdir -p `dirname ${perf_baseline_file}`
+		touch ${perf_baseline_file}
+		sed -i -e "/^${key},/d" ${perf_baseline_file}
+		echo "${key},${value},${unit}" >> ${perf_baseline_file}
+		perf_summary+=" ${metric}=${value}${unit} (new baseline)"
+		return 0
+	fi
+
+	# Regression in percent of the baseline
+	if [ "${better}" = "higher" ]; then
+		delta=$(( (baseline - value) * 100 / baseline ))
+	else
+		delta=$(( (value - baseline) * 100 / baseline ))
+	fi
+
+	echo "[PERF] ${key}: baseline ${baseline} ${unit}, regression ${delta}% (threshold ${perf_threshold}%)" >> ${log_file}
+
+	if [ ${delta} -gt ${perf_threshold} ]; then
+		perf_regressions+=" ${metric}=${value}${unit} (baseline ${baseline}${unit}, -${delta}%)"
+		return 1
+	fi
+
+	perf_summary+=" ${metric}=${value}${unit} (baseline ${baseline}${unit})"
+
+	return 0
+}
+
+function zbc_test_perf_print_res()
+{
+	if [ -n "${perf_regressions}" ]; then
+		echo "=> Regression:${perf_regressions}" >> ${log_file} 2>&1
+		zbc_test_print_failed "regression:${perf_regressions}"
+	else
+		zbc_test_print_passed "${perf_summary}"
+	fi
+}
+
 function zbc_test_dump_zone_info()
 {
 	zbc_report_zones ${device} > ${dump_zone_info_file}
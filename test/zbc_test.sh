@@ -50,6 +50,15 @@ function zbc_print_usage()
 	echo "                                for individual layouts, list them instead."
 	echo "  -o | --offline              : Specify this flag if testing a device that has"
 	echo "                                any offline and/or read-only zones."
+	echo "  -p | --perf                 : Also run the performance regression section (10)."
+	echo "                                This section writes and resets zones."
+	echo "       --perf-zones <num>     : Number of zones written by performance tests"
+	echo "                                (default: 4)"
+	echo "       --perf-threshold <pct> : Regression threshold in percent of the baseline"
+	echo "                                (default: 20)"
+	echo "       --perf-baseline <dir>  : Directory of the per device model baseline files"
+	echo "                                (default: perf)"
+	echo "       --perf-update          : Record the measured performance as new baselines"
 	echo "Test numbers must be in the form \"<section number>.<case number>\"."
 	echo "The device path can be omitted with the -h and -l options."
 	echo "If -e, -s or -S are not used, all defined test cases are executed."
@@ -82,6 +91,7 @@ bin_path=${ZBC_TEST_BIN_PATH}
 test_progs=( \
     zbc_test_print_devinfo \
     zbc_test_report_zones \
+    zbc_test_find_zone \
     zbc_test_reset_zone \
     zbc_test_open_zone \
     zbc_test_close_zone \
@@ -92,6 +102,7 @@ test_progs=( \
     zbc_test_report_realms \
     zbc_test_zone_activate \
     zbc_test_dev_control \
+    zbc_test_probe \
 )
 
 for p in ${test_progs[@]}; do
@@ -198,6 +209,24 @@ for (( i=0; i<${argc}; i++ )); do
 	-x | --run_extended_tests )
 		run_extended_tests=1
 		;;
+	-p | --perf )
+		PERF_SECTION="10"
+		;;
+	--perf-zones )
+		i=$((i+1))
+		ZBC_TEST_PERF_NR_ZONES="${argv[$i]}"
+		;;
+	--perf-threshold )
+		i=$((i+1))
+		ZBC_TEST_PERF_THRESHOLD="${argv[$i]}"
+		;;
+	--perf-baseline )
+		i=$((i+1))
+		ZBC_TEST_PERF_BASELINE_PATH="${argv[$i]}"
+		;;
+	--perf-update )
+		ZBC_TEST_PERF_UPDATE=1
+		;;
 	-* )
 		echo "Unknown option \"${argv[$i]}\""
 		zbc_print_usage
@@ -437,6 +466,9 @@ function zbc_run_config()
 		"09")
 			section_name="site-local (unpublished)"
 			;;
+		"10")
+			section_name="Performance regression"
+			;;
 		* )
 			echo "Unknown test section ${section}"
 			exit 1
@@ -508,13 +540,13 @@ function zbc_run_gamut()
 		fi
 		ZBC_TEST_SECTION_LIST+=" ${EXTRA_SECTION}"
 		# Drive testing of Zone Domains devices through Sections 03 and 04
-		prepare_lists "03 04"			# parent section list
+		prepare_lists "03 04 ${PERF_SECTION}"	# parent section list
 	else
 		# Not a Zone Domains device -- omit ZD tests
 		if [ ${device_is_ata} -eq 0 -a ${force_ata} -eq 0 ]; then
 			ZBC_TEST_SECTION_LIST+=" ${SCSI_ZBC_SECTION}"
 		fi
-		ZBC_TEST_SECTION_LIST+=" ${EXTRA_SECTION}"
+		ZBC_TEST_SECTION_LIST+=" ${EXTRA_SECTION} ${PERF_SECTION}"
 		# Drive testing of classic ZBC devices through Sections 00, 01, 02 (and 08 for SCSI)
 		prepare_lists ${ZBC_TEST_SECTION_LIST}
 		ZBC_TEST_SECTION_LIST=""	# Test sections run directly from this script
@@ -610,6 +642,12 @@ function do_exports()
 		unset ZBC_RUN_EXTENDED_TESTS
 	fi
 
+	# Used by Section 10 performance regression scripts
+	export ZBC_TEST_PERF_NR_ZONES
+	export ZBC_TEST_PERF_THRESHOLD
+	export ZBC_TEST_PERF_BASELINE_PATH
+	export ZBC_TEST_PERF_UPDATE
+
 	# Transmit --batch flag to meta-children via Section 04 scripts
 	if [ ${batch_mode} -ne 0 ]; then
 		export ZBC_TEST_BATCH_MODE=1
@@ -641,8 +679,8 @@ do_exports
 
 if [ ${print_list} -ne 0 ]; then
 	# List all the tests in all the test sections
-	prepare_lists  "00 01 02 03 04 05 ${SCSI_ZD_SECTION} ${SCSI_ZBC_SECTION} ${EXTRA_SECTION}"
-	zbc_run_config "00 01 02 03 04 05 ${SCSI_ZD_SECTION} ${SCSI_ZBC_SECTION} ${EXTRA_SECTION}"
+	prepare_lists  "00 01 02 03 04 05 ${SCSI_ZD_SECTION} ${SCSI_ZBC_SECTION} ${EXTRA_SECTION} ${PERF_SECTION}"
+	zbc_run_config "00 01 02 03 04 05 ${SCSI_ZD_SECTION} ${SCSI_ZBC_SECTION} ${EXTRA_SECTION} ${PERF_SECTION}"
 elif [ -n "${ZBC_TEST_SECTION_LIST}" ] ; then
 	# We are being invoked recursively with a specified Section list.
 	prepare_lists ${ZBC_TEST_SECTION_LIST}
@@ -0,0 +1,940 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <libgen.h>
+
+#include <libzbc/zbc.h>
+
+enum zbc_bench_wl {
+	ZBC_BENCH_SEQWRITE,
+	ZBC_BENCH_RANDREAD,
+	ZBC_BENCH_MIXED,
+	ZBC_BENCH_RESET,
+	ZBC_BENCH_FINISH,
+	ZBC_BENCH_REPORT,
+	ZBC_BENCH_ACTIVATE,
+};
+
+static const char *zbc_bench_wl_name[] = {
+	"seqwrite",
+	"randread",
+	"mixed",
+	"reset",
+	"finish",
+	"report",
+	"activate",
+};
+
+#define ZBC_BENCH_NR_WL \
+	(sizeof(zbc_bench_wl_name) / sizeof(zbc_bench_wl_name[0]))
+
+struct zbc_bench;
+
+/*
+ * Asynchronous I/O slot.
+ */
+struct zbc_bench_io {
+	struct zbc_aio		aio;
+	unsigned long long	start;
+	void			*buf;
+};
+
+/*
+ * Per-thread context. Threads use their own device handle.
+ */
+struct zbc_bench_thread {
+	struct zbc_bench	*b;
+	pthread_t		thread;
+	unsigned int		id;
+	struct zbc_device	*dev;
+	unsigned int		seed;
+
+	/* Zones (indexes in the zone list) and realms of the thread */
+	unsigned int		*zones;
+	unsigned int		nr_zones;
+	unsigned int		next_zone;
+	uint64_t		*wp;
+	struct zbc_zone_realm	*realms;
+	unsigned int		nr_realms;
+
+	/* Latencies in nanoseconds */
+	unsigned long long	*lat;
+	unsigned long long	nr_lat;
+	unsigned long long	max_lat;
+
+	unsigned long long	bytes;
+	int			err;
+};
+
+struct zbc_bench {
+	char			*path;
+	int			oflags;
+	enum zbc_bench_wl	wl;
+	unsigned int		nr_threads;
+	unsigned int		qd;
+	size_t			bs;
+	unsigned int		zno;
+	unsigned int		nz;
+	unsigned long long	nr_ops;
+	unsigned int		rdpct;
+	bool			json;
+
+	struct zbc_device_info	info;
+	struct zbc_zone		*zones;
+	unsigned int		nr_zones;
+	struct zbc_zone_realm	*realms;
+	unsigned int		nr_realms;
+
+	struct zbc_bench_thread	*threads;
+};
+
+static int zbc_bench_abort = 0;
+
+static inline unsigned long long zbc_bench_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void zbc_bench_sigcatcher(int sig)
+{
+	zbc_bench_abort = 1;
+}
+
+static int zbc_bench_usage(FILE *out, char *prog)
+{
+	fprintf(out,
+		"Usage: %s [options] <dev> <workload>\n"
+		"  Measure the performance of a zoned device. Workloads:\n"
+		"    seqwrite : Sequential writes at the write pointer of zones\n"
+		"    randread : Random reads of the written data of zones\n"
+		"    mixed    : Random reads and sequential writes\n"
+		"    reset    : Zone reset (of finished zones)\n"
+		"    finish   : Zone finish (of empty zones)\n"
+		"    report   : REPORT ZONES of <nz> zones\n"
+		"    activate : Activation of realms to another domain\n"
+		"Options:\n"
+		"  -h | --help  : Display this help message and exit\n"
+		"  -v           : Verbose mode\n"
+		"  -scsi        : Force the use of SCSI passthrough commands\n"
+		"  -ata         : Force the use of ATA passthrough commands\n"
+		"  -t <num>     : Use <num> threads (default: 1)\n"
+		"  -qd <num>    : Use a queue depth of <num> asynchronous\n"
+		"                 I/Os per thread (default: 1)\n"
+		"  -bs <size>   : I/O size in B (default: 131072)\n"
+		"  -z <num>     : First zone number (default: first sequential\n"
+		"                 zone)\n"
+		"  -nz <num>    : Number of zones (default: 16)\n"
+		"  -n <num>     : Number of operations per thread (default:\n"
+		"                 until the zones are full for seqwrite and\n"
+		"                 1000 otherwise)\n"
+		"  -rw <pct>    : Percentage of reads for mixed (default: 70)\n"
+		"  -json        : Output results in JSON format\n",
+		basename(prog));
+	return 1;
+}
+
+static int zbc_bench_add_lat(struct zbc_bench_thread *t,
+			     unsigned long long lat)
+{
+	unsigned long long *l;
+
+	if (t->nr_lat == t->max_lat) {
+		t->max_lat = t->max_lat ? t->max_lat * 2 : 4096;
+		l = realloc(t->lat, t->max_lat * sizeof(unsigned long long));
+		if (!l)
+			return -ENOMEM;
+		t->lat = l;
+	}
+
+	t->lat[t->nr_lat++] = lat;
+
+	return 0;
+}
+
+static inline struct zbc_zone *zbc_bench_zone(struct zbc_bench_thread *t,
+					      unsigned int i)
+{
+	return &t->b->zones[t->zones[i]];
+}
+
+/*
+ * Get the sector of the next write, in round robin over the zones of
+ * the thread that are not full.
+ */
+static bool zbc_bench_next_write(struct zbc_bench_thread *t,
+				 uint64_t *sector, size_t *count)
+{
+	size_t bs = t->b->bs >> 9;
+	struct zbc_zone *z;
+	unsigned int i, n;
+	uint64_t end;
+
+	for (n = 0; n < t->nr_zones; n++) {
+		i = t->next_zone;
+		t->next_zone = (t->next_zone + 1) % t->nr_zones;
+		z = zbc_bench_zone(t, i);
+		end = zbc_zone_start(z) + zbc_zone_capacity(z);
+		if (t->wp[i] >= end)
+			continue;
+		*sector = t->wp[i];
+		*count = end - t->wp[i] < bs ? end - t->wp[i] : bs;
+		t->wp[i] += *count;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Get the sector of a random read of written data.
+ */
+static bool zbc_bench_next_read(struct zbc_bench_thread *t,
+				uint64_t *sector, size_t *count)
+{
+	size_t bs = t->b->bs >> 9;
+	uint64_t lbs = t->b->info.zbd_lblock_size >> 9;
+	uint64_t written, ofst;
+	struct zbc_zone *z;
+	unsigned int i, n;
+
+	for (n = 0; n < t->nr_zones; n++) {
+		i = rand_r(&t->seed) % t->nr_zones;
+		z = zbc_bench_zone(t, i);
+		written = t->wp[i] - zbc_zone_start(z);
+		if (zbc_zone_conventional(z))
+			written = zbc_zone_length(z);
+		if (written < bs)
+			continue;
+		ofst = ((uint64_t)rand_r(&t->seed) << 31 | rand_r(&t->seed)) %
+			((written - bs) / lbs + 1);
+		*sector = zbc_zone_start(z) + ofst * lbs;
+		*count = bs;
+		return true;
+	}
+
+	return false;
+}
+
+static bool zbc_bench_next_io(struct zbc_bench_thread *t, bool *write,
+			      uint64_t *sector, size_t *count)
+{
+	switch (t->b->wl) {
+	case ZBC_BENCH_SEQWRITE:
+		*write = true;
+		break;
+	case ZBC_BENCH_RANDREAD:
+		*write = false;
+		break;
+	default:
+		*write = (unsigned int)(rand_r(&t->seed) % 100) >= t->b->rdpct;
+		break;
+	}
+
+	if (*write)
+		return zbc_bench_next_write(t, sector, count);
+
+	return zbc_bench_next_read(t, sector, count);
+}
+
+/*
+ * Data workloads, using up to qd asynchronous I/Os.
+ */
+static int zbc_bench_run_io(struct zbc_bench_thread *t)
+{
+	struct zbc_bench *b = t->b;
+	struct zbc_bench_io *ios, **free_ios;
+	unsigned long long nr_ops = 0;
+	unsigned int i, nr_free = 0, inflight = 0;
+	struct zbc_bench_io *io;
+	struct zbc_aio *aio;
+	bool done = false, write;
+	uint64_t sector;
+	size_t count;
+	int ret = 0;
+
+	ios = calloc(b->qd, sizeof(struct zbc_bench_io));
+	free_ios = calloc(b->qd, sizeof(struct zbc_bench_io *));
+	if (!ios || !free_ios) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < b->qd; i++) {
+		ret = posix_memalign(&ios[i].buf, sysconf(_SC_PAGESIZE), b->bs);
+		if (ret != 0) {
+			ret = -ret;
+			goto out;
+		}
+		memset(ios[i].buf, 0, b->bs);
+		ios[i].aio.zio_private = &ios[i];
+		free_ios[nr_free++] = &ios[i];
+	}
+
+	while (!done || inflight) {
+
+		/* Fill the queue */
+		while (!done && nr_free && !zbc_bench_abort) {
+			if ((b->nr_ops && nr_ops >= b->nr_ops) ||
+			    !zbc_bench_next_io(t, &write, &sector, &count)) {
+				done = true;
+				break;
+			}
+
+			io = free_ios[--nr_free];
+			io->aio.zio_buf = io->buf;
+			io->aio.zio_count = count;
+			io->aio.zio_offset = sector;
+			io->aio.zio_write = write;
+			io->start = zbc_bench_nsec();
+			ret = zbc_aio_submit(t->dev, &io->aio);
+			if (ret == -EAGAIN) {
+				/* Queue full: retry once an I/O completed */
+				free_ios[nr_free++] = io;
+				if (write)
+					t->wp[(t->next_zone + t->nr_zones - 1) %
+					      t->nr_zones] -= count;
+				break;
+			}
+			if (ret != 0) {
+				fprintf(stderr,
+					"Thread %u: zbc_aio_submit failed %d (%s)\n",
+					t->id, ret, strerror(-ret));
+				done = true;
+				free_ios[nr_free++] = io;
+				break;
+			}
+			inflight++;
+			nr_ops++;
+		}
+
+		if (zbc_bench_abort)
+			done = true;
+		if (!inflight)
+			break;
+
+		ret = zbc_aio_reap(t->dev, &aio, true);
+		if (ret != 0) {
+			fprintf(stderr, "Thread %u: zbc_aio_reap failed %d (%s)\n",
+				t->id, ret, strerror(-ret));
+			break;
+		}
+		io = aio->zio_private;
+		inflight--;
+		free_ios[nr_free++] = io;
+
+		if (aio->zio_ret < 0) {
+			fprintf(stderr,
+				"Thread %u: %s sector %llu failed %zd (%s)\n",
+				t->id, aio->zio_write ? "Write" : "Read",
+				(unsigned long long)aio->zio_offset,
+				-aio->zio_ret, strerror(-aio->zio_ret));
+			ret = aio->zio_ret;
+			done = true;
+			continue;
+		}
+
+		t->bytes += (unsigned long long)aio->zio_ret << 9;
+		if (zbc_bench_add_lat(t, zbc_bench_nsec() - io->start)) {
+			ret = -ENOMEM;
+			done = true;
+		}
+	}
+
+out:
+	if (ios) {
+		for (i = 0; i < b->qd; i++)
+			free(ios[i].buf);
+	}
+	free(ios);
+	free(free_ios);
+
+	return ret;
+}
+
+/*
+ * Execute one timed operation of a zone or report workload.
+ */
+static int zbc_bench_zone_op(struct zbc_bench_thread *t, struct zbc_zone *buf,
+			     unsigned long long *lat)
+{
+	struct zbc_bench *b = t->b;
+	struct zbc_zone *z;
+	unsigned int nr_zones;
+	unsigned long long start;
+	int ret;
+
+	z = zbc_bench_zone(t, t->next_zone);
+	t->next_zone = (t->next_zone + 1) % t->nr_zones;
+
+	/* Prepare the zone (not timed) */
+	if (b->wl == ZBC_BENCH_RESET)
+		ret = zbc_finish_zone(t->dev, zbc_zone_start(z), 0);
+	else if (b->wl == ZBC_BENCH_FINISH)
+		ret = zbc_reset_zone(t->dev, zbc_zone_start(z), 0);
+	else
+		ret = 0;
+	if (ret != 0)
+		return ret;
+
+	start = zbc_bench_nsec();
+	switch (b->wl) {
+	case ZBC_BENCH_RESET:
+		ret = zbc_reset_zone(t->dev, zbc_zone_start(z), 0);
+		break;
+	case ZBC_BENCH_FINISH:
+		ret = zbc_finish_zone(t->dev, zbc_zone_start(z), 0);
+		break;
+	default:
+		nr_zones = b->nz;
+		ret = zbc_report_zones(t->dev, zbc_zone_start(z),
+				       ZBC_RZ_RO_ALL, buf, &nr_zones);
+		break;
+	}
+	*lat = zbc_bench_nsec() - start;
+
+	return ret;
+}
+
+/*
+ * Activate the next realm of the thread to another domain.
+ */
+static int zbc_bench_activate(struct zbc_bench_thread *t,
+			      unsigned long long *lat)
+{
+	struct zbc_zone_realm *r;
+	unsigned int d, nr_recs = 0;
+	unsigned long long start;
+	int ret;
+
+	r = &t->realms[t->next_zone];
+	t->next_zone = (t->next_zone + 1) % t->nr_realms;
+
+	for (d = (r->zbr_dom_id + 1) % r->zbr_nr_domains;
+	     d != r->zbr_dom_id; d = (d + 1) % r->zbr_nr_domains) {
+		if (zbc_realm_actv_as_dom_id(r, d))
+			break;
+	}
+	if (d == r->zbr_dom_id)
+		return -ENOTSUP;
+
+	/* Zones must be empty to be deactivated (not timed) */
+	if (zbc_realm_zone_type(r, r->zbr_dom_id) != ZBC_ZT_CONVENTIONAL) {
+		ret = zbc_zone_group_op(t->dev,
+				zbc_realm_start_sector(r, r->zbr_dom_id),
+				zbc_realm_length(r, r->zbr_dom_id),
+				ZBC_OP_RESET_ZONE, 0);
+		if (ret != 0)
+			return ret;
+	}
+
+	start = zbc_bench_nsec();
+	ret = zbc_zone_activate(t->dev, true, false, false,
+				zbc_realm_start_sector(r, d),
+				zbc_realm_length(r, d), d, NULL, &nr_recs);
+	*lat = zbc_bench_nsec() - start;
+	if (ret == 0) {
+		r->zbr_dom_id = d;
+		r->zbr_type = zbc_realm_zone_type(r, d);
+	}
+
+	return ret;
+}
+
+static int zbc_bench_run_ops(struct zbc_bench_thread *t)
+{
+	struct zbc_bench *b = t->b;
+	unsigned long long i, lat;
+	struct zbc_zone *buf = NULL;
+	int ret = 0;
+
+	if (b->wl == ZBC_BENCH_REPORT) {
+		buf = calloc(b->nz, sizeof(struct zbc_zone));
+		if (!buf)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < b->nr_ops && !zbc_bench_abort; i++) {
+		if (b->wl == ZBC_BENCH_ACTIVATE)
+			ret = zbc_bench_activate(t, &lat);
+		else
+			ret = zbc_bench_zone_op(t, buf, &lat);
+		if (ret != 0) {
+			fprintf(stderr, "Thread %u: %s failed %d (%s)\n",
+				t->id, zbc_bench_wl_name[b->wl],
+				ret, strerror(-ret));
+			break;
+		}
+		ret = zbc_bench_add_lat(t, lat);
+		if (ret != 0)
+			break;
+	}
+
+	free(buf);
+
+	return ret;
+}
+
+static void *zbc_bench_thread_fn(void *arg)
+{
+	struct zbc_bench_thread *t = arg;
+
+	switch (t->b->wl) {
+	case ZBC_BENCH_SEQWRITE:
+	case ZBC_BENCH_RANDREAD:
+	case ZBC_BENCH_MIXED:
+		t->err = zbc_bench_run_io(t);
+		break;
+	default:
+		t->err = zbc_bench_run_ops(t);
+		break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Distribute the zones (or realms) in round robin to the threads.
+ */
+static int zbc_bench_setup_thread(struct zbc_bench *b,
+				  struct zbc_bench_thread *t)
+{
+	unsigned int i, n = 0;
+	struct zbc_zone *z;
+	int ret;
+
+	t->b = b;
+	t->seed = t->id + 1;
+
+	ret = zbc_open(b->path, b->oflags | O_RDWR, &t->dev);
+	if (ret != 0) {
+		fprintf(stderr, "Open %s failed (%s)\n",
+			b->path, strerror(-ret));
+		return ret;
+	}
+
+	if (b->wl == ZBC_BENCH_ACTIVATE) {
+		t->realms = calloc(b->nr_realms, sizeof(struct zbc_zone_realm));
+		if (!t->realms)
+			return -ENOMEM;
+		for (i = t->id; i < b->nr_realms; i += b->nr_threads)
+			t->realms[n++] = b->realms[i];
+		t->nr_realms = n;
+		return n ? 0 : -EINVAL;
+	}
+
+	t->zones = calloc(b->nz, sizeof(unsigned int));
+	t->wp = calloc(b->nz, sizeof(uint64_t));
+	if (!t->zones || !t->wp)
+		return -ENOMEM;
+
+	for (i = b->zno + t->id; i < b->zno + b->nz; i += b->nr_threads) {
+		z = &b->zones[i];
+		t->zones[n] = i;
+		if (zbc_zone_conventional(z) || zbc_zone_empty(z))
+			t->wp[n] = zbc_zone_start(z);
+		else if (zbc_zone_full(z))
+			t->wp[n] = zbc_zone_start(z) + zbc_zone_capacity(z);
+		else
+			t->wp[n] = zbc_zone_wp(z);
+		n++;
+	}
+	t->nr_zones = n;
+
+	return n ? 0 : -EINVAL;
+}
+
+static int zbc_bench_lat_cmp(const void *a, const void *b)
+{
+	unsigned long long la = *(const unsigned long long *)a;
+	unsigned long long lb = *(const unsigned long long *)b;
+
+	if (la < lb)
+		return -1;
+	return la > lb;
+}
+
+static inline unsigned long long zbc_bench_pct(unsigned long long *lat,
+					       unsigned long long nr,
+					       double pct)
+{
+	unsigned long long i = (unsigned long long)(pct * (nr - 1) / 100.0);
+
+	return lat[i];
+}
+
+static int zbc_bench_report(struct zbc_bench *b, unsigned long long elapsed)
+{
+	unsigned long long nr_lat = 0, bytes = 0, sum = 0, i, n = 0;
+	unsigned long long *lat, iops, bw, elapsed_us;
+	static const double pct[] = { 50.0, 90.0, 99.0, 99.9 };
+	static const char *pct_name[] = { "p50", "p90", "p99", "p99.9" };
+	struct zbc_bench_thread *t;
+	unsigned int j;
+
+	for (j = 0; j < b->nr_threads; j++) {
+		nr_lat += b->threads[j].nr_lat;
+		bytes += b->threads[j].bytes;
+	}
+
+	if (!nr_lat) {
+		fprintf(stderr, "No operation executed\n");
+		return 1;
+	}
+
+	lat = malloc(nr_lat * sizeof(unsigned long long));
+	if (!lat) {
+		fprintf(stderr, "No memory\n");
+		return 1;
+	}
+	for (j = 0; j < b->nr_threads; j++) {
+		t = &b->threads[j];
+		for (i = 0; i < t->nr_lat; i++) {
+			lat[n++] = t->lat[i];
+			sum += t->lat[i];
+		}
+	}
+	qsort(lat, nr_lat, sizeof(unsigned long long), zbc_bench_lat_cmp);
+
+	if (!elapsed)
+		elapsed = 1;
+	iops = nr_lat * 1000000000ULL / elapsed;
+
+	/* Bandwidth in KB/s, printed in MB/s */
+	elapsed_us = elapsed / 1000ULL;
+	if (!elapsed_us)
+		elapsed_us = 1;
+	bw = bytes * 1000ULL / elapsed_us;
+
+	if (b->json) {
+		printf("{\n"
+		       "  \"device\": \"%s\",\n"
+		       "  \"workload\": \"%s\",\n"
+		       "  \"threads\": %u,\n"
+		       "  \"qd\": %u,\n"
+		       "  \"bs\": %zu,\n"
+		       "  \"ops\": %llu,\n"
+		       "  \"bytes\": %llu,\n"
+		       "  \"elapsed_ns\": %llu,\n"
+		       "  \"iops\": %llu,\n"
+		       "  \"bw_mbps\": %llu.%03llu,\n"
+		       "  \"lat_ns\": {\n"
+		       "    \"min\": %llu,\n"
+		       "    \"mean\": %llu,\n",
+		       b->path, zbc_bench_wl_name[b->wl],
+		       b->nr_threads, b->qd, b->bs,
+		       nr_lat, bytes, elapsed, iops,
+		       bw / 1000, bw % 1000,
+		       lat[0], sum / nr_lat);
+		for (j = 0; j < sizeof(pct) / sizeof(pct[0]); j++)
+			printf("    \"%s\": %llu,\n", pct_name[j],
+			       zbc_bench_pct(lat, nr_lat, pct[j]));
+		printf("    \"max\": %llu\n"
+		       "  }\n"
+		       "}\n",
+		       lat[nr_lat - 1]);
+	} else {
+		printf("%s: %llu ops, %llu B in %llu.%03llu sec\n",
+		       zbc_bench_wl_name[b->wl], nr_lat, bytes,
+		       elapsed / 1000000000ULL,
+		       (elapsed % 1000000000ULL) / 1000000ULL);
+		printf("  IOPS %llu\n", iops);
+		if (bytes)
+			printf("  BW %llu.%03llu MB/s\n", bw / 1000, bw % 1000);
+		printf("  Latency (usec): min %llu.%03llu, mean %llu.%03llu\n",
+		       lat[0] / 1000, lat[0] % 1000,
+		       (sum / nr_lat) / 1000, (sum / nr_lat) % 1000);
+		printf("   ");
+		for (j = 0; j < sizeof(pct) / sizeof(pct[0]); j++) {
+			i = zbc_bench_pct(lat, nr_lat, pct[j]);
+			printf(" %s %llu.%03llu,", pct_name[j],
+			       i / 1000, i % 1000);
+		}
+		printf(" max %llu.%03llu\n",
+		       lat[nr_lat - 1] / 1000, lat[nr_lat - 1] % 1000);
+	}
+
+	free(lat);
+
+	return 0;
+}
+
+static int zbc_bench_get_zones(struct zbc_bench *b, struct zbc_device *dev,
+			       bool zno_set)
+{
+	unsigned int i;
+	int ret;
+
+	if (b->wl == ZBC_BENCH_ACTIVATE) {
+		if (!zbc_device_is_zdr(&b->info)) {
+			fprintf(stderr, "Not a Zone Domains/Realms device\n");
+			return -ENOTSUP;
+		}
+		ret = zbc_list_zone_realms(dev, 0, ZBC_RR_RO_ALL,
+					   &b->realms, &b->nr_realms);
+		if (ret != 0)
+			fprintf(stderr, "zbc_list_zone_realms failed %d\n",
+				ret);
+		return ret;
+	}
+
+	ret = zbc_list_zones(dev, 0, ZBC_RZ_RO_ALL, &b->zones, &b->nr_zones);
+	if (ret != 0) {
+		fprintf(stderr, "zbc_list_zones failed %d\n", ret);
+		return ret;
+	}
+
+	if (!zno_set) {
+		for (i = 0; i < b->nr_zones; i++) {
+			if (zbc_zone_sequential(&b->zones[i]))
+				break;
+		}
+		b->zno = i < b->nr_zones ? i : 0;
+	}
+
+	if (b->zno >= b->nr_zones) {
+		fprintf(stderr, "Invalid zone number %u\n", b->zno);
+		return -EINVAL;
+	}
+	if (b->zno + b->nz > b->nr_zones)
+		b->nz = b->nr_zones - b->zno;
+
+	if (b->wl == ZBC_BENCH_RESET || b->wl == ZBC_BENCH_FINISH) {
+		for (i = b->zno; i < b->zno + b->nz; i++) {
+			if (!zbc_zone_sequential(&b->zones[i])) {
+				fprintf(stderr,
+					"Zone %u is not a sequential zone\n",
+					i);
+				return -EINVAL;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct zbc_bench b;
+	struct zbc_device *dev = NULL;
+	unsigned long long elapsed;
+	unsigned int i, n = 0;
+	bool zno_set = false;
+	int ret = 1;
+
+	memset(&b, 0, sizeof(b));
+	b.nr_threads = 1;
+	b.qd = 1;
+	b.bs = 131072;
+	b.nz = 16;
+	b.rdpct = 70;
+
+	/* Parse command line */
+	if (argc < 3)
+		return zbc_bench_usage(stderr, argv[0]);
+
+	for (i = 1; i < (unsigned int)(argc - 1); i++) {
+
+		if (strcmp(argv[i], "-h") == 0 ||
+		    strcmp(argv[i], "--help") == 0)
+			return zbc_bench_usage(stdout, argv[0]);
+
+		if (strcmp(argv[i], "-v") == 0) {
+
+			zbc_set_log_level("debug");
+
+		} else if (strcmp(argv[i], "-scsi") == 0) {
+
+			b.oflags = ZBC_O_DRV_SCSI;
+
+		} else if (strcmp(argv[i], "-ata") == 0) {
+
+			b.oflags = ZBC_O_DRV_ATA;
+
+		} else if (strcmp(argv[i], "-json") == 0) {
+
+			b.json = true;
+
+		} else if (strcmp(argv[i], "-t") == 0 ||
+			   strcmp(argv[i], "-qd") == 0 ||
+			   strcmp(argv[i], "-bs") == 0 ||
+			   strcmp(argv[i], "-z") == 0 ||
+			   strcmp(argv[i], "-nz") == 0 ||
+			   strcmp(argv[i], "-n") == 0 ||
+			   strcmp(argv[i], "-rw") == 0) {
+
+			long long val;
+
+			if (i >= (unsigned int)(argc - 2))
+				goto err;
+			val = atoll(argv[i + 1]);
+			if (val < 0 || (val == 0 && strcmp(argv[i], "-z"))) {
+				fprintf(stderr, "Invalid value for %s\n",
+					argv[i]);
+				return 1;
+			}
+
+			if (strcmp(argv[i], "-t") == 0)
+				b.nr_threads = val;
+			else if (strcmp(argv[i], "-qd") == 0)
+				b.qd = val;
+			else if (strcmp(argv[i], "-bs") == 0)
+				b.bs = val;
+			else if (strcmp(argv[i], "-nz") == 0)
+				b.nz = val;
+			else if (strcmp(argv[i], "-n") == 0)
+				b.nr_ops = val;
+			else if (strcmp(argv[i], "-rw") == 0)
+				b.rdpct = val > 100 ? 100 : val;
+			else {
+				b.zno = val;
+				zno_set = true;
+			}
+			i++;
+
+		} else if (argv[i][0] == '-') {
+
+			fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
+			return 1;
+
+		} else {
+
+			break;
+
+		}
+
+	}
+
+	if (i != (unsigned int)(argc - 2))
+		goto err;
+
+	b.path = argv[i];
+	for (b.wl = 0; b.wl < ZBC_BENCH_NR_WL; b.wl++) {
+		if (strcmp(argv[i + 1], zbc_bench_wl_name[b.wl]) == 0)
+			break;
+	}
+	if (b.wl >= ZBC_BENCH_NR_WL) {
+		fprintf(stderr, "Unknown workload \"%s\"\n", argv[i + 1]);
+		return 1;
+	}
+	if (!b.nr_ops && b.wl != ZBC_BENCH_SEQWRITE)
+		b.nr_ops = 1000;
+
+	/* Setup signal handler */
+	signal(SIGQUIT, zbc_bench_sigcatcher);
+	signal(SIGINT, zbc_bench_sigcatcher);
+	signal(SIGTERM, zbc_bench_sigcatcher);
+
+	/* Use queued commands for asynchronous I/Os */
+	if (b.qd > 1)
+		b.oflags |= ZBC_O_NCQ;
+	ret = zbc_open(b.path, b.oflags | O_RDWR, &dev);
+	if (ret != 0) {
+		if (ret == -ENODEV)
+			fprintf(stderr,
+				"Open %s failed (not a zoned block device)\n",
+				b.path);
+		else
+			fprintf(stderr, "Open %s failed (%s)\n",
+				b.path, strerror(-ret));
+		return 1;
+	}
+
+	zbc_get_device_info(dev, &b.info);
+
+	if (zbc_aio_queue_depth(dev) < b.qd)
+		fprintf(stderr,
+			"[WARNING] %s: Device queue depth %u is lower than "
+			"the requested queue depth %u\n",
+			b.path, zbc_aio_queue_depth(dev), b.qd);
+
+	ret = 1;
+	if (b.bs % b.info.zbd_lblock_size ||
+	    (b.bs >> 9) > b.info.zbd_max_rw_sectors) {
+		fprintf(stderr, "Invalid I/O size %zu\n", b.bs);
+		goto out;
+	}
+
+	if (zbc_bench_get_zones(&b, dev, zno_set) != 0)
+		goto out;
+
+	b.threads = calloc(b.nr_threads, sizeof(struct zbc_bench_thread));
+	if (!b.threads) {
+		fprintf(stderr, "No memory\n");
+		goto out;
+	}
+	for (i = 0; i < b.nr_threads; i++) {
+		b.threads[i].id = i;
+		if (zbc_bench_setup_thread(&b, &b.threads[i]) != 0) {
+			fprintf(stderr, "Thread %u setup failed\n", i);
+			goto out;
+		}
+	}
+
+	if (!b.json)
+		printf("%s: %s, %u threads, QD %u, %zu B I/Os, %u zones from zone %u\n",
+		       b.path, zbc_bench_wl_name[b.wl], b.nr_threads, b.qd,
+		       b.bs, b.nz, b.zno);
+
+	elapsed = zbc_bench_nsec();
+
+	for (n = 0; n < b.nr_threads; n++) {
+		if (pthread_create(&b.threads[n].thread, NULL,
+				   zbc_bench_thread_fn, &b.threads[n])) {
+			fprintf(stderr, "Create thread failed\n");
+			zbc_bench_abort = 1;
+			break;
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(b.threads[i].thread, NULL);
+
+	elapsed = zbc_bench_nsec() - elapsed;
+
+	ret = 0;
+	for (i = 0; i < n; i++) {
+		if (b.threads[i].err)
+			ret = 1;
+	}
+
+	if (zbc_bench_report(&b, elapsed))
+		ret = 1;
+
+out:
+	if (b.threads) {
+		for (i = 0; i < b.nr_threads; i++) {
+			if (b.threads[i].dev)
+				zbc_close(b.threads[i].dev);
+			free(b.threads[i].zones);
+			free(b.threads[i].wp);
+			free(b.threads[i].realms);
+			free(b.threads[i].lat);
+		}
+		free(b.threads);
+	}
+	free(b.zones);
+	free(b.realms);
+	zbc_close(dev);
+
+	return ret;
+
+err:
+	printf("Invalid command line\n");
+
+	return 1;
+}
@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <libgen.h>
+
+#include <libzbc/zbc.h>
+
+static int zbc_copy_zone_abort = 0;
+
+static inline unsigned long long zbc_copy_zone_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (unsigned long long) tv.tv_sec * 1000000LL +
+		(unsigned long long) tv.tv_usec;
+}
+
+static void zbc_copy_zone_sigcatcher(int sig)
+{
+	zbc_copy_zone_abort = 1;
+}
+
+static int zbc_copy_zone_usage(FILE *out, char *prog)
+{
+	fprintf(out,
+		"Usage: %s [options] <src dev> <src zone no> "
+		"<dst dev> <dst zone no>\n"
+		"  Copy the data of a zone, up to the zone write pointer,\n"
+		"  to a zone of the same or of another device. Reads of the\n"
+		"  source zone overlap writes to the destination zone only\n"
+		"  for ATA devices supporting NCQ accessed through an SG node.\n"
+		"Options:\n"
+		"  -h | --help  : Display this help message and exit\n"
+		"  -v           : Verbose mode\n"
+		"  -scsi        : Force the use of SCSI passthrough commands\n"
+		"  -ata         : Force the use of ATA passthrough commands\n"
+		"  -nz <num>    : Copy <num> consecutive zones. If <num> is 0,\n"
+		"                 copy all zones up to the last source zone\n"
+		"  -r           : Reset the destination zones before copying\n",
+		basename(prog));
+	return 1;
+}
+
+static int zbc_copy_zone_open(char *path, int oflags, struct zbc_device **dev,
+			      struct zbc_zone **zones, unsigned int *nr_zones)
+{
+	int ret;
+
+	ret = zbc_open(path, oflags, dev);
+	if (ret != 0) {
+		if (ret == -ENODEV)
+			fprintf(stderr,
+				"Open %s failed (not a zoned block device)\n",
+				path);
+		else
+			fprintf(stderr, "Open %s failed (%s)\n",
+				path, strerror(-ret));
+		return ret;
+	}
+
+	ret = zbc_list_zones(*dev, 0, ZBC_RZ_RO_ALL, zones, nr_zones);
+	if (ret != 0) {
+		fprintf(stderr, "%s: zbc_list_zones failed %d (%s)\n",
+			path, ret, strerror(-ret));
+		zbc_close(*dev);
+		*dev = NULL;
+	}
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct zbc_device *src = NULL, *dst = NULL;
+	struct zbc_zone *szones = NULL, *dzones = NULL;
+	struct zbc_zone *szone, *dzone;
+	unsigned int nr_szones, nr_dzones;
+	unsigned long long elapsed, bcount = 0, brate;
+	unsigned int zcount = 0;
+	uint64_t nr_sectors;
+	char *spath, *dpath;
+	int szidx, dzidx, nz = 1, oflags = 0, i, ret = 1;
+	bool reset = false;
+
+	/* Parse command line */
+	if (argc < 5)
+		return zbc_copy_zone_usage(stderr, argv[0]);
+
+	for (i = 1; i < (argc - 1); i++) {
+
+		if (strcmp(argv[i], "-h") == 0 ||
+		    strcmp(argv[i], "--help") == 0)
+			return zbc_copy_zone_usage(stdout, argv[0]);
+
+		if (strcmp(argv[i], "-v") == 0) {
+
+			zbc_set_log_level("debug");
+
+		} else if (strcmp(argv[i], "-scsi") == 0) {
+
+			oflags = ZBC_O_DRV_SCSI;
+
+		} else if (strcmp(argv[i], "-ata") == 0) {
+
+			oflags = ZBC_O_DRV_ATA;
+
+		} else if (strcmp(argv[i], "-nz") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			nz = atoi(argv[i]);
+			if (nz < 0) {
+				fprintf(stderr, "Invalid number of zones\n");
+				return 1;
+			}
+
+		} else if (strcmp(argv[i], "-r") == 0) {
+
+			reset = true;
+
+		} else if (argv[i][0] == '-') {
+
+			fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
+			return 1;
+
+		} else {
+
+			break;
+
+		}
+
+	}
+
+	if (i != (argc - 4))
+		goto err;
+
+	/* Get parameters */
+	spath = argv[i];
+	szidx = atoi(argv[i + 1]);
+	dpath = argv[i + 2];
+	dzidx = atoi(argv[i + 3]);
+	if (szidx < 0 || dzidx < 0) {
+		fprintf(stderr, "Invalid zone number\n");
+		return 1;
+	}
+
+	/* Setup signal handler */
+	signal(SIGQUIT, zbc_copy_zone_sigcatcher);
+	signal(SIGINT, zbc_copy_zone_sigcatcher);
+	signal(SIGTERM, zbc_copy_zone_sigcatcher);
+
+	/*
+	 * Open devices, using queued commands to overlap reads and writes.
+	 * ZBC_O_NCQ is ignored by the SCSI and block device drivers.
+	 */
+	oflags |= ZBC_O_NCQ;
+	if (zbc_copy_zone_open(spath, oflags | O_RDONLY,
+			       &src, &szones, &nr_szones))
+		goto out;
+	if (zbc_copy_zone_open(dpath, oflags | O_RDWR,
+			       &dst, &dzones, &nr_dzones))
+		goto out;
+
+	if ((unsigned int)szidx >= nr_szones ||
+	    (unsigned int)dzidx >= nr_dzones) {
+		fprintf(stderr, "Target zone not found\n");
+		goto out;
+	}
+
+	if (!nz)
+		nz = nr_szones - szidx;
+	if ((unsigned int)(szidx + nz) > nr_szones ||
+	    (unsigned int)(dzidx + nz) > nr_dzones) {
+		fprintf(stderr, "Not enough zones to copy %d zones\n", nz);
+		goto out;
+	}
+
+	printf("Copying %d zone%s from %s zone %d to %s zone %d\n",
+	       nz, nz > 1 ? "s" : "", spath, szidx, dpath, dzidx);
+
+	elapsed = zbc_copy_zone_usec();
+
+	for (i = 0; i < nz && !zbc_copy_zone_abort; i++) {
+
+		szone = &szones[szidx + i];
+		dzone = &dzones[dzidx + i];
+
+		if (reset && zbc_zone_sequential(dzone) &&
+		    !zbc_zone_empty(dzone)) {
+			ret = zbc_reset_zone(dst, zbc_zone_start(dzone), 0);
+			if (ret != 0) {
+				fprintf(stderr,
+					"Reset zone %d failed %d (%s)\n",
+					dzidx + i, ret, strerror(-ret));
+				ret = 1;
+				goto out;
+			}
+		}
+
+		ret = zbc_copy_zone(src, zbc_zone_start(szone),
+				    dst, zbc_zone_start(dzone), &nr_sectors);
+		if (ret != 0) {
+			fprintf(stderr,
+				"Copy zone %d to zone %d failed %d (%s)\n",
+				szidx + i, dzidx + i, ret, strerror(-ret));
+			ret = 1;
+			goto out;
+		}
+
+		bcount += nr_sectors << 9;
+		zcount++;
+	}
+
+	elapsed = zbc_copy_zone_usec() - elapsed;
+	if (elapsed) {
+		printf("Copied %llu B (%u zones) in %llu.%03llu sec\n",
+		       bcount,
+		       zcount,
+		       elapsed / 1000000,
+		       (elapsed % 1000000) / 1000);
+		brate = bcount * 1000000 / elapsed;
+		printf("  BW %llu.%03llu MB/s\n",
+		       brate / 1000000,
+		       (brate % 1000000) / 1000);
+	} else {
+		printf("Copied %llu B (%u zones)\n",
+		       bcount,
+		       zcount);
+	}
+
+	ret = zbc_copy_zone_abort ? 1 : 0;
+
+out:
+	free(szones);
+	free(dzones);
+	if (dst)
+		zbc_close(dst);
+	if (src)
+		zbc_close(src);
+
+	return ret;
+
+err:
+	printf("Invalid command line\n");
+
+	return 1;
+}
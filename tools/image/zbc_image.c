@@ -0,0 +1,791 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ */
+#define _GNU_SOURCE     /* O_LARGEFILE */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <libgen.h>
+
+#include <libzbc/zbc.h>
+
+/*
+ * Image file layout: a header, the zone table at ZBC_IMG_ZONES_OFST
+ * followed by the realm table of Zone Domains and Zone Realms devices, and
+ * the data of the device sectors at data_ofst + sector * 512. Unwritten
+ * sectors, empty zones and zero-filled conventional zone blocks are left
+ * as holes, so that the image file is sparse and can be read at any
+ * offset. All fields are stored in host byte order.
+ */
+#define ZBC_IMG_MAGIC		"ZBCIMAGE"
+#define ZBC_IMG_VERSION		2
+#define ZBC_IMG_ZONES_OFST	4096ULL
+#define ZBC_IMG_DATA_ALIGN	(1024ULL * 1024ULL)
+
+/* The image has the active domain of each realm */
+#define ZBC_IMG_REALMS		0x01
+
+struct zbc_img_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	flags;
+	uint32_t	model;
+	uint32_t	lblock_size;
+	uint32_t	pblock_size;
+	uint32_t	nr_zones;
+	uint64_t	sectors;
+	uint64_t	data_ofst;
+	uint32_t	nr_realms;
+	uint32_t	pad;
+};
+
+struct zbc_img_zone {
+	uint64_t	start;
+	uint64_t	length;
+	uint64_t	capacity;
+	uint64_t	wp;
+	uint8_t		type;
+	uint8_t		cond;
+	uint8_t		pad[6];
+};
+
+struct zbc_img_realm {
+	uint32_t	number;
+	uint8_t		dom_id;
+	uint8_t		type;
+	uint8_t		pad[2];
+};
+
+struct zbc_img {
+	struct zbc_device	*dev;
+	char			*path;
+	char			*file;
+	int			fd;
+	bool			restore;
+
+	struct zbc_img_hdr	hdr;
+	struct zbc_img_zone	*zones;
+	struct zbc_img_realm	*realms;
+
+	size_t			bufsize;
+
+	pthread_mutex_t		lock;
+	unsigned int		next_zone;
+	unsigned long long	bcount;
+	int			err;
+};
+
+static int zbc_img_abort = 0;
+
+static inline unsigned long long zbc_img_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (unsigned long long) tv.tv_sec * 1000000LL +
+		(unsigned long long) tv.tv_usec;
+}
+
+static void zbc_img_sigcatcher(int sig)
+{
+	zbc_img_abort = 1;
+}
+
+static int zbc_img_usage(FILE *out, char *prog)
+{
+	fprintf(out,
+		"Usage: %s [options] dump <dev> <image file>\n"
+		"       %s [options] restore <image file> <dev>\n"
+		"  Dump the zones of a device to a sparse image file or\n"
+		"  restore an image onto a device with the same zone layout.\n"
+		"Options:\n"
+		"  -h | --help  : Display this help message and exit\n"
+		"  -v           : Verbose mode\n"
+		"  -scsi        : Force the use of SCSI passthrough commands\n"
+		"  -ata         : Force the use of ATA passthrough commands\n"
+		"  -t <num>     : Use <num> threads (default: 4)\n"
+		"  -bs <size>   : Use I/Os of <size> B (default: maximum\n"
+		"                 I/O size of the device)\n"
+		"  -a           : Restore: activate each zone realm to its\n"
+		"                 domain in the image\n",
+		basename(prog), basename(prog));
+	return 1;
+}
+
+/*
+ * Number of sectors of a zone holding data.
+ */
+static uint64_t zbc_img_zone_sectors(struct zbc_img_zone *z)
+{
+	switch (z->cond) {
+	case ZBC_ZC_EMPTY:
+	case ZBC_ZC_OFFLINE:
+	case ZBC_ZC_INACTIVE:
+		return 0;
+	case ZBC_ZC_FULL:
+	case ZBC_ZC_NOT_WP:
+	case ZBC_ZC_RDONLY:
+		return z->capacity;
+	default:
+		return z->wp - z->start;
+	}
+}
+
+static bool zbc_img_zero(void *buf, size_t size)
+{
+	uint64_t *w = buf;
+	size_t i;
+
+	for (i = 0; i < size / sizeof(uint64_t); i++) {
+		if (w[i])
+			return false;
+	}
+
+	return true;
+}
+
+static void zbc_img_set_err(struct zbc_img *img, int err)
+{
+	pthread_mutex_lock(&img->lock);
+	if (!img->err)
+		img->err = err;
+	pthread_mutex_unlock(&img->lock);
+}
+
+/*
+ * Copy the data of a zone from the device to the image file or from the
+ * image file to the device.
+ */
+static int zbc_img_copy_zone(struct zbc_img *img, struct zbc_img_zone *z,
+			     void *buf)
+{
+	uint64_t count = zbc_img_zone_sectors(z);
+	uint64_t sector = z->start, end = z->start + count;
+	size_t nr_sectors;
+	off_t ofst;
+	ssize_t ret;
+
+	/* Read-only zones cannot be restored */
+	if (img->restore && z->cond == ZBC_ZC_RDONLY)
+		return 0;
+
+	while (sector < end && !zbc_img_abort) {
+
+		nr_sectors = img->bufsize >> 9;
+		if (sector + nr_sectors > end)
+			nr_sectors = end - sector;
+		ofst = img->hdr.data_ofst + (sector << 9);
+
+		if (img->restore) {
+			ret = pread(img->fd, buf, nr_sectors << 9, ofst);
+			if (ret != (ssize_t)(nr_sectors << 9)) {
+				fprintf(stderr, "Read image \"%s\" failed\n",
+					img->file);
+				return -EIO;
+			}
+			ret = zbc_pwrite(img->dev, buf, nr_sectors, sector);
+			if (ret <= 0) {
+				fprintf(stderr,
+					"zbc_pwrite sector %llu failed %zd (%s)\n",
+					(unsigned long long)sector,
+					-ret, strerror(-ret));
+				return ret ? ret : -EIO;
+			}
+		} else {
+			ret = zbc_pread(img->dev, buf, nr_sectors, sector);
+			if (ret <= 0) {
+				fprintf(stderr,
+					"zbc_pread sector %llu failed %zd (%s)\n",
+					(unsigned long long)sector,
+					-ret, strerror(-ret));
+				return ret ? ret : -EIO;
+			}
+			nr_sectors = ret;
+
+			/* Leave holes for zeroed conventional zone blocks */
+			if (z->type != ZBC_ZT_CONVENTIONAL ||
+			    !zbc_img_zero(buf, nr_sectors << 9)) {
+				ret = pwrite(img->fd, buf, nr_sectors << 9,
+					     ofst);
+				if (ret != (ssize_t)(nr_sectors << 9)) {
+					fprintf(stderr,
+						"Write image \"%s\" failed\n",
+						img->file);
+					return -EIO;
+				}
+			}
+		}
+
+		sector += nr_sectors;
+	}
+
+	pthread_mutex_lock(&img->lock);
+	img->bcount += (sector - z->start) << 9;
+	pthread_mutex_unlock(&img->lock);
+
+	if (!img->restore || z->type == ZBC_ZT_CONVENTIONAL ||
+	    !count || count == z->capacity)
+		return 0;
+
+	/* Restore the zone condition */
+	switch (z->cond) {
+	case ZBC_ZC_FULL:
+		return zbc_finish_zone(img->dev, z->start, 0);
+	case ZBC_ZC_EXP_OPEN:
+		return zbc_open_zone(img->dev, z->start, 0);
+	default:
+		return zbc_close_zone(img->dev, z->start, 0);
+	}
+}
+
+static void *zbc_img_worker(void *arg)
+{
+	struct zbc_img *img = arg;
+	unsigned int zno;
+	void *buf;
+	int ret;
+
+	ret = posix_memalign(&buf, sysconf(_SC_PAGESIZE), img->bufsize);
+	if (ret != 0) {
+		zbc_img_set_err(img, -ret);
+		return NULL;
+	}
+
+	while (!zbc_img_abort) {
+		pthread_mutex_lock(&img->lock);
+		zno = img->next_zone++;
+		ret = img->err;
+		pthread_mutex_unlock(&img->lock);
+		if (ret || zno >= img->hdr.nr_zones)
+			break;
+
+		ret = zbc_img_copy_zone(img, &img->zones[zno], buf);
+		if (ret != 0) {
+			fprintf(stderr, "Zone %u failed %d (%s)\n",
+				zno, ret, strerror(-ret));
+			zbc_img_set_err(img, ret);
+			break;
+		}
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+static int zbc_img_run(struct zbc_img *img, int nr_threads)
+{
+	pthread_t *threads;
+	int i, n;
+
+	threads = calloc(nr_threads, sizeof(pthread_t));
+	if (!threads)
+		return -ENOMEM;
+
+	for (n = 0; n < nr_threads; n++) {
+		if (pthread_create(&threads[n], NULL, zbc_img_worker, img)) {
+			zbc_img_set_err(img, -EAGAIN);
+			break;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+
+	if (zbc_img_abort && !img->err)
+		return -EINTR;
+
+	return img->err;
+}
+
+static int zbc_img_dump(struct zbc_img *img, struct zbc_device_info *info)
+{
+	struct zbc_zone_realm *realms = NULL;
+	struct zbc_zone *zones = NULL;
+	struct zbc_img_hdr *hdr = &img->hdr;
+	unsigned int nr_zones, nr_realms = 0, i;
+	uint64_t realms_ofst;
+	size_t zsize, rsize;
+	ssize_t ret;
+
+	ret = zbc_list_zones(img->dev, 0, ZBC_RZ_RO_ALL, &zones, &nr_zones);
+	if (ret != 0) {
+		fprintf(stderr, "zbc_list_zones failed %zd\n", ret);
+		return ret;
+	}
+
+	memcpy(hdr->magic, ZBC_IMG_MAGIC, sizeof(hdr->magic));
+	hdr->version = ZBC_IMG_VERSION;
+	hdr->model = info->zbd_model;
+	hdr->lblock_size = info->zbd_lblock_size;
+	hdr->pblock_size = info->zbd_pblock_size;
+	hdr->nr_zones = nr_zones;
+	hdr->sectors = info->zbd_sectors;
+
+	img->zones = calloc(nr_zones, sizeof(struct zbc_img_zone));
+	if (!img->zones) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < nr_zones; i++) {
+		img->zones[i].start = zbc_zone_start(&zones[i]);
+		img->zones[i].length = zbc_zone_length(&zones[i]);
+		img->zones[i].capacity = zbc_zone_capacity(&zones[i]);
+		img->zones[i].wp = zbc_zone_wp(&zones[i]);
+		img->zones[i].type = zbc_zone_type(&zones[i]);
+		img->zones[i].cond = zbc_zone_condition(&zones[i]);
+	}
+
+	/* Save the active domain of each realm */
+	if (zbc_device_is_zdr(info)) {
+		ret = zbc_list_zone_realms(img->dev, 0, ZBC_RR_RO_ALL,
+					   &realms, &nr_realms);
+		if (ret != 0) {
+			fprintf(stderr, "zbc_list_zone_realms failed %zd\n",
+				ret);
+			goto out;
+		}
+		img->realms = calloc(nr_realms, sizeof(struct zbc_img_realm));
+		if (!img->realms) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		for (i = 0; i < nr_realms; i++) {
+			img->realms[i].number = realms[i].zbr_number;
+			img->realms[i].dom_id = realms[i].zbr_dom_id;
+			img->realms[i].type = zbc_zone_realm_type(&realms[i]);
+		}
+		hdr->nr_realms = nr_realms;
+		hdr->flags |= ZBC_IMG_REALMS;
+	}
+
+	zsize = nr_zones * sizeof(struct zbc_img_zone);
+	rsize = nr_realms * sizeof(struct zbc_img_realm);
+	realms_ofst = ZBC_IMG_ZONES_OFST + zsize;
+	hdr->data_ofst = (realms_ofst + rsize + ZBC_IMG_DATA_ALIGN - 1) &
+		~(ZBC_IMG_DATA_ALIGN - 1);
+
+	/* Size the image file so that it can be read at any offset */
+	if (ftruncate(img->fd, hdr->data_ofst + (hdr->sectors << 9)) ||
+	    pwrite(img->fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr) ||
+	    pwrite(img->fd, img->zones, zsize, ZBC_IMG_ZONES_OFST) !=
+	    (ssize_t)zsize ||
+	    (rsize && pwrite(img->fd, img->realms, rsize, realms_ofst) !=
+	     (ssize_t)rsize)) {
+		fprintf(stderr, "Write image \"%s\" header failed\n",
+			img->file);
+		ret = -EIO;
+		goto out;
+	}
+
+	ret = 0;
+
+out:
+	free(realms);
+	free(zones);
+
+	return ret;
+}
+
+/*
+ * Activate the realms of the device that are not in the domain saved in
+ * the image. Each realm is activated with its own plan step: grouping the
+ * realms by zone type with zbc_plan_activation() would only restore the
+ * number of realms of each type, not which realms have that type.
+ */
+static int zbc_img_activate(struct zbc_img *img, struct zbc_device_info *info)
+{
+	struct zbc_img_hdr *hdr = &img->hdr;
+	struct zbc_zone_realm *realms = NULL, *r;
+	struct zbc_img_realm *ir;
+	struct zbc_actv_plan plan;
+	struct zbc_actv_step *s;
+	unsigned int nr_realms, i;
+	int ret;
+
+	if (!(hdr->flags & ZBC_IMG_REALMS) || !zbc_device_is_zdr(info)) {
+		fprintf(stderr, "Zone realms cannot be restored\n");
+		return -ENOTSUP;
+	}
+
+	if (!(info->zbd_flags &
+	      (ZBC_NOZSRC_SUPPORT | ZBC_ZA_CONTROL_SUPPORT))) {
+		fprintf(stderr, "Neither NOZSRC nor FSNOZ are supported\n");
+		return -ENOTSUP;
+	}
+
+	ret = zbc_list_zone_realms(img->dev, 0, ZBC_RR_RO_ALL,
+				   &realms, &nr_realms);
+	if (ret != 0) {
+		fprintf(stderr, "zbc_list_zone_realms failed %d\n", ret);
+		return ret;
+	}
+
+	memset(&plan, 0, sizeof(plan));
+	plan.zbp_fsnoz = !(info->zbd_flags & ZBC_NOZSRC_SUPPORT);
+	plan.zbp_steps = calloc(hdr->nr_realms, sizeof(struct zbc_actv_step));
+	if (!plan.zbp_steps) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < hdr->nr_realms; i++) {
+		ir = &img->realms[i];
+		if (i >= nr_realms || realms[i].zbr_number != ir->number ||
+		    ir->dom_id >= zbc_zone_realm_nr_domains(&realms[i]) ||
+		    !zbc_realm_length(&realms[i], ir->dom_id)) {
+			fprintf(stderr, "Realm %u layout does not match\n",
+				ir->number);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		r = &realms[i];
+		if (r->zbr_dom_id == ir->dom_id)
+			continue;
+
+		if (!zbc_realm_activation_allowed(r)) {
+			fprintf(stderr, "Realm %u cannot be activated\n",
+				ir->number);
+			ret = -EPERM;
+			goto out;
+		}
+
+		s = &plan.zbp_steps[plan.zbp_nr_steps++];
+		s->zbs_start_sector = zbc_realm_start_sector(r, ir->dom_id);
+		s->zbs_nr_zones = zbc_realm_length(r, ir->dom_id);
+		s->zbs_dom_id = ir->dom_id;
+		s->zbs_realm = r->zbr_number;
+		s->zbs_nr_realms = 1;
+		if (!zbc_zone_realm_conventional(r)) {
+			s->zbs_src_sector =
+				zbc_realm_start_sector(r, r->zbr_dom_id);
+			s->zbs_src_nr_zones =
+				zbc_realm_length(r, r->zbr_dom_id);
+		}
+		plan.zbp_nr_realms++;
+	}
+
+	if (!plan.zbp_nr_steps)
+		goto out;
+
+	printf("Activating %u realms\n", plan.zbp_nr_realms);
+
+	ret = zbc_exec_activation_plan(img->dev, &plan, 0, NULL, NULL);
+	if (ret != 0)
+		fprintf(stderr, "Activation failed %d (%s)\n",
+			ret, strerror(-ret));
+
+out:
+	free(plan.zbp_steps);
+	free(realms);
+
+	return ret;
+}
+
+static int zbc_img_load(struct zbc_img *img, struct zbc_device_info *info,
+			bool activate)
+{
+	struct zbc_img_hdr *hdr = &img->hdr;
+	struct zbc_zone *zones = NULL;
+	unsigned int nr_zones, i;
+	size_t size;
+	off_t ofst;
+	int ret;
+
+	if (pread(img->fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr) ||
+	    memcmp(hdr->magic, ZBC_IMG_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != ZBC_IMG_VERSION) {
+		fprintf(stderr, "\"%s\" is not a zoned device image\n",
+			img->file);
+		return -EINVAL;
+	}
+
+	if (hdr->lblock_size != info->zbd_lblock_size ||
+	    hdr->sectors > info->zbd_sectors) {
+		fprintf(stderr,
+			"Image of %llu sectors of %u B does not fit the device\n",
+			(unsigned long long)hdr->sectors, hdr->lblock_size);
+		return -EINVAL;
+	}
+
+	size = hdr->nr_zones * sizeof(struct zbc_img_zone);
+	img->zones = malloc(size);
+	if (!img->zones)
+		return -ENOMEM;
+	if (pread(img->fd, img->zones, size, ZBC_IMG_ZONES_OFST) !=
+	    (ssize_t)size) {
+		fprintf(stderr, "Read image \"%s\" zones failed\n", img->file);
+		return -EIO;
+	}
+
+	if (activate && hdr->nr_realms) {
+		ofst = ZBC_IMG_ZONES_OFST + size;
+		size = hdr->nr_realms * sizeof(struct zbc_img_realm);
+		img->realms = malloc(size);
+		if (!img->realms)
+			return -ENOMEM;
+		if (pread(img->fd, img->realms, size, ofst) != (ssize_t)size) {
+			fprintf(stderr, "Read image \"%s\" realms failed\n",
+				img->file);
+			return -EIO;
+		}
+	}
+
+	if (activate) {
+		ret = zbc_img_activate(img, info);
+		if (ret != 0)
+			return ret;
+	}
+
+	/* The device zone layout must match the image */
+	ret = zbc_list_zones(img->dev, 0, ZBC_RZ_RO_ALL, &zones, &nr_zones);
+	if (ret != 0) {
+		fprintf(stderr, "zbc_list_zones failed %d\n", ret);
+		return ret;
+	}
+
+	for (i = 0; i < hdr->nr_zones; i++) {
+		if (i >= nr_zones ||
+		    zbc_zone_start(&zones[i]) != img->zones[i].start ||
+		    zbc_zone_length(&zones[i]) != img->zones[i].length ||
+		    zbc_zone_type(&zones[i]) != img->zones[i].type) {
+			fprintf(stderr, "Zone %u layout does not match\n", i);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	free(zones);
+
+	if (ret != 0)
+		return ret;
+
+	/* Start from empty zones */
+	ret = zbc_reset_zone(img->dev, 0, ZBC_OP_ALL_ZONES);
+	if (ret != 0)
+		fprintf(stderr, "Reset all zones failed %d (%s)\n",
+			ret, strerror(-ret));
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct zbc_device_info info;
+	struct zbc_img img;
+	unsigned long long elapsed, brate;
+	int nr_threads = 4, oflags = 0, flags, i, ret = 1;
+	bool activate = false;
+	size_t bufsize = 0;
+
+	/* Parse command line */
+	if (argc < 4)
+		return zbc_img_usage(stderr, argv[0]);
+
+	for (i = 1; i < (argc - 1); i++) {
+
+		if (strcmp(argv[i], "-h") == 0 ||
+		    strcmp(argv[i], "--help") == 0)
+			return zbc_img_usage(stdout, argv[0]);
+
+		if (strcmp(argv[i], "-v") == 0) {
+
+			zbc_set_log_level("debug");
+
+		} else if (strcmp(argv[i], "-scsi") == 0) {
+
+			oflags = ZBC_O_DRV_SCSI;
+
+		} else if (strcmp(argv[i], "-ata") == 0) {
+
+			oflags = ZBC_O_DRV_ATA;
+
+		} else if (strcmp(argv[i], "-t") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			nr_threads = atoi(argv[i]);
+			if (nr_threads <= 0) {
+				fprintf(stderr, "Invalid number of threads\n");
+				return 1;
+			}
+
+		} else if (strcmp(argv[i], "-bs") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			bufsize = atol(argv[i]);
+			if (!bufsize || bufsize % 512) {
+				fprintf(stderr, "Invalid I/O size\n");
+				return 1;
+			}
+
+		} else if (strcmp(argv[i], "-a") == 0) {
+
+			activate = true;
+
+		} else if (argv[i][0] == '-') {
+
+			fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
+			return 1;
+
+		} else {
+
+			break;
+
+		}
+
+	}
+
+	if (i != (argc - 3))
+		goto err;
+
+	memset(&img, 0, sizeof(img));
+	img.fd = -1;
+	pthread_mutex_init(&img.lock, NULL);
+
+	if (strcmp(argv[i], "dump") == 0) {
+		img.path = argv[i + 1];
+		img.file = argv[i + 2];
+		flags = O_RDONLY;
+	} else if (strcmp(argv[i], "restore") == 0) {
+		img.file = argv[i + 1];
+		img.path = argv[i + 2];
+		img.restore = true;
+		flags = O_RDWR;
+	} else {
+		goto err;
+	}
+
+	/* Setup signal handler */
+	signal(SIGQUIT, zbc_img_sigcatcher);
+	signal(SIGINT, zbc_img_sigcatcher);
+	signal(SIGTERM, zbc_img_sigcatcher);
+
+	/* Open device */
+	ret = zbc_open(img.path, oflags | flags, &img.dev);
+	if (ret != 0) {
+		if (ret == -ENODEV)
+			fprintf(stderr,
+				"Open %s failed (not a zoned block device)\n",
+				img.path);
+		else
+			fprintf(stderr, "Open %s failed (%s)\n",
+				img.path, strerror(-ret));
+		return 1;
+	}
+
+	zbc_get_device_info(img.dev, &info);
+
+	if (!bufsize)
+		bufsize = (size_t)info.zbd_max_rw_sectors << 9;
+	if (bufsize % info.zbd_lblock_size) {
+		fprintf(stderr,
+			"Invalid I/O size %zu (must be a multiple of %u B)\n",
+			bufsize, (unsigned int) info.zbd_lblock_size);
+		ret = 1;
+		goto out;
+	}
+	img.bufsize = bufsize;
+
+	/* Open the image file */
+	if (img.restore)
+		img.fd = open(img.file, O_LARGEFILE | O_RDONLY);
+	else
+		img.fd = open(img.file,
+			      O_CREAT | O_TRUNC | O_LARGEFILE | O_WRONLY,
+			      S_IRUSR | S_IWUSR | S_IRGRP);
+	if (img.fd < 0) {
+		fprintf(stderr, "Open file \"%s\" failed %d (%s)\n",
+			img.file, errno, strerror(errno));
+		ret = 1;
+		goto out;
+	}
+
+	if (img.restore)
+		ret = zbc_img_load(&img, &info, activate);
+	else
+		ret = zbc_img_dump(&img, &info);
+	if (ret != 0) {
+		ret = 1;
+		goto out;
+	}
+
+	printf("%s %s %s %s, %u zones, %d threads, %zu B I/Os\n",
+	       img.restore ? "Restoring" : "Dumping",
+	       img.restore ? img.file : img.path,
+	       img.restore ? "to" : "to image",
+	       img.restore ? img.path : img.file,
+	       img.hdr.nr_zones, nr_threads, img.bufsize);
+
+	elapsed = zbc_img_usec();
+
+	ret = zbc_img_run(&img, nr_threads);
+	if (ret == 0 && img.restore)
+		ret = zbc_flush(img.dev);
+	else if (ret == 0 && fsync(img.fd))
+		ret = -errno;
+	if (ret != 0) {
+		fprintf(stderr, "%s failed %d (%s)\n",
+			img.restore ? "Restore" : "Dump",
+			ret, strerror(-ret));
+		ret = 1;
+		goto out;
+	}
+
+	elapsed = zbc_img_usec() - elapsed;
+	if (elapsed) {
+		printf("%s %llu B in %llu.%03llu sec\n",
+		       img.restore ? "Restored" : "Dumped",
+		       img.bcount,
+		       elapsed / 1000000,
+		       (elapsed % 1000000) / 1000);
+		brate = img.bcount * 1000000 / elapsed;
+		printf("  BW %llu.%03llu MB/s\n",
+		       brate / 1000000,
+		       (brate % 1000000) / 1000);
+	} else {
+		printf("%s %llu B\n",
+		       img.restore ? "Restored" : "Dumped",
+		       img.bcount);
+	}
+
+out:
+	if (img.fd >= 0) {
+		close(img.fd);
+		if (ret != 0 && !img.restore)
+			unlink(img.file);
+	}
+
+	free(img.zones);
+	free(img.realms);
+	pthread_mutex_destroy(&img.lock);
+
+	zbc_close(img.dev);
+
+	return ret;
+
+err:
+	printf("Invalid command line\n");
+
+	return 1;
+}
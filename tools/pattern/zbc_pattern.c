@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+
+#include "zbc_pattern.h"
+
+#define ZBC_PATTERN_SECTOR_WORDS	(512 / sizeof(uint64_t))
+#define ZBC_PATTERN_HDR_WORDS		4
+#define ZBC_PATTERN_MAGIC		0x5a4243504154524eULL	/* "ZBCPATRN" */
+
+/*
+ * The payload words of a sector are the sector base value XOR-ed with
+ * a fixed template. The fill and check loops below thus only use 64-bit
+ * XOR, OR and load/store operations on independent words, without any
+ * architecture specific code. Whether the compiler vectorizes them
+ * depends on its version and optimization level (e.g. -O3 or
+ * -ftree-vectorize).
+ */
+static uint64_t zbc_pattern_tmpl[ZBC_PATTERN_SECTOR_WORDS];
+static pthread_once_t zbc_pattern_tmpl_once = PTHREAD_ONCE_INIT;
+
+/*
+ * 64-bit mixing function (splitmix64 finalizer).
+ */
+static inline uint64_t zbc_pattern_mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+
+	return x;
+}
+
+static void zbc_pattern_init_tmpl(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ZBC_PATTERN_SECTOR_WORDS; i++)
+		zbc_pattern_tmpl[i] = zbc_pattern_mix(ZBC_PATTERN_MAGIC + i);
+}
+
+static inline uint64_t zbc_pattern_key(uint64_t seed, uint64_t gen)
+{
+	return zbc_pattern_mix(seed ^ zbc_pattern_mix(gen));
+}
+
+static inline uint64_t zbc_pattern_base(uint64_t key, uint64_t sector)
+{
+	return zbc_pattern_mix(key + sector);
+}
+
+static void zbc_pattern_fill_sector(struct zbc_pattern *p, uint64_t *w,
+				    uint64_t key, uint64_t sector)
+{
+	uint64_t base = zbc_pattern_base(key, sector);
+	unsigned int i;
+
+	w[0] = htole64(sector);
+	w[1] = htole64(p->seed);
+	w[2] = htole64(p->gen);
+	w[3] = htole64(base ^ ZBC_PATTERN_MAGIC);
+
+	for (i = ZBC_PATTERN_HDR_WORDS; i < ZBC_PATTERN_SECTOR_WORDS; i++)
+		w[i] = htole64(base ^ zbc_pattern_tmpl[i]);
+}
+
+/**
+ * Fill sectors with the pattern.
+ */
+void zbc_pattern_fill(struct zbc_pattern *p, void *buf,
+		      uint64_t sector, size_t nr_sectors)
+{
+	uint64_t key = zbc_pattern_key(p->seed, p->gen);
+	uint64_t *w = buf;
+	size_t i;
+
+	pthread_once(&zbc_pattern_tmpl_once, zbc_pattern_init_tmpl);
+
+	for (i = 0; i < nr_sectors; i++) {
+		zbc_pattern_fill_sector(p, w, key, sector + i);
+		w += ZBC_PATTERN_SECTOR_WORDS;
+	}
+}
+
+/*
+ * Fill a mismatch description for a sector that does not match.
+ */
+static void zbc_pattern_mismatch(struct zbc_pattern *p, const uint64_t *w,
+				 uint64_t key, uint64_t sector,
+				 struct zbc_pattern_mismatch *m)
+{
+	uint64_t exp[ZBC_PATTERN_SECTOR_WORDS];
+	const uint8_t *b = (const uint8_t *)w;
+	const uint8_t *e = (const uint8_t *)exp;
+	uint64_t hdr_key;
+
+	zbc_pattern_fill_sector(p, exp, key, sector);
+
+	m->sector = sector;
+	for (m->offset = 0; m->offset < 512; m->offset++) {
+		if (b[m->offset] != e[m->offset])
+			break;
+	}
+
+	/* Decode the sector header to identify the data found */
+	m->hdr_sector = le64toh(w[0]);
+	m->hdr_seed = le64toh(w[1]);
+	m->hdr_gen = le64toh(w[2]);
+	hdr_key = zbc_pattern_key(m->hdr_seed, m->hdr_gen);
+	m->hdr_valid = (le64toh(w[3]) ^ ZBC_PATTERN_MAGIC) ==
+		zbc_pattern_base(hdr_key, m->hdr_sector);
+}
+
+/**
+ * Check sectors against the pattern.
+ */
+size_t zbc_pattern_check(struct zbc_pattern *p, const void *buf,
+			 uint64_t sector, size_t nr_sectors,
+			 struct zbc_pattern_mismatch *m)
+{
+	uint64_t key = zbc_pattern_key(p->seed, p->gen);
+	const uint64_t *w = buf;
+	uint64_t base, diff;
+	size_t i, nr_bad = 0;
+	unsigned int j;
+
+	pthread_once(&zbc_pattern_tmpl_once, zbc_pattern_init_tmpl);
+
+	for (i = 0; i < nr_sectors; i++, w += ZBC_PATTERN_SECTOR_WORDS) {
+		base = zbc_pattern_base(key, sector + i);
+
+		diff = (le64toh(w[0]) ^ (sector + i)) |
+			(le64toh(w[1]) ^ p->seed) |
+			(le64toh(w[2]) ^ p->gen) |
+			(le64toh(w[3]) ^ base ^ ZBC_PATTERN_MAGIC);
+		for (j = ZBC_PATTERN_HDR_WORDS;
+		     j < ZBC_PATTERN_SECTOR_WORDS; j++)
+			diff |= le64toh(w[j]) ^ base ^ zbc_pattern_tmpl[j];
+		if (!diff)
+			continue;
+
+		if (!nr_bad)
+			zbc_pattern_mismatch(p, w, key, sector + i, m);
+		nr_bad++;
+	}
+
+	return nr_bad;
+}
+
+/**
+ * Print a mismatch description.
+ */
+void zbc_pattern_print_mismatch(struct zbc_pattern *p,
+				struct zbc_pattern_mismatch *m,
+				FILE *out)
+{
+	fprintf(out,
+		"Data mismatch @sector %llu, byte %zu: ",
+		(unsigned long long)m->sector, m->offset);
+
+	if (!m->hdr_valid)
+		fprintf(out, "no valid pattern found\n");
+	else if (m->hdr_sector != m->sector)
+		fprintf(out, "found data of sector %llu\n",
+			(unsigned long long)m->hdr_sector);
+	else if (m->hdr_seed != p->seed)
+		fprintf(out, "found seed %llu data\n",
+			(unsigned long long)m->hdr_seed);
+	else if (m->hdr_gen != p->gen)
+		fprintf(out, "found generation %llu data\n",
+			(unsigned long long)m->hdr_gen);
+	else
+		fprintf(out, "corrupted data\n");
+}
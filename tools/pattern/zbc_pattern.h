@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2020 Western Digital Corporation or its affiliates.
+ */
+#ifndef _ZBC_PATTERN_H_
+#define _ZBC_PATTERN_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Self-describing sector pattern.
+ *
+ * Each 512 B sector starts with a header of 4 little-endian 64-bit words:
+ * the sector number, the pattern seed, the pattern generation and a check
+ * word. The remaining words of the sector are derived from the header
+ * values, so that any sector read back can be checked without knowing
+ * what was written, and a sector containing the data of another sector,
+ * of another seed or of a previous generation can be identified.
+ */
+struct zbc_pattern {
+	uint64_t	seed;
+	uint64_t	gen;
+};
+
+/**
+ * Description of the first mismatch found by zbc_pattern_check().
+ */
+struct zbc_pattern_mismatch {
+	uint64_t	sector;		/* Sector checked */
+	size_t		offset;		/* Byte offset of the mismatch */
+	bool		hdr_valid;	/* The sector header is valid */
+	uint64_t	hdr_sector;	/* Sector header values */
+	uint64_t	hdr_seed;
+	uint64_t	hdr_gen;
+};
+
+/**
+ * Fill @nr_sectors sectors of @buf with the pattern for the sectors
+ * starting at @sector.
+ */
+extern void zbc_pattern_fill(struct zbc_pattern *p, void *buf,
+			     uint64_t sector, size_t nr_sectors);
+
+/**
+ * Check @nr_sectors sectors of @buf against the pattern for the sectors
+ * starting at @sector. Return the number of sectors that do not match,
+ * with the first mismatch described in @m.
+ */
+extern size_t zbc_pattern_check(struct zbc_pattern *p, const void *buf,
+				uint64_t sector, size_t nr_sectors,
+				struct zbc_pattern_mismatch *m);
+
+/**
+ * Print a mismatch description.
+ */
+extern void zbc_pattern_print_mismatch(struct zbc_pattern *p,
+				       struct zbc_pattern_mismatch *m,
+				       FILE *out);
+
+#endif /* _ZBC_PATTERN_H_ */
@@ -23,10 +23,90 @@
 #include <sys/ioctl.h>
 #include <linux/fs.h>
 #include <libgen.h>
+#include <pthread.h>
 
 #include <libzbc/zbc.h>
+#include "../pattern/zbc_pattern.h"
 
-static int zbc_read_zone_abort = 0;
+static int zbc_read_zone_abort;
+
+/*
+ * Read context shared by the worker threads.
+ */
+struct zbc_read_zone {
+	char			*path;
+	int			oflags;
+
+	/* Target zones */
+	struct zbc_zone		*zones;
+	unsigned int		nz;
+	unsigned int		next_zone;
+
+	/* I/O parameters */
+	size_t			bufsize;
+	size_t			iosize;
+	int			iovcnt;
+	bool			vio;
+	bool			ptrn_set;
+	unsigned long		pattern;
+	bool			spattern_set;
+	struct zbc_pattern	spattern;
+	long long		zone_ofst;
+	unsigned long long	ionum;
+	unsigned long long	iocount;
+
+	/* File to write, if any */
+	char			*file;
+	int			fd;
+	int			dfd;
+	bool			seekable;
+	size_t			dio_align;
+	unsigned long long	*foffsets;
+	unsigned int		nbuf;
+
+	pthread_mutex_t		lock;
+};
+
+/*
+ * I/O buffer. When the zone data is written to a file using a writer
+ * thread, the buffers of a reader thread form a ring: the reader thread
+ * fills the buffer at the ring head and the writer thread writes to the
+ * file the buffer at the ring tail.
+ */
+struct zbc_read_zone_buf {
+	void			*data;
+	size_t			count;
+	unsigned long long	offset;
+};
+
+/*
+ * Worker thread. Each thread uses its own device handle and reads
+ * whole zones.
+ */
+struct zbc_read_zone_thread {
+	struct zbc_read_zone	*rz;
+	pthread_t		thread;
+	unsigned int		id;
+	struct zbc_device	*dev;
+	void			*iobuf;
+	struct iovec		*iov;
+
+	/* Buffer ring */
+	struct zbc_read_zone_buf *bufs;
+	unsigned int		head;
+	unsigned int		tail;
+	unsigned int		nr_full;
+	bool			rdone;
+	bool			werr;
+	pthread_t		writer;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+
+	unsigned long long	bcount;
+	unsigned long long	iocount;
+	unsigned long long	nr_bad;
+	int			err;
+};
 
 static inline unsigned long long zbc_read_zone_usec(void)
 {
@@ -62,42 +142,417 @@ static int zbc_read_zone_usage(FILE *out, char *prog)
 		"  -p <num>     : Expect all bytes that are read to have the\n"
 		"                 value <num>. In case of a mismatch, the\n"
 		"                 offset of the mismatch is printed\n"
+		"  -sp <seed>   : Verify that the data read is the self-\n"
+		"                 describing pattern written with\n"
+		"                 zbc_write_zone -sp <seed>\n"
+		"  -gen <num>   : Set the generation number of the pattern\n"
+		"                 verified with -sp (default: 0)\n"
 		"  -f <file>    : Write the content of the zone to <file>\n"
 		"                 If <file> is \"-\", the zone content is\n"
 		"                 written to the standard output\n"
+		"  -fdio        : Use direct I/Os to write to <file>\n"
+		"  -nbuf <num>  : Use a ring of <num> I/O buffers per thread\n"
+		"                 to overlap reading the zones and writing\n"
+		"                 to <file> (default: 1)\n"
 		"  -ofst <ofst> : Read the zone starting at sector <ofst>\n"
-		"                 instead of from the zone start sector\n",
+		"                 instead of from the zone start sector\n"
+		"  -nz <num>    : Read <num> consecutive zones starting from\n"
+		"                 the target zone\n"
+		"  -t <num>     : Use <num> threads, each thread reading\n"
+		"                 different zones (default: 1)\n",
 		basename(prog));
 	return 1;
 }
 
+/*
+ * Get the number of sectors that can be read from a zone.
+ */
+static long long zbc_read_zone_sector_max(struct zbc_zone *iozone)
+{
+	if (zbc_zone_sequential_req(iozone) && !zbc_zone_full(iozone))
+		return zbc_zone_wp(iozone) - zbc_zone_start(iozone);
+
+	return zbc_zone_length(iozone);
+}
+
+/*
+ * Get the index of the next zone to read, or -1 if there are none left.
+ */
+static int zbc_read_zone_next(struct zbc_read_zone *rz)
+{
+	int idx = -1;
+
+	pthread_mutex_lock(&rz->lock);
+	if (!zbc_read_zone_abort && rz->next_zone < rz->nz)
+		idx = rz->next_zone++;
+	pthread_mutex_unlock(&rz->lock);
+
+	return idx;
+}
+
+/*
+ * Reserve an I/O within the limit set with -nio.
+ */
+static bool zbc_read_zone_get_io(struct zbc_read_zone *rz)
+{
+	bool ret = true;
+
+	pthread_mutex_lock(&rz->lock);
+	if (rz->ionum > 0 && rz->iocount >= rz->ionum)
+		ret = false;
+	else
+		rz->iocount++;
+	pthread_mutex_unlock(&rz->lock);
+
+	return ret;
+}
+
+/*
+ * Write a buffer to the output file. Writes that are aligned on the
+ * page size use the file descriptor opened with O_DIRECT, if any.
+ */
+static int zbc_read_zone_output(struct zbc_read_zone *rz,
+				struct zbc_read_zone_buf *b)
+{
+	unsigned long long offset = b->offset;
+	size_t count = b->count;
+	void *data = b->data;
+	ssize_t ret;
+	int fd;
+
+	while (count) {
+		fd = rz->fd;
+		if (rz->dfd >= 0 &&
+		    !(offset % rz->dio_align) &&
+		    !(count % rz->dio_align) &&
+		    !((unsigned long)data % rz->dio_align))
+			fd = rz->dfd;
+
+		if (rz->seekable)
+			ret = pwrite(fd, data, count, offset);
+		else
+			ret = write(fd, data, count);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Write file \"%s\" failed %d (%s)\n",
+				rz->file,
+				errno, strerror(errno));
+			return 1;
+		}
+
+		data += ret;
+		count -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Get a free buffer to read into. Return NULL if the writer thread failed.
+ */
+static struct zbc_read_zone_buf *
+zbc_read_zone_get_buf(struct zbc_read_zone_thread *t)
+{
+	struct zbc_read_zone_buf *b = NULL;
+
+	if (t->rz->nbuf == 1)
+		return &t->bufs[0];
+
+	pthread_mutex_lock(&t->lock);
+	while (t->nr_full == t->rz->nbuf && !t->werr)
+		pthread_cond_wait(&t->cond, &t->lock);
+	if (!t->werr)
+		b = &t->bufs[t->head];
+	pthread_mutex_unlock(&t->lock);
+
+	return b;
+}
+
+/*
+ * Write a buffer filled with zone data to the output file, either
+ * directly or by passing it to the writer thread.
+ */
+static int zbc_read_zone_put_buf(struct zbc_read_zone_thread *t,
+				 struct zbc_read_zone_buf *b)
+{
+	if (t->rz->nbuf == 1)
+		return zbc_read_zone_output(t->rz, b);
+
+	pthread_mutex_lock(&t->lock);
+	t->head = (t->head + 1) % t->rz->nbuf;
+	t->nr_full++;
+	pthread_cond_broadcast(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+
+	return 0;
+}
+
+static void *zbc_read_zone_writer_fn(void *arg)
+{
+	struct zbc_read_zone_thread *t = arg;
+	struct zbc_read_zone_buf *b;
+
+	pthread_mutex_lock(&t->lock);
+
+	for (;;) {
+		while (!t->nr_full && !t->rdone)
+			pthread_cond_wait(&t->cond, &t->lock);
+		if (!t->nr_full)
+			break;
+
+		b = &t->bufs[t->tail];
+		pthread_mutex_unlock(&t->lock);
+
+		if (zbc_read_zone_output(t->rz, b)) {
+			pthread_mutex_lock(&t->lock);
+			t->werr = true;
+			zbc_read_zone_abort = 1;
+			pthread_cond_broadcast(&t->cond);
+			break;
+		}
+
+		pthread_mutex_lock(&t->lock);
+		t->tail = (t->tail + 1) % t->rz->nbuf;
+		t->nr_full--;
+		pthread_cond_broadcast(&t->cond);
+	}
+
+	pthread_mutex_unlock(&t->lock);
+
+	return NULL;
+}
+
+/*
+ * Read a zone, writing its data to the output file starting from
+ * the byte offset @foffset.
+ */
+static int zbc_read_zone_read(struct zbc_read_zone_thread *t,
+			      struct zbc_zone *iozone,
+			      unsigned long long foffset)
+{
+	struct zbc_read_zone *rz = t->rz;
+	long long sector_max = zbc_read_zone_sector_max(iozone);
+	long long zofst = rz->zone_ofst, sector_ofst;
+	struct zbc_pattern_mismatch m;
+	struct zbc_read_zone_buf *b;
+	size_t nr_bad;
+	ssize_t ret, sector_count, byte_count, i;
+	unsigned char *p;
+	int n;
+
+	while (!zbc_read_zone_abort) {
+
+		/* Do not exceed the end of the zone */
+		sector_count = rz->iosize >> 9;
+		if (zofst + sector_count > sector_max)
+			sector_count = sector_max - zofst;
+		if (sector_count <= 0 || !zbc_read_zone_get_io(rz))
+			break;
+
+		b = zbc_read_zone_get_buf(t);
+		if (!b)
+			return 1;
+
+		sector_ofst = zbc_zone_start(iozone) + zofst;
+
+		/* Read zone */
+		if (rz->vio) {
+			n = zbc_map_iov(b->data, sector_count,
+					t->iov, rz->iovcnt, rz->bufsize >> 9);
+			if (n < 0) {
+				fprintf(stderr, "iov map failed %d (%s)\n",
+					-n, strerror(-n));
+				return 1;
+			}
+			ret = zbc_preadv(t->dev, t->iov, n, sector_ofst);
+		} else {
+			ret = zbc_pread(t->dev, b->data, sector_count,
+					sector_ofst);
+		}
+		if (ret <= 0) {
+			fprintf(stderr, "%s failed %zd (%s)\n",
+				rz->vio ? "zbc_preadv" : "zbc_pread",
+				-ret, strerror(-ret));
+			return 1;
+		}
+
+		sector_count = ret;
+		byte_count = sector_count << 9;
+
+		if (rz->ptrn_set) {
+			for (i = 0, p = b->data; i < byte_count; i++, p++) {
+				if (*p != (unsigned char)rz->pattern) {
+					fprintf(stderr,
+						"Data mismatch @%llu: read %#x, exp %#lx\n",
+						sector_ofst + i, *p,
+						rz->pattern);
+					break;
+				}
+			}
+		}
+
+		if (rz->spattern_set) {
+			nr_bad = zbc_pattern_check(&rz->spattern, b->data,
+						   sector_ofst, sector_count,
+						   &m);
+			if (nr_bad) {
+				zbc_pattern_print_mismatch(&rz->spattern,
+							   &m, stderr);
+				t->nr_bad += nr_bad;
+			}
+		}
+
+		if (rz->file) {
+			/* Write zone data to output file */
+			b->count = byte_count;
+			b->offset = foffset;
+			if (zbc_read_zone_put_buf(t, b))
+				return 1;
+		}
+
+		zofst += sector_count;
+		foffset += byte_count;
+		t->bcount += byte_count;
+		t->iocount++;
+	}
+
+	return 0;
+}
+
+static void *zbc_read_zone_thread_fn(void *arg)
+{
+	struct zbc_read_zone_thread *t = arg;
+	struct zbc_read_zone *rz = t->rz;
+	bool pipeline = rz->file && rz->nbuf > 1;
+	int idx;
+
+	if (pipeline &&
+	    pthread_create(&t->writer, NULL, zbc_read_zone_writer_fn, t)) {
+		fprintf(stderr, "Create writer thread failed\n");
+		t->err = 1;
+		zbc_read_zone_abort = 1;
+		return NULL;
+	}
+
+	while ((idx = zbc_read_zone_next(rz)) >= 0) {
+		t->err = zbc_read_zone_read(t, &rz->zones[idx],
+					    rz->foffsets ?
+					    rz->foffsets[idx] : 0);
+		if (t->err) {
+			/* Stop the other threads */
+			zbc_read_zone_abort = 1;
+			break;
+		}
+	}
+
+	if (pipeline) {
+		/* Wait for all buffers to be written */
+		pthread_mutex_lock(&t->lock);
+		t->rdone = true;
+		pthread_cond_broadcast(&t->cond);
+		pthread_mutex_unlock(&t->lock);
+		pthread_join(t->writer, NULL);
+		if (t->werr)
+			t->err = 1;
+	}
+
+	return NULL;
+}
+
+/*
+ * Setup a worker thread I/O buffers.
+ */
+static int zbc_read_zone_setup_thread(struct zbc_read_zone *rz,
+				      struct zbc_read_zone_thread *t)
+{
+	size_t bufsz = rz->iosize * rz->nbuf;
+	unsigned int i;
+	int ret;
+
+	t->rz = rz;
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->cond, NULL);
+
+	/* The first thread uses the main device handle */
+	if (!t->dev) {
+		ret = zbc_open(rz->path, rz->oflags, &t->dev);
+		if (ret != 0) {
+			fprintf(stderr, "Open %s failed (%s)\n",
+				rz->path, strerror(-ret));
+			t->dev = NULL;
+			return ret;
+		}
+	}
+
+	ret = posix_memalign((void **) &t->iobuf, sysconf(_SC_PAGESIZE),
+			     bufsz);
+	if (ret != 0) {
+		fprintf(stderr, "No memory for I/O buffer (%zu B)\n", bufsz);
+		t->iobuf = NULL;
+		return -ENOMEM;
+	}
+
+	t->bufs = calloc(rz->nbuf, sizeof(struct zbc_read_zone_buf));
+	if (!t->bufs) {
+		fprintf(stderr, "No memory for I/O buffers\n");
+		return -ENOMEM;
+	}
+	for (i = 0; i < rz->nbuf; i++)
+		t->bufs[i].data = t->iobuf + i * rz->iosize;
+
+	if (rz->vio) {
+		t->iov = calloc(rz->iovcnt, sizeof(struct iovec));
+		if (!t->iov) {
+			fprintf(stderr, "No memory for I/O vector\n");
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void zbc_read_zone_cleanup_thread(struct zbc_read_zone_thread *t,
+					 bool close)
+{
+	if (close && t->dev)
+		zbc_close(t->dev);
+	free(t->iobuf);
+	free(t->bufs);
+	free(t->iov);
+	pthread_mutex_destroy(&t->lock);
+	pthread_cond_destroy(&t->cond);
+}
+
 int main(int argc, char **argv)
 {
+	struct zbc_read_zone rz;
+	struct zbc_read_zone_thread *threads = NULL;
 	struct zbc_device_info info;
 	struct zbc_device *dev = NULL;
 	unsigned long long elapsed;
-	unsigned long long bcount = 0;
-	unsigned long long brate;
-	int zidx, fd = -1, i;
+	unsigned long long bcount = 0, iocount = 0, nr_bad = 0;
+	unsigned long long brate, foffset;
+	unsigned int nr_threads = 1, n;
+	int zidx, i;
 	ssize_t ret = 1;
-	size_t bufsize, iosize;
-	void *iobuf = NULL;
-	ssize_t sector_count, byte_count;
-	unsigned long long ionum = 0, iocount = 0;
+	long long sector_count;
 	struct zbc_zone *zones = NULL;
 	struct zbc_zone *iozone = NULL;
 	unsigned int nr_zones;
-	char *path, *file = NULL, *end;
-	unsigned char *b;
-	long long sector_ofst = 0;
-	long long sector_max = 0;
-	long long zone_ofst = 0;
+	char *end;
 	int flags = O_RDONLY;
 	int oflags = 0;
-	bool vio = false, ptrn_set = false;
-	unsigned long pattern = 0;
-	struct iovec *iov = NULL;
-	int iovcnt = 1, n;
+	bool fdio = false;
+	int nz = 1;
+
+	memset(&rz, 0, sizeof(rz));
+	rz.fd = -1;
+	rz.dfd = -1;
+	rz.iovcnt = 1;
+	rz.nbuf = 1;
+	pthread_mutex_init(&rz.lock, NULL);
 
 	/* Parse command line */
 	if (argc < 4)
@@ -127,20 +582,49 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			pattern = strtol(argv[i], &end, 0);
+			rz.pattern = strtol(argv[i], &end, 0);
 			if (*end != '\0' || errno != 0) {
 				fprintf(stderr,
 					"Invalid data pattern value \"%s\"\n",
 					argv[i]);
 				return 1;
 			}
-			if (pattern > 0xff) {
+			if (rz.pattern > 0xff) {
 				fprintf(stderr,
 					"Not a single-byte pattern:\"%s\"\n",
 					argv[i]);
 				return 1;
 			}
-			ptrn_set = true;
+			rz.ptrn_set = true;
+
+		} else if (strcmp(argv[i], "-sp") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			rz.spattern.seed = strtoull(argv[i], &end, 0);
+			if (*end != '\0' || errno != 0) {
+				fprintf(stderr,
+					"Invalid pattern seed \"%s\"\n",
+					argv[i]);
+				return 1;
+			}
+			rz.spattern_set = true;
+
+		} else if (strcmp(argv[i], "-gen") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			rz.spattern.gen = strtoull(argv[i], &end, 0);
+			if (*end != '\0' || errno != 0) {
+				fprintf(stderr,
+					"Invalid pattern generation \"%s\"\n",
+					argv[i]);
+				return 1;
+			}
 
 		} else if (strcmp(argv[i], "-dio") == 0) {
 
@@ -152,13 +636,13 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			iovcnt = atoi(argv[i]);
-			if (iovcnt <= 0) {
+			rz.iovcnt = atoi(argv[i]);
+			if (rz.iovcnt <= 0) {
 				fprintf(stderr,
 					"Invalid number of IO buffers\n");
 				return 1;
 			}
-			vio = true;
+			rz.vio = true;
 
 		} else if (strcmp(argv[i], "-nio") == 0) {
 
@@ -166,8 +650,8 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			ionum = atoi(argv[i]);
-			if (ionum <= 0) {
+			rz.ionum = atoi(argv[i]);
+			if (rz.ionum <= 0) {
 				fprintf(stderr, "Invalid number of I/Os\n");
 				return 1;
 			}
@@ -178,7 +662,23 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			file = argv[i];
+			rz.file = argv[i];
+
+		} else if (strcmp(argv[i], "-fdio") == 0) {
+
+			fdio = true;
+
+		} else if (strcmp(argv[i], "-nbuf") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			if (atoi(argv[i]) <= 0) {
+				fprintf(stderr, "Invalid number of buffers\n");
+				return 1;
+			}
+			rz.nbuf = atoi(argv[i]);
 
 		} else if (strcmp(argv[i], "-ofst") == 0) {
 
@@ -186,12 +686,36 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			zone_ofst = atoll(argv[i]);
-			if (zone_ofst < 0) {
+			rz.zone_ofst = atoll(argv[i]);
+			if (rz.zone_ofst < 0) {
 				fprintf(stderr, "Invalid zone sector offset\n");
 				return 1;
 			}
 
+		} else if (strcmp(argv[i], "-nz") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			nz = atoi(argv[i]);
+			if (nz <= 0) {
+				fprintf(stderr, "Invalid number of zones\n");
+				return 1;
+			}
+
+		} else if (strcmp(argv[i], "-t") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			if (atoi(argv[i]) <= 0) {
+				fprintf(stderr, "Invalid number of threads\n");
+				return 1;
+			}
+			nr_threads = atoi(argv[i]);
+
 		} else if (argv[i][0] == '-') {
 
 			fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
@@ -209,7 +733,7 @@ int main(int argc, char **argv)
 		goto err;
 
 	/* Get parameters */
-	path = argv[i];
+	rz.path = argv[i];
 
 	if (oflags & ZBC_O_DRV_SCSI && oflags & ZBC_O_DRV_ATA) {
 		fprintf(stderr,
@@ -217,14 +741,40 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if ((fdio || rz.nbuf > 1) && !rz.file) {
+		fprintf(stderr,
+			"-fdio and -nbuf options require the -f option\n");
+		return 1;
+	}
+
+	if (rz.spattern_set && rz.ptrn_set) {
+		fprintf(stderr,
+			"-sp and -p options are mutually exclusive\n");
+		return 1;
+	}
+
+	if (rz.file && strcmp(rz.file, "-") == 0 &&
+	    (fdio || nr_threads > 1)) {
+		fprintf(stderr,
+			"-fdio and -t options cannot be used with "
+			"the standard output\n");
+		return 1;
+	}
+
+	if (rz.file && rz.ionum && nr_threads > 1) {
+		fprintf(stderr,
+			"-nio option cannot be used with -f and -t options\n");
+		return 1;
+	}
+
 	zidx = atoi(argv[i + 1]);
 	if (zidx < 0) {
 		fprintf(stderr, "Invalid zone number %s\n", argv[i + 1]);
 		return 1;
 	}
 
-	bufsize = atol(argv[i + 2]);
-	if (!bufsize) {
+	rz.bufsize = atol(argv[i + 2]);
+	if (!rz.bufsize) {
 		fprintf(stderr, "Invalid buffer (I/O) size %s\n", argv[i + 2]);
 		return 1;
 	}
@@ -235,21 +785,22 @@ int main(int argc, char **argv)
 	signal(SIGTERM, zbc_read_zone_sigcatcher);
 
 	/* Open device */
-	ret = zbc_open(path, oflags | flags, &dev);
+	rz.oflags = oflags | flags;
+	ret = zbc_open(rz.path, rz.oflags, &dev);
 	if (ret != 0) {
 		if (ret == -ENODEV)
 			fprintf(stderr,
 				"Open %s failed (not a zoned block device)\n",
-				path);
+				rz.path);
 		else
 			fprintf(stderr, "Open %s failed (%s)\n",
-				path, strerror(-ret));
+				rz.path, strerror(-ret));
 		return 1;
 	}
 
 	zbc_get_device_info(dev, &info);
 
-	printf("Device %s:\n", path);
+	printf("Device %s:\n", rz.path);
 	zbc_print_device_info(&info, stdout);
 
 	/* Get zone list */
@@ -266,7 +817,14 @@ int main(int argc, char **argv)
 		ret = 1;
 		goto out;
 	}
+	if ((unsigned int)(zidx + nz) > nr_zones) {
+		fprintf(stderr, "-nz value is too large\n");
+		ret = 1;
+		goto out;
+	}
 	iozone = &zones[zidx];
+	rz.zones = iozone;
+	rz.nz = nz;
 
 	if (zbc_zone_conventional(iozone))
 		printf("Target zone: Conventional zone %d / %d, "
@@ -291,150 +849,147 @@ int main(int argc, char **argv)
 		       zbc_zone_length(iozone),
 		       zbc_zone_wp(iozone));
 
-	/* Check I/O alignment and get an I/O buffer */
-	if (bufsize % info.zbd_lblock_size) {
+	/* Check I/O alignment */
+	if (rz.bufsize % info.zbd_lblock_size) {
 		fprintf(stderr,
 			"Invalid I/O size %zu (must be a multiple of %u B)\n",
-			bufsize, (unsigned int) info.zbd_lblock_size);
-		ret = 1;
-		goto out;
-	}
-
-	if (vio) {
-		iov = calloc(iovcnt, sizeof(struct iovec));
-		if (!iov) {
-			fprintf(stderr, "No memory for I/O vector\n");
-			ret = -ENOMEM;
-			goto out;
-		}
-	}
-
-	iosize = bufsize * iovcnt;
-	ret = posix_memalign((void **) &iobuf, sysconf(_SC_PAGESIZE), iosize);
-	if (ret != 0) {
-		fprintf(stderr, "No memory for I/O buffer (%zu B)\n", iosize);
+			rz.bufsize, (unsigned int) info.zbd_lblock_size);
 		ret = 1;
 		goto out;
 	}
+	rz.iosize = rz.bufsize * rz.iovcnt;
 
 	/* Open the file to write, if any */
-	if (file) {
+	if (rz.file) {
 
-		if (strcmp(file, "-") == 0) {
+		if (strcmp(rz.file, "-") == 0) {
 
-			fd = fileno(stdout);
+			rz.fd = fileno(stdout);
 			printf("Writing target zone %d to standard output, "
 			       "%zu B I/Os\n",
-			       zidx, iosize);
+			       zidx, rz.iosize);
 
 		} else {
 
-			fd = open(file,
-				  O_CREAT | O_TRUNC | O_LARGEFILE | O_WRONLY,
-				  S_IRUSR | S_IWUSR | S_IRGRP);
-			if (fd < 0) {
+			rz.fd = open(rz.file,
+				     O_CREAT | O_TRUNC | O_LARGEFILE | O_WRONLY,
+				     S_IRUSR | S_IWUSR | S_IRGRP);
+			if (rz.fd < 0) {
 				fprintf(stderr,
 					"Open file \"%s\" failed %d (%s)\n",
-					file,
+					rz.file,
 					errno,
 					strerror(errno));
 				ret = 1;
 				goto out;
 			}
+			rz.seekable = true;
+
+			if (fdio) {
+				rz.dfd = open(rz.file,
+					      O_LARGEFILE | O_WRONLY | O_DIRECT);
+				if (rz.dfd < 0) {
+					fprintf(stderr,
+						"Open file \"%s\" for direct I/O failed %d (%s)\n",
+						rz.file,
+						errno,
+						strerror(errno));
+					ret = 1;
+					goto out;
+				}
+				rz.dio_align = sysconf(_SC_PAGESIZE);
+			}
 
 			printf("Writing target zone %d data to file \"%s\", "
 			       "%zu B I/Os\n",
-			       zidx, file, iosize);
+			       zidx, rz.file, rz.iosize);
+
+		}
 
+		/* Get the file offset of the data of each zone */
+		rz.foffsets = calloc(nz, sizeof(unsigned long long));
+		if (!rz.foffsets) {
+			fprintf(stderr, "No memory for file offsets\n");
+			ret = 1;
+			goto out;
+		}
+		for (i = 0, foffset = 0; i < nz; i++) {
+			rz.foffsets[i] = foffset;
+			sector_count =
+				zbc_read_zone_sector_max(&rz.zones[i]) -
+				rz.zone_ofst;
+			if (sector_count > 0)
+				foffset += sector_count << 9;
 		}
 
-	} else if (!ionum) {
+	} else if (!rz.ionum) {
 
 		printf("Reading target zone %d, %zu B I/Os\n",
-		       zidx, iosize);
+		       zidx, rz.iosize);
 
 	} else {
 
 		printf("Reading target zone %d, %llu I/Os of %zu B\n",
-		       zidx, ionum, iosize);
+		       zidx, rz.ionum, rz.iosize);
 
 	}
 
-	if (zbc_zone_sequential_req(iozone) && !zbc_zone_full(iozone))
-		sector_max = zbc_zone_wp(iozone) - zbc_zone_start(iozone);
-	else
-		sector_max = zbc_zone_length(iozone);
-
-	elapsed = zbc_read_zone_usec();
-
-	while (!zbc_read_zone_abort) {
-
-		/* Do not exceed the end of the zone */
-		sector_count = iosize >> 9;
-		if (zone_ofst + sector_count > sector_max)
-			sector_count = sector_max - zone_ofst;
-		if (!sector_count)
-			break;
-
-		sector_ofst = zbc_zone_start(iozone) + zone_ofst;
-
-		/* Read zone */
-		if (vio) {
-			n = zbc_map_iov(iobuf, sector_count,
-					iov, iovcnt, bufsize >> 9);
-			if (n < 0) {
-				fprintf(stderr, "iov map failed %d (%s)\n",
-					-n, strerror(-n));
-				ret = 1;
-				goto out;
-			}
-			ret = zbc_preadv(dev, iov, n, sector_ofst);
-		} else {
-			ret = zbc_pread(dev, iobuf, sector_count, sector_ofst);
-		}
-		if (ret <= 0) {
-			fprintf(stderr, "%s failed %zd (%s)\n",
-				vio ? "zbc_preadv" : "zbc_pread",
-				-ret, strerror(-ret));
+	/* Setup the worker threads */
+	if (nr_threads > (unsigned int)nz)
+		nr_threads = nz;
+	threads = calloc(nr_threads, sizeof(struct zbc_read_zone_thread));
+	if (!threads) {
+		fprintf(stderr, "No memory for threads\n");
+		ret = 1;
+		goto out;
+	}
+	threads[0].dev = dev;
+	for (n = 0; n < nr_threads; n++) {
+		threads[n].id = n;
+		if (zbc_read_zone_setup_thread(&rz, &threads[n]) != 0) {
 			ret = 1;
 			goto out;
 		}
+	}
 
-		sector_count = ret;
-		byte_count = sector_count << 9;
+	if (nz > 1 || nr_threads > 1 || rz.nbuf > 1)
+		printf("  %d zone%s, %u thread%s, %u buffer%s per thread\n",
+		       nz, nz > 1 ? "s" : "",
+		       nr_threads, nr_threads > 1 ? "s" : "",
+		       rz.nbuf, rz.nbuf > 1 ? "s" : "");
 
-		if (ptrn_set) {
-			for (i = 0, b = iobuf; i < byte_count; i++, b++) {
-				if (*b != (unsigned char)pattern) {
-					fprintf(stderr,
-						"Data mismatch @%llu: read %#x, exp %#lx\n",
-						sector_ofst + i, *b, pattern);
-					ret = ERANGE;
-					break;
-				}
-			}
-		}
+	elapsed = zbc_read_zone_usec();
 
-		if (file) {
-			/* Write zone data to output file */
-			ret = write(fd, iobuf, byte_count);
-			if (ret < 0) {
-				fprintf(stderr, "Write file \"%s\" failed %d (%s)\n",
-					file,
-					errno, strerror(errno));
-				ret = 1;
-				goto out;
+	if (nr_threads == 1) {
+		zbc_read_zone_thread_fn(&threads[0]);
+	} else {
+		for (n = 0; n < nr_threads; n++) {
+			if (pthread_create(&threads[n].thread, NULL,
+					   zbc_read_zone_thread_fn,
+					   &threads[n])) {
+				fprintf(stderr, "Create thread failed\n");
+				zbc_read_zone_abort = 1;
+				threads[n].err = 1;
+				break;
 			}
 		}
+		for (i = 0; i < (int)n; i++)
+			pthread_join(threads[i].thread, NULL);
+	}
 
-		zone_ofst += sector_count;
-		bcount += byte_count;
-		iocount++;
-		ret = 0;
-
-		if (ionum > 0 && iocount >= ionum)
-			break;
+	ret = 0;
+	for (i = 0; i < (int)nr_threads; i++) {
+		bcount += threads[i].bcount;
+		iocount += threads[i].iocount;
+		nr_bad += threads[i].nr_bad;
+		if (threads[i].err)
+			ret = 1;
+	}
 
+	if (nr_bad) {
+		fprintf(stderr, "%llu sector%s with invalid pattern data\n",
+			nr_bad, nr_bad > 1 ? "s" : "");
+		ret = 1;
 	}
 
 	elapsed = zbc_read_zone_usec() - elapsed;
@@ -457,19 +1012,28 @@ int main(int argc, char **argv)
 	}
 
 out:
-	if (file && fd > 0) {
-		if (fd != fileno(stdout))
-			close(fd);
+	if (threads) {
+		for (n = 0; n < nr_threads; n++)
+			zbc_read_zone_cleanup_thread(&threads[n], n > 0);
+		free(threads);
+	}
+
+	if (rz.dfd >= 0)
+		close(rz.dfd);
+	if (rz.file && rz.fd > 0) {
+		if (rz.fd != fileno(stdout))
+			close(rz.fd);
 		if (ret != 0)
-			unlink(file);
+			unlink(rz.file);
 	}
 
-	free(iobuf);
+	free(rz.foffsets);
 	free(zones);
-	free(iov);
 
 	zbc_close(dev);
 
+	pthread_mutex_destroy(&rz.lock);
+
 	return ret;
 
 err:
@@ -477,4 +1041,3 @@ err:
 
 	return 1;
 }
-
@@ -19,6 +19,56 @@
 
 #include <libzbc/zbc.h>
 
+/*
+ * Number of zones reported with a single call to zbc_report_zones().
+ * Zones are printed as each chunk is received, so that the report output
+ * starts immediately and its memory usage does not depend on the number
+ * of zones of the device.
+ */
+#define ZBC_REPORT_CHUNK_ZONES	4096
+
+enum zbc_report_format {
+	ZBC_REPORT_TEXT,
+	ZBC_REPORT_CSV,
+	ZBC_REPORT_JSON,
+	ZBC_REPORT_BIN,
+};
+
+/*
+ * Binary report format: a header followed by one record per zone
+ * reported, in report order. All fields are stored in host byte order.
+ * Zone start, length and write pointer values are in 512B sectors, or
+ * in logical blocks if the ZBC_REPORT_BIN_LBA flag is set.
+ */
+#define ZBC_REPORT_BIN_MAGIC	"ZBCZONES"
+#define ZBC_REPORT_BIN_VERSION	1
+
+#define ZBC_REPORT_BIN_LBA	0x01
+
+struct zbc_report_bin_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	flags;
+	uint32_t	zone_size;
+	uint32_t	lblock_size;
+	uint64_t	sectors;
+};
+
+/* Zone record attributes */
+#define ZBC_REPORT_BIN_RWP	0x01
+#define ZBC_REPORT_BIN_NON_SEQ	0x02
+#define ZBC_REPORT_BIN_WP	0x04
+
+struct zbc_report_bin_zone {
+	uint64_t	start;
+	uint64_t	length;
+	uint64_t	wp;
+	uint8_t		type;
+	uint8_t		cond;
+	uint8_t		attrs;
+	uint8_t		pad[5];
+};
+
 static inline unsigned long long zbc_report_val(struct zbc_device_info *info,
 						unsigned long long val,
 						bool lba_unit)
@@ -118,6 +168,226 @@ static void zbc_report_print_zone(struct zbc_device_info *info,
 	       length);
 }
 
+/*
+ * Test if the write pointer of a zone is valid, using the same rules as
+ * the text output.
+ */
+static bool zbc_report_zone_has_wp(struct zbc_zone *z)
+{
+	if (zbc_zone_sobr(z))
+		return zbc_zone_condition(z) == ZBC_ZC_IMP_OPEN ||
+			zbc_zone_condition(z) == ZBC_ZC_EMPTY;
+
+	if (zbc_zone_conventional(z) || zbc_zone_inactive(z) ||
+	    zbc_zone_gap(z))
+		return false;
+
+	return zbc_zone_sequential(z);
+}
+
+static void zbc_report_print_zone_csv(struct zbc_device_info *info,
+				      struct zbc_zone *z, int zno,
+				      bool lba_unit)
+{
+	printf("%d,%d,%d,%llu,%llu,",
+	       zno,
+	       zbc_zone_type(z),
+	       zbc_zone_condition(z),
+	       zbc_report_val(info, zbc_zone_start(z), lba_unit),
+	       zbc_report_val(info, zbc_zone_length(z), lba_unit));
+	if (zbc_report_zone_has_wp(z))
+		printf("%llu", zbc_report_val(info, zbc_zone_wp(z), lba_unit));
+	printf(",%d,%d\n",
+	       zbc_zone_rwp_recommended(z),
+	       zbc_zone_non_seq(z));
+}
+
+static void zbc_report_print_zone_json(struct zbc_device_info *info,
+				       struct zbc_zone *z, int zno,
+				       bool lba_unit)
+{
+	printf("%s\n    {\"zone\": %d, \"type\": %d, \"cond\": %d, "
+	       "\"start\": %llu, \"length\": %llu, ",
+	       zno ? "," : "",
+	       zno,
+	       zbc_zone_type(z),
+	       zbc_zone_condition(z),
+	       zbc_report_val(info, zbc_zone_start(z), lba_unit),
+	       zbc_report_val(info, zbc_zone_length(z), lba_unit));
+	if (zbc_report_zone_has_wp(z))
+		printf("\"wp\": %llu, ",
+		       zbc_report_val(info, zbc_zone_wp(z), lba_unit));
+	else
+		printf("\"wp\": null, ");
+	printf("\"rwp\": %d, \"non_seq\": %d}",
+	       zbc_zone_rwp_recommended(z),
+	       zbc_zone_non_seq(z));
+}
+
+static int zbc_report_print_zones_bin(struct zbc_device_info *info,
+				      struct zbc_zone *zones,
+				      unsigned int nr_zones, bool lba_unit)
+{
+	static struct zbc_report_bin_zone rec[ZBC_REPORT_CHUNK_ZONES];
+	struct zbc_zone *z;
+	unsigned int i;
+
+	memset(rec, 0, sizeof(struct zbc_report_bin_zone) * nr_zones);
+	for (i = 0; i < nr_zones; i++) {
+		z = &zones[i];
+		rec[i].start =
+			zbc_report_val(info, zbc_zone_start(z), lba_unit);
+		rec[i].length =
+			zbc_report_val(info, zbc_zone_length(z), lba_unit);
+		rec[i].type = zbc_zone_type(z);
+		rec[i].cond = zbc_zone_condition(z);
+		if (zbc_zone_rwp_recommended(z))
+			rec[i].attrs |= ZBC_REPORT_BIN_RWP;
+		if (zbc_zone_non_seq(z))
+			rec[i].attrs |= ZBC_REPORT_BIN_NON_SEQ;
+		if (zbc_report_zone_has_wp(z)) {
+			rec[i].wp = zbc_report_val(info, zbc_zone_wp(z),
+						   lba_unit);
+			rec[i].attrs |= ZBC_REPORT_BIN_WP;
+		}
+	}
+
+	if (fwrite(rec, sizeof(struct zbc_report_bin_zone), nr_zones,
+		   stdout) != nr_zones)
+		return -EIO;
+
+	return 0;
+}
+
+static void zbc_report_print_header(struct zbc_device_info *info,
+				    enum zbc_report_format fmt,
+				    char *path, bool lba_unit)
+{
+	struct zbc_report_bin_hdr hdr;
+
+	switch (fmt) {
+	case ZBC_REPORT_CSV:
+		printf("zone,type,cond,start,length,wp,rwp,non_seq\n");
+		break;
+	case ZBC_REPORT_JSON:
+		printf("{\n"
+		       "  \"device\": \"%s\",\n"
+		       "  \"unit\": \"%s\",\n"
+		       "  \"zones\": [",
+		       path, lba_unit ? "lba" : "sector");
+		break;
+	case ZBC_REPORT_BIN:
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, ZBC_REPORT_BIN_MAGIC, sizeof(hdr.magic));
+		hdr.version = ZBC_REPORT_BIN_VERSION;
+		if (lba_unit)
+			hdr.flags |= ZBC_REPORT_BIN_LBA;
+		hdr.zone_size = sizeof(struct zbc_report_bin_zone);
+		hdr.lblock_size = info->zbd_lblock_size;
+		hdr.sectors = info->zbd_sectors;
+		fwrite(&hdr, sizeof(hdr), 1, stdout);
+		break;
+	case ZBC_REPORT_TEXT:
+	default:
+		break;
+	}
+}
+
+static void zbc_report_print_footer(enum zbc_report_format fmt)
+{
+	if (fmt == ZBC_REPORT_JSON)
+		printf("\n  ]\n}\n");
+}
+
+static int zbc_report_print_summary(struct zbc_device *dev,
+				    struct zbc_device_info *info,
+				    unsigned long long sector,
+				    enum zbc_report_format fmt,
+				    char *path, bool lba_unit)
+{
+	struct zbc_zone_summary zs;
+	unsigned int t, c, nr;
+	bool first = true;
+	int ret;
+
+	ret = zbc_zone_summary(dev, sector, &zs);
+	if (ret != 0) {
+		fprintf(stderr, "zbc_zone_summary failed %d\n", ret);
+		return ret;
+	}
+
+	if (fmt == ZBC_REPORT_JSON) {
+		printf("{\n"
+		       "  \"device\": \"%s\",\n"
+		       "  \"unit\": \"%s\",\n"
+		       "  \"nr_zones\": %u,\n"
+		       "  \"capacity\": %llu,\n"
+		       "  \"seq_capacity\": %llu,\n"
+		       "  \"used_capacity\": %llu,\n"
+		       "  \"nr_open\": %u,\n",
+		       path, lba_unit ? "lba" : "sector",
+		       zs.zsm_nr_zones,
+		       zbc_report_val(info, zs.zsm_sectors, lba_unit),
+		       zbc_report_val(info, zs.zsm_seq_sectors, lba_unit),
+		       zbc_report_val(info, zs.zsm_used_sectors, lba_unit),
+		       zs.zsm_nr_open);
+		if (zs.zsm_max_nr_open == ZBC_NO_LIMIT)
+			printf("  \"max_nr_open\": null,\n");
+		else
+			printf("  \"max_nr_open\": %u,\n",
+			       zs.zsm_max_nr_open);
+		printf("  \"nr_rwp\": %u,\n"
+		       "  \"nr_non_seq\": %u,\n"
+		       "  \"zones\": [",
+		       zs.zsm_nr_rwp_recommended,
+		       zs.zsm_nr_non_seq);
+	} else {
+		printf("%u zone%s from %llu:\n",
+		       zs.zsm_nr_zones, zs.zsm_nr_zones > 1 ? "s" : "",
+		       zbc_report_val(info, sector, lba_unit));
+	}
+
+	for (t = 0; t < ZBC_ZSM_NR_TYPES; t++) {
+		for (c = 0; c < ZBC_ZSM_NR_CONDS; c++) {
+			nr = zbc_zone_summary_nr(&zs, t, c);
+			if (!nr)
+				continue;
+			if (fmt == ZBC_REPORT_JSON)
+				printf("%s\n    {\"type\": %u, \"cond\": %u, "
+				       "\"nr_zones\": %u}",
+				       first ? "" : ",", t, c, nr);
+			else
+				printf("    %s zones, %s: %u\n",
+				       zbc_zone_type_str(t),
+				       zbc_zone_condition_str(c), nr);
+			first = false;
+		}
+	}
+
+	if (fmt == ZBC_REPORT_JSON) {
+		printf("\n  ]\n}\n");
+		return 0;
+	}
+
+	printf("    Capacity: %llu %s, sequential zones %llu %s, "
+	       "used %llu %s\n",
+	       zbc_report_val(info, zs.zsm_sectors, lba_unit),
+	       lba_unit ? "blocks" : "sectors",
+	       zbc_report_val(info, zs.zsm_seq_sectors, lba_unit),
+	       lba_unit ? "blocks" : "sectors",
+	       zbc_report_val(info, zs.zsm_used_sectors, lba_unit),
+	       lba_unit ? "blocks" : "sectors");
+	if (zs.zsm_max_nr_open == ZBC_NO_LIMIT)
+		printf("    Open zones: %u (no limit)\n", zs.zsm_nr_open);
+	else
+		printf("    Open zones: %u / %u\n",
+		       zs.zsm_nr_open, zs.zsm_max_nr_open);
+	printf("    Reset recommended: %u, non-sequential write "
+	       "resources allocated: %u\n",
+	       zs.zsm_nr_rwp_recommended, zs.zsm_nr_non_seq);
+
+	return 0;
+}
 
 static int zbc_report_zones_usage(FILE *out, char *prog)
 {
@@ -135,6 +405,11 @@ static int zbc_report_zones_usage(FILE *out, char *prog)
 		"                  512B sector value. Default is 0\n"
 		"  -n            : Get only the number of zones in the report\n"
 		"  -nz <num>     : Report at most <num> zones\n"
+		"  -csv          : Output the zones in CSV format\n"
+		"  -json         : Output the zones in JSON format\n"
+		"  -bin          : Output the zones in binary format\n"
+		"  -sum          : Only display the number of zones of each\n"
+		"                  type and condition and capacity totals\n"
 		"  -ro <opt>     : Specify a reporting option. <opt> can be:\n"
 		"                  - all: report all zones (default)\n"
 		"                  - empty: report only empty zones\n"
@@ -160,9 +435,10 @@ int main(int argc, char **argv)
 	struct zbc_device *dev;
 	unsigned long long sector = 0, nr_sectors = 0;
 	enum zbc_zone_reporting_options ro = ZBC_RZ_RO_ALL;
-	unsigned int nr_zones = 0, nz = 0;
+	enum zbc_report_format fmt = ZBC_REPORT_TEXT;
+	unsigned int nr_zones = 0, nz = 0, n, zno = 0;
 	struct zbc_zone *z, *zones = NULL;
-	bool lba_unit = false;
+	bool lba_unit = false, summary = false;
 	unsigned long long start = 0;
 	int i, ret = 1, oflags = 0;
 	int num = 0;
@@ -207,6 +483,22 @@ int main(int argc, char **argv)
 				return 1;
 			}
 
+		} else if (strcmp(argv[i], "-sum") == 0) {
+
+			summary = true;
+
+		} else if (strcmp(argv[i], "-csv") == 0) {
+
+			fmt = ZBC_REPORT_CSV;
+
+		} else if (strcmp(argv[i], "-json") == 0) {
+
+			fmt = ZBC_REPORT_JSON;
+
+		} else if (strcmp(argv[i], "-bin") == 0) {
+
+			fmt = ZBC_REPORT_BIN;
+
 		} else if (strcmp(argv[i], "-lba") == 0) {
 
 			lba_unit = true;
@@ -289,6 +581,12 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if (summary && (fmt == ZBC_REPORT_CSV || fmt == ZBC_REPORT_BIN)) {
+		fprintf(stderr,
+			"-sum option can only be used with -json option\n");
+		return 1;
+	}
+
 	/* Open device */
 	path = argv[i];
 	ret = zbc_open(path, oflags | O_RDONLY, &dev);
@@ -305,78 +603,142 @@ int main(int argc, char **argv)
 
 	zbc_get_device_info(dev, &info);
 
-	printf("Device %s:\n", path);
-	zbc_print_device_info(&info, stdout);
-
-	/* Get the number of zones */
 	if (lba_unit)
 		sector = zbc_lba2sect(&info, start);
 	else
 		sector = start;
-	ret = zbc_report_nr_zones(dev, sector, ro, &nr_zones);
-	if (ret != 0) {
-		fprintf(stderr, "zbc_report_nr_zones at %llu, ro 0x%02x failed %d\n",
-			start, (unsigned int) ro, ret);
-		ret = 1;
+
+	if (summary) {
+		if (fmt == ZBC_REPORT_TEXT) {
+			printf("Device %s:\n", path);
+			zbc_print_device_info(&info, stdout);
+		}
+		ret = zbc_report_print_summary(dev, &info, sector, fmt,
+					       path, lba_unit);
+		if (ret != 0)
+			ret = 1;
 		goto out;
 	}
 
-	/* Print zone info */
-	printf("    %u zone%s from %llu, reporting option 0x%02x\n",
-	       nr_zones,
-	       (nr_zones > 1) ? "s" : "",
-	       start, ro);
+	if (fmt == ZBC_REPORT_TEXT || num) {
 
-	if (num)
-		goto out;
+		printf("Device %s:\n", path);
+		zbc_print_device_info(&info, stdout);
 
-	if (!nz || nz > nr_zones)
-		nz = nr_zones;
-	if (!nz)
-		goto out;
+		/* Get the number of zones */
+		ret = zbc_report_nr_zones(dev, sector, ro, &nr_zones);
+		if (ret != 0) {
+			fprintf(stderr, "zbc_report_nr_zones at %llu, ro 0x%02x failed %d\n",
+				start, (unsigned int) ro, ret);
+			ret = 1;
+			goto out;
+		}
+
+		/* Print zone info */
+		printf("    %u zone%s from %llu, reporting option 0x%02x\n",
+		       nr_zones,
+		       (nr_zones > 1) ? "s" : "",
+		       start, ro);
+
+		if (num)
+			goto out;
+
+		if (!nz || nz > nr_zones)
+			nz = nr_zones;
+		if (!nz)
+			goto out;
+
+		printf("%u / %u zone%s:\n", nz, nr_zones, (nz > 1) ? "s" : "");
+
+	}
 
 	/* Allocate zone array */
-	zones = (struct zbc_zone *) calloc(nz, sizeof(struct zbc_zone));
+	zones = (struct zbc_zone *) calloc(ZBC_REPORT_CHUNK_ZONES,
+					   sizeof(struct zbc_zone));
 	if (!zones) {
 		fprintf(stderr, "No memory\n");
 		ret = 1;
 		goto out;
 	}
 
-	/* Get zone information */
-	ret = zbc_report_zones(dev, sector, ro, zones, &nz);
-	if (ret != 0) {
-		fprintf(stderr, "zbc_report_zones failed %d\n", ret);
-		ret = 1;
-		goto out;
-	}
+	zbc_report_print_header(&info, fmt, path, lba_unit);
 
-	printf("%u / %u zone%s:\n", nz, nr_zones, (nz > 1) ? "s" : "");
-	if (lba_unit)
-		sector = zbc_lba2sect(&info, start);
-	else
-		sector = start;
-	for (i = 0; i < (int)nz; i++) {
+	/*
+	 * Get and print zone information, one chunk of zones at a time.
+	 * Each report starts after the last zone of the previous chunk.
+	 */
+	while (!nz || zno < nz) {
 
-		z = &zones[i];
+		n = ZBC_REPORT_CHUNK_ZONES;
+		if (nz && nz - zno < n)
+			n = nz - zno;
 
-		if (ro == ZBC_RZ_RO_ALL) {
-			/* Check */
-			if (zbc_zone_start(z) != sector) {
-				printf("[WARNING] Zone %05d: sector %llu "
-				       "should be %llu\n",
-				       i, zbc_zone_start(z), sector);
-				sector = zbc_zone_start(z);
+		ret = zbc_report_zones(dev, sector, ro, zones, &n);
+		if (ret != 0) {
+			fprintf(stderr, "zbc_report_zones failed %d\n", ret);
+			ret = 1;
+			goto out;
+		}
+		if (!n)
+			break;
+
+		if (fmt == ZBC_REPORT_BIN) {
+			ret = zbc_report_print_zones_bin(&info, zones, n,
+							 lba_unit);
+			if (ret != 0) {
+				fprintf(stderr, "Write zones failed\n");
+				ret = 1;
+				goto out;
 			}
-			nr_sectors += zbc_zone_length(z);
-			sector += zbc_zone_length(z);
+			zno += n;
 		}
 
-		zbc_report_print_zone(&info, z, i, lba_unit);
+		for (i = 0; fmt != ZBC_REPORT_BIN && i < (int)n; i++, zno++) {
+
+			z = &zones[i];
+
+			switch (fmt) {
+			case ZBC_REPORT_CSV:
+				zbc_report_print_zone_csv(&info, z, zno,
+							  lba_unit);
+				break;
+			case ZBC_REPORT_JSON:
+				zbc_report_print_zone_json(&info, z, zno,
+							   lba_unit);
+				break;
+			case ZBC_REPORT_TEXT:
+			default:
+				if (ro == ZBC_RZ_RO_ALL) {
+					/* Check */
+					if (zbc_zone_start(z) != sector) {
+						printf("[WARNING] Zone %05d: sector %llu "
+						       "should be %llu\n",
+						       zno, zbc_zone_start(z),
+						       sector);
+						sector = zbc_zone_start(z);
+					}
+					nr_sectors += zbc_zone_length(z);
+					sector += zbc_zone_length(z);
+				}
+				zbc_report_print_zone(&info, z, zno, lba_unit);
+				break;
+			}
+
+		}
+
+		fflush(stdout);
+
+		z = &zones[n - 1];
+		sector = zbc_zone_start(z) + zbc_zone_length(z);
+		if (sector >= info.zbd_sectors)
+			break;
 
 	}
 
-	if (start == 0 && ro == ZBC_RZ_RO_ALL && nz == nr_zones) {
+	zbc_report_print_footer(fmt);
+
+	if (fmt == ZBC_REPORT_TEXT &&
+	    start == 0 && ro == ZBC_RZ_RO_ALL && nz == nr_zones) {
 		/* Check */
 		if ( zbc_sect2lba(&info, nr_sectors) != info.zbd_lblocks ) {
 			printf("[WARNING] %llu logical blocks reported "
@@ -386,6 +748,8 @@ int main(int argc, char **argv)
 		}
 	}
 
+	ret = 0;
+
 out:
 	if (zones)
 		free(zones);
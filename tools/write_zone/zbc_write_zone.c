@@ -23,11 +23,64 @@
 #include <sys/ioctl.h>
 #include <linux/fs.h>
 #include <libgen.h>
+#include <pthread.h>
 
 #include <libzbc/zbc.h>
+#include "../pattern/zbc_pattern.h"
 
 static int zbc_write_zone_abort;
 
+/*
+ * Write context shared by the worker threads.
+ */
+struct zbc_write_zone {
+	char			*path;
+	int			oflags;
+
+	/* Target zones */
+	struct zbc_zone		*zones;
+	unsigned int		nz;
+	unsigned int		next_zone;
+
+	/* I/O parameters */
+	size_t			bufsize;
+	size_t			iosize;
+	int			iovcnt;
+	bool			vio;
+	unsigned int		qd;
+	unsigned long		pattern;
+	bool			spattern_set;
+	struct zbc_pattern	spattern;
+	long long		zone_ofst;
+	unsigned long long	ionum;
+	unsigned long long	iocount;
+
+	/* File to write, if any */
+	char			*file;
+	int			fd;
+	bool			floop;
+
+	pthread_mutex_t		lock;
+};
+
+/*
+ * Worker thread. Each thread uses its own device handle and writes
+ * whole zones, with up to qd asynchronous writes in flight.
+ */
+struct zbc_write_zone_thread {
+	struct zbc_write_zone	*wz;
+	pthread_t		thread;
+	unsigned int		id;
+	struct zbc_device	*dev;
+	void			*iobuf;
+	struct iovec		*iov;
+	struct zbc_aio		*aios;
+	struct zbc_aio		**free_aios;
+	unsigned long long	bcount;
+	unsigned long long	iocount;
+	int			err;
+};
+
 static ssize_t zbc_read_pattern_file(char *file, int fd, void *iobuf,
 				     size_t iosize, size_t ios)
 {
@@ -73,6 +126,10 @@ static int zbc_write_zone_usage(FILE *out, char *prog)
 		"                 size of <num> x <I/O size> bytes.\n"
 		"  -p <num>     : Set the byte pattern to write. If this option\n"
 		"                 is omitted, zeroes are written.\n"
+		"  -sp <seed>   : Write a self-describing pattern identifying\n"
+		"                 each sector, generated from <seed>\n"
+		"  -gen <num>   : Set the generation number of the pattern\n"
+		"                 written with -sp (default: 0)\n"
 		"  -nio <num>   : Limit the number of I/O executed to <num>\n"
 		"  -f <file>    : Write the content of <file>\n"
 		"  -loop        : If a file is specified, repeatedly write the\n"
@@ -80,7 +137,13 @@ static int zbc_write_zone_usage(FILE *out, char *prog)
 		"  -ofst <ofst> : Write the zone starting form the sector offset\n"
 		"                 <ofst> instead of from the zone start sector.\n"
 		"                 This option should be used only with\n"
-		"                 conventional zones.\n",
+		"                 conventional zones.\n"
+		"  -nz <num>    : Write <num> consecutive zones starting from\n"
+		"                 the target zone\n"
+		"  -t <num>     : Use <num> threads, each thread writing\n"
+		"                 different zones (default: 1)\n"
+		"  -qd <num>    : Use up to <num> asynchronous writes in\n"
+		"                 flight per thread (default: 1)\n",
 		basename(prog));
 	return 1;
 }
@@ -90,33 +153,363 @@ static void zbc_write_zone_sigcatcher(int sig)
 	zbc_write_zone_abort = 1;
 }
 
+/*
+ * Get the next zone to write, if any.
+ */
+static struct zbc_zone *zbc_write_zone_next(struct zbc_write_zone *wz)
+{
+	struct zbc_zone *zone = NULL;
+
+	pthread_mutex_lock(&wz->lock);
+	if (!zbc_write_zone_abort && wz->next_zone < wz->nz)
+		zone = &wz->zones[wz->next_zone++];
+	pthread_mutex_unlock(&wz->lock);
+
+	return zone;
+}
+
+/*
+ * Reserve an I/O within the limit set with -nio.
+ */
+static bool zbc_write_zone_get_io(struct zbc_write_zone *wz)
+{
+	bool ret = true;
+
+	pthread_mutex_lock(&wz->lock);
+	if (wz->ionum > 0 && wz->iocount >= wz->ionum)
+		ret = false;
+	else
+		wz->iocount++;
+	pthread_mutex_unlock(&wz->lock);
+
+	return ret;
+}
+
+static void zbc_write_zone_put_io(struct zbc_write_zone *wz)
+{
+	pthread_mutex_lock(&wz->lock);
+	wz->iocount--;
+	pthread_mutex_unlock(&wz->lock);
+}
+
+/*
+ * Get the number of sectors that can be written to a zone.
+ */
+static long long zbc_write_zone_sector_max(struct zbc_zone *iozone)
+{
+	long long sector_max = zbc_zone_length(iozone);
+
+	if (zbc_zone_sequential(iozone)) {
+		if (zbc_zone_full(iozone))
+			sector_max = 0;
+		else if (zbc_zone_wp(iozone) > zbc_zone_start(iozone))
+			sector_max =
+				zbc_zone_wp(iozone) - zbc_zone_start(iozone);
+	}
+
+	return sector_max;
+}
+
+/*
+ * Write a zone one I/O at a time.
+ */
+static int zbc_write_zone_sync(struct zbc_write_zone_thread *t,
+			       struct zbc_zone *iozone)
+{
+	struct zbc_write_zone *wz = t->wz;
+	long long sector_max = zbc_write_zone_sector_max(iozone);
+	long long zofst = wz->zone_ofst, sector_ofst;
+	size_t iosize = wz->iosize;
+	void *iobuf = t->iobuf;
+	ssize_t ret, sector_count;
+	int n;
+
+	while (!zbc_write_zone_abort) {
+
+		if (wz->file) {
+
+			size_t ios;
+
+			/* Read file */
+			ret = zbc_read_pattern_file(wz->file, wz->fd, iobuf,
+						    iosize, 0);
+			if (ret < 0)
+				return 1;
+
+			ios = ret;
+			if (ios < iosize && wz->floop) {
+				/* Rewind and read remaining of buffer */
+				lseek(wz->fd, 0, SEEK_SET);
+				ret = zbc_read_pattern_file(wz->file, wz->fd,
+							    iobuf, iosize, 0);
+				if (ret < 0)
+					return 1;
+				ios += ret;
+			} else if (ios) {
+				/* Clear end of buffer */
+				memset(iobuf + ios, 0, iosize - ios);
+			}
+
+			if (!ios)
+				/* EOF */
+				break;
+
+		}
+
+		/* Do not exceed the end of the zone */
+		if (zbc_zone_sequential(iozone) && zbc_zone_full(iozone))
+			sector_count = 0;
+		else
+			sector_count = iosize >> 9;
+		if (zofst + sector_count > sector_max)
+			sector_count = sector_max - zofst;
+		if (sector_count <= 0 || !zbc_write_zone_get_io(wz))
+			break;
+		sector_ofst = zbc_zone_start(iozone) + zofst;
+
+		if (wz->spattern_set)
+			zbc_pattern_fill(&wz->spattern, iobuf, sector_ofst,
+					 sector_count);
+
+		/* Write to zone */
+		if (wz->vio) {
+			n = zbc_map_iov(iobuf, sector_count,
+					t->iov, wz->iovcnt, wz->bufsize >> 9);
+			if (n < 0) {
+				fprintf(stderr, "iov map failed %d (%s)\n",
+					-n, strerror(-n));
+				return 1;
+			}
+			ret = zbc_pwritev(t->dev, t->iov, n, sector_ofst);
+		} else {
+			ret = zbc_pwrite(t->dev, iobuf, sector_count,
+					 sector_ofst);
+		}
+		if (ret <= 0) {
+			fprintf(stderr, "%s failed %zd (%s)\n",
+				wz->vio ? "zbc_pwritev" : "zbc_pwrite",
+				-ret, strerror(-ret));
+			return 1;
+		}
+
+		zofst += ret;
+		t->bcount += ret << 9;
+		t->iocount++;
+	}
+
+	return 0;
+}
+
+/*
+ * Write a zone with up to qd asynchronous writes in flight. Writes are
+ * submitted in increasing sector order: for conventional zones, all writes
+ * are executed concurrently, and for sequential write required zones, the
+ * library executes the writes one after the other in submission order.
+ */
+static int zbc_write_zone_async(struct zbc_write_zone_thread *t,
+				struct zbc_zone *iozone)
+{
+	struct zbc_write_zone *wz = t->wz;
+	long long sector_max = zbc_write_zone_sector_max(iozone);
+	long long zofst = wz->zone_ofst;
+	unsigned int i, nr_free = 0, inflight = 0;
+	bool done = false;
+	struct zbc_aio *aio;
+	ssize_t count;
+	int ret, err = 0;
+
+	if (zbc_zone_sequential(iozone) && zbc_zone_full(iozone))
+		return 0;
+
+	for (i = 0; i < wz->qd; i++)
+		t->free_aios[nr_free++] = &t->aios[i];
+
+	while (!done || inflight) {
+
+		/* Fill the queue */
+		while (!done && nr_free) {
+			count = wz->iosize >> 9;
+			if (zofst + count > sector_max)
+				count = sector_max - zofst;
+			if (count <= 0 || zbc_write_zone_abort ||
+			    !zbc_write_zone_get_io(wz)) {
+				done = true;
+				break;
+			}
+
+			aio = t->free_aios[--nr_free];
+			aio->zio_count = count;
+			aio->zio_offset = zbc_zone_start(iozone) + zofst;
+			aio->zio_write = true;
+			if (wz->spattern_set)
+				zbc_pattern_fill(&wz->spattern, aio->zio_buf,
+						 aio->zio_offset, count);
+			ret = zbc_aio_submit(t->dev, aio);
+			if (ret == -EAGAIN) {
+				/* Device queue full: retry after a completion */
+				t->free_aios[nr_free++] = aio;
+				zbc_write_zone_put_io(wz);
+				break;
+			}
+			if (ret != 0) {
+				fprintf(stderr,
+					"zbc_aio_submit failed %d (%s)\n",
+					-ret, strerror(-ret));
+				t->free_aios[nr_free++] = aio;
+				zbc_write_zone_put_io(wz);
+				err = 1;
+				done = true;
+				break;
+			}
+
+			zofst += count;
+			inflight++;
+		}
+
+		if (!inflight)
+			break;
+
+		ret = zbc_aio_reap(t->dev, &aio, true);
+		if (ret != 0) {
+			fprintf(stderr, "zbc_aio_reap failed %d (%s)\n",
+				-ret, strerror(-ret));
+			return 1;
+		}
+		inflight--;
+		t->free_aios[nr_free++] = aio;
+
+		if (aio->zio_ret <= 0) {
+			fprintf(stderr,
+				"Write %zu sectors at sector %llu failed %zd (%s)\n",
+				aio->zio_count,
+				(unsigned long long)aio->zio_offset,
+				-aio->zio_ret, strerror(-aio->zio_ret));
+			err = 1;
+			done = true;
+			continue;
+		}
+
+		t->bcount += aio->zio_ret << 9;
+		t->iocount++;
+	}
+
+	return err;
+}
+
+static void *zbc_write_zone_thread_fn(void *arg)
+{
+	struct zbc_write_zone_thread *t = arg;
+	struct zbc_write_zone *wz = t->wz;
+	struct zbc_zone *iozone;
+
+	while ((iozone = zbc_write_zone_next(wz)) != NULL) {
+		if (wz->qd > 1)
+			t->err = zbc_write_zone_async(t, iozone);
+		else
+			t->err = zbc_write_zone_sync(t, iozone);
+		if (t->err) {
+			/* Stop the other threads */
+			zbc_write_zone_abort = 1;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Setup a worker thread I/O buffers.
+ */
+static int zbc_write_zone_setup_thread(struct zbc_write_zone *wz,
+				       struct zbc_write_zone_thread *t)
+{
+	size_t bufsz = wz->iosize * wz->qd;
+	unsigned int i;
+	int ret;
+
+	t->wz = wz;
+
+	/* The first thread uses the main device handle */
+	if (!t->dev) {
+		ret = zbc_open(wz->path, wz->oflags, &t->dev);
+		if (ret != 0) {
+			fprintf(stderr, "Open %s failed (%s)\n",
+				wz->path, strerror(-ret));
+			t->dev = NULL;
+			return ret;
+		}
+	}
+
+	ret = posix_memalign((void **) &t->iobuf, sysconf(_SC_PAGESIZE),
+			     bufsz);
+	if (ret != 0) {
+		fprintf(stderr, "No memory for I/O buffer (%zu B)\n", bufsz);
+		t->iobuf = NULL;
+		return -ENOMEM;
+	}
+	memset(t->iobuf, wz->pattern, bufsz);
+
+	if (wz->vio) {
+		t->iov = calloc(wz->iovcnt, sizeof(struct iovec));
+		if (!t->iov) {
+			fprintf(stderr, "No memory for I/O vector\n");
+			return -ENOMEM;
+		}
+	}
+
+	if (wz->qd > 1) {
+		t->aios = calloc(wz->qd, sizeof(struct zbc_aio));
+		t->free_aios = calloc(wz->qd, sizeof(struct zbc_aio *));
+		if (!t->aios || !t->free_aios) {
+			fprintf(stderr, "No memory for asynchronous I/Os\n");
+			return -ENOMEM;
+		}
+		for (i = 0; i < wz->qd; i++)
+			t->aios[i].zio_buf = t->iobuf + i * wz->iosize;
+	}
+
+	return 0;
+}
+
+static void zbc_write_zone_cleanup_thread(struct zbc_write_zone_thread *t,
+					  bool close)
+{
+	if (close && t->dev)
+		zbc_close(t->dev);
+	free(t->iobuf);
+	free(t->iov);
+	free(t->aios);
+	free(t->free_aios);
+}
+
 int main(int argc, char **argv)
 {
+	struct zbc_write_zone wz;
+	struct zbc_write_zone_thread *threads = NULL;
 	struct zbc_device_info info;
 	struct zbc_device *dev = NULL;
 	unsigned long long elapsed;
-	unsigned long long bcount = 0;
+	unsigned long long bcount = 0, iocount = 0;
 	unsigned long long fsize, brate;
+	unsigned int nr_threads = 1, n;
 	struct stat st;
-	int zidx, fd = -1, i;
+	int zidx, i, err;
 	ssize_t ret = 1;
-	size_t bufsize, iosize, ioalign;
-	void *iobuf = NULL;
-	ssize_t sector_count = 0;
-	unsigned long long iocount = 0, ionum = 0;
+	size_t ioalign;
 	struct zbc_zone *zones = NULL;
 	struct zbc_zone *iozone = NULL;
 	unsigned int nr_zones;
-	char *path, *file = NULL, *end;
-	long long sector_ofst = 0;
-	long long sector_max = 0;
-	long long zone_ofst = 0, zofst;
-	bool flush = false, floop = false, vio = false;
-	unsigned long pattern = 0;
+	char *end;
+	bool flush = false;
 	int flags = O_WRONLY;
 	int oflags = 0;
-	struct iovec *iov = NULL;
-	int iovcnt = 1, n, z, nz = 1;
+	int nz = 1;
+
+	memset(&wz, 0, sizeof(wz));
+	wz.fd = -1;
+	wz.iovcnt = 1;
+	wz.qd = 1;
+	pthread_mutex_init(&wz.lock, NULL);
 
 	/* Check command line */
 	if (argc < 4)
@@ -155,33 +548,62 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			pattern = strtol(argv[i], &end, 0);
+			wz.pattern = strtol(argv[i], &end, 0);
 			if (*end != '\0' || errno != 0) {
 				fprintf(stderr,
 					"Invalid data pattern value \"%s\"\n",
 					argv[i]);
 				return 1;
 			}
-			if (pattern > 0xff) {
+			if (wz.pattern > 0xff) {
 				fprintf(stderr,
 					"Not a single-byte pattern:\"%s\"\n",
 					argv[i]);
 				return 1;
 			}
 
+		} else if (strcmp(argv[i], "-sp") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			wz.spattern.seed = strtoull(argv[i], &end, 0);
+			if (*end != '\0' || errno != 0) {
+				fprintf(stderr,
+					"Invalid pattern seed \"%s\"\n",
+					argv[i]);
+				return 1;
+			}
+			wz.spattern_set = true;
+
+		} else if (strcmp(argv[i], "-gen") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			wz.spattern.gen = strtoull(argv[i], &end, 0);
+			if (*end != '\0' || errno != 0) {
+				fprintf(stderr,
+					"Invalid pattern generation \"%s\"\n",
+					argv[i]);
+				return 1;
+			}
+
 		} else if (strcmp(argv[i], "-vio") == 0) {
 
 			if (i >= (argc - 1))
 				goto err;
 			i++;
 
-			iovcnt = atoi(argv[i]);
-			if (iovcnt <= 0) {
+			wz.iovcnt = atoi(argv[i]);
+			if (wz.iovcnt <= 0) {
 				fprintf(stderr,
 					"Invalid number of IO buffers\n");
 				return 1;
 			}
-			vio = true;
+			wz.vio = true;
 
 		} else if (strcmp(argv[i], "-nio") == 0) {
 
@@ -189,8 +611,8 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			ionum = atoi(argv[i]);
-			if (ionum <= 0) {
+			wz.ionum = atoi(argv[i]);
+			if (wz.ionum <= 0) {
 				fprintf(stderr, "Invalid number of I/Os\n");
 				return 1;
 			}
@@ -201,11 +623,11 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			file = argv[i];
+			wz.file = argv[i];
 
 		} else if (strcmp(argv[i], "-loop") == 0) {
 
-			floop = true;
+			wz.floop = true;
 
 		} else if (strcmp(argv[i], "-ofst") == 0) {
 
@@ -213,8 +635,8 @@ int main(int argc, char **argv)
 				goto err;
 			i++;
 
-			zone_ofst = atoll(argv[i]);
-			if (zone_ofst < 0) {
+			wz.zone_ofst = atoll(argv[i]);
+			if (wz.zone_ofst < 0) {
 				fprintf(stderr, "Invalid zone sector offset\n");
 				return 1;
 			}
@@ -231,6 +653,30 @@ int main(int argc, char **argv)
 				return 1;
 			}
 
+		} else if (strcmp(argv[i], "-t") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			if (atoi(argv[i]) <= 0) {
+				fprintf(stderr, "Invalid number of threads\n");
+				return 1;
+			}
+			nr_threads = atoi(argv[i]);
+
+		} else if (strcmp(argv[i], "-qd") == 0) {
+
+			if (i >= (argc - 1))
+				goto err;
+			i++;
+
+			if (atoi(argv[i]) <= 0) {
+				fprintf(stderr, "Invalid queue depth\n");
+				return 1;
+			}
+			wz.qd = atoi(argv[i]);
+
 		} else if (argv[i][0] == '-') {
 
 			fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
@@ -248,7 +694,7 @@ int main(int argc, char **argv)
 		goto err;
 
 	/* Get parameters */
-	path = argv[i];
+	wz.path = argv[i];
 
 	if (oflags & ZBC_O_DRV_SCSI && oflags & ZBC_O_DRV_ATA) {
 		fprintf(stderr,
@@ -256,6 +702,24 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if (wz.file && (nr_threads > 1 || wz.qd > 1)) {
+		fprintf(stderr,
+			"-f option cannot be used with -t and -qd options\n");
+		return 1;
+	}
+
+	if (wz.spattern_set && (wz.file || wz.pattern)) {
+		fprintf(stderr,
+			"-sp option cannot be used with -f and -p options\n");
+		return 1;
+	}
+
+	if (wz.vio && wz.qd > 1) {
+		fprintf(stderr,
+			"-vio and -qd options are mutually exclusive\n");
+		return 1;
+	}
+
 	zidx = atoi(argv[i + 1]);
 	if (zidx < 0) {
 		fprintf(stderr, "Invalid zone number %s\n",
@@ -263,8 +727,8 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	bufsize = atol(argv[i + 2]);
-	if (!bufsize) {
+	wz.bufsize = atol(argv[i + 2]);
+	if (!wz.bufsize) {
 		fprintf(stderr, "Invalid I/O size %s\n", argv[i + 2]);
 		return 1;
 	}
@@ -274,24 +738,33 @@ int main(int argc, char **argv)
 	signal(SIGINT, zbc_write_zone_sigcatcher);
 	signal(SIGTERM, zbc_write_zone_sigcatcher);
 
-	/* Open device */
-	ret = zbc_open(path, oflags | flags, &dev);
+	/* Open device, using queued commands for asynchronous writes */
+	wz.oflags = oflags | flags;
+	if (wz.qd > 1)
+		wz.oflags |= ZBC_O_NCQ;
+	ret = zbc_open(wz.path, wz.oflags, &dev);
 	if (ret != 0) {
 		if (ret == -ENODEV)
 			fprintf(stderr,
 				"Open %s failed (not a zoned block device)\n",
-				path);
+				wz.path);
 		else
 			fprintf(stderr, "Open %s failed (%s)\n",
-				path, strerror(-ret));
+				wz.path, strerror(-ret));
 		return 1;
 	}
 
 	zbc_get_device_info(dev, &info);
 
-	printf("Device %s:\n", path);
+	printf("Device %s:\n", wz.path);
 	zbc_print_device_info(&info, stdout);
 
+	if (zbc_aio_queue_depth(dev) < wz.qd)
+		fprintf(stderr,
+			"[WARNING] %s: Device queue depth %u is lower than "
+			"the requested queue depth %u\n",
+			wz.path, zbc_aio_queue_depth(dev), wz.qd);
+
 	/* Get zone list */
 	ret = zbc_list_zones(dev, 0, ZBC_RZ_RO_ALL, &zones, &nr_zones);
 	if (ret != 0) {
@@ -312,6 +785,8 @@ int main(int argc, char **argv)
 		goto out;
 	}
 	iozone = &zones[zidx];
+	wz.zones = iozone;
+	wz.nz = nz;
 
 	if (zbc_zone_conventional(iozone))
 		printf("Target zone: Conventional zone %d / %d, "
@@ -336,54 +811,46 @@ int main(int argc, char **argv)
 		       zbc_zone_length(iozone),
 		       zbc_zone_wp(iozone));
 
-	/* Check I/O alignment and get an I/O buffer */
+	/* Check I/O alignment */
 	if (zbc_zone_sequential(iozone))
 		ioalign = info.zbd_pblock_size;
 	else
 		ioalign = info.zbd_lblock_size;
-	if (bufsize % ioalign) {
+	if (wz.bufsize % ioalign) {
 		fprintf(stderr,
 			"Invalid I/O size %zu (must be aligned on %zu)\n",
-			bufsize, ioalign);
+			wz.bufsize, ioalign);
 		ret = 1;
 		goto out;
 	}
 
-	if (vio) {
-		iov = calloc(iovcnt, sizeof(struct iovec));
-		if (!iov) {
-			fprintf(stderr, "No memory for I/O vector\n");
-			ret = -ENOMEM;
-			goto out;
-		}
-	}
-
-	iosize = bufsize * iovcnt;
-	ret = posix_memalign((void **) &iobuf, sysconf(_SC_PAGESIZE), iosize);
-	if (ret != 0) {
-		fprintf(stderr, "No memory for I/O buffer (%zu B)\n", iosize);
+	wz.iosize = wz.bufsize * wz.iovcnt;
+	if (wz.qd > 1 && (wz.iosize >> 9) > info.zbd_max_rw_sectors) {
+		fprintf(stderr,
+			"Invalid I/O size %zu for asynchronous writes "
+			"(maximum is %llu B)\n",
+			wz.iosize,
+			(unsigned long long)info.zbd_max_rw_sectors << 9);
 		ret = 1;
 		goto out;
 	}
 
-	memset(iobuf, pattern, iosize);
-
 	/* Open the file to read, if any */
-	if (file) {
+	if (wz.file) {
 
-		fd = open(file, O_LARGEFILE | O_RDONLY);
-		if (fd < 0) {
+		wz.fd = open(wz.file, O_LARGEFILE | O_RDONLY);
+		if (wz.fd < 0) {
 			fprintf(stderr, "Open file \"%s\" failed %d (%s)\n",
-				file,
+				wz.file,
 				errno, strerror(errno));
 			ret = 1;
 			goto out;
 		}
 
-		ret = fstat(fd, &st);
+		ret = fstat(wz.fd, &st);
 		if (ret != 0) {
 			fprintf(stderr, "Stat file \"%s\" failed %d (%s)\n",
-				file,
+				wz.file,
 				errno, strerror(errno));
 			ret = 1;
 			goto out;
@@ -392,131 +859,95 @@ int main(int argc, char **argv)
 		if (S_ISREG(st.st_mode)) {
 			fsize = st.st_size;
 		} else if (S_ISBLK(st.st_mode)) {
-			ret = ioctl(fd, BLKGETSIZE64, &fsize);
+			ret = ioctl(wz.fd, BLKGETSIZE64, &fsize);
 			if (ret != 0) {
 				fprintf(stderr,
 					"ioctl BLKGETSIZE64 block device \"%s\" failed %d (%s)\n",
-					file,
+					wz.file,
 					errno, strerror(errno));
 				ret = 1;
 				goto out;
 			}
 		} else {
-			fprintf(stderr, "Unsupported file \"%s\" type\n", file);
+			fprintf(stderr, "Unsupported file \"%s\" type\n",
+				wz.file);
 			ret = 1;
 			goto out;
 		}
 
 		printf("Writing file \"%s\" (%llu B) to target zone %d, %zu B I/Os\n",
-		       file, fsize, zidx, iosize);
+		       wz.file, fsize, zidx, wz.iosize);
 
-	} else if (!ionum) {
+	} else if (!wz.ionum) {
 
 		printf("Filling target zone %d, %zu B I/Os\n",
-		       zidx, iosize);
+		       zidx, wz.iosize);
 
 	} else {
 
 		printf("Writing to target zone %d, %llu I/Os of %zu B\n",
-		       zidx, ionum, iosize);
+		       zidx, wz.ionum, wz.iosize);
 
 	}
 
-	elapsed = zbc_write_zone_usec();
-
-	for (z = 0; z < nz && !zbc_write_zone_abort; z++, iozone++) {
-		sector_max = zbc_zone_length(iozone);
-		if (zbc_zone_sequential(iozone)) {
-			if (zbc_zone_full(iozone))
-				sector_max = 0;
-			else if (zbc_zone_wp(iozone) > zbc_zone_start(iozone))
-				sector_max =
-					zbc_zone_wp(iozone) - zbc_zone_start(iozone);
+	/* Setup the worker threads */
+	if (nz && nr_threads > (unsigned int)nz)
+		nr_threads = nz;
+	threads = calloc(nr_threads, sizeof(struct zbc_write_zone_thread));
+	if (!threads) {
+		fprintf(stderr, "No memory for threads\n");
+		ret = 1;
+		goto out;
+	}
+	threads[0].dev = dev;
+	for (n = 0; n < nr_threads; n++) {
+		threads[n].id = n;
+		if (zbc_write_zone_setup_thread(&wz, &threads[n]) != 0) {
+			ret = 1;
+			goto out;
 		}
-		zofst = zone_ofst;
-
-		while (!zbc_write_zone_abort) {
-
-			if (file) {
-
-				size_t ios;
-
-				/* Read file */
-				ret = zbc_read_pattern_file(file, fd, iobuf, iosize, 0);
-				if (ret < 0) {
-					ret = 1;
-					break;
-				}
-
-				ios = ret;
-				if (ios < iosize && floop) {
-					/* Rewind and read remaining of buffer */
-					lseek(fd, 0, SEEK_SET);
-					ret = zbc_read_pattern_file(file, fd, iobuf, iosize, 0);
-					if (ret < 0) {
-						ret = 1;
-						break;
-					}
-					ios += ret;
-				} else if (ios) {
-					/* Clear end of buffer */
-					memset(iobuf + ios, 0, iosize - ios);
-				}
-
-				if (!ios)
-					/* EOF */
-					break;
-
-			}
+	}
 
-			/* Do not exceed the end of the zone */
-			if (zbc_zone_sequential(iozone) && zbc_zone_full(iozone))
-				sector_count = 0;
-			else
-				sector_count = iosize >> 9;
-			if (zofst + sector_count > sector_max)
-				sector_count = sector_max - zofst;
-			if (!sector_count)
-				break;
-			sector_ofst = zbc_zone_start(iozone) + zofst;
-
-			/* Write to zone */
-			if (vio) {
-				n = zbc_map_iov(iobuf, sector_count,
-						iov, iovcnt, bufsize >> 9);
-				if (n < 0) {
-					fprintf(stderr, "iov map failed %d (%s)\n",
-						-n, strerror(-n));
-					ret = 1;
-					goto out;
-				}
-				ret = zbc_pwritev(dev, iov, n, sector_ofst);
-			} else {
-				ret = zbc_pwrite(dev, iobuf, sector_count, sector_ofst);
-			}
-			if (ret <= 0) {
-				fprintf(stderr, "%s failed %zd (%s)\n",
-					vio ? "zbc_pwritev" : "zbc_pwrite",
-					-ret, strerror(-ret));
-				ret = 1;
-				goto out;
-			}
+	if (nr_threads > 1 || wz.qd > 1)
+		printf("  %u thread%s, %u asynchronous writes per thread "
+		       "(device queue depth %u)\n",
+		       nr_threads, nr_threads > 1 ? "s" : "",
+		       wz.qd, zbc_aio_queue_depth(dev));
 
-			zofst += ret;
-			bcount += ret << 9;
-			iocount++;
+	elapsed = zbc_write_zone_usec();
 
-			if (ionum > 0 && iocount >= ionum)
+	if (nr_threads == 1) {
+		zbc_write_zone_thread_fn(&threads[0]);
+		n = 1;
+	} else {
+		for (n = 0; n < nr_threads; n++) {
+			if (pthread_create(&threads[n].thread, NULL,
+					   zbc_write_zone_thread_fn,
+					   &threads[n])) {
+				fprintf(stderr, "Create thread failed\n");
+				zbc_write_zone_abort = 1;
+				threads[n].err = 1;
 				break;
+			}
 		}
+		for (i = 0; i < (int)n; i++)
+			pthread_join(threads[i].thread, NULL);
+	}
+
+	ret = 0;
+	for (i = 0; i < (int)nr_threads; i++) {
+		bcount += threads[i].bcount;
+		iocount += threads[i].iocount;
+		if (threads[i].err)
+			ret = 1;
 	}
 
 	if (flush) {
 		printf("Flushing device...\n");
-		ret = zbc_flush(dev);
-		if (ret != 0) {
-			fprintf(stderr, "zbc_flush failed %zd (%s)\n",
-				-ret, strerror(-ret));
+		err = zbc_flush(dev);
+		if (err != 0) {
+			fprintf(stderr, "zbc_flush failed %d (%s)\n",
+				-err, strerror(-err));
 			ret = 1;
 		}
 	}
@@ -542,12 +973,16 @@ int main(int argc, char **argv)
 	}
 
 out:
-	if (fd > 0)
-		close(fd);
+	if (threads) {
+		for (n = 0; n < nr_threads; n++)
+			zbc_write_zone_cleanup_thread(&threads[n], n > 0);
+		free(threads);
+	}
+	if (wz.fd > 0)
+		close(wz.fd);
 	zbc_close(dev);
-	free(iobuf);
 	free(zones);
-	free(iov);
+	pthread_mutex_destroy(&wz.lock);
 
 	return ret;
 
@@ -556,4 +991,3 @@ err:
 
 	return 1;
 }
-
@@ -32,8 +32,57 @@ struct cmd_options {
 	bool list;
 	bool cdb32;
 	bool reset;
+	bool plan;
 };
 
+static void plan_progress(struct zbc_device *dev, struct zbc_actv_plan *plan,
+			  unsigned int step, void *data)
+{
+	struct zbc_actv_step *s = &plan->zbp_steps[step];
+	struct cmd_options *opts = data;
+
+	printf("[%u/%u] %s realms %u..%u: %u zones at sector %"PRIu64
+	       " in domain %u\n",
+	       step + 1, plan->zbp_nr_steps,
+	       opts->query ? "Queried" : "Activated",
+	       s->zbs_realm, s->zbs_realm + s->zbs_nr_realms - 1,
+	       s->zbs_nr_zones, s->zbs_start_sector, s->zbs_dom_id);
+}
+
+static int perform_plan(struct zbc_device *dev, struct cmd_options *opts)
+{
+	struct zbc_actv_plan *plan;
+	unsigned int flags = 0;
+	int ret;
+
+	ret = zbc_plan_activation(dev, opts->new_type, opts->nr_units, &plan);
+	if (ret != 0) {
+		fprintf(stderr, "zbc_plan_activation failed, err %i (%s)\n",
+			ret, strerror(-ret));
+		return 1;
+	}
+
+	printf("Activating %u realms in %u steps%s\n",
+	       plan->zbp_nr_realms, plan->zbp_nr_steps,
+	       plan->zbp_fsnoz ? " (using FSNOZ)" : "");
+
+	if (opts->query)
+		flags |= ZBC_ACTV_PLAN_QUERY;
+	if (opts->reset)
+		flags |= ZBC_ACTV_PLAN_RESET;
+
+	ret = zbc_exec_activation_plan(dev, plan, flags, plan_progress, opts);
+	if (ret != 0) {
+		fprintf(stderr, "zbc_exec_activation_plan failed, err %i (%s)\n",
+			ret, strerror(-ret));
+		ret = 1;
+	}
+
+	zbc_free_activation_plan(plan);
+
+	return ret;
+}
+
 static int perform_activation(struct zbc_device *dev, struct zbc_device_info *info,
 			      struct cmd_options *opts)
 {
@@ -270,11 +319,12 @@ int main(int argc, char **argv)
 	int i, ret, end_realm, oflags = 0;
 
 	/* Check command line */
-	if (argc < 5) {
+	if (argc < 4) {
 		fprintf(stderr, "Not enough arguments\n");
 usage:
 		printf("Usage:\n%s [options] <dev> <start realm> <num realms> <conv|seq[r]|sobr|seqp>\n"
 		       "or\n%s -z [options] <dev> <start zone> <num zones> <conv|seq[r]|sobr|seqp>\n"
+		       "or\n%s -p [options] <dev> <num realms> <conv|seq[r]|sobr|seqp>\n"
 		       "Options:\n"
 		       "    -v            : Verbose mode\n"
 		       "    -scsi         : Force the use of SCSI passthrough commands\n"
@@ -285,13 +335,16 @@ usage:
 		       "    -r            : Reset zones before activation (ignored for query and zone addressing)\n"
 		       "    -n | --fsnoz  : Set the number of zones to activate via a separate call\n"
 		       "    -32           : Use 32-byte SCSI commands, default is 16\n"
-		       "    -l            : List activation results records\n\n"
+		       "    -l            : List activation results records\n"
+		       "    -p            : Plan and execute the activations needed for\n"
+		       "                    the device to have <num realms> realms of the\n"
+		       "                    new zone type\n\n"
 		       "Zone types:\n"
 		       "    conv          : conventional\n"
 		       "    sobr          : sequential or before required\n"
 		       "    seq or seqr   : sequential write required\n"
 		       "    seqp          : sequential write preferred\n",
-		       argv[0], argv[0]);
+		       argv[0], argv[0], argv[0]);
 		return 1;
 	}
 
@@ -330,6 +383,8 @@ usage:
 			opts.list = true;
 		} else if (strcmp(argv[i], "-z") == 0) {
 			opts.zone_addr = true;
+		} else if (strcmp(argv[i], "-p") == 0) {
+			opts.plan = true;
 		} else {
 			fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
 			goto usage;
@@ -345,7 +400,17 @@ usage:
 	if (opts.reset && (opts.query || opts.zone_addr))
 		opts.reset = false;
 
-	if (opts.all) {
+	if (opts.plan) {
+		if (opts.all || opts.zone_addr) {
+			fprintf(stderr, "-p cannot be used with -a or -z\n");
+			goto usage;
+		}
+		if (i >= argc) {
+			fprintf(stderr, "Missing the number of realms\n");
+			goto usage;
+		}
+		opts.nr_units = atoi(argv[i++]);
+	} else if (opts.all) {
 		/*
 		 * FIXME make zone ID and size to follow the new zone type.
 		 * This way, just omitting these for all would be possible.
@@ -412,6 +477,11 @@ usage:
 		zbc_print_device_info(&info, stdout);
 	}
 
+	if (opts.plan) {
+		ret = perform_plan(dev, &opts);
+		goto close;
+	}
+
 	/* Find domain ID for the new zone type */
 	ret = zbc_list_domains(dev, 0LL, ZBC_RZD_RO_ALL,
 			       &domains, &nr_domains);